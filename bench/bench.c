@@ -0,0 +1,921 @@
+// Copyright 2023 Contributors to the Veraison project.
+// SPDX-License-Identifier: Apache-2.0
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "counters.h"
+#include "ear.h"
+#include "ear_priv.h"
+#include <err.h>
+#include <getopt.h>
+#include <jansson.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_THREADS 256
+#define WARMUP_ITERATIONS 64
+#define REPLAY_CAPACITY (1u << 21)
+#define INPLACE_ROOM 1024 /* bytes past the token, for the in-place summary */
+#define HOSTILE_MAX_SUBMODS 16 /* the limit on the -H token's records */
+#define TICKET_TTL 3600        /* seconds, longer than any run */
+
+/* HDR-style latency histogram: below HIST_SUB ns buckets are 1ns wide, above
+ * that every power of two is split into HIST_SUB linear buckets, which keeps
+ * the relative error under 1/HIST_SUB (< 1%) over the whole range */
+#define HIST_SUB_BITS 7
+#define HIST_SUB (1u << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct hist_s {
+  uint64_t counts[HIST_BUCKETS];
+  uint64_t total;
+  uint64_t max;
+} hist_t;
+
+typedef struct args_s {
+  char key_fn[1024];
+  char alg[16];
+  char ear_fn[1024];
+  char cwt_fn[1024];
+  char api[32];
+  unsigned threads[32];
+  size_t threads_sz;
+  unsigned long iterations;
+  double duration;
+  int stages;
+  unsigned long hostile; /* appraisal records in the hostile token */
+} args_t;
+
+typedef struct bench_s bench_t;
+
+typedef struct api_s {
+  const char *name;
+  int (*verify)(const bench_t *b);
+  int cwt;     /* needs -c */
+  int hostile; /* needs -H */
+} api_t;
+
+struct bench_s {
+  const api_t *api;
+  const char *ear_jwt;
+  const uint8_t *ear_cwt;
+  size_t ear_cwt_sz;
+  const uint8_t *key;
+  size_t key_sz;
+  const char *alg;
+  ear_verifier_t *verifier;
+  ear_verifier_t *cached; /* same key, with a cache */
+  ear_replay_guard_t *guard;
+  ear_cache_t *cache;
+  char *hostile_jwt; /* signed with hostile_key */
+  ear_verifier_t *hostile;
+  ear_verifier_t *limited; /* same key, with limits */
+  ear_verifier_t *sealer;  /* ticket_key */
+  uint8_t *ticket;
+  size_t ticket_sz;
+  unsigned long iterations; /* 0 means run for duration seconds */
+  double duration;
+  atomic_int stop;
+  pthread_barrier_t start;
+  /* per-stage breakdown */
+  jws_t jws;
+  uint8_t *payload;
+  size_t payload_sz;
+  uint8_t *scratch;
+  cose_t cose;
+};
+
+typedef struct stage_s {
+  const char *name;
+  int (*run)(const bench_t *b);
+  int cwt; /* needs -c */
+} stage_t;
+
+typedef struct worker_s {
+  pthread_t tid;
+  const bench_t *b;
+  unsigned long ops;
+  unsigned long failures;
+  unsigned long ssl_allocs;
+  unsigned long json_allocs;
+  hist_t hist;
+} worker_t;
+
+void parse_opts(int ac, char **av, args_t *pargs);
+int read_from_file(const char *fn, uint8_t **pb, size_t *pb_sz);
+void usage(const char *name);
+// from utils.c
+extern size_t u_strlcpy(char *dst, const char *src, size_t sz);
+
+/* Allocation counters, kept per thread so that counting does not itself
+ * become a point of contention */
+static _Thread_local unsigned long ssl_allocs;
+static _Thread_local unsigned long json_allocs;
+
+static void *count_crypto_malloc(size_t sz, const char *file, int line) {
+  (void)file, (void)line;
+  ssl_allocs++;
+  return malloc(sz);
+}
+
+static void *count_crypto_realloc(void *p, size_t sz, const char *file,
+                                  int line) {
+  (void)file, (void)line;
+  ssl_allocs++;
+  return realloc(p, sz);
+}
+
+static void count_crypto_free(void *p, const char *file, int line) {
+  (void)file, (void)line;
+  free(p);
+}
+
+static void *count_json_malloc(size_t sz) {
+  json_allocs++;
+  return malloc(sz);
+}
+
+static double now_s(void) {
+  struct timespec ts;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static unsigned hist_index(uint64_t v) {
+  unsigned shift;
+
+  if (v < HIST_SUB)
+    return (unsigned)v;
+
+  shift = 63 - (unsigned)__builtin_clzll(v) - HIST_SUB_BITS;
+
+  return (shift + 1) * HIST_SUB + (unsigned)(v >> shift) - HIST_SUB;
+}
+
+/* midpoint of the bucket's value range */
+static uint64_t hist_value(unsigned i) {
+  unsigned shift;
+
+  if (i < HIST_SUB)
+    return i;
+
+  shift = i / HIST_SUB - 1;
+
+  return ((uint64_t)(i % HIST_SUB + HIST_SUB) << shift) +
+         (((uint64_t)1 << shift) - 1) / 2;
+}
+
+static void hist_record(hist_t *h, uint64_t v) {
+  h->counts[hist_index(v)]++;
+  h->total++;
+  if (v > h->max)
+    h->max = v;
+}
+
+static void hist_merge(hist_t *dst, const hist_t *src) {
+  for (unsigned i = 0; i < HIST_BUCKETS; i++)
+    dst->counts[i] += src->counts[i];
+
+  dst->total += src->total;
+  if (src->max > dst->max)
+    dst->max = src->max;
+}
+
+static uint64_t hist_percentile(const hist_t *h, double p) {
+  uint64_t want = (uint64_t)(p / 100.0 * (double)h->total + 0.5), seen = 0;
+
+  if (want == 0)
+    want = 1;
+
+  for (unsigned i = 0; i < HIST_BUCKETS; i++) {
+    if ((seen += h->counts[i]) >= want)
+      return hist_value(i) < h->max ? hist_value(i) : h->max;
+  }
+
+  return h->max;
+}
+
+static int verify_legacy(const bench_t *b) {
+  ear_t *ear = NULL;
+
+  if (ear_jwt_verify(b->ear_jwt, b->key, b->key_sz, b->alg, &ear, NULL) != 0)
+    return -1;
+
+  ear_free(ear);
+
+  return 0;
+}
+
+static int verify_verifier(const bench_t *b) {
+  ear_t *ear = NULL;
+
+  if (ear_verifier_jwt_verify(b->verifier, b->ear_jwt, &ear, NULL) != 0)
+    return -1;
+
+  ear_free(ear);
+
+  return 0;
+}
+
+/* each thread verifies into its own ear_t, which it keeps for good */
+static _Thread_local ear_t *reverify_ear;
+
+static int verify_reverify(const bench_t *b) {
+  if (reverify_ear == NULL)
+    return ear_verifier_jwt_verify(b->verifier, b->ear_jwt, &reverify_ear,
+                                   NULL);
+
+  return ear_verifier_jwt_reverify(b->verifier, b->ear_jwt, reverify_ear,
+                                   NULL);
+}
+
+/* each thread gives up its own copy of the token, as if freshly received */
+static _Thread_local char *inplace_buf;
+
+static int verify_inplace(const bench_t *b) {
+  size_t sz = strlen(b->ear_jwt) + 1, buf_sz = sz + INPLACE_ROOM;
+  ear_t *ear = NULL;
+
+  if (inplace_buf == NULL && (inplace_buf = malloc(buf_sz)) == NULL)
+    return -1;
+
+  memcpy(inplace_buf, b->ear_jwt, sz);
+
+  if (ear_verifier_jwt_verify_inplace(b->verifier, inplace_buf, buf_sz, &ear,
+                                      NULL) != 0)
+    return -1;
+
+  ear_free(ear);
+
+  return 0;
+}
+
+/* the least demanding gate, so that every call goes all the way through */
+static int verify_gate(const bench_t *b) {
+  return ear_verifier_jwt_gate(b->verifier, b->ear_jwt, NULL,
+                               EAR_TIER_CONTRAINDICATED) == EAR_OK
+             ? 0
+             : -1;
+}
+
+/* the hostile token goes all the way through without limits ... */
+static int verify_hostile(const bench_t *b) {
+  return ear_verifier_jwt_gate(b->hostile, b->hostile_jwt, NULL,
+                               EAR_TIER_CONTRAINDICATED) == EAR_OK
+             ? 0
+             : -1;
+}
+
+/* ... and is turned away as soon as it has too many records with them */
+static int verify_limited(const bench_t *b) {
+  return ear_verifier_jwt_gate(b->limited, b->hostile_jwt, NULL,
+                               EAR_TIER_CONTRAINDICATED) ==
+                 EAR_ERR_LIMIT_SUBMODS
+             ? 0
+             : -1;
+}
+
+static int verify_ticket(const bench_t *b) {
+  ear_t *ear = NULL;
+
+  if (ear_ticket_verify(b->sealer, b->ticket, b->ticket_sz, &ear, NULL) != 0)
+    return -1;
+
+  ear_free(ear);
+
+  return 0;
+}
+
+static int verify_cached(const bench_t *b) {
+  ear_t *ear = NULL;
+
+  if (ear_verifier_jwt_verify(b->cached, b->ear_jwt, &ear, NULL) != 0)
+    return -1;
+
+  ear_free(ear);
+
+  return 0;
+}
+
+static atomic_uint replay_thread_ids;
+
+static int verify_cwt_legacy(const bench_t *b) {
+  ear_t *ear = NULL;
+
+  if (ear_cwt_verify(b->ear_cwt, b->ear_cwt_sz, b->key, b->key_sz, b->alg,
+                     &ear, NULL) != 0)
+    return -1;
+
+  ear_free(ear);
+
+  return 0;
+}
+
+static int verify_cwt(const bench_t *b) {
+  ear_t *ear = NULL;
+
+  if (ear_verifier_cwt_verify(b->verifier, b->ear_cwt, b->ear_cwt_sz, &ear,
+                              NULL) != 0)
+    return -1;
+
+  ear_free(ear);
+
+  return 0;
+}
+
+static int guard_check(const bench_t *b) {
+  static _Thread_local uint64_t jti[2];
+
+  // a distinct jti per call: (thread, sequence number), remembered for ~1s
+  if (jti[0] == 0)
+    jti[0] = atomic_fetch_add(&replay_thread_ids, 1) + 1;
+  jti[1]++;
+
+  return ear_replay_guard_check(b->guard, (const char *)jti, sizeof jti,
+                                (int64_t)time(NULL) + 1, NULL);
+}
+
+static int stage_b64(const bench_t *b) {
+  size_t sz;
+
+  return u_b64url_decode_n(b->jws.pld, b->jws.pld_sz, b->scratch,
+                           b->payload_sz, &sz);
+}
+
+static int stage_json(const bench_t *b) {
+  json_t *j = json_loadb((const char *)b->payload, b->payload_sz, 0, NULL);
+
+  if (j == NULL)
+    return -1;
+
+  json_decref(j);
+
+  return 0;
+}
+
+static int stage_jscan(const bench_t *b) {
+  claims_t claims;
+
+  if (jscan_claims(b->payload, b->payload_sz, NULL, &claims) != EAR_OK)
+    return -1;
+
+  return 0;
+}
+
+static int stage_signature(const bench_t *b) {
+  return jws_verify(b->verifier, &b->jws);
+}
+
+static int stage_cbor(const bench_t *b) {
+  json_t *j = NULL;
+  char e[EAR_ERR_SZ];
+
+  if (cwt_claims(&b->cose, &j, e) != EAR_OK)
+    return -1;
+
+  json_decref(j);
+
+  return 0;
+}
+
+static int stage_cwt_signature(const bench_t *b) {
+  return cose_verify(b->verifier, &b->cose);
+}
+
+static int verify_verifier(const bench_t *b);
+
+static const stage_t stages[] = {
+    {"b64 payload", stage_b64, 0},
+    {"json payload", stage_json, 0},
+    {"jscan payload", stage_jscan, 0},
+    {"signature", stage_signature, 0},
+    {"verify (total)", verify_verifier, 0},
+    {"cbor payload", stage_cbor, 1},
+    {"cose signature", stage_cwt_signature, 1},
+    {"cwt verify", verify_cwt, 1},
+};
+
+static const api_t apis[] = {
+    {"ear_jwt_verify", verify_legacy, 0, 0},
+    {"ear_verifier_jwt_verify", verify_verifier, 0, 0},
+    {"ear_verifier_jwt_reverify", verify_reverify, 0, 0},
+    {"ear_verifier_jwt_verify_inplace", verify_inplace, 0, 0},
+    {"ear_verifier_jwt_gate", verify_gate, 0, 0},
+    {"ear_verifier_jwt_gate/hostile", verify_hostile, 0, 1},
+    {"ear_verifier_jwt_gate/limited", verify_limited, 0, 1},
+    {"ear_cwt_verify", verify_cwt_legacy, 1, 0},
+    {"ear_verifier_cwt_verify", verify_cwt, 1, 0},
+    {"ear_replay_guard_check", guard_check, 0, 0},
+    {"ear_cache_jwt_verify", verify_cached, 0, 0},
+    {"ear_ticket_verify", verify_ticket, 0, 0},
+};
+
+static void *worker(void *arg) {
+  worker_t *w = arg;
+  const bench_t *b = w->b;
+  unsigned long ssl0, json0;
+
+  // let the per-thread state settle before measuring
+  for (unsigned i = 0; i < WARMUP_ITERATIONS; i++)
+    (void)b->api->verify(b);
+
+  (void)pthread_barrier_wait((pthread_barrier_t *)&b->start);
+
+  ssl0 = ssl_allocs, json0 = json_allocs;
+
+  while (b->iterations ? w->ops < b->iterations
+                       : !atomic_load_explicit((atomic_int *)&b->stop,
+                                               memory_order_relaxed)) {
+    uint64_t t0 = now_ns();
+
+    if (b->api->verify(b) != 0)
+      w->failures++;
+
+    hist_record(&w->hist, now_ns() - t0);
+    w->ops++;
+  }
+
+  w->ssl_allocs = ssl_allocs - ssl0;
+  w->json_allocs = json_allocs - json0;
+
+  return NULL;
+}
+
+/* Run the benchmark with nthreads, returning the throughput, or -1 */
+static double run(bench_t *b, unsigned nthreads, double base) {
+  worker_t *workers = NULL;
+  hist_t *all = NULL;
+  unsigned long failures = 0, ssl = 0, json = 0;
+  double t0, t1, ops = 0, tput;
+
+  if ((workers = calloc(nthreads, sizeof *workers)) == NULL ||
+      (all = calloc(1, sizeof *all)) == NULL)
+    errx(EXIT_FAILURE, "cannot allocate the per-thread results");
+
+  if (pthread_barrier_init(&b->start, NULL, nthreads + 1) != 0)
+    return -1;
+
+  atomic_store(&b->stop, 0);
+
+  for (unsigned i = 0; i < nthreads; i++) {
+    workers[i].b = b;
+    if (pthread_create(&workers[i].tid, NULL, worker, &workers[i]) != 0)
+      errx(EXIT_FAILURE, "cannot create thread");
+  }
+
+  (void)pthread_barrier_wait(&b->start);
+  t0 = now_s();
+
+  if (b->iterations == 0) {
+    struct timespec ts = {(time_t)b->duration,
+                          (long)((b->duration - (time_t)b->duration) * 1e9)};
+
+    while (nanosleep(&ts, &ts) == -1)
+      ;
+
+    atomic_store(&b->stop, 1);
+  }
+
+  for (unsigned i = 0; i < nthreads; i++) {
+    (void)pthread_join(workers[i].tid, NULL);
+    ops += (double)workers[i].ops;
+    failures += workers[i].failures;
+    ssl += workers[i].ssl_allocs;
+    json += workers[i].json_allocs;
+    hist_merge(all, &workers[i].hist);
+  }
+
+  t1 = now_s();
+  (void)pthread_barrier_destroy(&b->start);
+
+  tput = ops / (t1 - t0);
+
+  // scaling efficiency: per-thread throughput relative to the first run
+  printf("%-31s %7u %11.0f %6.2f %9.1f %9.1f %9.1f %9.1f %10.1f %10.1f %8lu\n",
+         b->api->name, nthreads, tput, base > 0 ? tput / nthreads / base : 1.0,
+         hist_percentile(all, 50.0) / 1e3, hist_percentile(all, 99.0) / 1e3,
+         hist_percentile(all, 99.9) / 1e3, all->max / 1e3, (double)ssl / ops,
+         (double)json / ops, failures);
+
+  free(all);
+  free(workers);
+
+  return tput;
+}
+
+static const uint8_t hostile_key[32]; /* HS256, all zeroes */
+static const uint8_t ticket_key[32];  /* likewise */
+
+/* A ticket sealed with ticket_key from the EAR that b verifies */
+static void ticket_new(bench_t *b) {
+  ear_t *ear = NULL;
+  char err_msg[EAR_ERR_SZ];
+
+  if (ear_verifier_new(ticket_key, sizeof ticket_key, "HS256", &b->sealer,
+                       err_msg) != 0 ||
+      ear_verifier_jwt_verify(b->verifier, b->ear_jwt, &ear, err_msg) != 0 ||
+      ear_ticket_seal(b->sealer, ear, TICKET_TTL, NULL, 0, &b->ticket_sz,
+                      err_msg) != 0)
+    errx(EXIT_FAILURE, "cannot seal a ticket: %s", err_msg);
+
+  if ((b->ticket = malloc(b->ticket_sz)) == NULL ||
+      ear_ticket_seal(b->sealer, ear, TICKET_TTL, b->ticket, b->ticket_sz,
+                      &b->ticket_sz, err_msg) != 0)
+    errx(EXIT_FAILURE, "cannot seal a ticket: %s", err_msg);
+
+  ear_free(ear);
+}
+
+/* An HS256 EAR JWT with n appraisal records, which a verifier without limits
+ * decodes and checks one by one */
+static char *hostile_new(unsigned long n) {
+  const char *header = "{\"alg\":\"HS256\",\"typ\":\"JWT\"}";
+  const char *rec = "\"r%lu\":{\"ear.status\":\"affirming\"}";
+  size_t claims_sz = 128 + n * 48, off, hdr_sz, jwt_sz;
+  uint8_t mac[EVP_MAX_MD_SIZE];
+  unsigned mac_sz;
+  char *claims, *jwt;
+
+  if ((claims = malloc(claims_sz)) == NULL)
+    return NULL;
+
+  off = (size_t)snprintf(claims, claims_sz,
+                         "{\"eat_profile\":\"tag:github.com,2023:veraison/"
+                         "ear\",\"submods\":{");
+
+  for (unsigned long i = 0; i < n; i++) {
+    if (i > 0)
+      claims[off++] = ',';
+    off += (size_t)snprintf(claims + off, claims_sz - off, rec, i);
+  }
+
+  off += (size_t)snprintf(claims + off, claims_sz - off, "}}");
+
+  jwt_sz = U_B64URL_ENCODED_SZ(strlen(header)) + U_B64URL_ENCODED_SZ(off) +
+           U_B64URL_ENCODED_SZ(EVP_MAX_MD_SIZE) + 3;
+
+  if ((jwt = malloc(jwt_sz)) == NULL) {
+    free(claims);
+    return NULL;
+  }
+
+  hdr_sz = u_b64url_encode_n((const uint8_t *)header, strlen(header), jwt);
+  jwt[hdr_sz] = '.';
+  off = hdr_sz + 1 +
+        u_b64url_encode_n((const uint8_t *)claims, off, jwt + hdr_sz + 1);
+  free(claims);
+
+  if (HMAC(EVP_sha256(), hostile_key, sizeof hostile_key, (uint8_t *)jwt, off,
+           mac, &mac_sz) == NULL) {
+    free(jwt);
+    return NULL;
+  }
+
+  jwt[off++] = '.';
+  off += u_b64url_encode_n(mac, mac_sz, jwt + off);
+  jwt[off] = '\0';
+
+  return jwt;
+}
+
+/* Single-threaded breakdown of a verification into its main stages, with
+ * hardware counters next to the timings when the kernel allows them */
+static void run_stages(bench_t *b, unsigned long n) {
+  counters_t c;
+  double v[CTR_COUNT];
+
+  if (jws_split(b->ear_jwt, &b->jws) == -1)
+    errx(EXIT_FAILURE, "malformed EAR JWT");
+
+  b->payload_sz = U_B64URL_DECODED_SZ(b->jws.pld_sz);
+  if ((b->payload = malloc(b->payload_sz)) == NULL ||
+      (b->scratch = malloc(b->payload_sz)) == NULL ||
+      u_b64url_decode_n(b->jws.pld, b->jws.pld_sz, b->payload, b->payload_sz,
+                        &b->payload_sz) == -1)
+    errx(EXIT_FAILURE, "cannot decode the EAR JWT payload");
+
+  if (counters_open(&c) == 0)
+    (void)fprintf(stderr, "hardware counters unavailable (see "
+                          "/proc/sys/kernel/perf_event_paranoid), "
+                          "reporting timings only\n");
+
+  printf("\n%-16s %10s", "stage", "ns/op");
+  for (int i = 0; i < CTR_COUNT; i++)
+    printf(" %13s", counter_names[i]);
+  printf(" %6s\n", "IPC");
+
+  for (size_t i = 0; i < sizeof stages / sizeof stages[0]; i++) {
+    uint64_t t0, t1;
+
+    if (stages[i].cwt && b->ear_cwt == NULL)
+      continue;
+
+    for (unsigned j = 0; j < WARMUP_ITERATIONS; j++)
+      (void)stages[i].run(b);
+
+    counters_start(&c);
+    t0 = now_ns();
+
+    for (unsigned long j = 0; j < n; j++) {
+      if (stages[i].run(b) != 0)
+        errx(EXIT_FAILURE, "stage \"%s\" failed", stages[i].name);
+    }
+
+    t1 = now_ns();
+    counters_stop(&c, v);
+
+    printf("%-16s %10.1f", stages[i].name, (double)(t1 - t0) / n);
+
+    for (int k = 0; k < CTR_COUNT; k++) {
+      if (v[k] < 0)
+        printf(" %13s", "n/a");
+      else
+        printf(" %13.1f", v[k] / n);
+    }
+
+    if (v[CTR_CYCLES] > 0 && v[CTR_INSTRUCTIONS] >= 0)
+      printf(" %6.2f\n", v[CTR_INSTRUCTIONS] / v[CTR_CYCLES]);
+    else
+      printf(" %6s\n", "n/a");
+  }
+
+  counters_close(&c);
+
+  free(b->payload);
+  free(b->scratch);
+}
+
+int main(int argc, char *argv[]) {
+  args_t args = {{'\0'}, {'\0'}, {'\0'}, {'\0'}, {'\0'},
+                 {1, 2, 4, 8}, 4, 0, 3.0, 0, 0};
+  const ear_limits_t limits = {.max_submods = HOSTILE_MAX_SUBMODS};
+  uint8_t *key = NULL, *ear_jwt = NULL, *ear_cwt = NULL;
+  size_t key_sz, ear_jwt_sz, ear_cwt_sz = 0;
+  char err_msg[EAR_ERR_SZ];
+  bench_t b;
+
+  // must come before anything is allocated by OpenSSL or jansson
+  (void)CRYPTO_set_mem_functions(count_crypto_malloc, count_crypto_realloc,
+                                 count_crypto_free);
+  json_set_alloc_funcs(count_json_malloc, free);
+
+  parse_opts(argc, argv, &args);
+
+  if (read_from_file(args.key_fn, &key, &key_sz) == -1)
+    err(EXIT_FAILURE, "error reading key from %s", args.key_fn);
+
+  if (read_from_file(args.ear_fn, &ear_jwt, &ear_jwt_sz) == -1)
+    err(EXIT_FAILURE, "error reading EAR JWT from %s", args.ear_fn);
+
+  // read_from_file leaves room for the NUL
+  ear_jwt[ear_jwt_sz] = '\0';
+
+  if (args.cwt_fn[0] != '\0' &&
+      read_from_file(args.cwt_fn, &ear_cwt, &ear_cwt_sz) == -1)
+    err(EXIT_FAILURE, "error reading EAR CWT from %s", args.cwt_fn);
+
+  memset(&b, 0, sizeof b);
+  b.ear_jwt = (const char *)ear_jwt;
+  b.ear_cwt = ear_cwt;
+  b.ear_cwt_sz = ear_cwt_sz;
+  b.key = key;
+  b.key_sz = key_sz;
+  b.alg = args.alg;
+  b.iterations = args.iterations;
+  b.duration = args.duration;
+
+  if (ear_verifier_new(key, key_sz, args.alg, &b.verifier, err_msg) != 0)
+    errx(EXIT_FAILURE, "cannot create verifier: %s", err_msg);
+
+  if (ear_replay_guard_new(REPLAY_CAPACITY, 0, &b.guard, err_msg) != 0)
+    errx(EXIT_FAILURE, "cannot create replay guard: %s", err_msg);
+
+  if (ear_verifier_new(key, key_sz, args.alg, &b.cached, err_msg) != 0 ||
+      ear_cache_open(NULL, 1024, 4096, 3600, &b.cache, err_msg) != 0)
+    errx(EXIT_FAILURE, "cannot create cached verifier: %s", err_msg);
+
+  ear_verifier_set_cache(b.cached, b.cache);
+
+  if (args.hostile != 0) {
+    if ((b.hostile_jwt = hostile_new(args.hostile)) == NULL)
+      errx(EXIT_FAILURE, "cannot make the hostile EAR JWT");
+
+    if (ear_verifier_new(hostile_key, sizeof hostile_key, "HS256", &b.hostile,
+                         err_msg) != 0 ||
+        ear_verifier_new(hostile_key, sizeof hostile_key, "HS256", &b.limited,
+                         err_msg) != 0)
+      errx(EXIT_FAILURE, "cannot create hostile verifier: %s", err_msg);
+
+    ear_verifier_set_limits(b.limited, &limits);
+
+    if (verify_hostile(&b) != 0 || verify_limited(&b) != 0)
+      errx(EXIT_FAILURE, "the hostile EAR JWT is not what it should be");
+  }
+
+  if (verify_verifier(&b) != 0)
+    errx(EXIT_FAILURE, "the EAR does not verify with the supplied key");
+
+  ticket_new(&b);
+
+  if (ear_cwt != NULL &&
+      (verify_cwt(&b) != 0 || cose_split(ear_cwt, ear_cwt_sz, &b.cose) != 0))
+    errx(EXIT_FAILURE, "the EAR CWT does not verify with the supplied key");
+
+  printf("%-31s %7s %11s %6s %9s %9s %9s %9s %10s %10s %8s\n", "api",
+         "threads", "ops/s", "eff", "p50(us)", "p99(us)", "p99.9(us)",
+         "max(us)", "ssl-al/op", "json-al/op", "failures");
+
+  for (size_t i = 0; i < sizeof apis / sizeof apis[0]; i++) {
+    double base = 0, tput;
+
+    if (args.api[0] != '\0' && strcmp(args.api, apis[i].name))
+      continue;
+
+    if (apis[i].cwt && b.ear_cwt == NULL)
+      continue;
+
+    if (apis[i].hostile && b.hostile_jwt == NULL)
+      continue;
+
+    b.api = &apis[i];
+
+    for (size_t j = 0; j < args.threads_sz; j++) {
+      if ((tput = run(&b, args.threads[j], base)) < 0)
+        errx(EXIT_FAILURE, "cannot run with %u threads", args.threads[j]);
+
+      if (j == 0)
+        base = tput / args.threads[j];
+    }
+  }
+
+  if (args.stages)
+    run_stages(&b, args.iterations ? args.iterations : 2000);
+
+  ear_verifier_free(b.verifier);
+  ear_replay_guard_free(b.guard);
+  ear_verifier_free(b.cached);
+  ear_cache_close(b.cache);
+  ear_verifier_free(b.hostile);
+  ear_verifier_free(b.limited);
+  free(b.hostile_jwt);
+  ear_verifier_free(b.sealer);
+  free(b.ticket);
+  free(key);
+  free(ear_jwt);
+  free(ear_cwt);
+
+  return 0;
+}
+
+int read_from_file(const char *fn, uint8_t **pb, size_t *pb_sz) {
+  long sz;
+  uint8_t *b = NULL;
+  FILE *fp = NULL;
+
+  if ((fp = fopen(fn, "rb")) == NULL || (fseek(fp, 0L, SEEK_END) == -1)) {
+    goto err;
+  }
+
+  sz = ftell(fp);
+  rewind(fp);
+
+  if (sz <= 0 || (b = malloc(sz + 1)) == NULL) {
+    goto err;
+  }
+
+  if (fread(b, sz, 1, fp) != 1) {
+    goto err;
+  }
+
+  (void)fclose(fp), fp = NULL;
+
+  *pb = b;
+  *pb_sz = sz;
+
+  return 0;
+
+err:
+  if (fp != NULL)
+    (void)fclose(fp);
+  if (b != NULL)
+    free(b);
+
+  return -1;
+}
+
+void usage(const char *name) {
+  const char *fmt =
+      "\nUsage: %s [opts] <ear_jwt>\n\n"
+      "    where \'ear_jwt\' is a EAR in JWT format, and \'opts\' is:\n\n"
+      "  -k KEY   The key to use for verification\n"
+      "  -a ALG   The algorithm to use for verification\n"
+      "  -c CWT   Also benchmark the CWT serialization, using the EAR CWT in\n"
+      "           file CWT (signed with the same key as ear_jwt)\n"
+      "  -t LIST  Comma-separated thread counts (default: 1,2,4,8)\n"
+      "  -d SECS  Run each thread count for SECS seconds (default: 3)\n"
+      "  -n N     Run N verifications per thread instead of a fixed time\n"
+      "  -A API   Only run API (ear_jwt_verify, ear_verifier_jwt_verify,\n"
+      "           ear_verifier_jwt_reverify,\n"
+      "           ear_verifier_jwt_verify_inplace, ear_verifier_jwt_gate,\n"
+      "           ear_verifier_jwt_gate/hostile,\n"
+      "           ear_verifier_jwt_gate/limited, ear_cwt_verify,\n"
+      "           ear_verifier_cwt_verify,\n"
+      "           ear_replay_guard_check, ear_cache_jwt_verify,\n"
+      "           ear_ticket_verify)\n"
+      "  -H N     Also verify a hostile HS256 EAR JWT with N appraisal\n"
+      "           records, without limits and with at most 16\n"
+      "  -p       Also break a verification down into stages, with hardware\n"
+      "           performance counters where the kernel allows them\n"
+      "\n"
+      "  Latencies are per verification; 'eff' is the scaling efficiency,\n"
+      "  i.e. the per-thread throughput relative to the first thread count.\n";
+
+  (void)fprintf(stderr, fmt, name);
+
+  exit(EXIT_FAILURE);
+}
+
+static void parse_threads(const char *s, args_t *pargs, const char *name) {
+  char *end;
+
+  pargs->threads_sz = 0;
+
+  do {
+    unsigned long n = strtoul(s, &end, 10);
+
+    if (end == s || n == 0 || n > MAX_THREADS ||
+        pargs->threads_sz == sizeof pargs->threads / sizeof pargs->threads[0])
+      usage(name);
+
+    pargs->threads[pargs->threads_sz++] = (unsigned)n;
+    s = end + 1;
+  } while (*end == ',');
+
+  if (*end != '\0')
+    usage(name);
+}
+
+void parse_opts(int ac, char **av, args_t *pargs) {
+  int c;
+
+  while ((c = getopt(ac, av, "A:a:c:d:H:k:n:pt:")) != -1) {
+    switch (c) {
+    case 'A':
+      u_strlcpy(pargs->api, optarg, sizeof pargs->api);
+      break;
+    case 'p':
+      pargs->stages = 1;
+      break;
+    case 'd':
+      if ((pargs->duration = strtod(optarg, NULL)) <= 0)
+        usage(av[0]);
+      break;
+    case 'a':
+      u_strlcpy(pargs->alg, optarg, sizeof pargs->alg);
+      break;
+    case 'c':
+      u_strlcpy(pargs->cwt_fn, optarg, sizeof pargs->cwt_fn);
+      break;
+    case 'H':
+      if ((pargs->hostile = strtoul(optarg, NULL, 10)) == 0)
+        usage(av[0]);
+      break;
+    case 'k':
+      u_strlcpy(pargs->key_fn, optarg, sizeof pargs->key_fn);
+      break;
+    case 'n':
+      if ((pargs->iterations = strtoul(optarg, NULL, 10)) == 0)
+        usage(av[0]);
+      break;
+    case 't':
+      parse_threads(optarg, pargs, av[0]);
+      break;
+    default:
+      usage(av[0]);
+    }
+  }
+
+  if (optind == ac || pargs->key_fn[0] == '\0' || pargs->alg[0] == '\0') {
+    usage(av[0]);
+  }
+
+  u_strlcpy(pargs->ear_fn, av[optind], sizeof pargs->ear_fn);
+}
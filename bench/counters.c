@@ -0,0 +1,118 @@
+// Copyright 2023 Contributors to the Veraison project.
+// SPDX-License-Identifier: Apache-2.0
+
+#define _GNU_SOURCE
+
+#include "counters.h"
+#include <string.h>
+
+const char *counter_names[CTR_COUNT] = {
+    [CTR_CYCLES] = "cycles",
+    [CTR_INSTRUCTIONS] = "instructions",
+    [CTR_BRANCH_MISSES] = "branch-misses",
+    [CTR_L1D_MISSES] = "L1d-misses",
+    [CTR_LLC_MISSES] = "LLC-misses",
+};
+
+#ifdef __linux__
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const struct {
+  uint32_t type;
+  uint64_t config;
+} events[CTR_COUNT] = {
+    [CTR_CYCLES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    [CTR_INSTRUCTIONS] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    [CTR_BRANCH_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    [CTR_L1D_MISSES] = {PERF_TYPE_HW_CACHE,
+                        PERF_COUNT_HW_CACHE_L1D |
+                            (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    [CTR_LLC_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+};
+
+int counters_open(counters_t *c) {
+  struct perf_event_attr attr;
+  int n = 0;
+
+  for (int i = 0; i < CTR_COUNT; i++) {
+    memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = events[i].type;
+    attr.config = events[i].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    // this thread, any CPU
+    c->fd[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (c->fd[i] >= 0)
+      n++;
+  }
+
+  return n;
+}
+
+void counters_start(counters_t *c) {
+  for (int i = 0; i < CTR_COUNT; i++) {
+    if (c->fd[i] >= 0) {
+      (void)ioctl(c->fd[i], PERF_EVENT_IOC_RESET, 0);
+      (void)ioctl(c->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+}
+
+void counters_stop(counters_t *c, double v[CTR_COUNT]) {
+  uint64_t r[3]; // value, time enabled, time running
+
+  for (int i = 0; i < CTR_COUNT; i++) {
+    v[i] = -1;
+
+    if (c->fd[i] < 0)
+      continue;
+
+    (void)ioctl(c->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+
+    if (read(c->fd[i], r, sizeof r) != (ssize_t)sizeof r || r[2] == 0)
+      continue;
+
+    // scale up if the counter was multiplexed
+    v[i] = (double)r[0] * ((double)r[1] / (double)r[2]);
+  }
+}
+
+void counters_close(counters_t *c) {
+  for (int i = 0; i < CTR_COUNT; i++) {
+    if (c->fd[i] >= 0)
+      (void)close(c->fd[i]);
+    c->fd[i] = -1;
+  }
+}
+
+#else // !__linux__
+
+int counters_open(counters_t *c) {
+  for (int i = 0; i < CTR_COUNT; i++)
+    c->fd[i] = -1;
+
+  return 0;
+}
+
+void counters_start(counters_t *c) { (void)c; }
+
+void counters_stop(counters_t *c, double v[CTR_COUNT]) {
+  (void)c;
+
+  for (int i = 0; i < CTR_COUNT; i++)
+    v[i] = -1;
+}
+
+void counters_close(counters_t *c) { (void)c; }
+
+#endif // __linux__
@@ -0,0 +1,36 @@
+// Copyright 2023 Contributors to the Veraison project.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <stdint.h>
+
+/* Hardware performance counters for the calling thread, read through
+ * perf_event_open(2) on Linux.  Any counter the kernel (or the hypervisor)
+ * does not allow is left closed and reported as unavailable; elsewhere all of
+ * them are */
+
+typedef enum {
+  CTR_CYCLES,
+  CTR_INSTRUCTIONS,
+  CTR_BRANCH_MISSES,
+  CTR_L1D_MISSES,
+  CTR_LLC_MISSES,
+  CTR_COUNT
+} counter_t;
+
+typedef struct counters_s {
+  int fd[CTR_COUNT];
+} counters_t;
+
+extern const char *counter_names[CTR_COUNT];
+
+/* Returns the number of counters that could be opened */
+int counters_open(counters_t *c);
+void counters_start(counters_t *c);
+/* v[i] is set to the (multiplexing-scaled) count, or -1 if unavailable */
+void counters_stop(counters_t *c, double v[CTR_COUNT]);
+void counters_close(counters_t *c);
+
+#endif // !COUNTERS_H
@@ -158,3 +158,44 @@ int Base64decode(char *bufplain, const char *bufcoded) {
   nbytesdecoded -= (4 - nprbytes) & 3;
   return nbytesdecoded;
 }
+
+/* Length-bounded variant of Base64decode(): decodes exactly @p nbytescoded
+ * characters, rejecting any that are outside the alphabet (and so padding),
+ * and does not NUL-terminate @p bufplain.  Returns the number of bytes
+ * decoded, or -1 on malformed input. */
+int Base64decode_n(char *bufplain, const char *bufcoded, size_t nbytescoded) {
+  register const unsigned char *bufin;
+  register unsigned char *bufout;
+  size_t nprbytes, i;
+
+  if (nbytescoded % 4 == 1 || nbytescoded / 4 * 3 + 2 > 0x7fffffff)
+    return -1;
+
+  bufin = (const unsigned char *)bufcoded;
+  for (i = 0; i < nbytescoded; i++) {
+    if (pr2six[bufin[i]] > 63)
+      return -1;
+  }
+
+  bufout = (unsigned char *)bufplain;
+  nprbytes = nbytescoded;
+
+  while (nprbytes >= 4) {
+    *(bufout++) = (unsigned char)(pr2six[*bufin] << 2 | pr2six[bufin[1]] >> 4);
+    *(bufout++) =
+        (unsigned char)(pr2six[bufin[1]] << 4 | pr2six[bufin[2]] >> 2);
+    *(bufout++) = (unsigned char)(pr2six[bufin[2]] << 6 | pr2six[bufin[3]]);
+    bufin += 4;
+    nprbytes -= 4;
+  }
+
+  if (nprbytes > 1) {
+    *(bufout++) = (unsigned char)(pr2six[*bufin] << 2 | pr2six[bufin[1]] >> 4);
+  }
+  if (nprbytes > 2) {
+    *(bufout++) =
+        (unsigned char)(pr2six[bufin[1]] << 4 | pr2six[bufin[2]] >> 2);
+  }
+
+  return (int)(bufout - (unsigned char *)bufplain);
+}
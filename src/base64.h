@@ -82,12 +82,15 @@
 #ifndef _BASE64_H_
 #define _BASE64_H_
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 int Base64decode_len(const char *coded_src);
 int Base64decode(char *plain_dst, const char *coded_src);
+int Base64decode_n(char *plain_dst, const char *coded_src, size_t coded_sz);
 
 #ifdef __cplusplus
 }
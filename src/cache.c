@@ -0,0 +1,711 @@
+// Copyright 2023 Contributors to the Veraison project.
+// SPDX-License-Identifier: Apache-2.0
+
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS */
+
+#include "ear.h"
+#include "ear_priv.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <openssl/rand.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* A table of verified EAR snapshots, keyed by the SHA-256 of the token and
+ * living in memory shared by several processes.
+ *
+ * The table is set-associative: a token can only live in the CACHE_WAYS
+ * slots of its bucket.  Each slot is protected by a sequence lock: a writer
+ * makes the sequence odd, fills the slot and makes it even again, and a
+ * reader copies the slot out and retries if the sequence moved.  Nobody
+ * ever blocks, and there is no lock to be left held: a writer that dies
+ * half-way leaves its slot odd, which readers see as a miss, and which the
+ * next writer takes over after CACHE_STALE_NS.  A checksum over each slot,
+ * checked after the copy, catches what the sequence cannot: a dead writer's
+ * half-written slot, or a slow one still writing into a slot taken over.
+ * The checksum is seeded from the table header, not from a secret: it tells
+ * torn slots from whole ones, not forged ones from genuine ones.  Whoever can
+ * write the table can store any snapshot under any token, which is why the
+ * table must be owned by the effective user and writable by nobody else.
+ *
+ * Once initialised, the header is only ever read.  Lookups count their hits
+ * and misses in one of CACHE_STRIPES counters, each on a cache line of its
+ * own and chosen by thread, which ear_cache_stats() adds up.
+ *
+ * A named table is initialised by whichever process first finds it
+ * uninitialised while holding flock(2) on it, which the others wait for.  A
+ * process that dies half-way through leaves the table uninitialised, and
+ * the kernel drops its lock: the next one to open the table builds it
+ * again.
+ *
+ * The same table can live in a regular file instead, which then keeps the
+ * cache warm across restarts.  Such a file is only ever seen initialised:
+ * it is built under a temporary name and linked into place. */
+
+#define CACHE_MAGIC 0x48434145u /* "EACH" */
+#define CACHE_VERSION 2
+#define CACHE_WAYS 4
+#define CACHE_READ_TRIES 4
+#define CACHE_STALE_NS 1000000000LL
+#define CACHE_STRIPES 64 /* of the hit and miss counters */
+
+typedef struct cache_hdr_s {
+  _Atomic uint32_t magic; /* stored last, once initialised */
+  uint32_t version;
+  uint64_t nslots;
+  uint64_t slot_sz;
+  uint64_t seed; /* of the slot checksums, public to whoever maps this */
+  uint32_t ttl;
+  uint32_t reserved;
+  uint8_t pad[24];
+} cache_hdr_t;
+
+/* Counters are striped over cache lines of their own, away from the header
+ * that every lookup reads, and picked by thread (see jws_tls_index()) */
+typedef struct cache_ctr_s {
+  _Atomic uint64_t hits;
+  _Atomic uint64_t misses;
+  uint8_t pad[48];
+} cache_ctr_t;
+
+typedef struct cache_slot_s {
+  _Atomic uint64_t seq;      /* odd while being written */
+  _Atomic int64_t locked_at; /* CLOCK_MONOTONIC, when seq went odd */
+  uint64_t sum;
+  int64_t expires;
+  uint32_t snap_sz; /* 0 if empty */
+  uint32_t reserved;
+  uint8_t digest[CACHE_DIGEST_SZ];
+  /* followed by the snapshot */
+} cache_slot_t;
+
+_Static_assert(sizeof(cache_hdr_t) == 64, "cache_hdr_t layout");
+_Static_assert(sizeof(cache_ctr_t) == 64, "cache_ctr_t layout");
+_Static_assert(sizeof(cache_slot_t) % 8 == 0, "cache_slot_t alignment");
+
+struct ear_cache_s {
+  cache_hdr_t *hdr;
+  cache_ctr_t *ctrs; /* CACHE_STRIPES of them */
+  uint8_t *slots;
+  size_t map_sz;
+  int persistent; /* backed by a regular file */
+  /* background compaction */
+  pthread_t compactor;
+  int compacting;
+  unsigned interval;
+  int stop;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+};
+
+static _Atomic(ear_cache_t *) cache_default_cache;
+
+static void *cache_compactor(void *arg);
+
+static int64_t mono_ns(void) {
+  struct timespec ts;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static cache_slot_t *cache_slot(const ear_cache_t *cache, uint64_t i) {
+  return (cache_slot_t *)(cache->slots + i * cache->hdr->slot_sz);
+}
+
+static uint64_t cache_tear_sum(const ear_cache_t *cache,
+                               const uint8_t *digest, int64_t expires,
+                               const uint8_t *snap, size_t sz) {
+  uint64_t h = cache->hdr->seed ^ (uint64_t)expires ^ ((uint64_t)sz << 32);
+
+  h = u_hash64(digest, CACHE_DIGEST_SZ, h);
+
+  return u_hash64(snap, sz, h);
+}
+
+static uint64_t cache_bucket(const ear_cache_t *cache, const uint8_t *digest) {
+  uint64_t i;
+
+  memcpy(&i, digest, sizeof i);
+
+  return i & (cache->hdr->nslots - 1) & ~(uint64_t)(CACHE_WAYS - 1);
+}
+
+static size_t cache_map_sz(uint64_t nslots, uint64_t slot_sz) {
+  return sizeof(cache_hdr_t) + CACHE_STRIPES * sizeof(cache_ctr_t) +
+         nslots * slot_sz;
+}
+
+/* Whether the table in fd has been initialised */
+static int cache_ready(int fd) {
+  uint32_t magic;
+
+  return pread(fd, &magic, sizeof magic, 0) == (ssize_t)sizeof magic &&
+         magic == CACHE_MAGIC;
+}
+
+/* Map the table in fd, which has been initialised */
+static int cache_map(int fd, cache_hdr_t **phdr, size_t *pmap_sz) {
+  struct stat st;
+  void *map;
+
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size < cache_map_sz(0, 0))
+    return -1;
+
+  map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+             0);
+  if (map == MAP_FAILED)
+    return -1;
+
+  if (atomic_load_explicit(&((cache_hdr_t *)map)->magic,
+                           memory_order_acquire) != CACHE_MAGIC) {
+    (void)munmap(map, (size_t)st.st_size);
+    return -1;
+  }
+
+  *phdr = map;
+  *pmap_sz = (size_t)st.st_size;
+
+  return 0;
+}
+
+ear_err_t cache_attach(int fd, int create, size_t capacity, size_t max_snap_sz,
+                       unsigned ttl, ear_cache_t **pcache,
+                       char err_msg[EAR_ERR_SZ]) {
+  ear_cache_t *cache = NULL;
+  cache_hdr_t *hdr = NULL;
+  uint64_t nslots = CACHE_WAYS, slot_sz;
+  size_t map_sz = 0;
+
+  slot_sz = (sizeof(cache_slot_t) + max_snap_sz + 63) & ~(uint64_t)63;
+
+  while (nslots < capacity)
+    nslots *= 2;
+
+  if ((cache = calloc(1, sizeof *cache)) == NULL) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "cannot allocate the cache");
+    return EAR_ERR_ALLOC;
+  }
+
+  if (create) {
+    map_sz = cache_map_sz(nslots, slot_sz);
+
+    // from scratch, whatever a dead initialiser may have left
+    if (fd != -1 &&
+        (ftruncate(fd, 0) == -1 || ftruncate(fd, (off_t)map_sz) == -1))
+      goto err_map;
+
+    hdr = mmap(NULL, map_sz, PROT_READ | PROT_WRITE,
+               (fd == -1) ? MAP_SHARED | MAP_ANONYMOUS : MAP_SHARED, fd, 0);
+    if (hdr == MAP_FAILED)
+      goto err_map;
+
+    hdr->version = CACHE_VERSION;
+    hdr->nslots = nslots;
+    hdr->slot_sz = slot_sz;
+    hdr->ttl = ttl;
+
+    if (RAND_bytes((unsigned char *)&hdr->seed, sizeof hdr->seed) != 1) {
+      (void)munmap(hdr, map_sz);
+      goto err_map;
+    }
+
+    atomic_store_explicit(&hdr->magic, CACHE_MAGIC, memory_order_release);
+  } else {
+    struct stat st;
+
+    // whoever can write the table can make any token pass verification
+    if (fstat(fd, &st) == -1 || st.st_uid != geteuid() ||
+        (st.st_mode & (S_IWGRP | S_IWOTH))) {
+      (void)snprintf(err_msg, EAR_ERR_SZ,
+                     "cache is not owned by us, or writable by others");
+      free(cache);
+      return EAR_ERR_CACHE;
+    }
+
+    // first creator wins: its geometry is the table's
+    if (cache_map(fd, &hdr, &map_sz) == -1) {
+      (void)snprintf(err_msg, EAR_ERR_SZ, "cache was never initialised");
+      free(cache);
+      return EAR_ERR_CACHE;
+    }
+
+    if (hdr->version != CACHE_VERSION || hdr->nslots < CACHE_WAYS ||
+        (hdr->nslots & (hdr->nslots - 1)) != 0 ||
+        hdr->slot_sz < sizeof(cache_slot_t) || hdr->slot_sz % 8 != 0 ||
+        hdr->nslots > (SIZE_MAX - cache_map_sz(0, 0)) / hdr->slot_sz ||
+        cache_map_sz(hdr->nslots, hdr->slot_sz) != map_sz) {
+      (void)snprintf(err_msg, EAR_ERR_SZ, "incompatible cache");
+      (void)munmap(hdr, map_sz);
+      free(cache);
+      return EAR_ERR_CACHE;
+    }
+  }
+
+  cache->hdr = hdr;
+  cache->ctrs = (cache_ctr_t *)(hdr + 1);
+  cache->slots = (uint8_t *)(cache->ctrs + CACHE_STRIPES);
+  cache->map_sz = map_sz;
+
+  *pcache = cache;
+
+  return EAR_OK;
+
+err_map:
+  (void)snprintf(err_msg, EAR_ERR_SZ, "cannot map the cache: %s",
+                 strerror(errno));
+  free(cache);
+
+  return EAR_ERR_CACHE;
+}
+
+int ear_cache_open(const char *name, size_t capacity, size_t max_snap_sz,
+                   unsigned ttl, ear_cache_t **pcache,
+                   char err_msg[EAR_ERR_SZ]) {
+  assert(capacity > 0);
+  assert(ttl > 0);
+  assert(pcache != NULL);
+
+  ear_err_t code;
+  int fd = -1, create = 1;
+  char e[EAR_ERR_SZ] = {'\0'};
+
+  if (!atomic_is_lock_free((_Atomic uint64_t *)NULL)) {
+    (void)snprintf(e, sizeof e, "no lock-free 64-bit atomics");
+    goto err;
+  }
+
+  if (name != NULL) {
+    struct stat st;
+
+    if ((fd = shm_open(name, O_RDWR | O_CREAT, 0600)) == -1 ||
+        flock(fd, LOCK_EX) == -1) {
+      (void)snprintf(e, sizeof e, "cannot open \"%s\": %s", name,
+                     strerror(errno));
+      goto err;
+    }
+
+    // whoever can write the table can make any token pass verification
+    if (fstat(fd, &st) == -1 || st.st_uid != geteuid() ||
+        (st.st_mode & (S_IWGRP | S_IWOTH))) {
+      (void)snprintf(e, sizeof e,
+                     "cache is not owned by us, or writable by others");
+      goto err;
+    }
+
+    create = !cache_ready(fd);
+  }
+
+  code = cache_attach(fd, create, capacity, max_snap_sz, ttl, pcache, e);
+
+  // the mapping keeps the segment alive, and the lock too unless dropped
+  if (fd != -1) {
+    (void)flock(fd, LOCK_UN);
+    (void)close(fd), fd = -1;
+  }
+
+  if (code == EAR_OK)
+    return 0;
+
+err:
+  if (fd != -1)
+    (void)close(fd);
+
+  if (err_msg != NULL)
+    (void)u_strlcpy(err_msg, e, EAR_ERR_SZ);
+
+  return -1;
+}
+
+int ear_cache_open_file(const char *path, size_t capacity, size_t max_snap_sz,
+                        unsigned ttl, unsigned compact_interval,
+                        ear_cache_t **pcache, char err_msg[EAR_ERR_SZ]) {
+  assert(path != NULL);
+  assert(capacity > 0);
+  assert(ttl > 0);
+  assert(pcache != NULL);
+
+  ear_cache_t *cache = NULL;
+  ear_err_t code = EAR_ERR_CACHE;
+  char *tmp = NULL;
+  int fd = -1;
+  char e[EAR_ERR_SZ] = {'\0'};
+
+  if ((fd = open(path, O_RDWR)) == -1 && errno == ENOENT) {
+    // build the table aside, then publish it whole
+    if ((tmp = malloc(strlen(path) + sizeof ".XXXXXX")) == NULL) {
+      (void)snprintf(e, sizeof e, "cannot allocate the cache");
+      goto err;
+    }
+
+    (void)strcpy(tmp, path);
+    (void)strcat(tmp, ".XXXXXX");
+
+    if ((fd = mkstemp(tmp)) == -1) {
+      (void)snprintf(e, sizeof e, "cannot create \"%s\": %s", tmp,
+                     strerror(errno));
+      goto err;
+    }
+
+    code = cache_attach(fd, 1, capacity, max_snap_sz, ttl, &cache, e);
+    (void)close(fd), fd = -1;
+
+    if (code == EAR_OK && link(tmp, path) == -1) {
+      ear_cache_close(cache), cache = NULL;
+
+      // somebody else got there first: use theirs
+      if (errno != EEXIST) {
+        (void)snprintf(e, sizeof e, "cannot create \"%s\": %s", path,
+                       strerror(errno));
+        code = EAR_ERR_CACHE;
+      }
+    }
+
+    (void)unlink(tmp);
+
+    if (code != EAR_OK)
+      goto err;
+
+    if (cache == NULL)
+      fd = open(path, O_RDWR);
+  }
+
+  if (cache == NULL) {
+    if (fd == -1) {
+      (void)snprintf(e, sizeof e, "cannot open \"%s\": %s", path,
+                     strerror(errno));
+      goto err;
+    }
+
+    code = cache_attach(fd, 0, capacity, max_snap_sz, ttl, &cache, e);
+    (void)close(fd), fd = -1;
+
+    if (code != EAR_OK)
+      goto err;
+
+    // fault the table in now rather than on the first lookups
+    (void)posix_madvise(cache->hdr, cache->map_sz, POSIX_MADV_WILLNEED);
+  }
+
+  cache->persistent = 1;
+
+  if (compact_interval > 0) {
+    cache->interval = compact_interval;
+
+    if (pthread_mutex_init(&cache->lock, NULL) != 0 ||
+        pthread_cond_init(&cache->wake, NULL) != 0 ||
+        pthread_create(&cache->compactor, NULL, cache_compactor, cache) != 0) {
+      (void)snprintf(e, sizeof e, "cannot start the cache compactor");
+      ear_cache_close(cache);
+      goto err;
+    }
+
+    cache->compacting = 1;
+  }
+
+  free(tmp);
+
+  *pcache = cache;
+
+  return 0;
+
+err:
+  free(tmp);
+
+  if (err_msg != NULL)
+    (void)u_strlcpy(err_msg, e, EAR_ERR_SZ);
+
+  return -1;
+}
+
+void ear_cache_close(ear_cache_t *cache) {
+  if (cache == NULL)
+    return;
+
+  if (cache->compacting) {
+    (void)pthread_mutex_lock(&cache->lock);
+    cache->stop = 1;
+    (void)pthread_cond_signal(&cache->wake);
+    (void)pthread_mutex_unlock(&cache->lock);
+
+    (void)pthread_join(cache->compactor, NULL);
+    (void)pthread_cond_destroy(&cache->wake);
+    (void)pthread_mutex_destroy(&cache->lock);
+  }
+
+  if (cache->persistent)
+    (void)msync(cache->hdr, cache->map_sz, MS_ASYNC);
+
+  (void)munmap(cache->hdr, cache->map_sz);
+  free(cache);
+}
+
+int ear_cache_stats(const ear_cache_t *cache, uint64_t *phits,
+                    uint64_t *pmisses) {
+  assert(cache != NULL);
+
+  uint64_t hits = 0, misses = 0;
+
+  for (unsigned i = 0; i < CACHE_STRIPES; i++) {
+    hits += atomic_load_explicit(&cache->ctrs[i].hits, memory_order_relaxed);
+    misses +=
+        atomic_load_explicit(&cache->ctrs[i].misses, memory_order_relaxed);
+  }
+
+  if (phits != NULL)
+    *phits = hits;
+
+  if (pmisses != NULL)
+    *pmisses = misses;
+
+  return 0;
+}
+
+/* Copy out the snapshot stored under digest, if any and if still valid at
+ * now, into the caller's heap buffer *pbuf of *pbuf_sz bytes, which is grown
+ * as needed (hit or miss) */
+static int cache_read(ear_cache_t *cache, cache_slot_t *slot,
+                      const uint8_t *digest, int64_t now, uint8_t **pbuf,
+                      size_t *pbuf_sz, size_t *psnap_sz) {
+  size_t max = cache->hdr->slot_sz - sizeof *slot, sz;
+  uint8_t *p;
+  uint64_t seq, sum;
+  int64_t expires;
+
+  for (int i = 0; i < CACHE_READ_TRIES; i++) {
+    seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+    if (seq & 1)
+      break;
+
+    if (memcmp(slot->digest, digest, CACHE_DIGEST_SZ) != 0)
+      break;
+
+    sz = slot->snap_sz;
+    sum = slot->sum;
+    expires = slot->expires;
+
+    if (sz == 0 || sz > max)
+      continue;
+
+    if (sz > *pbuf_sz) {
+      if ((p = realloc(*pbuf, sz)) == NULL)
+        break;
+
+      *pbuf = p;
+      *pbuf_sz = sz;
+    }
+
+    memcpy(*pbuf, slot + 1, sz);
+
+    // only trust what was read if no writer came by meanwhile
+    atomic_thread_fence(memory_order_acquire);
+
+    if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq)
+      continue;
+
+    if (sum != cache_tear_sum(cache, digest, expires, *pbuf, sz) ||
+        now >= expires)
+      break;
+
+    *psnap_sz = sz;
+
+    return 0;
+  }
+
+  return -1;
+}
+
+int cache_get(ear_cache_t *cache, const uint8_t *digest, int64_t now,
+              uint8_t **pbuf, size_t *pbuf_sz, size_t *psnap_sz) {
+  uint64_t b = cache_bucket(cache, digest);
+  cache_ctr_t *ctr = &cache->ctrs[jws_tls_index() % CACHE_STRIPES];
+
+  for (uint64_t w = 0; w < CACHE_WAYS; w++) {
+    if (cache_read(cache, cache_slot(cache, b + w), digest, now, pbuf,
+                   pbuf_sz, psnap_sz) == 0) {
+      atomic_fetch_add_explicit(&ctr->hits, 1, memory_order_relaxed);
+      return 0;
+    }
+  }
+
+  atomic_fetch_add_explicit(&ctr->misses, 1, memory_order_relaxed);
+
+  return -1;
+}
+
+/* Take the write side of slot's sequence lock, possibly over from a writer
+ * that has been at it for too long to still be alive */
+static int cache_lock(cache_slot_t *slot, uint64_t *pseq) {
+  uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+  int64_t now = mono_ns(), locked_at;
+
+  if (seq & 1) {
+    locked_at = atomic_load_explicit(&slot->locked_at, memory_order_relaxed);
+
+    // a lock taken before a reboot (or a clock step) is stale too
+    if (now - locked_at < CACHE_STALE_NS && now >= locked_at)
+      return -1;
+
+    // stay odd, but under a sequence the old writer does not own
+    if (!atomic_compare_exchange_strong(&slot->seq, &seq, seq + 2))
+      return -1;
+
+    seq += 2;
+  } else {
+    if (!atomic_compare_exchange_strong(&slot->seq, &seq, seq + 1))
+      return -1;
+
+    seq += 1;
+  }
+
+  atomic_store_explicit(&slot->locked_at, now, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  *pseq = seq;
+
+  return 0;
+}
+
+size_t ear_cache_compact(ear_cache_t *cache) {
+  assert(cache != NULL);
+
+  int64_t now = (int64_t)time(NULL);
+  cache_slot_t *slot;
+  size_t n = 0;
+  uint64_t seq;
+
+  for (uint64_t i = 0; i < cache->hdr->nslots; i++) {
+    slot = cache_slot(cache, i);
+
+    // empty, live, or being written by a writer that may still be alive
+    if (atomic_load_explicit(&slot->seq, memory_order_relaxed) % 2 == 0 &&
+        (slot->snap_sz == 0 || slot->expires > now))
+      continue;
+
+    if (cache_lock(slot, &seq) == -1)
+      continue;
+
+    // a dead writer may have finished nonetheless
+    if (slot->snap_sz == 0 || slot->expires <= now ||
+        slot->snap_sz > cache->hdr->slot_sz - sizeof *slot ||
+        slot->sum != cache_tear_sum(cache, slot->digest, slot->expires,
+                                    (const uint8_t *)(slot + 1),
+                                    slot->snap_sz)) {
+      memset(slot->digest, 0, sizeof slot->digest);
+      slot->snap_sz = 0;
+      slot->expires = 0;
+      slot->sum = 0;
+      n++;
+    }
+
+    (void)atomic_compare_exchange_strong_explicit(
+        &slot->seq, &seq, seq + 1, memory_order_release, memory_order_relaxed);
+  }
+
+  if (cache->persistent)
+    (void)msync(cache->hdr, cache->map_sz, MS_ASYNC);
+
+  return n;
+}
+
+static void *cache_compactor(void *arg) {
+  ear_cache_t *cache = arg;
+  struct timespec until;
+
+  (void)pthread_mutex_lock(&cache->lock);
+
+  while (!cache->stop) {
+    (void)clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += cache->interval;
+
+    if (pthread_cond_timedwait(&cache->wake, &cache->lock, &until) == 0 ||
+        cache->stop)
+      continue;
+
+    (void)pthread_mutex_unlock(&cache->lock);
+    (void)ear_cache_compact(cache);
+    (void)pthread_mutex_lock(&cache->lock);
+  }
+
+  (void)pthread_mutex_unlock(&cache->lock);
+
+  return NULL;
+}
+
+void cache_put(ear_cache_t *cache, const uint8_t *digest, int64_t now,
+               int64_t expires, const uint8_t *snap, size_t sz) {
+  uint64_t b = cache_bucket(cache, digest), seq;
+  cache_slot_t *slot, *victim = NULL;
+  int64_t oldest = INT64_MAX;
+
+  if (sz > cache->hdr->slot_sz - sizeof *slot)
+    return;
+
+  if (expires > now + (int64_t)cache->hdr->ttl)
+    expires = now + (int64_t)cache->hdr->ttl;
+
+  // the same token, else an empty or expired slot, else the one that
+  // expires first (all racy, but only a heuristic)
+  for (uint64_t w = 0; w < CACHE_WAYS; w++) {
+    slot = cache_slot(cache, b + w);
+
+    if (slot->snap_sz != 0 &&
+        memcmp(slot->digest, digest, CACHE_DIGEST_SZ) == 0) {
+      victim = slot;
+      break;
+    }
+
+    if (slot->snap_sz == 0 || slot->expires <= now) {
+      if (oldest > INT64_MIN) {
+        victim = slot;
+        oldest = INT64_MIN;
+      }
+      continue;
+    }
+
+    if (slot->expires < oldest) {
+      victim = slot;
+      oldest = slot->expires;
+    }
+  }
+
+  if (victim == NULL || cache_lock(victim, &seq) == -1)
+    return;
+
+  memcpy(victim->digest, digest, CACHE_DIGEST_SZ);
+  memcpy(victim + 1, snap, sz);
+  victim->snap_sz = (uint32_t)sz;
+  victim->expires = expires;
+  victim->sum = cache_tear_sum(cache, digest, expires, snap, sz);
+
+  // publish, unless somebody has taken the slot over meanwhile
+  (void)atomic_compare_exchange_strong_explicit(&victim->seq, &seq, seq + 1,
+                                                memory_order_release,
+                                                memory_order_relaxed);
+}
+
+void ear_verifier_set_cache(ear_verifier_t *verifier, ear_cache_t *cache) {
+  assert(verifier != NULL);
+
+  verifier->cache = cache;
+}
+
+void ear_set_cache(ear_cache_t *cache) {
+  atomic_store(&cache_default_cache, cache);
+}
+
+ear_cache_t *cache_default(void) {
+  return atomic_load_explicit(&cache_default_cache, memory_order_acquire);
+}
@@ -0,0 +1,161 @@
+// Copyright 2023 Contributors to the Veraison project.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ear_priv.h"
+#include <assert.h>
+#include <string.h>
+
+/* A minimal CBOR (RFC8949) pull decoder.  cbor_next() reads one item head at
+ * a time, and byte and text strings are returned as pointers into the input
+ * rather than copied.  Indefinite-length items are not supported: COSE and
+ * CWT producers are required to use definite lengths (RFC9052 9) */
+
+void cbor_init(cbor_t *c, const uint8_t *buf, size_t sz) {
+  assert(c != NULL);
+
+  c->p = buf;
+  c->end = buf + sz;
+}
+
+static double half_to_double(uint16_t h) {
+  uint64_t e = (h >> 10) & 0x1f, m = h & 0x3ff, bits;
+  double v;
+
+  if (e == 0) {
+    v = (double)m / 16777216.0; // subnormal: m * 2^-24
+    return (h & 0x8000) ? -v : v;
+  }
+
+  // re-bias the exponent and widen the mantissa
+  e = (e == 31) ? 0x7ff : e - 15 + 1023;
+  bits = (uint64_t)(h & 0x8000) << 48 | e << 52 | m << 42;
+  memcpy(&v, &bits, sizeof v);
+
+  return v;
+}
+
+int cbor_next(cbor_t *c, cbor_item_t *item) {
+  assert(c != NULL);
+  assert(item != NULL);
+
+  uint8_t ib, ai;
+  uint64_t arg = 0;
+  size_t n;
+
+  if (c->p >= c->end)
+    return -1;
+
+  ib = *c->p++;
+  ai = ib & 0x1f;
+
+  if (ai < 24) {
+    arg = ai;
+  } else if (ai <= 27) {
+    n = (size_t)1 << (ai - 24);
+
+    if ((size_t)(c->end - c->p) < n)
+      return -1;
+
+    for (size_t i = 0; i < n; i++)
+      arg = arg << 8 | *c->p++;
+  } else {
+    // reserved, or indefinite length
+    return -1;
+  }
+
+  item->type = (cbor_type_t)(ib >> 5);
+  item->u = arg;
+  item->ptr = NULL;
+
+  switch (item->type) {
+  case CBOR_BSTR:
+  case CBOR_TSTR:
+    if ((uint64_t)(c->end - c->p) < arg)
+      return -1;
+
+    item->ptr = c->p;
+    c->p += arg;
+    break;
+  case CBOR_ARRAY:
+  case CBOR_MAP:
+    // every element takes at least one byte
+    if ((uint64_t)(c->end - c->p) < arg)
+      return -1;
+    break;
+  case CBOR_SIMPLE:
+    if (ai == 25) {
+      item->type = CBOR_FLOAT;
+      item->f = half_to_double((uint16_t)arg);
+    } else if (ai == 26) {
+      float f;
+      uint32_t u32 = (uint32_t)arg;
+
+      memcpy(&f, &u32, sizeof f);
+      item->type = CBOR_FLOAT;
+      item->f = f;
+    } else if (ai == 27) {
+      item->type = CBOR_FLOAT;
+      memcpy(&item->f, &arg, sizeof item->f);
+    }
+    break;
+  default:
+    break;
+  }
+
+  return 0;
+}
+
+int cbor_skip(cbor_t *c, unsigned depth) {
+  cbor_item_t item;
+  uint64_t n;
+
+  if (depth > CBOR_MAX_DEPTH || cbor_next(c, &item) == -1)
+    return -1;
+
+  switch (item.type) {
+  case CBOR_ARRAY:
+  case CBOR_MAP:
+    n = (item.type == CBOR_MAP) ? item.u * 2 : item.u;
+
+    for (uint64_t i = 0; i < n; i++)
+      if (cbor_skip(c, depth + 1) == -1)
+        return -1;
+
+    return 0;
+  case CBOR_TAG:
+    return cbor_skip(c, depth + 1);
+  default:
+    return 0;
+  }
+}
+
+int cbor_int(const cbor_item_t *item, int64_t *pv) {
+  assert(item != NULL);
+  assert(pv != NULL);
+
+  if ((item->type != CBOR_UINT && item->type != CBOR_NINT) ||
+      item->u > INT64_MAX)
+    return -1;
+
+  *pv = (item->type == CBOR_UINT) ? (int64_t)item->u : -1 - (int64_t)item->u;
+
+  return 0;
+}
+
+size_t cbor_head(uint8_t *out, cbor_type_t type, uint64_t arg) {
+  uint8_t mt = (uint8_t)(type << 5);
+  size_t n;
+
+  if (arg < 24) {
+    out[0] = mt | (uint8_t)arg;
+    return 1;
+  }
+
+  n = (arg <= 0xff) ? 1 : (arg <= 0xffff) ? 2 : (arg <= 0xffffffff) ? 4 : 8;
+  out[0] = mt | (uint8_t)(n == 1 ? 24 : n == 2 ? 25 : n == 4 ? 26 : 27);
+
+  for (size_t i = 0; i < n; i++)
+    out[n - i] = (uint8_t)(arg >> (8 * i));
+
+  return 1 + n;
+}
@@ -0,0 +1,413 @@
+// Copyright 2023 Contributors to the Veraison project.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ear.h"
+#include "ear_priv.h"
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* EAR in the CWT (RFC8392) serialization: a COSE_Sign1 (RFC9052) whose
+ * payload is a CBOR map with integer claim keys.
+ *
+ * The claims are translated into the same JSON object the JWT serialization
+ * decodes to, using the JSON claim names and value encodings (tiers as
+ * strings, byte strings as unpadded base64url), so that every accessor works
+ * the same whichever form the EAR came in. */
+
+#define COSE_TAG_SIGN1 18
+#define CWT_TAG 61
+
+#define COSE_HDR_ALG 1
+#define COSE_HDR_CRIT 2
+
+static const struct cose_alg_s {
+  int64_t id;
+  jwt_alg_t alg;
+} cose_algs[] = {
+    {5, JWT_ALG_HS256},    {6, JWT_ALG_HS384},    {7, JWT_ALG_HS512},
+    {-257, JWT_ALG_RS256}, {-258, JWT_ALG_RS384}, {-259, JWT_ALG_RS512},
+    {-7, JWT_ALG_ES256},   {-35, JWT_ALG_ES384},  {-36, JWT_ALG_ES512},
+    {-37, JWT_ALG_PS256},  {-38, JWT_ALG_PS384},  {-39, JWT_ALG_PS512},
+};
+
+/* Where a map sits in the claims-set, which decides how its integer keys
+ * are named */
+typedef enum {
+  CWT_ANY,
+  CWT_CLAIMS,
+  CWT_SUBMODS,
+  CWT_VERIFIER_ID,
+  CWT_TVECTOR,
+} cwt_ctx_t;
+
+static const struct cwt_key_s {
+  int64_t key;
+  const char *name;
+  cwt_ctx_t child;
+  int is_tier;
+} cwt_keys[] = {
+    {1, "iss", CWT_ANY, 0},
+    {2, "sub", CWT_ANY, 0},
+    {3, "aud", CWT_ANY, 0},
+    {4, "exp", CWT_ANY, 0},
+    {5, "nbf", CWT_ANY, 0},
+    {6, "iat", CWT_ANY, 0},
+    {7, "jti", CWT_ANY, 0},
+    {265, "eat_profile", CWT_ANY, 0},
+    {266, "submods", CWT_SUBMODS, 0},
+    {1000, "ear.status", CWT_ANY, 1},
+    {1001, "ear.trustworthiness-vector", CWT_TVECTOR, 0},
+    {1002, "ear.raw-evidence", CWT_ANY, 0},
+    {1003, "ear.appraisal-policy-id", CWT_ANY, 0},
+    {1004, "ear.verifier-id", CWT_VERIFIER_ID, 0},
+    {-70000, "ear.veraison.annotated-evidence", CWT_ANY, 0},
+    {-70001, "ear.veraison.policy-claims", CWT_ANY, 0},
+    {-70002, "ear.veraison.key-attestation", CWT_ANY, 0},
+};
+
+static const char *cwt_verifier_id[] = {"build", "developer"};
+
+static const struct cwt_tier_s {
+  int64_t v;
+  const char *s;
+} cwt_tiers[] = {
+    {0, "none"},
+    {2, "affirming"},
+    {32, "warning"},
+    {96, "contraindicated"},
+};
+
+static int cose_bstr(cbor_t *c, u_slice_t *s) {
+  cbor_item_t item;
+
+  if (cbor_next(c, &item) == -1 || item.type != CBOR_BSTR)
+    return -1;
+
+  s->ptr = item.ptr;
+  s->sz = (size_t)item.u;
+
+  return 0;
+}
+
+int cose_split(const uint8_t *buf, size_t sz, cose_t *cose) {
+  assert(buf != NULL);
+  assert(cose != NULL);
+
+  cbor_t c;
+  cbor_item_t item;
+
+  cbor_init(&c, buf, sz);
+
+  if (cbor_next(&c, &item) == -1)
+    return -1;
+
+  // COSE_Sign1_Tagged, possibly wrapped in a CWT tag
+  if (item.type == CBOR_TAG && item.u == CWT_TAG && cbor_next(&c, &item) == -1)
+    return -1;
+
+  if (item.type == CBOR_TAG && item.u == COSE_TAG_SIGN1 &&
+      cbor_next(&c, &item) == -1)
+    return -1;
+
+  if (item.type != CBOR_ARRAY || item.u != 4)
+    return -1;
+
+  if (cose_bstr(&c, &cose->prot) == -1)
+    return -1;
+
+  // unprotected header: nothing in there is trusted
+  if (cbor_next(&c, &item) == -1 || item.type != CBOR_MAP)
+    return -1;
+
+  for (uint64_t i = 0; i < item.u * 2; i++)
+    if (cbor_skip(&c, 1) == -1)
+      return -1;
+
+  if (cose_bstr(&c, &cose->pld) == -1 || cose_bstr(&c, &cose->sig) == -1)
+    return -1;
+
+  return c.p == c.end ? 0 : -1;
+}
+
+ear_err_t cose_check_header(const ear_verifier_t *verifier, const cose_t *cose,
+                            char err_msg[EAR_ERR_SZ]) {
+  cbor_t c;
+  cbor_item_t item;
+  int64_t key, id;
+  int found = 0;
+
+  cbor_init(&c, cose->prot.ptr, cose->prot.sz);
+
+  if (cbor_next(&c, &item) == -1 || item.type != CBOR_MAP)
+    goto malformed;
+
+  for (uint64_t i = 0, n = item.u; i < n; i++) {
+    if (cbor_next(&c, &item) == -1)
+      goto malformed;
+
+    if (cbor_int(&item, &key) == 0 && key == COSE_HDR_ALG) {
+      if (cbor_next(&c, &item) == -1 || cbor_int(&item, &id) == -1)
+        goto mismatch;
+
+      for (size_t j = 0; j < sizeof cose_algs / sizeof cose_algs[0]; j++)
+        if (cose_algs[j].id == id && cose_algs[j].alg == verifier->alg)
+          found = 1;
+
+      if (!found)
+        goto mismatch;
+
+      continue;
+    }
+
+    // we implement no header parameter that could be marked critical
+    if (cbor_int(&item, &key) == 0 && key == COSE_HDR_CRIT) {
+      (void)snprintf(err_msg, EAR_ERR_SZ,
+                     "unsupported critical EAR COSE header parameters");
+      return EAR_ERR_HEADER;
+    }
+
+    // other labels must be integers or text, and their values are ignored
+    if ((item.type != CBOR_UINT && item.type != CBOR_NINT &&
+         item.type != CBOR_TSTR) ||
+        cbor_skip(&c, 1) == -1)
+      goto malformed;
+  }
+
+  if (c.p != c.end)
+    goto malformed;
+
+  if (!found)
+    goto mismatch;
+
+  return EAR_OK;
+
+malformed:
+  (void)snprintf(err_msg, EAR_ERR_SZ, "malformed EAR COSE protected header");
+  return EAR_ERR_HEADER;
+
+mismatch:
+  (void)snprintf(err_msg, EAR_ERR_SZ,
+                 "EAR COSE algorithm does not match the expected \"%s\"",
+                 jwt_alg_str(verifier->alg));
+  return EAR_ERR_ALG_MISMATCH;
+}
+
+int cose_verify(const ear_verifier_t *verifier, const cose_t *cose) {
+  assert(verifier != NULL);
+  assert(cose != NULL);
+
+  // Sig_structure = ["Signature1", protected, external_aad, payload], fed
+  // to the digest piecewise so that the payload is not copied
+  uint8_t head1[1 + 11 + 9], head2[1 + 9];
+  size_t head1_sz = 0, head2_sz = 0;
+  u_slice_t msg[4];
+
+  head1[head1_sz++] = 0x84;
+  head1[head1_sz++] = 0x6a;
+  memcpy(head1 + head1_sz, "Signature1", 10), head1_sz += 10;
+  head1_sz += cbor_head(head1 + head1_sz, CBOR_BSTR, cose->prot.sz);
+
+  head2[head2_sz++] = 0x40;
+  head2_sz += cbor_head(head2 + head2_sz, CBOR_BSTR, cose->pld.sz);
+
+  msg[0] = (u_slice_t){head1, head1_sz};
+  msg[1] = cose->prot;
+  msg[2] = (u_slice_t){head2, head2_sz};
+  msg[3] = cose->pld;
+
+  return jws_verify_raw(verifier, msg, 4, cose->sig.ptr, cose->sig.sz);
+}
+
+static json_t *cwt_value(cbor_t *c, cwt_ctx_t ctx, int is_tier,
+                         unsigned depth);
+
+static json_t *cwt_tier(const cbor_item_t *item) {
+  int64_t v;
+
+  if (item->type == CBOR_TSTR)
+    return json_stringn((const char *)item->ptr, (size_t)item->u);
+
+  if (cbor_int(item, &v) == -1)
+    return NULL;
+
+  for (size_t i = 0; i < sizeof cwt_tiers / sizeof cwt_tiers[0]; i++)
+    if (cwt_tiers[i].v == v)
+      return json_string(cwt_tiers[i].s);
+
+  return NULL;
+}
+
+static json_t *cwt_bstr(const cbor_item_t *item) {
+  char buf[128], *s = buf;
+  size_t sz = U_B64URL_ENCODED_SZ((size_t)item->u);
+  json_t *j;
+
+  if (sz > sizeof buf && (s = malloc(sz)) == NULL)
+    return NULL;
+
+  sz = u_b64url_encode_n(item->ptr, (size_t)item->u, s);
+  j = json_stringn(s, sz);
+
+  if (s != buf)
+    free(s);
+
+  return j;
+}
+
+/* Work out the JSON name of a map key, and how to translate its value */
+static int cwt_key(const cbor_item_t *item, cwt_ctx_t ctx, char *name,
+                   size_t name_sz, cwt_ctx_t *pchild, int *pis_tier) {
+  int64_t k;
+
+  *pchild = (ctx == CWT_SUBMODS) ? CWT_CLAIMS : CWT_ANY;
+  *pis_tier = 0;
+
+  if (item->type == CBOR_TSTR) {
+    if (item->u >= name_sz || memchr(item->ptr, '\0', (size_t)item->u))
+      return -1;
+
+    memcpy(name, item->ptr, (size_t)item->u);
+    name[item->u] = '\0';
+
+    return 0;
+  }
+
+  if (cbor_int(item, &k) == -1 || ctx == CWT_SUBMODS)
+    return -1;
+
+  if (ctx == CWT_CLAIMS) {
+    for (size_t i = 0; i < sizeof cwt_keys / sizeof cwt_keys[0]; i++) {
+      if (cwt_keys[i].key == k) {
+        *pchild = cwt_keys[i].child;
+        *pis_tier = cwt_keys[i].is_tier;
+        (void)u_strlcpy(name, cwt_keys[i].name, name_sz);
+        return 0;
+      }
+    }
+  } else if (ctx == CWT_VERIFIER_ID && k >= 0 && k < 2) {
+    (void)u_strlcpy(name, cwt_verifier_id[k], name_sz);
+    return 0;
+  } else if (ctx == CWT_TVECTOR && k >= 0 && k < EAR_TV_CLAIMS) {
+    (void)u_strlcpy(name, tvec_names[k], name_sz);
+    return 0;
+  }
+
+  // a key we have no name for keeps its number
+  (void)snprintf(name, name_sz, "%" PRId64, k);
+
+  return 0;
+}
+
+static json_t *cwt_map(cbor_t *c, uint64_t n, cwt_ctx_t ctx, unsigned depth) {
+  json_t *obj = json_object(), *v;
+  cbor_item_t item;
+  cwt_ctx_t child;
+  int is_tier;
+  char name[256];
+
+  if (obj == NULL)
+    return NULL;
+
+  for (uint64_t i = 0; i < n; i++) {
+    if (cbor_next(c, &item) == -1 ||
+        cwt_key(&item, ctx, name, sizeof name, &child, &is_tier) == -1)
+      goto err;
+
+    // duplicate keys are not valid CBOR maps, and could hide a claim
+    if (json_object_get(obj, name) != NULL)
+      goto err;
+
+    if ((v = cwt_value(c, child, is_tier, depth + 1)) == NULL ||
+        json_object_set_new(obj, name, v) == -1)
+      goto err;
+  }
+
+  return obj;
+
+err:
+  json_decref(obj);
+
+  return NULL;
+}
+
+static json_t *cwt_value(cbor_t *c, cwt_ctx_t ctx, int is_tier,
+                         unsigned depth) {
+  cbor_item_t item;
+  json_t *arr, *v;
+  int64_t i64;
+
+  if (depth > CBOR_MAX_DEPTH || cbor_next(c, &item) == -1)
+    return NULL;
+
+  // tags (e.g. epoch times, URIs) only qualify their content
+  while (item.type == CBOR_TAG)
+    if (cbor_next(c, &item) == -1)
+      return NULL;
+
+  if (is_tier)
+    return cwt_tier(&item);
+
+  switch (item.type) {
+  case CBOR_UINT:
+  case CBOR_NINT:
+    return cbor_int(&item, &i64) == 0 ? json_integer((json_int_t)i64) : NULL;
+  case CBOR_BSTR:
+    return cwt_bstr(&item);
+  case CBOR_TSTR:
+    return json_stringn((const char *)item.ptr, (size_t)item.u);
+  case CBOR_ARRAY:
+    if ((arr = json_array()) == NULL)
+      return NULL;
+
+    for (uint64_t i = 0; i < item.u; i++) {
+      if ((v = cwt_value(c, CWT_ANY, 0, depth + 1)) == NULL ||
+          json_array_append_new(arr, v) == -1) {
+        json_decref(arr);
+        return NULL;
+      }
+    }
+
+    return arr;
+  case CBOR_MAP:
+    return cwt_map(c, item.u, ctx, depth);
+  case CBOR_FLOAT:
+    return json_real(item.f);
+  case CBOR_SIMPLE:
+    if (item.u == 20)
+      return json_false();
+    if (item.u == 21)
+      return json_true();
+    if (item.u == 22)
+      return json_null();
+    return NULL;
+  default:
+    return NULL;
+  }
+}
+
+ear_err_t cwt_claims(const cose_t *cose, json_t **pclaims,
+                     char err_msg[EAR_ERR_SZ]) {
+  cbor_t c;
+  cbor_item_t item;
+  json_t *claims = NULL;
+
+  cbor_init(&c, cose->pld.ptr, cose->pld.sz);
+
+  if (cbor_next(&c, &item) == -1 || item.type != CBOR_MAP ||
+      (claims = cwt_map(&c, item.u, CWT_CLAIMS, 0)) == NULL ||
+      c.p != c.end) {
+    if (claims != NULL)
+      json_decref(claims);
+
+    (void)snprintf(err_msg, EAR_ERR_SZ,
+                   "EAR claims-set does not contain a valid CBOR map");
+    return EAR_ERR_PAYLOAD;
+  }
+
+  *pclaims = claims;
+
+  return EAR_OK;
+}
@@ -3,31 +3,143 @@
 
 #include "ear.h"
 #include "ear_priv.h"
+#include "ear_probes.h"
 #include <assert.h>
 #include <jwt.h>
+#include <openssl/crypto.h>
+#include <openssl/x509.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #define EAR_PROFILE "tag:github.com,2023:veraison/ear"
 
-static json_t *cache_submods(ear_t *ear, char err_msg[EAR_ERR_SZ]);
-static int tier_from_string(const char *tier, ear_tier_t *ptier);
-static ear_t *ear_new() { return (ear_t *)calloc(1, sizeof(ear_t)); }
-static int validate_profile(ear_t *ear, char err_msg[EAR_ERR_SZ]);
+static ear_err_t verifier_new(const uint8_t *pkey, size_t pkey_sz,
+                              const char *alg, ear_verifier_t **pverifier,
+                              char err_msg[EAR_ERR_SZ]);
+static ear_err_t tls_verifier(const uint8_t *pkey, size_t pkey_sz,
+                              const char *alg, ear_verifier_t **pverifier,
+                              char err_msg[EAR_ERR_SZ]);
+static ear_err_t finish_claims(const ear_verifier_t *verifier, ear_t *ear,
+                               const claims_t *claims, const json_t *header,
+                               time_t now, size_t token_sz, uint8_t *room,
+                               size_t room_sz, char err_msg[EAR_ERR_SZ]);
+static ear_err_t check_claims(const ear_verifier_t *verifier,
+                              const claims_t *claims, const json_t *header,
+                              time_t now, size_t token_sz,
+                              char err_msg[EAR_ERR_SZ]);
+static ear_err_t check_gate(const claims_t *claims, const char *app_rec,
+                            ear_tier_t min_tier, char err_msg[EAR_ERR_SZ]);
+static ear_err_t decode_header(const ear_verifier_t *verifier,
+                               const jws_t *jws, json_t **pheader,
+                               char err_msg[EAR_ERR_SZ]);
+static ear_err_t parse_header(const jws_t *jws, json_t **pheader,
+                              char err_msg[EAR_ERR_SZ]);
+static ear_err_t check_alg(const ear_verifier_t *verifier,
+                           const json_t *header, char err_msg[EAR_ERR_SZ]);
+static ear_err_t decode_claims(const jws_t *jws, const ear_limits_t *limits,
+                               json_t **pjson, claims_t *claims,
+                               char err_msg[EAR_ERR_SZ]);
+static ear_err_t decode_claims_inplace(const jws_t *jws,
+                                       const ear_limits_t *limits, char *buf,
+                                       size_t buf_sz, json_t **pjson,
+                                       claims_t *claims, uint8_t **proom,
+                                       size_t *proom_sz,
+                                       char err_msg[EAR_ERR_SZ]);
+static ear_err_t parse_claims(const uint8_t *payload, size_t payload_sz,
+                              const ear_limits_t *limits, json_t **pjson,
+                              claims_t *claims, char err_msg[EAR_ERR_SZ]);
+static ear_err_t check_token_sz(const ear_limits_t *limits, const char *token,
+                                size_t *ptoken_sz, char err_msg[EAR_ERR_SZ]);
+static ear_err_t check_limits(const ear_limits_t *limits, const json_t *json,
+                              char err_msg[EAR_ERR_SZ]);
+static ear_err_t limit_error(ear_err_t code, const ear_limits_t *limits,
+                             char err_msg[EAR_ERR_SZ]);
+static ear_err_t claims_from_json(const json_t *json, claims_t *claims,
+                                  char err_msg[EAR_ERR_SZ]);
+static ear_err_t validate_claims(const claims_t *claims, const json_t *header,
+                                 time_t now, char err_msg[EAR_ERR_SZ]);
+static ear_t *ear_new(void);
+static void ear_clear(ear_t *ear);
+static int jwt_verify(const ear_verifier_t *verifier, const char *ear_jwt,
+                      char *buf, size_t buf_sz, ear_t *ear,
+                      char err_msg[EAR_ERR_SZ]);
+static int cwt_verify(const ear_verifier_t *verifier, const uint8_t *ear_cwt,
+                      size_t ear_cwt_sz, ear_t *ear, char err_msg[EAR_ERR_SZ]);
+static ear_err_t validate_profile(const claims_t *claims,
+                                  char err_msg[EAR_ERR_SZ]);
+static ear_err_t check_replay(const ear_verifier_t *verifier, const char *jti,
+                              size_t jti_sz, int64_t exp, time_t now,
+                              size_t token_sz, char err_msg[EAR_ERR_SZ]);
+static ear_err_t cache_lookup(const ear_verifier_t *verifier,
+                              ear_cache_t *cache, const void *token,
+                              size_t token_sz, time_t now, uint8_t *digest,
+                              ear_t *ear, char err_msg[EAR_ERR_SZ]);
+static ear_err_t find_akpub(const ear_t *ear, const char *app_rec,
+                            const snap_rec_t **prec, char err_msg[EAR_ERR_SZ]);
+static EVP_PKEY *akpub_pkey(const ear_t *ear, const snap_rec_t *rec);
+static ear_err_t pop_key(const ear_t *ear, const char *app_rec,
+                         const char *alg, jwt_alg_t *palg, EVP_PKEY **ppkey,
+                         char err_msg[EAR_ERR_SZ]);
+static void cache_store(ear_cache_t *cache, const uint8_t *digest,
+                        const ear_t *ear, time_t now);
+static const snap_rec_t *rec_by_id(const ear_t *ear, ear_app_rec_id_t id);
+
+static ear_t *ear_new(void) {
+  ear_t *ear = jws_tls_ear_pop();
+
+  if (ear == NULL && (ear = calloc(1, sizeof(ear_t))) == NULL)
+    return NULL;
+
+  atomic_init(&ear->refs, 1);
+
+  return ear;
+}
+
+/* Empty ear, keeping its buffer for the next summary */
+static void ear_clear(ear_t *ear) {
+  if (ear->akpub_pkeys != NULL) {
+    for (uint32_t i = 0; i < SNAP_HDR(ear)->nrecs; i++)
+      EVP_PKEY_free(ear->akpub_pkeys[i]);
+
+    free((void *)ear->akpub_pkeys);
+    ear->akpub_pkeys = NULL;
+  }
+
+  free(ear->rec_ids);
+  ear->rec_ids = NULL;
+
+  ear->snap = NULL;
+  ear->snap_sz = 0;
+}
+
+ear_t *ear_ref(ear_t *ear) {
+  assert(ear != NULL);
+
+  atomic_fetch_add_explicit(&ear->refs, 1, memory_order_relaxed);
+
+  return ear;
+}
 
-void ear_free(ear_t *ear) {
+void ear_unref(ear_t *ear) {
   if (ear == NULL)
     return;
 
-  if (ear->jwt != NULL)
-    jwt_free(ear->jwt);
+  // the last one out sees every other holder's accesses
+  if (atomic_fetch_sub_explicit(&ear->refs, 1, memory_order_acq_rel) != 1)
+    return;
 
-  if (ear->submods)
-    json_decref(ear->submods);
+  ear_clear(ear);
 
-  free(ear);
+  if (jws_tls_ear_push(ear) == -1) {
+    free(ear->buf);
+    free(ear);
+  }
 }
 
+void ear_free(ear_t *ear) { ear_unref(ear); }
+
 int ear_jwt_verify(const char *ear_jwt, const uint8_t *pkey, size_t pkey_sz,
                    const char *alg, ear_t **pear, char err_msg[EAR_ERR_SZ]) {
   assert(ear_jwt != NULL);
@@ -36,263 +148,2498 @@ int ear_jwt_verify(const char *ear_jwt, const uint8_t *pkey, size_t pkey_sz,
   assert(alg != NULL);
   assert(pear != NULL);
 
-  int ret = 0;
-  jwt_valid_t *jwt_valid = NULL;
-  ear_t *ear = NULL;
-  jwt_alg_t opt_alg;
+  ear_verifier_t *verifier = NULL;
+
+  if (tls_verifier(pkey, pkey_sz, alg, &verifier, err_msg) != EAR_OK)
+    return -1;
+
+  return ear_verifier_jwt_verify(verifier, ear_jwt, pear, err_msg);
+}
+
+int ear_cwt_verify(const uint8_t *ear_cwt, size_t ear_cwt_sz,
+                   const uint8_t *pkey, size_t pkey_sz, const char *alg,
+                   ear_t **pear, char err_msg[EAR_ERR_SZ]) {
+  assert(ear_cwt != NULL);
+  assert(pkey != NULL);
+  assert(pkey_sz > 0);
+  assert(alg != NULL);
+  assert(pear != NULL);
+
+  ear_verifier_t *verifier = NULL;
+
+  if (tls_verifier(pkey, pkey_sz, alg, &verifier, err_msg) != EAR_OK)
+    return -1;
+
+  return ear_verifier_cwt_verify(verifier, ear_cwt, ear_cwt_sz, pear, err_msg);
+}
+
+int ear_verifier_new(const uint8_t *pkey, size_t pkey_sz, const char *alg,
+                     ear_verifier_t **pverifier, char err_msg[EAR_ERR_SZ]) {
+  assert(pkey != NULL);
+  assert(pkey_sz > 0);
+  assert(alg != NULL);
+  assert(pverifier != NULL);
+
+  ear_err_t code;
   char e[EAR_ERR_SZ] = {'\0'};
 
-  opt_alg = jwt_str_alg(alg);
-  if (opt_alg == JWT_ALG_INVAL) {
-    (void)snprintf(e, sizeof e, "unknown JWT algorithm \"%s\"", alg);
-    goto err;
+  if ((code = verifier_new(pkey, pkey_sz, alg, pverifier, e)) != EAR_OK) {
+    EAR_PROBE2(key__error, code, alg);
+
+    if (err_msg != NULL)
+      (void)u_strlcpy(err_msg, e, EAR_ERR_SZ);
+
+    return -1;
   }
 
-  ret = jwt_valid_new(&jwt_valid, opt_alg);
-  if (ret != 0 || jwt_valid == NULL) {
-    (void)snprintf(e, sizeof e,
-                   "cannot initialise JWT validation object (jwt_valid_new=%d)",
-                   ret);
-    goto err;
+  return 0;
+}
+
+void ear_verifier_free(ear_verifier_t *verifier) {
+  if (verifier == NULL)
+    return;
+
+  if (verifier->pkey != NULL)
+    EVP_PKEY_free(verifier->pkey);
+
+  if (verifier->key != NULL) {
+    OPENSSL_cleanse(verifier->key, verifier->key_sz);
+    free(verifier->key);
   }
 
-  jwt_valid_set_headers(jwt_valid, 1);
-  jwt_valid_set_now(jwt_valid, time(NULL));
+  free(verifier);
+}
+
+void ear_verifier_set_limits(ear_verifier_t *verifier,
+                             const ear_limits_t *limits) {
+  assert(verifier != NULL);
+
+  verifier->limits = limits != NULL ? *limits : (ear_limits_t){0};
+}
+
+int ear_verifier_jwt_verify(const ear_verifier_t *verifier, const char *ear_jwt,
+                            ear_t **pear, char err_msg[EAR_ERR_SZ]) {
+  assert(verifier != NULL);
+  assert(ear_jwt != NULL);
+  assert(pear != NULL);
+
+  ear_t *ear = NULL;
 
   if ((ear = ear_new()) == NULL) {
-    (void)snprintf(e, sizeof e, "cannot initialise the EAR object");
-    goto err;
+    if (err_msg != NULL)
+      (void)snprintf(err_msg, EAR_ERR_SZ, "cannot initialise the EAR object");
+    return -1;
   }
 
-  ret = jwt_decode(&ear->jwt, ear_jwt, pkey, pkey_sz);
-  if (ret != 0 || ear->jwt == NULL) {
-    (void)snprintf(e, sizeof e, "cannot verify EAR JWT (jwt_decode=%d)", ret);
-    goto err;
+  if (jwt_verify(verifier, ear_jwt, NULL, 0, ear, err_msg) == -1) {
+    ear_free(ear);
+    return -1;
   }
 
-  ret = jwt_validate(ear->jwt, jwt_valid);
-  if (ret != 0) {
-    (void)snprintf(e, sizeof e, "cannot validate EAR JWT (jwt_validate=%d)",
-                   ret);
-    goto err;
-  }
+  *pear = ear;
+
+  return 0;
+}
 
-  jwt_valid_free(jwt_valid), jwt_valid = NULL;
+int ear_verifier_jwt_verify_inplace(const ear_verifier_t *verifier, char *buf,
+                                    size_t buf_sz, ear_t **pear,
+                                    char err_msg[EAR_ERR_SZ]) {
+  assert(verifier != NULL);
+  assert(buf != NULL);
+  assert(pear != NULL);
 
-  if (validate_profile(ear, err_msg) == -1) {
-    goto err;
+  ear_t *ear = NULL;
+
+  if (memchr(buf, '\0', buf_sz) == NULL) {
+    if (err_msg != NULL)
+      (void)snprintf(err_msg, EAR_ERR_SZ, "malformed EAR JWT");
+    return -1;
   }
 
-  if ((ear->submods = cache_submods(ear, err_msg)) == NULL) {
-    goto err;
+  if ((ear = ear_new()) == NULL) {
+    if (err_msg != NULL)
+      (void)snprintf(err_msg, EAR_ERR_SZ, "cannot initialise the EAR object");
+    return -1;
+  }
+
+  if (jwt_verify(verifier, buf, buf, buf_sz, ear, err_msg) == -1) {
+    ear_free(ear);
+    return -1;
   }
 
   *pear = ear;
 
   return 0;
+}
 
-err:
-  if (ear != NULL)
-    ear_free(ear);
-
-  if (jwt_valid != NULL)
-    jwt_valid_free(jwt_valid);
+int ear_verifier_jwt_reverify(const ear_verifier_t *verifier,
+                              const char *ear_jwt, ear_t *ear,
+                              char err_msg[EAR_ERR_SZ]) {
+  assert(verifier != NULL);
+  assert(ear_jwt != NULL);
+  assert(ear != NULL);
+  assert(atomic_load(&ear->refs) == 1);
 
-  if (err_msg != NULL)
-    (void)u_strlcpy(err_msg, e, EAR_ERR_SZ);
+  ear_clear(ear);
 
-  return -1;
+  return jwt_verify(verifier, ear_jwt, NULL, 0, ear, err_msg);
 }
 
-int ear_get_app_recs(ear_t *ear, const char ***papp_rec, size_t *papp_rec_sz) {
-  assert(ear != NULL);
-  assert(ear->jwt != NULL);
-  assert(ear->submods != NULL);
-  assert(papp_rec != NULL);
-  assert(papp_rec_sz != NULL);
+ear_err_t ear_verifier_jwt_gate(const ear_verifier_t *verifier,
+                                const char *ear_jwt, const char *app_rec,
+                                ear_tier_t min_tier) {
+  assert(verifier != NULL);
+  assert(ear_jwt != NULL);
 
-  const char *key;
-  json_t *value;
-  size_t app_rec_count = 0, i = 0;
-  const char **keylist = NULL;
+  json_t *header = NULL, *json = NULL;
+  claims_t claims;
+  jws_t jws = {0};
+  ear_err_t code = EAR_OK;
+  const char *alg = jwt_alg_str(verifier->alg);
+  size_t token_sz = 0;
+  time_t now = time(NULL);
+  char e[EAR_ERR_SZ];
+
+  EAR_PROBE2(verify__entry, ear_jwt, alg);
+
+  if ((code = check_token_sz(&verifier->limits, ear_jwt, &token_sz, e)) !=
+      EAR_OK)
+    goto done;
 
-  // Preliminary loop to count the number of records
-  json_object_foreach(ear->submods, key, value) {
-    app_rec_count++;
+  if (jws_split(ear_jwt, &jws) == -1) {
+    code = EAR_ERR_MALFORMED;
+    goto done;
   }
 
-  // Allocate suitable buffer space
-  keylist = calloc(app_rec_count, sizeof(char*));
+  token_sz = jws.hdr_sz + jws.pld_sz + jws.sig_sz + 2;
+
+  EAR_PROBE3(verify__stage, "header", token_sz, alg);
+
+  if ((code = decode_header(verifier, &jws, &header, e)) != EAR_OK)
+    goto done;
 
-  // Second pass to populate the list with the keys, which are interior pointers
-  json_object_foreach(ear->submods, key, value) {
-    keylist[i++] = key;
+  EAR_PROBE3(verify__stage, "signature", token_sz, alg);
+
+  if (jws_verify(verifier, &jws) == -1) {
+    code = EAR_ERR_SIGNATURE;
+    goto done;
   }
 
-  *papp_rec_sz = app_rec_count;
-  *papp_rec = keylist;
-  return 0;
-}
+  EAR_PROBE3(verify__stage, "claims", token_sz, alg);
 
-int ear_get_status(ear_t *ear, const char *app_rec, ear_tier_t *ptier,
-                   char err_msg[EAR_ERR_SZ]) {
-  assert(ear != NULL);
-  assert(ear->jwt != NULL);
-  assert(ear->submods != NULL);
-  assert(app_rec != NULL);
-  assert(ptier != NULL);
+  if ((code = decode_claims(&jws, &verifier->limits, &json, &claims, e)) !=
+      EAR_OK)
+    goto done;
+
+  if ((code = check_claims(verifier, &claims, header, now, token_sz, e)) !=
+      EAR_OK)
+    goto done;
+
+  EAR_PROBE3(verify__stage, "gate", token_sz, alg);
+
+  if ((code = check_gate(&claims, app_rec, min_tier, e)) != EAR_OK)
+    goto done;
+
+  code = check_replay(verifier, claims.jti.ptr, claims.jti.len,
+                      (claims.flags & CLAIMS_EXP) ? claims.exp : 0, now,
+                      token_sz, e);
+
+done:
+  if (code != EAR_OK) {
+    EAR_PROBE3(verify__error, code, token_sz, alg);
+  }
+
+  EAR_PROBE3(verify__return, code, token_sz, alg);
 
+  if (json != NULL)
+    json_decref(json);
+
+  if (header != NULL)
+    json_decref(header);
+
+  return code;
+}
+
+/* Verify ear_jwt into ear, which is empty, and left empty on failure.  With
+ * buf not NULL, ear_jwt is the start of buf, which is worked in */
+static int jwt_verify(const ear_verifier_t *verifier, const char *ear_jwt,
+                      char *buf, size_t buf_sz, ear_t *ear,
+                      char err_msg[EAR_ERR_SZ]) {
+  ear_cache_t *cache = NULL;
+  json_t *header = NULL, *json = NULL;
+  claims_t claims;
+  jws_t jws = {0};
+  ear_err_t code = EAR_OK;
+  const char *alg = jwt_alg_str(verifier->alg);
+  uint8_t *room = NULL;
+  size_t token_sz = 0, room_sz = 0;
+  time_t now = time(NULL);
+  uint8_t digest[CACHE_DIGEST_SZ];
   char e[EAR_ERR_SZ] = {'\0'};
-  json_t *submod = NULL, *status = NULL;
 
-  if ((submod = json_object_get(ear->submods, app_rec)) == NULL) {
-    (void)snprintf(e, sizeof e, "no appraisal record found for \"%s\"",
-                   app_rec);
+  EAR_PROBE2(verify__entry, ear_jwt, alg);
+
+  if ((code = check_token_sz(&verifier->limits, ear_jwt, &token_sz, e)) !=
+      EAR_OK)
+    goto err;
+
+  if ((cache = verifier->cache) != NULL || (cache = cache_default()) != NULL) {
+    if (token_sz == 0)
+      token_sz = strlen(ear_jwt);
+
+    EAR_PROBE3(verify__stage, "cache", token_sz, alg);
+
+    code = cache_lookup(verifier, cache, ear_jwt, token_sz, now, digest, ear,
+                        e);
+
+    if (code == EAR_OK)
+      goto done;
+
+    if (code != EAR_ERR_CACHE_MISS)
+      goto err;
+  }
+
+  if (jws_split(ear_jwt, &jws) == -1) {
+    (void)snprintf(e, sizeof e, "malformed EAR JWT");
+    code = EAR_ERR_MALFORMED;
     goto err;
   }
 
-  status = json_object_get(submod, "ear.status");
-  if (!json_is_string(status)) {
-    (void)snprintf(e, sizeof e, "\"ear.status\" not found");
+  token_sz = jws.hdr_sz + jws.pld_sz + jws.sig_sz + 2;
+
+  EAR_PROBE3(verify__stage, "header", token_sz, alg);
+
+  if ((code = decode_header(verifier, &jws, &header, e)) != EAR_OK) {
+    goto err;
+  }
+
+  EAR_PROBE3(verify__stage, "signature", token_sz, alg);
+
+  if (jws_verify(verifier, &jws) == -1) {
+    (void)snprintf(e, sizeof e, "cannot verify EAR JWT signature");
+    code = EAR_ERR_SIGNATURE;
     goto err;
   }
 
-  const char *status_s = json_string_value(status);
+  EAR_PROBE3(verify__stage, "claims", token_sz, alg);
+
+  if (buf != NULL)
+    code = decode_claims_inplace(&jws, &verifier->limits, buf, buf_sz, &json,
+                                 &claims, &room, &room_sz, e);
+  else
+    code = decode_claims(&jws, &verifier->limits, &json, &claims, e);
+
+  if (code != EAR_OK) {
+    goto err;
+  }
 
-  if (tier_from_string(status_s, ptier) == -1) {
-    (void)snprintf(e, sizeof e, "unknown status \"%s\"", status_s);
+  if ((code = finish_claims(verifier, ear, &claims, header, now, token_sz,
+                            room, room_sz, e)) != EAR_OK) {
     goto err;
   }
 
+  if (json != NULL)
+    json_decref(json);
+
+  json_decref(header);
+
+  if (cache != NULL)
+    cache_store(cache, digest, ear, now);
+
+done:
+  EAR_PROBE3(verify__return, EAR_OK, token_sz, alg);
+
   return 0;
 
 err:
+  EAR_PROBE3(verify__error, code, token_sz, alg);
+  EAR_PROBE3(verify__return, code, token_sz, alg);
+
+  ear_clear(ear);
+
+  if (json != NULL)
+    json_decref(json);
+
+  if (header != NULL)
+    json_decref(header);
+
   if (err_msg != NULL)
     (void)u_strlcpy(err_msg, e, EAR_ERR_SZ);
 
   return -1;
 }
 
-int ear_veraison_get_akpub(ear_t *ear, const char *app_rec, uint8_t **pakpub,
-                           size_t *pakpub_sz, char err_msg[EAR_ERR_SZ]) {
+int ear_verifier_cwt_verify(const ear_verifier_t *verifier,
+                            const uint8_t *ear_cwt, size_t ear_cwt_sz,
+                            ear_t **pear, char err_msg[EAR_ERR_SZ]) {
+  assert(verifier != NULL);
+  assert(ear_cwt != NULL);
+  assert(pear != NULL);
+
+  ear_t *ear = NULL;
+
+  if ((ear = ear_new()) == NULL) {
+    if (err_msg != NULL)
+      (void)snprintf(err_msg, EAR_ERR_SZ, "cannot initialise the EAR object");
+    return -1;
+  }
+
+  if (cwt_verify(verifier, ear_cwt, ear_cwt_sz, ear, err_msg) == -1) {
+    ear_free(ear);
+    return -1;
+  }
+
+  *pear = ear;
+
+  return 0;
+}
+
+int ear_verifier_cwt_reverify(const ear_verifier_t *verifier,
+                              const uint8_t *ear_cwt, size_t ear_cwt_sz,
+                              ear_t *ear, char err_msg[EAR_ERR_SZ]) {
+  assert(verifier != NULL);
+  assert(ear_cwt != NULL);
   assert(ear != NULL);
-  assert(ear->jwt != NULL);
-  assert(app_rec != NULL);
-  assert(pakpub != NULL);
-  assert(pakpub_sz != NULL);
+  assert(atomic_load(&ear->refs) == 1);
 
+  ear_clear(ear);
+
+  return cwt_verify(verifier, ear_cwt, ear_cwt_sz, ear, err_msg);
+}
+
+/* Verify ear_cwt into ear, which is empty, and left empty on failure */
+static int cwt_verify(const ear_verifier_t *verifier, const uint8_t *ear_cwt,
+                      size_t ear_cwt_sz, ear_t *ear,
+                      char err_msg[EAR_ERR_SZ]) {
+  ear_cache_t *cache = NULL;
+  json_t *json = NULL;
+  claims_t claims;
+  cose_t cose = {0};
+  ear_err_t code = EAR_OK;
+  const char *alg = jwt_alg_str(verifier->alg);
+  time_t now = time(NULL);
+  uint8_t digest[CACHE_DIGEST_SZ];
   char e[EAR_ERR_SZ] = {'\0'};
-  json_t *submod = NULL, *key_attestation = NULL, *akpub = NULL;
 
-  if ((submod = json_object_get(ear->submods, app_rec)) == NULL) {
-    (void)snprintf(e, sizeof e, "no appraisal record found for \"%s\"",
-                   app_rec);
+  EAR_PROBE2(verify__entry, "(cwt)", alg);
+
+  if (verifier->limits.max_token_sz != 0 &&
+      ear_cwt_sz > verifier->limits.max_token_sz) {
+    code = limit_error(EAR_ERR_LIMIT_TOKEN, &verifier->limits, e);
+    goto err;
+  }
+
+  if ((cache = verifier->cache) != NULL || (cache = cache_default()) != NULL) {
+    EAR_PROBE3(verify__stage, "cache", ear_cwt_sz, alg);
+
+    code = cache_lookup(verifier, cache, ear_cwt, ear_cwt_sz, now, digest,
+                        ear, e);
+
+    if (code == EAR_OK)
+      goto done;
+
+    if (code != EAR_ERR_CACHE_MISS)
+      goto err;
+  }
+
+  if (cose_split(ear_cwt, ear_cwt_sz, &cose) == -1) {
+    (void)snprintf(e, sizeof e, "malformed EAR CWT");
+    code = EAR_ERR_MALFORMED;
     goto err;
   }
 
-  key_attestation = json_object_get(submod, "ear.veraison.key-attestation");
-  if (key_attestation == NULL) {
-    (void)snprintf(e, sizeof e, "\"ear.veraison.key-attestation\" not found");
+  EAR_PROBE3(verify__stage, "header", ear_cwt_sz, alg);
+
+  if ((code = cose_check_header(verifier, &cose, e)) != EAR_OK) {
     goto err;
   }
 
-  akpub = json_object_get(key_attestation, "akpub");
-  if (!json_is_string(akpub)) {
-    (void)snprintf(e, sizeof e, "\"akpub\" not found");
+  EAR_PROBE3(verify__stage, "signature", ear_cwt_sz, alg);
+
+  if (cose_verify(verifier, &cose) == -1) {
+    (void)snprintf(e, sizeof e, "cannot verify EAR CWT signature");
+    code = EAR_ERR_SIGNATURE;
     goto err;
   }
 
-  const char *akpub_s = json_string_value(akpub);
+  EAR_PROBE3(verify__stage, "claims", ear_cwt_sz, alg);
 
-  if (u_b64url_decode(akpub_s, pakpub, pakpub_sz) == -1) {
-    (void)snprintf(e, sizeof e, "base64 decoding of \"akpub\" failed");
+  if ((code = cwt_claims(&cose, &json, e)) != EAR_OK ||
+      (code = check_limits(&verifier->limits, json, e)) != EAR_OK ||
+      (code = claims_from_json(json, &claims, e)) != EAR_OK) {
     goto err;
   }
 
+  // the COSE header has no counterpart to the JWT replicated claims
+  if ((code = finish_claims(verifier, ear, &claims, NULL, now, ear_cwt_sz,
+                            NULL, 0, e)) != EAR_OK) {
+    goto err;
+  }
+
+  json_decref(json);
+
+  if (cache != NULL)
+    cache_store(cache, digest, ear, now);
+
+done:
+  EAR_PROBE3(verify__return, EAR_OK, ear_cwt_sz, alg);
+
   return 0;
 
 err:
+  EAR_PROBE3(verify__error, code, ear_cwt_sz, alg);
+  EAR_PROBE3(verify__return, code, ear_cwt_sz, alg);
+
+  ear_clear(ear);
+
+  if (json != NULL)
+    json_decref(json);
+
   if (err_msg != NULL)
     (void)u_strlcpy(err_msg, e, EAR_ERR_SZ);
 
   return -1;
 }
 
-static json_t *cache_submods(ear_t *ear, char err_msg[EAR_ERR_SZ]) {
-  assert(ear != NULL);
-  assert(ear->jwt != NULL);
+int ear_jwt_parse(const char *ear_jwt, ear_jwt_parsed_t **pparsed,
+                  char err_msg[EAR_ERR_SZ]) {
+  assert(ear_jwt != NULL);
+  assert(pparsed != NULL);
 
+  ear_jwt_parsed_t *parsed = NULL;
+  size_t token_sz = strlen(ear_jwt);
+  ear_err_t code = EAR_OK;
   char e[EAR_ERR_SZ] = {'\0'};
-  char *submods_js = NULL;
-  json_t *submods = NULL;
 
-  if ((submods_js = jwt_get_grants_json(ear->jwt, "submods")) == NULL) {
-    (void)snprintf(e, sizeof e, "\"submods\" not found");
+  if ((parsed = calloc(1, sizeof *parsed + token_sz + 1)) == NULL) {
+    (void)snprintf(e, sizeof e, "cannot initialise the parsed EAR JWT");
+    code = EAR_ERR_ALLOC;
     goto err;
   }
 
-  if ((submods = json_loads(submods_js, 0, NULL)) == NULL) {
-    (void)snprintf(e, sizeof e, "\"submods\" does not contain valid JSON");
+  memcpy(parsed->token, ear_jwt, token_sz + 1);
+
+  // the segments point into the handle's own copy of the token
+  if (jws_split(parsed->token, &parsed->jws) == -1) {
+    (void)snprintf(e, sizeof e, "malformed EAR JWT");
+    code = EAR_ERR_MALFORMED;
     goto err;
   }
 
-  free(submods_js), submods_js = NULL;
+  if ((code = parse_header(&parsed->jws, &parsed->header, e)) != EAR_OK)
+    goto err;
+
+  if ((code = decode_claims(&parsed->jws, NULL, &parsed->claims, NULL, e)) !=
+      EAR_OK)
+    goto err;
+
+  *pparsed = parsed;
 
-  return submods;
+  return 0;
 
 err:
-  if (submods_js != NULL)
-    free(submods_js);
+  EAR_PROBE3(verify__error, code, token_sz, "(parse)");
 
-  if (submods)
-    json_decref(submods);
+  ear_jwt_parsed_free(parsed);
 
   if (err_msg != NULL)
     (void)u_strlcpy(err_msg, e, EAR_ERR_SZ);
 
-  return NULL;
+  return -1;
 }
 
-static int tier_from_string(const char *tier, ear_tier_t *ptier) {
-  struct tiers_map {
-    const char *s;
-    ear_tier_t e;
-  } tiers[] = {
-      {"affirming", EAR_TIER_AFFIRMING},
-      {"contraindicated", EAR_TIER_CONTRAINDICATED},
-      {"warning", EAR_TIER_WARNING},
-      {"none", EAR_TIER_NONE},
-  };
-
-  for (unsigned i = 0; i < sizeof tiers / sizeof(struct tiers_map); i++) {
-    if (!strcmp(tier, tiers[i].s)) {
-      *ptier = tiers[i].e;
-      return 0;
-    }
-  }
+static const char *get_string(const json_t *object, const char *name) {
+  return json_string_value(json_object_get(object, name));
+}
 
-  return -1;
+int ear_jwt_parsed_get_info(const ear_jwt_parsed_t *parsed, const char **palg,
+                            const char **pkid, const char **piss,
+                            const char **pprofile) {
+  assert(parsed != NULL);
+
+  if (palg != NULL)
+    *palg = get_string(parsed->header, "alg");
+
+  if (pkid != NULL)
+    *pkid = get_string(parsed->header, "kid");
+
+  if (piss != NULL)
+    *piss = get_string(parsed->claims, "iss");
+
+  if (pprofile != NULL)
+    *pprofile = get_string(parsed->claims, "eat_profile");
+
+  return 0;
 }
 
-static int validate_profile(ear_t *ear, char err_msg[EAR_ERR_SZ]) {
+int ear_jwt_verify_parsed(const ear_verifier_t *verifier,
+                          const ear_jwt_parsed_t *parsed, ear_t **pear,
+                          char err_msg[EAR_ERR_SZ]) {
+  assert(verifier != NULL);
+  assert(parsed != NULL);
+  assert(pear != NULL);
+
+  ear_t *ear = NULL;
+  claims_t claims;
+  const jws_t *jws = &parsed->jws;
+  ear_err_t code = EAR_OK;
+  const char *alg = jwt_alg_str(verifier->alg);
+  size_t token_sz = jws->hdr_sz + jws->pld_sz + jws->sig_sz + 2;
+  time_t now = time(NULL);
   char e[EAR_ERR_SZ] = {'\0'};
 
-  const char *eat_profile = jwt_get_grant(ear->jwt, "eat_profile");
+  EAR_PROBE2(verify__entry, parsed->token, alg);
+
+  if (verifier->limits.max_token_sz != 0 &&
+      token_sz > verifier->limits.max_token_sz) {
+    code = limit_error(EAR_ERR_LIMIT_TOKEN, &verifier->limits, e);
+    goto err;
+  }
 
-  if (eat_profile == NULL) {
-    (void)snprintf(e, sizeof e, "missing mandatory eat_profile");
+  if ((ear = ear_new()) == NULL) {
+    (void)snprintf(e, sizeof e, "cannot initialise the EAR object");
+    code = EAR_ERR_ALLOC;
     goto err;
   }
 
-  if (strcmp(eat_profile, EAR_PROFILE)) {
-    (void)snprintf(e, sizeof e, "unknown eat_profile \"%s\"", eat_profile);
+  EAR_PROBE3(verify__stage, "header", token_sz, alg);
+
+  if ((code = check_alg(verifier, parsed->header, e)) != EAR_OK)
+    goto err;
+
+  EAR_PROBE3(verify__stage, "signature", token_sz, alg);
+
+  if (jws_verify(verifier, jws) == -1) {
+    (void)snprintf(e, sizeof e, "cannot verify EAR JWT signature");
+    code = EAR_ERR_SIGNATURE;
     goto err;
   }
 
+  if ((code = check_limits(&verifier->limits, parsed->claims, e)) != EAR_OK ||
+      (code = claims_from_json(parsed->claims, &claims, e)) != EAR_OK ||
+      (code = finish_claims(verifier, ear, &claims, parsed->header, now,
+                            token_sz, NULL, 0, e)) != EAR_OK)
+    goto err;
+
+  EAR_PROBE3(verify__return, EAR_OK, token_sz, alg);
+
+  *pear = ear;
+
   return 0;
+
 err:
+  EAR_PROBE3(verify__error, code, token_sz, alg);
+  EAR_PROBE3(verify__return, code, token_sz, alg);
+
+  ear_free(ear);
+
   if (err_msg != NULL)
     (void)u_strlcpy(err_msg, e, EAR_ERR_SZ);
 
   return -1;
 }
+
+void ear_jwt_parsed_free(ear_jwt_parsed_t *parsed) {
+  if (parsed == NULL)
+    return;
+
+  if (parsed->claims != NULL)
+    json_decref(parsed->claims);
+
+  if (parsed->header != NULL)
+    json_decref(parsed->header);
+
+  free(parsed);
+}
+
+int ear_get_app_recs(const ear_t *ear, const char ***papp_rec,
+                     size_t *papp_rec_sz) {
+  assert(ear != NULL);
+  assert(ear->snap != NULL);
+  assert(papp_rec != NULL);
+  assert(papp_rec_sz != NULL);
+
+  const snap_rec_t *recs = SNAP_RECS(ear);
+  size_t app_rec_count = SNAP_HDR(ear)->nrecs;
+  const char **keylist = NULL;
+
+  // Allocate suitable buffer space
+  keylist = calloc(app_rec_count, sizeof(char*));
+
+  // Populate the list with the names, which are interior pointers
+  for (size_t i = 0; i < app_rec_count; i++) {
+    keylist[i] = SNAP_STR(ear, recs[i].name);
+  }
+
+  *papp_rec_sz = app_rec_count;
+  *papp_rec = keylist;
+  return 0;
+}
+
+int ear_get_status(const ear_t *ear, const char *app_rec, ear_tier_t *ptier,
+                   char err_msg[EAR_ERR_SZ]) {
+  assert(ear != NULL);
+  assert(ear->snap != NULL);
+  assert(app_rec != NULL);
+  assert(ptier != NULL);
+
+  char e[EAR_ERR_SZ] = {'\0'};
+  ear_err_t code = EAR_OK;
+  const snap_rec_t *rec = NULL;
+
+  if ((rec = snap_find(ear, app_rec)) == NULL) {
+    (void)snprintf(e, sizeof e, "no appraisal record found for \"%s\"",
+                   app_rec);
+    code = EAR_ERR_NO_APP_REC;
+    goto err;
+  }
+
+  if (!(rec->flags & SNAP_REC_STATUS)) {
+    (void)snprintf(e, sizeof e, "\"ear.status\" not found");
+    code = EAR_ERR_STATUS;
+    goto err;
+  }
+
+  if (rec->tier == SNAP_TIER_UNKNOWN) {
+    (void)snprintf(e, sizeof e, "unknown status \"%s\"",
+                   SNAP_STR(ear, rec->status));
+    code = EAR_ERR_STATUS;
+    goto err;
+  }
+
+  *ptier = (ear_tier_t)rec->tier;
+
+  return 0;
+
+err:
+  EAR_PROBE2(lookup__error, code, app_rec);
+
+  if (err_msg != NULL)
+    (void)u_strlcpy(err_msg, e, EAR_ERR_SZ);
+
+  return -1;
+}
+
+ear_tier_t ear_get_worst_tier(const ear_t *ear) {
+  assert(ear != NULL);
+  assert(ear->snap != NULL);
+
+  return (ear_tier_t)SNAP_HDR(ear)->worst_tier;
+}
+
+size_t ear_get_tiers(const ear_t *ear, ear_tier_t *tiers, size_t tiers_sz) {
+  assert(ear != NULL);
+  assert(ear->snap != NULL);
+  assert(tiers != NULL || tiers_sz == 0);
+
+  const snap_rec_t *recs = SNAP_RECS(ear);
+  size_t nrecs = SNAP_HDR(ear)->nrecs;
+
+  for (size_t i = 0; i < nrecs && i < tiers_sz; i++)
+    tiers[i] = recs[i].tier == SNAP_TIER_UNKNOWN ? EAR_TIER_NONE
+                                                 : (ear_tier_t)recs[i].tier;
+
+  return nrecs;
+}
+
+size_t ear_batch_get_status(const ear_t *const *ears, size_t ears_sz,
+                            ear_app_rec_id_t id, ear_tier_t *tiers) {
+  assert(ears != NULL || ears_sz == 0);
+  assert(tiers != NULL || ears_sz == 0);
+
+  size_t found = 0;
+
+  for (size_t i = 0; i < ears_sz; i++) {
+    const snap_rec_t *rec = rec_by_id(ears[i], id);
+
+    tiers[i] = EAR_TIER_NONE;
+
+    if (rec == NULL)
+      continue;
+
+    found++;
+
+    if (rec->tier != SNAP_TIER_UNKNOWN)
+      tiers[i] = (ear_tier_t)rec->tier;
+  }
+
+  return found;
+}
+
+size_t ear_batch_get_tvec(const ear_t *const *ears, size_t ears_sz,
+                          ear_app_rec_id_t id, ear_tvec_t *tvecs) {
+  assert(ears != NULL || ears_sz == 0);
+  assert(tvecs != NULL || ears_sz == 0);
+
+  size_t found = 0;
+
+  for (size_t i = 0; i < ears_sz; i++) {
+    const snap_rec_t *rec = rec_by_id(ears[i], id);
+
+    memset(&tvecs[i], 0, sizeof tvecs[i]);
+
+    if (rec == NULL)
+      continue;
+
+    found++;
+
+    tvecs[i].present = (rec->flags / SNAP_REC_TV(0)) & 0xffu;
+    memcpy(tvecs[i].claims, rec->tvec, sizeof tvecs[i].claims);
+  }
+
+  return found;
+}
+
+size_t ear_batch_get_akpub(const ear_t *const *ears, size_t ears_sz,
+                           ear_app_rec_id_t id, ear_slice_t *akpubs) {
+  assert(ears != NULL || ears_sz == 0);
+  assert(akpubs != NULL || ears_sz == 0);
+
+  size_t found = 0;
+
+  for (size_t i = 0; i < ears_sz; i++) {
+    const snap_rec_t *rec = rec_by_id(ears[i], id);
+
+    akpubs[i].ptr = NULL;
+    akpubs[i].sz = 0;
+
+    if (rec == NULL)
+      continue;
+
+    found++;
+
+    if (rec->flags & SNAP_REC_AKPUB_DER) {
+      akpubs[i].ptr = (const uint8_t *)SNAP_STR(ears[i], rec->akpub_der);
+      akpubs[i].sz = rec->akpub_der.len;
+    }
+  }
+
+  return found;
+}
+
+int ear_get_appraisal_policy_id(const ear_t *ear, const char *app_rec,
+                                const char **ppolicy_id, size_t *ppolicy_id_sz,
+                                char err_msg[EAR_ERR_SZ]) {
+  assert(ear != NULL);
+  assert(ear->snap != NULL);
+  assert(app_rec != NULL);
+  assert(ppolicy_id != NULL);
+  assert(ppolicy_id_sz != NULL);
+
+  char e[EAR_ERR_SZ] = {'\0'};
+  ear_err_t code = EAR_OK;
+  const snap_rec_t *rec = NULL;
+
+  if ((rec = snap_find(ear, app_rec)) == NULL) {
+    (void)snprintf(e, sizeof e, "no appraisal record found for \"%s\"",
+                   app_rec);
+    code = EAR_ERR_NO_APP_REC;
+    goto err;
+  }
+
+  if (!(rec->flags & SNAP_REC_POLICY_ID)) {
+    (void)snprintf(e, sizeof e, "\"ear.appraisal-policy-id\" not found");
+    code = EAR_ERR_NO_CLAIM;
+    goto err;
+  }
+
+  *ppolicy_id = SNAP_STR(ear, rec->policy_id);
+  *ppolicy_id_sz = rec->policy_id.len;
+
+  return 0;
+
+err:
+  EAR_PROBE2(lookup__error, code, app_rec);
+
+  if (err_msg != NULL)
+    (void)u_strlcpy(err_msg, e, EAR_ERR_SZ);
+
+  return -1;
+}
+
+static const char *const claim_names[] = {
+    "\"iat\"",
+    "\"nbf\"",
+    "\"exp\"",
+    "\"eat_profile\"",
+    "\"jti\"",
+    "\"build\" of \"ear.verifier-id\"",
+    "\"developer\" of \"ear.verifier-id\"",
+};
+
+int ear_get_time(const ear_t *ear, ear_claim_t claim, int64_t *pt,
+                 char err_msg[EAR_ERR_SZ]) {
+  assert(ear != NULL);
+  assert(ear->snap != NULL);
+  assert(claim <= EAR_CLAIM_EXP);
+  assert(pt != NULL);
+
+  const snap_hdr_t *hdr = SNAP_HDR(ear);
+  const int64_t times[] = {hdr->iat, hdr->nbf, hdr->exp};
+
+  // SNAP_IAT, SNAP_NBF and SNAP_EXP are in ear_claim_t order
+  if (!(hdr->flags & (SNAP_IAT << claim))) {
+    EAR_PROBE2(lookup__error, EAR_ERR_NO_CLAIM, claim_names[claim]);
+
+    if (err_msg != NULL)
+      (void)snprintf(err_msg, EAR_ERR_SZ, "%s not found", claim_names[claim]);
+
+    return -1;
+  }
+
+  *pt = times[claim];
+
+  return 0;
+}
+
+int ear_get_string(const ear_t *ear, ear_claim_t claim, const char **pstr,
+                   size_t *pstr_sz, char err_msg[EAR_ERR_SZ]) {
+  assert(ear != NULL);
+  assert(ear->snap != NULL);
+  assert(claim >= EAR_CLAIM_PROFILE && claim <= EAR_CLAIM_VERIFIER_DEVELOPER);
+  assert(pstr != NULL);
+  assert(pstr_sz != NULL);
+
+  const snap_hdr_t *hdr = SNAP_HDR(ear);
+  // the profile has been validated, so it is always there
+  const uint32_t flags[] = {0, SNAP_JTI, SNAP_BUILD, SNAP_DEVELOPER};
+  const snap_str_t strs[] = {hdr->profile, hdr->jti, hdr->build,
+                             hdr->developer};
+  unsigned i = claim - EAR_CLAIM_PROFILE;
+
+  if ((hdr->flags & flags[i]) != flags[i]) {
+    EAR_PROBE2(lookup__error, EAR_ERR_NO_CLAIM, claim_names[claim]);
+
+    if (err_msg != NULL)
+      (void)snprintf(err_msg, EAR_ERR_SZ, "%s not found", claim_names[claim]);
+
+    return -1;
+  }
+
+  *pstr = SNAP_STR(ear, strs[i]);
+  *pstr_sz = strs[i].len;
+
+  return 0;
+}
+
+/* The "ear.raw-evidence" of ear, or NULL if it has none */
+static const char *raw_evidence(const ear_t *ear, size_t *psz,
+                                char err_msg[EAR_ERR_SZ]) {
+  const snap_hdr_t *hdr = SNAP_HDR(ear);
+
+  if (!(hdr->flags & SNAP_RAW_EVIDENCE)) {
+    EAR_PROBE2(lookup__error, EAR_ERR_NO_CLAIM, "ear.raw-evidence");
+
+    if (err_msg != NULL)
+      (void)snprintf(err_msg, EAR_ERR_SZ, "\"ear.raw-evidence\" not found");
+
+    return NULL;
+  }
+
+  *psz = hdr->raw_evidence.len;
+
+  return SNAP_STR(ear, hdr->raw_evidence);
+}
+
+int ear_get_raw_evidence_sz(const ear_t *ear, size_t *psz,
+                            char err_msg[EAR_ERR_SZ]) {
+  assert(ear != NULL);
+  assert(ear->snap != NULL);
+  assert(psz != NULL);
+
+  const char *b64;
+  size_t b64_sz;
+
+  if ((b64 = raw_evidence(ear, &b64_sz, err_msg)) == NULL)
+    return -1;
+
+  // as u_b64_decode_at() counts it, padding aside
+  if (b64_sz > 0 && b64[b64_sz - 1] == '=')
+    b64_sz--;
+  if (b64_sz > 0 && b64[b64_sz - 1] == '=')
+    b64_sz--;
+
+  *psz = U_B64URL_DECODED_SZ(b64_sz);
+
+  return 0;
+}
+
+int ear_raw_evidence_read(const ear_t *ear, size_t off, uint8_t *buf,
+                          size_t buf_sz, size_t *pn, char err_msg[EAR_ERR_SZ]) {
+  assert(ear != NULL);
+  assert(ear->snap != NULL);
+  assert(buf != NULL || buf_sz == 0);
+  assert(pn != NULL);
+
+  const char *b64;
+  size_t b64_sz;
+
+  if ((b64 = raw_evidence(ear, &b64_sz, err_msg)) == NULL)
+    return -1;
+
+  if (u_b64_decode_at(b64, b64_sz, off, buf, buf_sz, pn) == -1) {
+    if (err_msg != NULL)
+      (void)snprintf(err_msg, EAR_ERR_SZ,
+                     "\"ear.raw-evidence\" is not valid base64url");
+    return -1;
+  }
+
+  return 0;
+}
+
+int ear_raw_evidence_digest(const ear_t *ear, EVP_MD_CTX *md_ctx,
+                            char err_msg[EAR_ERR_SZ]) {
+  assert(ear != NULL);
+  assert(ear->snap != NULL);
+  assert(md_ctx != NULL);
+
+  uint8_t chunk[3 * 1024]; // whole base64 quanta
+  size_t off = 0, n = 0;
+
+  do {
+    if (ear_raw_evidence_read(ear, off, chunk, sizeof chunk, &n, err_msg) ==
+        -1)
+      return -1;
+
+    if (n > 0 && EVP_DigestUpdate(md_ctx, chunk, n) != 1) {
+      if (err_msg != NULL)
+        (void)snprintf(err_msg, EAR_ERR_SZ, "cannot update the digest");
+      return -1;
+    }
+
+    off += n;
+  } while (n == sizeof chunk);
+
+  return 0;
+}
+
+// the top-level claims a query can name, in ear_claim_t order
+static const char *const query_claims[] = {
+    "iat", "nbf", "exp", "eat_profile", "jti", "ear.verifier-id/build",
+    "ear.verifier-id/developer",
+};
+
+#define QUERY_TV_PREFIX "ear.trustworthiness-vector/"
+
+int ear_query_compile(const char *path, ear_query_t **pquery,
+                      char err_msg[EAR_ERR_SZ]) {
+  assert(path != NULL);
+  assert(pquery != NULL);
+
+  ear_query_t *query = NULL;
+  const char *rec = NULL, *claim = NULL;
+  char *name = NULL, e[EAR_ERR_SZ];
+  size_t name_sz = 0;
+
+  if ((query = calloc(1, sizeof *query)) == NULL) {
+    (void)snprintf(e, sizeof e, "cannot allocate the query");
+    goto err;
+  }
+
+  for (unsigned i = 0; i < sizeof query_claims / sizeof query_claims[0]; i++) {
+    if (!strcmp(path, query_claims[i])) {
+      query->field = QUERY_CLAIM;
+      query->type = i <= EAR_CLAIM_EXP ? EAR_VALUE_INT : EAR_VALUE_STRING;
+      query->arg = i;
+      goto done;
+    }
+  }
+
+  if (strncmp(path, "submods/", 8) != 0 ||
+      (claim = strchr(rec = path + 8, '/')) == NULL)
+    goto unsupported;
+
+  claim++;
+
+  if (!strcmp(claim, "ear.status")) {
+    query->field = QUERY_STATUS;
+    query->type = EAR_VALUE_TIER;
+  } else if (!strcmp(claim, "ear.appraisal-policy-id")) {
+    query->field = QUERY_POLICY_ID;
+    query->type = EAR_VALUE_STRING;
+  } else if (!strcmp(claim, "ear.veraison.key-attestation/akpub")) {
+    query->field = QUERY_AKPUB;
+    query->type = EAR_VALUE_BYTES;
+  } else if (!strncmp(claim, QUERY_TV_PREFIX, sizeof QUERY_TV_PREFIX - 1)) {
+    query->field = QUERY_TV;
+    query->type = EAR_VALUE_INT;
+
+    for (query->arg = 0; query->arg < EAR_TV_CLAIMS; query->arg++)
+      if (!strcmp(claim + sizeof QUERY_TV_PREFIX - 1, tvec_names[query->arg]))
+        break;
+
+    if (query->arg == EAR_TV_CLAIMS)
+      goto unsupported;
+  } else {
+    goto unsupported;
+  }
+
+  if (claim - rec == 2 && rec[0] == '*') {
+    query->any_rec = 1;
+    goto done;
+  }
+
+  // unescaped, the name is never longer than it is in the path
+  if ((name = malloc((size_t)(claim - rec))) == NULL) {
+    (void)snprintf(e, sizeof e, "cannot allocate the query");
+    goto err;
+  }
+
+  for (const char *p = rec; p < claim - 1; p++) {
+    if (*p != '~')
+      name[name_sz++] = *p;
+    else if (p[1] == '0' || p[1] == '1')
+      name[name_sz++] = *++p == '0' ? '~' : '/';
+    else
+      goto unsupported;
+  }
+
+  if (intern_id(name, name_sz, &query->rec) == -1) {
+    (void)snprintf(e, sizeof e, "cannot intern the record name of \"%s\"",
+                   path);
+    goto err;
+  }
+
+  free(name);
+
+done:
+  *pquery = query;
+
+  return 0;
+
+unsupported:
+  (void)snprintf(e, sizeof e, "unsupported claim path \"%s\"", path);
+
+err:
+  free(name);
+  free(query);
+
+  if (err_msg != NULL)
+    (void)u_strlcpy(err_msg, e, EAR_ERR_SZ);
+
+  return -1;
+}
+
+ear_value_type_t ear_query_type(const ear_query_t *query) {
+  assert(query != NULL);
+
+  return query->type;
+}
+
+/* Whether ear has the top-level claim of query, into *value if not NULL */
+static int query_claim(const ear_query_t *query, const ear_t *ear,
+                       ear_value_t *value) {
+  const snap_hdr_t *hdr = SNAP_HDR(ear);
+  // the profile has been validated, so it is always there
+  const uint32_t flags[] = {SNAP_IAT, SNAP_NBF,   SNAP_EXP,      0,
+                            SNAP_JTI, SNAP_BUILD, SNAP_DEVELOPER};
+  const int64_t times[] = {hdr->iat, hdr->nbf, hdr->exp};
+  const snap_str_t strs[] = {hdr->profile, hdr->jti, hdr->build,
+                             hdr->developer};
+
+  if ((hdr->flags & flags[query->arg]) != flags[query->arg])
+    return 0;
+
+  if (value == NULL)
+    return 1;
+
+  value->app_rec = NULL;
+  value->i = 0;
+  value->s.ptr = NULL;
+  value->s.sz = 0;
+
+  if (query->arg <= EAR_CLAIM_EXP) {
+    value->i = times[query->arg];
+  } else {
+    value->s.ptr =
+        (const uint8_t *)SNAP_STR(ear, strs[query->arg - EAR_CLAIM_PROFILE]);
+    value->s.sz = strs[query->arg - EAR_CLAIM_PROFILE].len;
+  }
+
+  return 1;
+}
+
+/* Whether rec has the record claim of query, into *value if not NULL */
+static int query_rec(const ear_query_t *query, const ear_t *ear,
+                     const snap_rec_t *rec, ear_value_t *value) {
+  const snap_str_t *str = NULL;
+  int64_t i = 0;
+
+  switch (query->field) {
+  case QUERY_STATUS:
+    if (!(rec->flags & SNAP_REC_STATUS))
+      return 0;
+    str = &rec->status;
+    i = rec->tier == SNAP_TIER_UNKNOWN ? EAR_TIER_NONE : (int64_t)rec->tier;
+    break;
+  case QUERY_POLICY_ID:
+    if (!(rec->flags & SNAP_REC_POLICY_ID))
+      return 0;
+    str = &rec->policy_id;
+    break;
+  case QUERY_AKPUB:
+    if (!(rec->flags & SNAP_REC_AKPUB_DER))
+      return 0;
+    str = &rec->akpub_der;
+    break;
+  case QUERY_TV:
+    if (!(rec->flags & SNAP_REC_TV(query->arg)))
+      return 0;
+    i = rec->tvec[query->arg];
+    break;
+  case QUERY_CLAIM:
+    assert(0);
+    return 0;
+  }
+
+  if (value == NULL)
+    return 1;
+
+  value->app_rec = SNAP_STR(ear, rec->name);
+  value->i = i;
+  value->s.ptr = str != NULL ? (const uint8_t *)SNAP_STR(ear, *str) : NULL;
+  value->s.sz = str != NULL ? str->len : 0;
+
+  return 1;
+}
+
+size_t ear_query_eval(const ear_query_t *query, const ear_t *ear,
+                      ear_value_t *values, size_t values_sz) {
+  assert(query != NULL);
+  assert(ear != NULL);
+  assert(ear->snap != NULL);
+  assert(values != NULL || values_sz == 0);
+
+  const snap_rec_t *recs = SNAP_RECS(ear), *rec = NULL;
+  ear_value_t *first = values_sz > 0 ? values : NULL;
+  size_t n = 0;
+
+  if (query->field == QUERY_CLAIM)
+    return (size_t)query_claim(query, ear, first);
+
+  if (!query->any_rec)
+    return (rec = rec_by_id(ear, query->rec)) != NULL &&
+           query_rec(query, ear, rec, first);
+
+  for (uint32_t i = 0; i < SNAP_HDR(ear)->nrecs; i++)
+    if (query_rec(query, ear, &recs[i], n < values_sz ? &values[n] : NULL))
+      n++;
+
+  return n;
+}
+
+void ear_query_free(ear_query_t *query) { free(query); }
+
+int ear_veraison_get_akpub(const ear_t *ear, const char *app_rec,
+                           uint8_t **pakpub, size_t *pakpub_sz,
+                           char err_msg[EAR_ERR_SZ]) {
+  assert(ear != NULL);
+  assert(ear->snap != NULL);
+  assert(app_rec != NULL);
+  assert(pakpub != NULL);
+  assert(pakpub_sz != NULL);
+
+  char e[EAR_ERR_SZ] = {'\0'};
+  ear_err_t code = EAR_OK;
+  const snap_rec_t *rec = NULL;
+  uint8_t *akpub = NULL;
+
+  if ((code = find_akpub(ear, app_rec, &rec, e)) != EAR_OK) {
+    goto err;
+  }
+
+  if ((akpub = malloc(rec->akpub_der.len)) == NULL) {
+    (void)snprintf(e, sizeof e, "cannot allocate \"akpub\"");
+    code = EAR_ERR_ALLOC;
+    goto err;
+  }
+
+  memcpy(akpub, SNAP_STR(ear, rec->akpub_der), rec->akpub_der.len);
+
+  *pakpub = akpub;
+  *pakpub_sz = rec->akpub_der.len;
+
+  return 0;
+
+err:
+  EAR_PROBE2(lookup__error, code, app_rec);
+
+  if (err_msg != NULL)
+    (void)u_strlcpy(err_msg, e, EAR_ERR_SZ);
+
+  return -1;
+}
+
+int ear_veraison_get_akpub_ref(const ear_t *ear, const char *app_rec,
+                               const uint8_t **pakpub, size_t *pakpub_sz,
+                               char err_msg[EAR_ERR_SZ]) {
+  assert(ear != NULL);
+  assert(ear->snap != NULL);
+  assert(app_rec != NULL);
+  assert(pakpub != NULL);
+  assert(pakpub_sz != NULL);
+
+  char e[EAR_ERR_SZ] = {'\0'};
+  ear_err_t code = EAR_OK;
+  const snap_rec_t *rec = NULL;
+
+  if ((code = find_akpub(ear, app_rec, &rec, e)) != EAR_OK) {
+    EAR_PROBE2(lookup__error, code, app_rec);
+
+    if (err_msg != NULL)
+      (void)u_strlcpy(err_msg, e, EAR_ERR_SZ);
+
+    return -1;
+  }
+
+  *pakpub = (const uint8_t *)SNAP_STR(ear, rec->akpub_der);
+  *pakpub_sz = rec->akpub_der.len;
+
+  return 0;
+}
+
+int ear_veraison_get_akpub_pkey(const ear_t *ear, const char *app_rec,
+                                EVP_PKEY **ppkey, char err_msg[EAR_ERR_SZ]) {
+  assert(ear != NULL);
+  assert(ear->snap != NULL);
+  assert(app_rec != NULL);
+  assert(ppkey != NULL);
+
+  char e[EAR_ERR_SZ] = {'\0'};
+  ear_err_t code = EAR_OK;
+  const snap_rec_t *rec = NULL;
+  EVP_PKEY *pkey = NULL;
+
+  if ((code = find_akpub(ear, app_rec, &rec, e)) != EAR_OK) {
+    goto err;
+  }
+
+  if ((pkey = akpub_pkey(ear, rec)) == NULL) {
+    (void)snprintf(e, sizeof e, "\"akpub\" is not a valid public key");
+    code = EAR_ERR_AKPUB;
+    goto err;
+  }
+
+  *ppkey = pkey;
+
+  return 0;
+
+err:
+  EAR_PROBE2(lookup__error, code, app_rec);
+
+  if (err_msg != NULL)
+    (void)u_strlcpy(err_msg, e, EAR_ERR_SZ);
+
+  return -1;
+}
+
+int ear_veraison_verify_pop(const ear_t *ear, const char *app_rec,
+                            const char *alg, const uint8_t *data,
+                            size_t data_sz, const uint8_t *sig, size_t sig_sz,
+                            char err_msg[EAR_ERR_SZ]) {
+  assert(ear != NULL);
+  assert(ear->snap != NULL);
+  assert(app_rec != NULL);
+  assert(alg != NULL);
+  assert(data != NULL || data_sz == 0);
+  assert(sig != NULL);
+
+  u_slice_t msg = {data, data_sz};
+  char e[EAR_ERR_SZ] = {'\0'};
+  ear_err_t code = EAR_OK;
+  EVP_PKEY *pkey = NULL;
+  jwt_alg_t opt_alg;
+
+  if ((code = pop_key(ear, app_rec, alg, &opt_alg, &pkey, e)) != EAR_OK) {
+    goto err;
+  }
+
+  if (jws_verify_pop(opt_alg, pkey, &msg, 1, sig, sig_sz) == -1) {
+    (void)snprintf(e, sizeof e,
+                   "cannot verify the proof-of-possession signature");
+    code = EAR_ERR_SIGNATURE;
+    goto err;
+  }
+
+  return 0;
+
+err:
+  EAR_PROBE2(lookup__error, code, app_rec);
+
+  if (err_msg != NULL)
+    (void)u_strlcpy(err_msg, e, EAR_ERR_SZ);
+
+  return -1;
+}
+
+int ear_veraison_verify_pop_batch(const ear_t *ear, const char *app_rec,
+                                  const char *alg, const ear_pop_t *pops,
+                                  size_t pops_sz, int *results,
+                                  char err_msg[EAR_ERR_SZ]) {
+  assert(ear != NULL);
+  assert(ear->snap != NULL);
+  assert(app_rec != NULL);
+  assert(alg != NULL);
+  assert(pops != NULL || pops_sz == 0);
+
+  char e[EAR_ERR_SZ] = {'\0'};
+  ear_err_t code = EAR_OK;
+  EVP_PKEY *pkey = NULL;
+  jwt_alg_t opt_alg;
+  size_t failed = 0;
+  int ret;
+
+  // the record, key and algorithm are looked up once for the whole batch
+  if ((code = pop_key(ear, app_rec, alg, &opt_alg, &pkey, e)) != EAR_OK) {
+    goto err;
+  }
+
+  for (size_t i = 0; i < pops_sz; i++) {
+    u_slice_t msg = {pops[i].data, pops[i].data_sz};
+
+    ret = jws_verify_pop(opt_alg, pkey, &msg, 1, pops[i].sig, pops[i].sig_sz);
+
+    if (ret == -1)
+      failed++;
+
+    if (results != NULL)
+      results[i] = ret;
+  }
+
+  if (failed > 0) {
+    (void)snprintf(e, sizeof e,
+                   "%zu of %zu proof-of-possession signatures do not verify",
+                   failed, pops_sz);
+    code = EAR_ERR_SIGNATURE;
+    goto err;
+  }
+
+  return 0;
+
+err:
+  EAR_PROBE2(lookup__error, code, app_rec);
+
+  if (err_msg != NULL)
+    (void)u_strlcpy(err_msg, e, EAR_ERR_SZ);
+
+  return -1;
+}
+
+int ear_snapshot(const ear_t *ear, const uint8_t **psnap, size_t *psnap_sz) {
+  assert(ear != NULL);
+  assert(ear->snap != NULL);
+  assert(psnap != NULL);
+  assert(psnap_sz != NULL);
+
+  *psnap = ear->snap;
+  *psnap_sz = ear->snap_sz;
+
+  return 0;
+}
+
+/* Wrap the summary in snap into *pear, as ear_snapshot_load() */
+static ear_err_t snap_load(const uint8_t *snap, size_t snap_sz, ear_t **pear,
+                           char err_msg[EAR_ERR_SZ]) {
+  const snap_hdr_t *hdr = (const snap_hdr_t *)snap;
+  ear_t *ear = NULL;
+  ear_err_t code;
+
+  if ((code = snap_check(snap, snap_sz, err_msg)) != EAR_OK)
+    return code;
+
+  // the EAR was valid when verified, but may have expired since
+  if ((hdr->flags & SNAP_EXP) && (int64_t)time(NULL) >= hdr->exp) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "EAR has expired");
+    return EAR_ERR_EXPIRED;
+  }
+
+  if ((ear = ear_new()) == NULL) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "cannot initialise the EAR object");
+    return EAR_ERR_ALLOC;
+  }
+
+  ear->snap = snap;
+  ear->snap_sz = snap_sz;
+
+  *pear = ear;
+
+  return EAR_OK;
+}
+
+int ear_snapshot_load(const uint8_t *snap, size_t snap_sz, ear_t **pear,
+                      char err_msg[EAR_ERR_SZ]) {
+  assert(snap != NULL);
+  assert(pear != NULL);
+
+  ear_err_t code;
+  char e[EAR_ERR_SZ] = {'\0'};
+
+  if ((code = snap_load(snap, snap_sz, pear, e)) != EAR_OK) {
+    EAR_PROBE2(lookup__error, code, "(snapshot)");
+
+    if (err_msg != NULL)
+      (void)u_strlcpy(err_msg, e, EAR_ERR_SZ);
+
+    return -1;
+  }
+
+  return 0;
+}
+
+/* The size of the MAC that sealer puts on tickets, or 0 if it has no HMAC
+ * key */
+static size_t ticket_mac_sz(const ear_verifier_t *sealer) {
+  switch (sealer->alg) {
+  case JWT_ALG_HS256:
+    return 32;
+  case JWT_ALG_HS384:
+    return 48;
+  case JWT_ALG_HS512:
+    return 64;
+  default:
+    return 0;
+  }
+}
+
+int ear_ticket_seal(const ear_verifier_t *sealer, const ear_t *ear,
+                    unsigned ttl, uint8_t *buf, size_t buf_sz,
+                    size_t *pticket_sz, char err_msg[EAR_ERR_SZ]) {
+  assert(sealer != NULL);
+  assert(ear != NULL);
+  assert(ear->snap != NULL);
+  assert(ttl > 0);
+  assert(pticket_sz != NULL);
+
+  int64_t expires = (int64_t)time(NULL) + ttl;
+  u_slice_t msg[2] = {{ear->snap, ear->snap_sz},
+                      {(const uint8_t *)&expires, sizeof expires}};
+  size_t mac_sz = ticket_mac_sz(sealer),
+         ticket_sz = ear->snap_sz + sizeof expires + mac_sz;
+  char e[EAR_ERR_SZ] = {'\0'};
+
+  if (mac_sz == 0) {
+    (void)snprintf(e, sizeof e, "tickets are sealed with an HMAC key");
+    goto err;
+  }
+
+  *pticket_sz = ticket_sz;
+
+  if (buf == NULL)
+    return 0;
+
+  if (buf_sz < ticket_sz) {
+    (void)snprintf(e, sizeof e, "ticket needs %zu bytes, buffer has %zu",
+                   ticket_sz, buf_sz);
+    goto err;
+  }
+
+  // the summary and the ticket's own expiry, followed by their MAC
+  if (jws_mac(sealer, msg, 2, buf + ticket_sz - mac_sz, &mac_sz) == -1) {
+    (void)snprintf(e, sizeof e, "cannot compute the ticket MAC");
+    goto err;
+  }
+
+  memcpy(buf, ear->snap, ear->snap_sz);
+  memcpy(buf + ear->snap_sz, &expires, sizeof expires);
+
+  return 0;
+
+err:
+  if (err_msg != NULL)
+    (void)u_strlcpy(err_msg, e, EAR_ERR_SZ);
+
+  return -1;
+}
+
+int ear_ticket_verify(const ear_verifier_t *sealer, const uint8_t *ticket,
+                      size_t ticket_sz, ear_t **pear,
+                      char err_msg[EAR_ERR_SZ]) {
+  assert(sealer != NULL);
+  assert(ticket != NULL);
+  assert(pear != NULL);
+
+  const snap_hdr_t *hdr = (const snap_hdr_t *)ticket;
+  u_slice_t msg = {ticket, 0};
+  uint8_t mac[EVP_MAX_MD_SIZE];
+  size_t mac_sz = ticket_mac_sz(sealer);
+  int64_t expires;
+  ear_err_t code;
+  char e[EAR_ERR_SZ] = {'\0'};
+
+  if (mac_sz == 0) {
+    (void)snprintf(e, sizeof e, "tickets are sealed with an HMAC key");
+    code = EAR_ERR_ALG;
+    goto err;
+  }
+
+  // the summary says how long it is, and the expiry and MAC take up the rest
+  if ((uintptr_t)ticket % _Alignof(snap_hdr_t) != 0 ||
+      ticket_sz < sizeof *hdr + sizeof expires + mac_sz ||
+      hdr->size != ticket_sz - sizeof expires - mac_sz) {
+    (void)snprintf(e, sizeof e, "malformed EAR ticket");
+    code = EAR_ERR_SNAPSHOT;
+    goto err;
+  }
+
+  msg.sz = hdr->size + sizeof expires;
+
+  if (jws_mac(sealer, &msg, 1, mac, &mac_sz) == -1 ||
+      CRYPTO_memcmp(mac, ticket + msg.sz, mac_sz) != 0) {
+    (void)snprintf(e, sizeof e, "ticket MAC verification failed");
+    code = EAR_ERR_SIGNATURE;
+    goto err;
+  }
+
+  memcpy(&expires, ticket + hdr->size, sizeof expires);
+
+  if ((int64_t)time(NULL) >= expires) {
+    (void)snprintf(e, sizeof e, "ticket expired");
+    code = EAR_ERR_EXPIRED;
+    goto err;
+  }
+
+  if ((code = snap_load(ticket, hdr->size, pear, e)) != EAR_OK)
+    goto err;
+
+  return 0;
+
+err:
+  EAR_PROBE2(lookup__error, code, "(ticket)");
+
+  if (err_msg != NULL)
+    (void)u_strlcpy(err_msg, e, EAR_ERR_SZ);
+
+  return -1;
+}
+
+int ear_get_verification_context(const ear_t *ear, const char **palg,
+                                 const uint8_t **pkey_id,
+                                 int64_t *pverified_at) {
+  assert(ear != NULL);
+  assert(ear->snap != NULL);
+
+  const snap_hdr_t *hdr = SNAP_HDR(ear);
+
+  if (palg != NULL)
+    *palg = jwt_alg_str((jwt_alg_t)hdr->alg);
+
+  if (pkey_id != NULL)
+    *pkey_id = hdr->key_id;
+
+  if (pverified_at != NULL)
+    *pverified_at = hdr->verified_at;
+
+  return 0;
+}
+
+static ear_err_t find_akpub(const ear_t *ear, const char *app_rec,
+                            const snap_rec_t **prec,
+                            char err_msg[EAR_ERR_SZ]) {
+  const snap_rec_t *rec = NULL;
+
+  if ((rec = snap_find(ear, app_rec)) == NULL) {
+    (void)snprintf(err_msg, EAR_ERR_SZ,
+                   "no appraisal record found for \"%s\"", app_rec);
+    return EAR_ERR_NO_APP_REC;
+  }
+
+  if (!(rec->flags & SNAP_REC_KEY_ATTESTATION)) {
+    (void)snprintf(err_msg, EAR_ERR_SZ,
+                   "\"ear.veraison.key-attestation\" not found");
+    return EAR_ERR_AKPUB;
+  }
+
+  if (!(rec->flags & SNAP_REC_AKPUB)) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "\"akpub\" not found");
+    return EAR_ERR_AKPUB;
+  }
+
+  if (!(rec->flags & SNAP_REC_AKPUB_DER)) {
+    (void)snprintf(err_msg, EAR_ERR_SZ,
+                   "base64 decoding of \"akpub\" failed");
+    return EAR_ERR_AKPUB;
+  }
+
+  *prec = rec;
+
+  return EAR_OK;
+}
+
+/* The akpub of rec as an EVP_PKEY, parsed on first use and then kept with
+ * the EAR.  Threads racing to parse it all succeed, and all but one throw
+ * their copy away */
+static EVP_PKEY *akpub_pkey(const ear_t *ear, const snap_rec_t *rec) {
+  ear_t *cached = (ear_t *)ear; // the caches are not part of the EAR's value
+  _Atomic(EVP_PKEY *) *pkeys = NULL, *fresh = NULL;
+  const unsigned char *der =
+      (const unsigned char *)SNAP_STR(ear, rec->akpub_der);
+  size_t i = (size_t)(rec - SNAP_RECS(ear));
+  EVP_PKEY *pkey = NULL, *expected = NULL;
+
+  if ((pkeys = atomic_load_explicit(&cached->akpub_pkeys,
+                                    memory_order_acquire)) == NULL) {
+    if ((fresh = calloc(SNAP_HDR(ear)->nrecs, sizeof *fresh)) == NULL)
+      return NULL;
+
+    if (atomic_compare_exchange_strong(&cached->akpub_pkeys, &pkeys, fresh))
+      pkeys = fresh;
+    else
+      free((void *)fresh);
+  }
+
+  if ((pkey = atomic_load_explicit(&pkeys[i], memory_order_acquire)) != NULL)
+    return pkey;
+
+  if ((pkey = d2i_PUBKEY(NULL, &der, (long)rec->akpub_der.len)) == NULL)
+    return NULL;
+
+  if (!atomic_compare_exchange_strong(&pkeys[i], &expected, pkey)) {
+    EVP_PKEY_free(pkey);
+    pkey = expected;
+  }
+
+  return pkey;
+}
+
+/* The record of ear whose name has ID id.  The IDs of its record names are
+ * looked up on first use and kept with the EAR, along with the number of
+ * names interned by then.  Names are never interned here: one that has not
+ * been cannot be that of any ID.  An ID interned since, or a failure to keep
+ * the IDs, has the name of id compared instead */
+static const snap_rec_t *rec_by_id(const ear_t *ear, ear_app_rec_id_t id) {
+  ear_t *cached = (ear_t *)ear; // the caches are not part of the EAR's value
+  const snap_rec_t *recs = SNAP_RECS(ear);
+  uint32_t nrecs = SNAP_HDR(ear)->nrecs, *ids = NULL, *fresh = NULL;
+  const char *name;
+  size_t len;
+
+  if ((ids = atomic_load_explicit(&cached->rec_ids, memory_order_acquire)) ==
+      NULL) {
+    if ((fresh = malloc((nrecs + 1) * sizeof *fresh)) == NULL)
+      goto slow;
+
+    // every name interned before this count is found below
+    fresh[nrecs] = intern_count();
+
+    for (uint32_t i = 0; i < nrecs; i++) {
+      if (intern_find(SNAP_STR(ear, recs[i].name), recs[i].name.len,
+                      &fresh[i]) == -1)
+        fresh[i] = INTERN_NONE;
+    }
+
+    if (atomic_compare_exchange_strong(&cached->rec_ids, &ids, fresh))
+      ids = fresh;
+    else
+      free(fresh);
+  }
+
+  if (id >= ids[nrecs])
+    goto slow;
+
+  for (uint32_t i = 0; i < nrecs; i++)
+    if (ids[i] == id)
+      return &recs[i];
+
+  return NULL;
+
+slow:
+  if ((name = intern_name(id, &len)) == NULL)
+    return NULL;
+
+  for (uint32_t i = 0; i < nrecs; i++) {
+    if (recs[i].name.len == len &&
+        !memcmp(SNAP_STR(ear, recs[i].name), name, len))
+      return &recs[i];
+  }
+
+  return NULL;
+}
+
+static ear_err_t pop_key(const ear_t *ear, const char *app_rec,
+                         const char *alg, jwt_alg_t *palg, EVP_PKEY **ppkey,
+                         char err_msg[EAR_ERR_SZ]) {
+  const snap_rec_t *rec = NULL;
+  jwt_alg_t opt_alg = jwt_str_alg(alg);
+  ear_err_t code;
+
+  // the attested key is a public key: no HS* here
+  if (opt_alg == JWT_ALG_INVAL || opt_alg == JWT_ALG_NONE ||
+      opt_alg == JWT_ALG_HS256 || opt_alg == JWT_ALG_HS384 ||
+      opt_alg == JWT_ALG_HS512) {
+    (void)snprintf(err_msg, EAR_ERR_SZ,
+                   "unsupported proof-of-possession algorithm \"%s\"", alg);
+    return EAR_ERR_ALG;
+  }
+
+  if ((code = find_akpub(ear, app_rec, &rec, err_msg)) != EAR_OK)
+    return code;
+
+  if ((*ppkey = akpub_pkey(ear, rec)) == NULL) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "\"akpub\" is not a valid public key");
+    return EAR_ERR_AKPUB;
+  }
+
+  *palg = opt_alg;
+
+  return EAR_OK;
+}
+
+/* Find (or build) the calling thread's verifier for the given key.  Each
+ * thread keeps the last verifier it built, so that repeated one-shot calls
+ * with the same key do not parse it again */
+static ear_err_t tls_verifier(const uint8_t *pkey, size_t pkey_sz,
+                              const char *alg, ear_verifier_t **pverifier,
+                              char err_msg[EAR_ERR_SZ]) {
+  ear_verifier_t **plast = NULL, *verifier = NULL;
+  ear_err_t code = EAR_OK;
+  char e[EAR_ERR_SZ] = {'\0'};
+
+  if ((plast = jws_tls_verifier()) == NULL) {
+    (void)snprintf(e, sizeof e, "cannot allocate thread state");
+    code = EAR_ERR_ALLOC;
+    goto err;
+  }
+
+  verifier = *plast;
+
+  if (verifier == NULL || verifier->key_sz != pkey_sz ||
+      memcmp(verifier->key, pkey, pkey_sz) ||
+      verifier->alg != jwt_str_alg(alg)) {
+    if ((code = verifier_new(pkey, pkey_sz, alg, &verifier, e)) != EAR_OK)
+      goto err;
+
+    ear_verifier_free(*plast);
+    *plast = verifier;
+  }
+
+  *pverifier = verifier;
+
+  return EAR_OK;
+
+err:
+  EAR_PROBE2(key__error, code, alg);
+
+  if (err_msg != NULL)
+    (void)u_strlcpy(err_msg, e, EAR_ERR_SZ);
+
+  return code;
+}
+
+/* check_claims(), after which the claims-set is summarized into ear, in room
+ * if it is not NULL and the summary fits, and its jti recorded */
+static ear_err_t finish_claims(const ear_verifier_t *verifier, ear_t *ear,
+                               const claims_t *claims, const json_t *header,
+                               time_t now, size_t token_sz, uint8_t *room,
+                               size_t room_sz, char err_msg[EAR_ERR_SZ]) {
+  ear_err_t code;
+
+  if ((code = check_claims(verifier, claims, header, now, token_sz,
+                           err_msg)) != EAR_OK)
+    return code;
+
+  if ((code = snap_build(ear, claims, verifier, (int64_t)now, room, room_sz,
+                         err_msg)) != EAR_OK)
+    return code;
+
+  // only EARs that are otherwise valid get their jti recorded
+  return check_replay(verifier, claims->jti.ptr, claims->jti.len,
+                      (claims->flags & CLAIMS_EXP) ? claims->exp : 0, now,
+                      token_sz, err_msg);
+}
+
+/* The checks on a decoded claims-set that do not depend on the serialization
+ * (validity period, replicated header claims for JWT, profile and submods) */
+static ear_err_t check_claims(const ear_verifier_t *verifier,
+                              const claims_t *claims, const json_t *header,
+                              time_t now, size_t token_sz,
+                              char err_msg[EAR_ERR_SZ]) {
+  const char *alg = jwt_alg_str(verifier->alg);
+  ear_err_t code;
+
+  EAR_PROBE3(verify__stage, "validate", token_sz, alg);
+
+  if ((code = validate_claims(claims, header, now, err_msg)) != EAR_OK)
+    return code;
+
+  if ((code = validate_profile(claims, err_msg)) != EAR_OK)
+    return code;
+
+  EAR_PROBE3(verify__stage, "submods", token_sz, alg);
+
+  if (!(claims->flags & CLAIMS_SUBMODS)) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "\"submods\" not found");
+    return EAR_ERR_SUBMODS;
+  }
+
+  if (!(claims->flags & CLAIMS_SUBMODS_OBJECT)) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "\"submods\" is not a JSON object");
+    return EAR_ERR_SUBMODS;
+  }
+
+  return EAR_OK;
+}
+
+/* Whether app_rec, or else every record, is at min_tier or better */
+static ear_err_t check_gate(const claims_t *claims, const char *app_rec,
+                            ear_tier_t min_tier, char err_msg[EAR_ERR_SZ]) {
+  size_t len = app_rec != NULL ? strlen(app_rec) : 0;
+  int found = 0;
+
+  // as ear_get_worst_tier() has it, no record at all is "none"
+  if (app_rec == NULL && claims->nsubmods == 0 &&
+      snap_tier_rank(EAR_TIER_NONE) > snap_tier_rank(min_tier))
+    goto below;
+
+  for (size_t i = 0; i < claims->nsubmods; i++) {
+    const claims_submod_t *submod = &claims->submods[i];
+    ear_tier_t tier = EAR_TIER_NONE;
+
+    if (app_rec != NULL &&
+        (submod->name.len != len || memcmp(submod->name.ptr, app_rec, len)))
+      continue;
+
+    found = 1;
+
+    if (submod->status.ptr != NULL)
+      (void)snap_tier(submod->status, &tier);
+
+    if (snap_tier_rank(tier) > snap_tier_rank(min_tier))
+      goto below;
+  }
+
+  if (app_rec != NULL && !found) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "no appraisal record found for \"%s\"",
+                   app_rec);
+    return EAR_ERR_NO_APP_REC;
+  }
+
+  return EAR_OK;
+
+below:
+  (void)snprintf(err_msg, EAR_ERR_SZ, "appraisal record below the gate's tier");
+  return EAR_ERR_TIER;
+}
+
+/* Look the token up in cache.  On a miss, digest is still filled in, for
+ * cache_store().  A cached snapshot is only trusted if it was verified with
+ * the same algorithm and key as verifier's, and is still valid at now */
+/* The key of token in the cache: its SHA-256, hashed again with the limits
+ * of verifier if it has any.  A verifier then only ever gets the EARs that
+ * were verified within the same limits, whoever else shares the cache */
+static int cache_digest(const ear_verifier_t *verifier, const void *token,
+                        size_t token_sz, uint8_t *digest) {
+  const ear_limits_t *limits = &verifier->limits;
+  uint64_t buf[CACHE_DIGEST_SZ / 8 + 5];
+
+  if (jws_sha256(token, token_sz, digest) == -1)
+    return -1;
+
+  if (limits->max_token_sz == 0 && limits->max_submods == 0 &&
+      limits->max_str_sz == 0 && limits->max_depth == 0 &&
+      limits->max_raw_evidence_sz == 0)
+    return 0;
+
+  // field by field, for the struct has padding
+  memcpy(buf, digest, CACHE_DIGEST_SZ);
+  buf[CACHE_DIGEST_SZ / 8 + 0] = limits->max_token_sz;
+  buf[CACHE_DIGEST_SZ / 8 + 1] = limits->max_submods;
+  buf[CACHE_DIGEST_SZ / 8 + 2] = limits->max_str_sz;
+  buf[CACHE_DIGEST_SZ / 8 + 3] = limits->max_depth;
+  buf[CACHE_DIGEST_SZ / 8 + 4] = limits->max_raw_evidence_sz;
+
+  return jws_sha256(buf, sizeof buf, digest);
+}
+
+static ear_err_t cache_lookup(const ear_verifier_t *verifier,
+                              ear_cache_t *cache, const void *token,
+                              size_t token_sz, time_t now, uint8_t *digest,
+                              ear_t *ear, char err_msg[EAR_ERR_SZ]) {
+  const snap_hdr_t *hdr = NULL;
+  size_t snap_sz = 0;
+  ear_err_t code;
+  char e[EAR_ERR_SZ];
+
+  if (cache_digest(verifier, token, token_sz, digest) == -1) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "cannot hash the EAR");
+    return EAR_ERR_CACHE;
+  }
+
+  // straight into the EAR's own buffer
+  if (cache_get(cache, digest, (int64_t)now, &ear->buf, &ear->buf_sz,
+                &snap_sz) == -1)
+    return EAR_ERR_CACHE_MISS;
+
+  hdr = (const snap_hdr_t *)ear->buf;
+
+  if (snap_check(ear->buf, snap_sz, e) != EAR_OK ||
+      hdr->alg != (uint32_t)verifier->alg ||
+      memcmp(hdr->key_id, verifier->key_id, sizeof hdr->key_id) ||
+      ((hdr->flags & SNAP_EXP) && (int64_t)now >= hdr->exp) ||
+      ((hdr->flags & SNAP_NBF) && (int64_t)now < hdr->nbf))
+    return EAR_ERR_CACHE_MISS;
+
+  ear->snap = ear->buf;
+  ear->snap_sz = snap_sz;
+
+  code = check_replay(verifier,
+                      (hdr->flags & SNAP_JTI) ? SNAP_STR(ear, hdr->jti) : NULL,
+                      hdr->jti.len, (hdr->flags & SNAP_EXP) ? hdr->exp : 0,
+                      now, token_sz, err_msg);
+
+  if (code != EAR_OK) {
+    ear_clear(ear);
+    return code;
+  }
+
+  return EAR_OK;
+}
+
+static void cache_store(ear_cache_t *cache, const uint8_t *digest,
+                        const ear_t *ear, time_t now) {
+  const snap_hdr_t *hdr = SNAP_HDR(ear);
+
+  cache_put(cache, digest, (int64_t)now,
+            (hdr->flags & SNAP_EXP) ? hdr->exp : INT64_MAX, ear->snap,
+            ear->snap_sz);
+}
+
+static ear_err_t verifier_new(const uint8_t *pkey, size_t pkey_sz,
+                              const char *alg, ear_verifier_t **pverifier,
+                              char err_msg[EAR_ERR_SZ]) {
+  ear_verifier_t *verifier = NULL;
+  ear_err_t code = EAR_OK;
+  jwt_alg_t opt_alg;
+
+  opt_alg = jwt_str_alg(alg);
+  if (opt_alg == JWT_ALG_INVAL || opt_alg == JWT_ALG_NONE) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "unknown JWT algorithm \"%s\"", alg);
+    code = EAR_ERR_ALG;
+    goto err;
+  }
+
+  if ((verifier = calloc(1, sizeof *verifier)) == NULL ||
+      (verifier->key = malloc(pkey_sz)) == NULL) {
+    (void)snprintf(err_msg, EAR_ERR_SZ,
+                   "cannot initialise the verifier object");
+    code = EAR_ERR_ALLOC;
+    goto err;
+  }
+
+  memcpy(verifier->key, pkey, pkey_sz);
+  verifier->key_sz = pkey_sz;
+  verifier->alg = opt_alg;
+
+  // identifies the key in the summaries of the EARs it verifies
+  if (!EVP_Digest(pkey, pkey_sz, verifier->key_id, NULL, EVP_sha256(), NULL)) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "cannot fingerprint the key");
+    code = EAR_ERR_KEY;
+    goto err;
+  }
+
+  if ((code = jws_key_load(opt_alg, pkey, pkey_sz, &verifier->pkey,
+                           err_msg)) != EAR_OK) {
+    goto err;
+  }
+
+  *pverifier = verifier;
+
+  return EAR_OK;
+
+err:
+  if (verifier != NULL)
+    ear_verifier_free(verifier);
+
+  return code;
+}
+
+static ear_err_t decode_header(const ear_verifier_t *verifier,
+                               const jws_t *jws, json_t **pheader,
+                               char err_msg[EAR_ERR_SZ]) {
+  ear_err_t code;
+  json_t *header = NULL;
+
+  // seen (and checked) before by this thread
+  if ((header = jws_tls_header_get(jws, verifier->alg)) != NULL) {
+    *pheader = json_incref(header);
+    return EAR_OK;
+  }
+
+  if ((code = parse_header(jws, &header, err_msg)) != EAR_OK)
+    return code;
+
+  if ((code = check_alg(verifier, header, err_msg)) != EAR_OK) {
+    json_decref(header);
+    return code;
+  }
+
+  jws_tls_header_put(jws, verifier->alg, header);
+
+  *pheader = header;
+
+  return EAR_OK;
+}
+
+static ear_err_t parse_header(const jws_t *jws, json_t **pheader,
+                              char err_msg[EAR_ERR_SZ]) {
+  uint8_t buf[512];
+  size_t buf_sz;
+  json_t *header = NULL;
+
+  if (u_b64url_decode_n(jws->hdr, jws->hdr_sz, buf, sizeof buf, &buf_sz) ==
+      -1) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "malformed EAR JWT header");
+    return EAR_ERR_HEADER;
+  }
+
+  if ((header = json_loadb((const char *)buf, buf_sz, 0, NULL)) == NULL ||
+      !json_is_object(header)) {
+    (void)snprintf(err_msg, EAR_ERR_SZ,
+                   "EAR JWT header does not contain a valid JSON object");
+
+    if (header != NULL)
+      json_decref(header);
+
+    return EAR_ERR_HEADER;
+  }
+
+  *pheader = header;
+
+  return EAR_OK;
+}
+
+static ear_err_t check_alg(const ear_verifier_t *verifier,
+                           const json_t *header, char err_msg[EAR_ERR_SZ]) {
+  json_t *alg = json_object_get(header, "alg");
+
+  if (!json_is_string(alg) ||
+      strcmp(json_string_value(alg), jwt_alg_str(verifier->alg))) {
+    (void)snprintf(err_msg, EAR_ERR_SZ,
+                   "EAR JWT algorithm does not match the expected \"%s\"",
+                   jwt_alg_str(verifier->alg));
+    return EAR_ERR_ALG_MISMATCH;
+  }
+
+  return EAR_OK;
+}
+
+/* Decode the payload of jws into claims, with jscan_claims() if it can, or
+ * else into *pjson, with jansson.  With claims NULL, always into *pjson.
+ * The claims are only valid until the next call on the same thread */
+static ear_err_t decode_claims(const jws_t *jws, const ear_limits_t *limits,
+                               json_t **pjson, claims_t *claims,
+                               char err_msg[EAR_ERR_SZ]) {
+  uint8_t *payload = NULL;
+  size_t payload_sz = U_B64URL_DECODED_SZ(jws->pld_sz);
+
+  *pjson = NULL;
+
+  if ((payload = jws_tls_scratch(JWS_TLS_PAYLOAD, payload_sz)) == NULL) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "cannot allocate the EAR payload");
+    return EAR_ERR_ALLOC;
+  }
+
+  if (u_b64url_decode_n(jws->pld, jws->pld_sz, payload, payload_sz,
+                        &payload_sz) == -1) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "malformed EAR JWT payload");
+    return EAR_ERR_PAYLOAD;
+  }
+
+  return parse_claims(payload, payload_sz, limits, pjson, claims, err_msg);
+}
+
+/* decode_claims() for a jws split from buf, with the payload decoded over
+ * its own base64url and then moved to the end of buf.  The claims borrow
+ * from buf, and what comes before the payload, from *proom for *proom_sz
+ * bytes, is free for the summary */
+static ear_err_t decode_claims_inplace(const jws_t *jws,
+                                       const ear_limits_t *limits, char *buf,
+                                       size_t buf_sz, json_t **pjson,
+                                       claims_t *claims, uint8_t **proom,
+                                       size_t *proom_sz,
+                                       char err_msg[EAR_ERR_SZ]) {
+  uint8_t *pld = (uint8_t *)buf + (jws->pld - buf), *payload = NULL;
+  size_t payload_sz = 0;
+
+  *pjson = NULL;
+
+  // base64url decoding never writes ahead of what it has yet to read
+  if (u_b64url_decode_n(jws->pld, jws->pld_sz, pld, jws->pld_sz,
+                        &payload_sz) == -1) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "malformed EAR JWT payload");
+    return EAR_ERR_PAYLOAD;
+  }
+
+  payload = (uint8_t *)buf + buf_sz - payload_sz;
+  memmove(payload, pld, payload_sz);
+
+  *proom = (uint8_t *)buf;
+  *proom_sz = buf_sz - payload_sz;
+
+  return parse_claims(payload, payload_sz, limits, pjson, claims, err_msg);
+}
+
+/* The claims-set in payload into claims and *pjson, as decode_claims(),
+ * within limits (if not NULL) */
+static ear_err_t parse_claims(const uint8_t *payload, size_t payload_sz,
+                              const ear_limits_t *limits, json_t **pjson,
+                              claims_t *claims, char err_msg[EAR_ERR_SZ]) {
+  ear_err_t code = EAR_ERR_PAYLOAD;
+
+  if (claims != NULL) {
+    code = jscan_claims(payload, payload_sz, limits, claims);
+
+    if (code == EAR_OK)
+      return EAR_OK;
+
+    // a limit is final; anything else is for jansson to decide
+    if (code != EAR_ERR_PAYLOAD)
+      return limit_error(code, limits, err_msg);
+  }
+
+  *pjson = json_loadb((const char *)payload, payload_sz, 0, NULL);
+  if (!json_is_object(*pjson)) {
+    (void)snprintf(err_msg, EAR_ERR_SZ,
+                   "EAR claims-set does not contain a valid JSON object");
+    goto err;
+  }
+
+  if (limits != NULL && (code = check_limits(limits, *pjson, err_msg)) !=
+      EAR_OK)
+    goto err;
+
+  if (claims != NULL &&
+      (code = claims_from_json(*pjson, claims, err_msg)) != EAR_OK)
+    goto err;
+
+  return EAR_OK;
+
+err:
+  if (*pjson != NULL)
+    json_decref(*pjson), *pjson = NULL;
+
+  return code;
+}
+
+// "ear.trustworthiness-vector" members, in ear_tv_claim_t (and CBOR key) order
+const char *const tvec_names[EAR_TV_CLAIMS] = {
+    "instance-identity", "configuration",  "executables",    "file-system",
+    "hardware",          "runtime-opaque", "storage-opaque", "sourced-data",
+};
+
+static claims_str_t get_str(const json_t *json, const char *name) {
+  json_t *j = json_object_get(json, name);
+  claims_str_t str = {NULL, 0};
+
+  if (json_is_string(j)) {
+    str.ptr = json_string_value(j);
+    str.len = json_string_length(j);
+  }
+
+  return str;
+}
+
+/* 1 if name is a time in json, 0 if it is not, -1 if it is out of range */
+static int get_time(const json_t *json, const char *name, int64_t *pt) {
+  json_t *t = json_object_get(json, name);
+  double d;
+
+  if (json_is_integer(t)) {
+    *pt = (int64_t)json_integer_value(t);
+    return 1;
+  }
+
+  if (!json_is_real(t))
+    return 0;
+
+  // the range of jscan_claims(), within that of int64_t
+  d = json_real_value(t);
+  if (!(d > -9.2e18 && d < 9.2e18))
+    return -1;
+
+  *pt = (int64_t)d;
+
+  return 1;
+}
+
+/* The jansson counterpart of jscan_claims() */
+static ear_err_t claims_from_json(const json_t *json, claims_t *claims,
+                                  char err_msg[EAR_ERR_SZ]) {
+  static const char *const times[] = {"iat", "nbf", "exp"};
+  json_t *submods = json_object_get(json, "submods"), *submod, *verifier_id;
+  int64_t *time_claims[] = {&claims->iat, &claims->nbf, &claims->exp};
+  const char *name;
+
+  memset(claims, 0, sizeof *claims);
+
+  for (unsigned i = 0; i < 3; i++) {
+    switch (get_time(json, times[i], time_claims[i])) {
+    case 1:
+      claims->flags |= CLAIMS_IAT << i;
+      break;
+    case -1:
+      (void)snprintf(err_msg, EAR_ERR_SZ, "\"%s\" is out of range",
+                     times[i]);
+      return EAR_ERR_PAYLOAD;
+    }
+  }
+
+  claims->profile = get_str(json, "eat_profile");
+  claims->jti = get_str(json, "jti");
+  claims->iss = get_str(json, "iss");
+  claims->sub = get_str(json, "sub");
+  claims->aud = get_str(json, "aud");
+  claims->raw_evidence = get_str(json, "ear.raw-evidence");
+
+  verifier_id = json_object_get(json, "ear.verifier-id");
+  claims->build = get_str(verifier_id, "build");
+  claims->developer = get_str(verifier_id, "developer");
+
+  if (submods != NULL)
+    claims->flags |= CLAIMS_SUBMODS;
+
+  if (!json_is_object(submods))
+    return EAR_OK;
+
+  claims->flags |= CLAIMS_SUBMODS_OBJECT;
+
+  if (json_object_size(submods) == 0)
+    return EAR_OK;
+
+  claims->submods = (claims_submod_t *)(void *)jws_tls_scratch(
+      JWS_TLS_SUBMODS, json_object_size(submods) * sizeof *claims->submods);
+
+  if (claims->submods == NULL) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "cannot allocate the EAR submods");
+    return EAR_ERR_ALLOC;
+  }
+
+  json_object_foreach((json_t *)submods, name, submod) {
+    claims_submod_t *s = &claims->submods[claims->nsubmods++];
+    json_t *key_attestation, *tvec;
+
+    memset(s, 0, sizeof *s);
+    s->name.ptr = name;
+    s->name.len = strlen(name);
+    s->status = get_str(submod, "ear.status");
+    s->policy_id = get_str(submod, "ear.appraisal-policy-id");
+
+    tvec = json_object_get(submod, "ear.trustworthiness-vector");
+
+    for (unsigned i = 0; i < EAR_TV_CLAIMS; i++) {
+      json_t *claim = json_object_get(tvec, tvec_names[i]);
+
+      if (json_is_integer(claim) && json_integer_value(claim) >= INT8_MIN &&
+          json_integer_value(claim) <= INT8_MAX) {
+        s->tvec_present |= 1u << i;
+        s->tvec[i] = (int8_t)json_integer_value(claim);
+      }
+    }
+
+    key_attestation = json_object_get(submod, "ear.veraison.key-attestation");
+
+    if (key_attestation != NULL) {
+      s->key_attestation = 1;
+      s->akpub = get_str(key_attestation, "akpub");
+    }
+  }
+
+  return EAR_OK;
+}
+
+static ear_err_t validate_claims(const claims_t *claims, const json_t *header,
+                                 time_t now, char err_msg[EAR_ERR_SZ]) {
+  const char *replicated[] = {"iss", "sub", "aud"};
+  const claims_str_t *values[] = {&claims->iss, &claims->sub, &claims->aud};
+
+  if ((claims->flags & CLAIMS_EXP) && (int64_t)now >= claims->exp) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "EAR has expired");
+    return EAR_ERR_EXPIRED;
+  }
+
+  if ((claims->flags & CLAIMS_NBF) && (int64_t)now < claims->nbf) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "EAR is not yet valid");
+    return EAR_ERR_NOT_YET_VALID;
+  }
+
+  // claims replicated in the header must match the claims-set (RFC7519 5.3)
+  for (unsigned i = 0; i < sizeof replicated / sizeof replicated[0]; i++) {
+    json_t *h = json_object_get(header, replicated[i]);
+    const claims_str_t *c = values[i];
+
+    if (json_is_string(h) &&
+        (c->ptr == NULL || c->len != json_string_length(h) ||
+         memcmp(json_string_value(h), c->ptr, c->len))) {
+      (void)snprintf(err_msg, EAR_ERR_SZ,
+                     "header claim \"%s\" does not match the claims-set",
+                     replicated[i]);
+      return EAR_ERR_HEADER_CLAIM;
+    }
+  }
+
+  return EAR_OK;
+}
+
+/* Record jti (NULL if the EAR has none) with the replay guard of verifier,
+ * if there is one.  exp is 0 if the EAR does not expire */
+static ear_err_t check_replay(const ear_verifier_t *verifier, const char *jti,
+                              size_t jti_sz, int64_t exp, time_t now,
+                              size_t token_sz, char err_msg[EAR_ERR_SZ]) {
+  ear_replay_guard_t *guard = NULL;
+  ear_err_t code;
+
+  if ((guard = verifier->replay) == NULL && (guard = replay_default()) == NULL)
+    return EAR_OK;
+
+  EAR_PROBE3(verify__stage, "replay", token_sz, jwt_alg_str(verifier->alg));
+
+  if (jti == NULL || jti_sz == 0) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "missing \"jti\"");
+    return EAR_ERR_JTI;
+  }
+
+  code = replay_check(guard, jti, jti_sz, exp, (int64_t)now);
+
+  if (code == EAR_ERR_REPLAY)
+    (void)snprintf(err_msg, EAR_ERR_SZ, "replayed EAR (\"jti\" seen before)");
+  else if (code != EAR_OK)
+    (void)snprintf(err_msg, EAR_ERR_SZ, "replay guard is full");
+
+  return code;
+}
+
+/* EAR_OK if token is within the size limit, with *ptoken_sz set if there is
+ * one (and so the token has been measured), or else left alone */
+static ear_err_t check_token_sz(const ear_limits_t *limits, const char *token,
+                                size_t *ptoken_sz, char err_msg[EAR_ERR_SZ]) {
+  const char *end;
+
+  if (limits->max_token_sz == 0)
+    return EAR_OK;
+
+  // look no further than the limit for the end of a token of any size
+  if ((end = memchr(token, '\0', limits->max_token_sz + 1)) == NULL)
+    return limit_error(EAR_ERR_LIMIT_TOKEN, limits, err_msg);
+
+  *ptoken_sz = (size_t)(end - token);
+
+  return EAR_OK;
+}
+
+/* Walk json at depth (the claims-set being 1) for what jscan_claims() would
+ * have stopped at */
+static ear_err_t check_json(const ear_limits_t *limits, const json_t *json,
+                            unsigned depth) {
+  const char *key;
+  json_t *value;
+  size_t i;
+  ear_err_t code;
+
+  if (json_is_string(json)) {
+    if (limits->max_str_sz != 0 &&
+        json_string_length(json) > limits->max_str_sz)
+      return EAR_ERR_LIMIT_STRING;
+    return EAR_OK;
+  }
+
+  if (!json_is_object(json) && !json_is_array(json))
+    return EAR_OK;
+
+  if (limits->max_depth != 0 && depth > limits->max_depth)
+    return EAR_ERR_LIMIT_DEPTH;
+
+  if (json_is_array(json)) {
+    json_array_foreach(json, i, value) {
+      if ((code = check_json(limits, value, depth + 1)) != EAR_OK)
+        return code;
+    }
+    return EAR_OK;
+  }
+
+  json_object_foreach((json_t *)json, key, value) {
+    if (limits->max_str_sz != 0 && strlen(key) > limits->max_str_sz)
+      return EAR_ERR_LIMIT_STRING;
+
+    // "ear.raw-evidence" has a limit of its own, checked by check_limits()
+    if (depth == 1 && json_is_string(value) &&
+        strcmp(key, "ear.raw-evidence") == 0)
+      continue;
+
+    if ((code = check_json(limits, value, depth + 1)) != EAR_OK)
+      return code;
+  }
+
+  return EAR_OK;
+}
+
+/* What jscan_claims() enforces while scanning, for a claims-set that it left
+ * to jansson or that came from a CWT */
+static ear_err_t check_limits(const ear_limits_t *limits, const json_t *json,
+                              char err_msg[EAR_ERR_SZ]) {
+  const json_t *submods = json_object_get(json, "submods");
+  const json_t *raw_evidence = json_object_get(json, "ear.raw-evidence");
+  ear_err_t code;
+
+  if (limits->max_submods != 0 && json_is_object(submods) &&
+      json_object_size(submods) > limits->max_submods)
+    return limit_error(EAR_ERR_LIMIT_SUBMODS, limits, err_msg);
+
+  if (limits->max_raw_evidence_sz != 0 && json_is_string(raw_evidence) &&
+      json_string_length(raw_evidence) > limits->max_raw_evidence_sz)
+    return limit_error(EAR_ERR_LIMIT_RAW_EVIDENCE, limits, err_msg);
+
+  if ((code = check_json(limits, json, 1)) != EAR_OK)
+    return limit_error(code, limits, err_msg);
+
+  return EAR_OK;
+}
+
+/* code (an EAR_ERR_LIMIT_*) with its message in err_msg */
+static ear_err_t limit_error(ear_err_t code, const ear_limits_t *limits,
+                             char err_msg[EAR_ERR_SZ]) {
+  switch (code) {
+  case EAR_ERR_LIMIT_TOKEN:
+    (void)snprintf(err_msg, EAR_ERR_SZ, "EAR token larger than %zu bytes",
+                   limits->max_token_sz);
+    break;
+  case EAR_ERR_LIMIT_SUBMODS:
+    (void)snprintf(err_msg, EAR_ERR_SZ, "more than %zu appraisal records",
+                   limits->max_submods);
+    break;
+  case EAR_ERR_LIMIT_STRING:
+    (void)snprintf(err_msg, EAR_ERR_SZ, "string longer than %zu bytes",
+                   limits->max_str_sz);
+    break;
+  case EAR_ERR_LIMIT_DEPTH:
+    (void)snprintf(err_msg, EAR_ERR_SZ, "nested deeper than %u levels",
+                   limits->max_depth);
+    break;
+  case EAR_ERR_LIMIT_RAW_EVIDENCE:
+    (void)snprintf(err_msg, EAR_ERR_SZ,
+                   "\"ear.raw-evidence\" larger than %zu bytes",
+                   limits->max_raw_evidence_sz);
+    break;
+  default:
+    assert(0);
+  }
+
+  return code;
+}
+
+static ear_err_t validate_profile(const claims_t *claims,
+                                  char err_msg[EAR_ERR_SZ]) {
+  const claims_str_t *eat_profile = &claims->profile;
+
+  if (eat_profile->ptr == NULL) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "missing mandatory eat_profile");
+    return EAR_ERR_PROFILE;
+  }
+
+  if (eat_profile->len != strlen(EAR_PROFILE) ||
+      memcmp(eat_profile->ptr, EAR_PROFILE, eat_profile->len)) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "unknown eat_profile \"%.*s\"",
+                   (int)eat_profile->len, eat_profile->ptr);
+    return EAR_ERR_PROFILE;
+  }
+
+  return EAR_OK;
+}
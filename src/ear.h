@@ -15,8 +15,18 @@ extern "C" {
 #define EAR_ERR_SZ 128
 #endif // !EAR_ERR_SZ
 
-// forward declaration
+// size of the key identifier returned by ear_get_verification_context()
+#define EAR_KEY_ID_SZ 32
+
+// forward declarations
 typedef struct ear_s ear_t;
+typedef struct ear_verifier_s ear_verifier_t;
+typedef struct ear_replay_guard_s ear_replay_guard_t;
+typedef struct ear_cache_s ear_cache_t;
+typedef struct ear_jwt_parsed_s ear_jwt_parsed_t;
+typedef struct ear_query_s ear_query_t;
+typedef struct evp_pkey_st EVP_PKEY; // from OpenSSL
+typedef struct evp_md_ctx_st EVP_MD_CTX; // from OpenSSL
 
 typedef enum {
   EAR_TIER_NONE,
@@ -25,6 +35,107 @@ typedef enum {
   EAR_TIER_CONTRAINDICATED
 } ear_tier_t;
 
+// Error codes, as returned by ear_verifier_jwt_gate() and carried by the
+// library's USDT probes
+typedef enum {
+  EAR_OK = 0,
+  EAR_ERR_ALG,                // unknown or unsupported JWT algorithm
+  EAR_ERR_KEY,                // unusable verification key
+  EAR_ERR_ALLOC,              // out of memory
+  EAR_ERR_MALFORMED,          // not a JWS in compact serialization
+  EAR_ERR_HEADER,             // header is not base64url encoded JSON
+  EAR_ERR_ALG_MISMATCH,       // header "alg" is not the expected algorithm
+  EAR_ERR_SIGNATURE,          // signature verification failed
+  EAR_ERR_PAYLOAD,            // payload is not a base64url encoded JSON object
+  EAR_ERR_EXPIRED,            // "exp" is in the past
+  EAR_ERR_NOT_YET_VALID,      // "nbf" is in the future
+  EAR_ERR_HEADER_CLAIM,       // header claim differs from the claims-set
+  EAR_ERR_PROFILE,            // missing or unknown "eat_profile"
+  EAR_ERR_SUBMODS,            // missing or malformed "submods"
+  EAR_ERR_NO_APP_REC,         // no such appraisal record
+  EAR_ERR_STATUS,             // missing or unknown "ear.status"
+  EAR_ERR_AKPUB,              // missing or malformed "akpub"
+  EAR_ERR_JTI,                // missing or malformed "jti"
+  EAR_ERR_REPLAY,             // "jti" has already been seen
+  EAR_ERR_REPLAY_FULL,        // the replay guard has no room left
+  EAR_ERR_SNAPSHOT,           // malformed EAR snapshot
+  EAR_ERR_CACHE,              // unusable verified-EAR cache
+  EAR_ERR_CACHE_MISS,         // token not in the cache (never reported)
+  EAR_ERR_NO_CLAIM,           // claim not in the EAR
+  EAR_ERR_TIER,               // appraisal record below the gate's tier
+  EAR_ERR_LIMIT_TOKEN,        // token larger than the verifier's limit
+  EAR_ERR_LIMIT_SUBMODS,      // more appraisal records than the limit
+  EAR_ERR_LIMIT_STRING,       // string longer than the limit
+  EAR_ERR_LIMIT_DEPTH,        // nested deeper than the limit
+  EAR_ERR_LIMIT_RAW_EVIDENCE, // "ear.raw-evidence" larger than the limit
+} ear_err_t;
+
+// what a verifier accepts at most, see ear_verifier_set_limits(); 0 is no
+// limit
+typedef struct ear_limits_s {
+  size_t max_token_sz;        // bytes of the token
+  size_t max_submods;         // appraisal records
+  size_t max_str_sz;          // bytes of any string, member names included
+  unsigned max_depth;         // nesting of objects and arrays, the claims-set
+                              // itself being 1
+  size_t max_raw_evidence_sz; // bytes of "ear.raw-evidence", as encoded
+} ear_limits_t;
+
+// the top-level claims read by ear_get_time() and ear_get_string()
+typedef enum {
+  EAR_CLAIM_IAT,                // "iat" (time)
+  EAR_CLAIM_NBF,                // "nbf" (time)
+  EAR_CLAIM_EXP,                // "exp" (time)
+  EAR_CLAIM_PROFILE,            // "eat_profile" (string)
+  EAR_CLAIM_JTI,                // "jti" (string)
+  EAR_CLAIM_VERIFIER_BUILD,     // "build" of "ear.verifier-id" (string)
+  EAR_CLAIM_VERIFIER_DEVELOPER, // "developer" of "ear.verifier-id" (string)
+} ear_claim_t;
+
+// the claims of an "ear.trustworthiness-vector", in CBOR key order
+typedef enum {
+  EAR_TV_INSTANCE_IDENTITY,
+  EAR_TV_CONFIGURATION,
+  EAR_TV_EXECUTABLES,
+  EAR_TV_FILE_SYSTEM,
+  EAR_TV_HARDWARE,
+  EAR_TV_RUNTIME_OPAQUE,
+  EAR_TV_STORAGE_OPAQUE,
+  EAR_TV_SOURCED_DATA,
+  EAR_TV_CLAIMS // number of claims
+} ear_tv_claim_t;
+
+// a trustworthiness vector: claims[i] is only meaningful if bit i of present
+// is set
+typedef struct ear_tvec_s {
+  uint32_t present;
+  int8_t claims[EAR_TV_CLAIMS];
+} ear_tvec_t;
+
+// a run of bytes, borrowed
+typedef struct ear_slice_s {
+  const uint8_t *ptr;
+  size_t sz;
+} ear_slice_t;
+
+// an appraisal record name, as interned by ear_app_rec_intern()
+typedef uint32_t ear_app_rec_id_t;
+
+// the type of the values yielded by a claim-path query
+typedef enum {
+  EAR_VALUE_INT,    // i
+  EAR_VALUE_STRING, // s, NUL-terminated (the NUL is not counted in s.sz)
+  EAR_VALUE_BYTES,  // s
+  EAR_VALUE_TIER,   // i is an ear_tier_t, s the "ear.status" string
+} ear_value_type_t;
+
+// a value yielded by a claim-path query, borrowed from the EAR
+typedef struct ear_value_s {
+  const char *app_rec; // the record it is from, NULL for a top-level claim
+  int64_t i;
+  ear_slice_t s;
+} ear_value_t;
+
 /**
  * @brief Verify an EAT Attestation Result in JWT format.
  *
@@ -54,6 +165,610 @@ typedef enum {
 int ear_jwt_verify(const char *ear_jwt, const uint8_t *pkey, size_t pkey_sz,
                    const char *alg, ear_t **pear, char err_msg[EAR_ERR_SZ]);
 
+/**
+ * @brief Create a verification context for EARs.
+ *
+ * Parse the supplied key once, so that it can be used for any number of
+ * subsequent calls to ear_verifier_jwt_verify() or ear_verifier_cwt_verify().
+ * A verifier is read-only after creation and can be shared among threads:
+ * each thread keeps its own reusable OpenSSL contexts, so concurrent
+ * verifications do no context allocation in steady state.
+ *
+ * @param[in]   pkey      The public key for verification.  The format is
+ *                        described in Section 13 of RFC7468.  For the HS*
+ *                        algorithms, the raw shared secret
+ * @param[in]   pkey_sz   Size in bytes of @p pkey
+ * @param[in]   alg       NUL-terminated C string with the JWT algorithm to use
+ *                        for verifying the EAR (e.g., "ES256", "RS256")
+ * @param[out]  pverifier Pointer to a ear_verifier_t object which, on success,
+ *                        will be populated with the verification context.
+ *                        The object is owned by the caller who needs to take
+ *                        care of its disposal using ear_verifier_free()
+ * @param[out]  err_msg   pointer to a pre-allocated buffer (of at least
+ *                        @c EAR_ERR_SZ bytes) which, on failure, will be
+ *                        filled in by the callee with a human readable error
+ *                        message.  This can be set to NULL if no extra error
+ *                        reporting is required
+ *
+ * @retval  0   on success
+ * @retval  -1  on failure
+ */
+int ear_verifier_new(const uint8_t *pkey, size_t pkey_sz, const char *alg,
+                     ear_verifier_t **pverifier, char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Verify an EAT Attestation Result in JWT format using a verifier.
+ *
+ * Same as ear_jwt_verify(), but using the key and algorithm held by the
+ * supplied verification context.
+ *
+ * @param[in]   verifier  a verification context created by ear_verifier_new()
+ * @param[in]   ear_jwt   NUL-terminated C string with the JWT carrying the EAR
+ *                        claims-set
+ * @param[out]  pear      Pointer to a ear_t object which, on success, will be
+ *                        populated with the EAR claims-set.
+ *                        The object is owned by the caller who needs to take
+ *                        care of its disposal using ear_free()
+ * @param[out]  err_msg   pointer to a pre-allocated buffer (of at least
+ *                        @c EAR_ERR_SZ bytes) which, on failure, will be
+ *                        filled in by the callee with a human readable error
+ *                        message.  This can be set to NULL if no extra error
+ *                        reporting is required
+ *
+ * @retval  0   on success
+ * @retval  -1  on failure
+ */
+int ear_verifier_jwt_verify(const ear_verifier_t *verifier, const char *ear_jwt,
+                            ear_t **pear, char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Verify an EAT Attestation Result in CWT format.
+ *
+ * Verify an EAT Attestation Result serialized as a CWT (a COSE_Sign1,
+ * optionally tagged, with a CBOR claims-set) using the supplied public key.
+ * On success, the decoded EAR claims-set is returned.  The resulting ear_t
+ * is the same as for the JWT serialization of the same claims: every accessor
+ * works on it, and claims are presented under their JSON names and encodings.
+ *
+ * @param[in]   ear_cwt     Buffer with the CWT carrying the EAR claims-set
+ * @param[in]   ear_cwt_sz  Size in bytes of @p ear_cwt
+ * @param[in]   pkey        The public key for verification.  The format is
+ *                          described in Section 13 of RFC7468
+ * @param[in]   pkey_sz     Size in bytes of @p pkey
+ * @param[in]   alg         NUL-terminated C string with the JWT name of the
+ *                          algorithm to use for verifying the EAR (e.g.,
+ *                          "ES256" for COSE algorithm -7)
+ * @param[out]  pear        Pointer to a ear_t object which, on success, will
+ *                          be populated with the EAR claims-set.
+ *                          The object is owned by the caller who needs to take
+ *                          care of its disposal using ear_free()
+ * @param[out]  err_msg     pointer to a pre-allocated buffer (of at least
+ *                          @c EAR_ERR_SZ bytes) which, on failure, will be
+ *                          filled in by the callee with a human readable error
+ *                          message.  This can be set to NULL if no extra error
+ *                          reporting is required
+ *
+ * @retval  0   on success
+ * @retval  -1  on failure
+ */
+int ear_cwt_verify(const uint8_t *ear_cwt, size_t ear_cwt_sz,
+                   const uint8_t *pkey, size_t pkey_sz, const char *alg,
+                   ear_t **pear, char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Verify an EAT Attestation Result in CWT format using a verifier.
+ *
+ * Same as ear_cwt_verify(), but using the key and algorithm held by the
+ * supplied verification context.
+ *
+ * @param[in]   verifier    a verification context created by
+ *                          ear_verifier_new()
+ * @param[in]   ear_cwt     Buffer with the CWT carrying the EAR claims-set
+ * @param[in]   ear_cwt_sz  Size in bytes of @p ear_cwt
+ * @param[out]  pear        Pointer to a ear_t object which, on success, will
+ *                          be populated with the EAR claims-set.
+ *                          The object is owned by the caller who needs to take
+ *                          care of its disposal using ear_free()
+ * @param[out]  err_msg     pointer to a pre-allocated buffer (of at least
+ *                          @c EAR_ERR_SZ bytes) which, on failure, will be
+ *                          filled in by the callee with a human readable error
+ *                          message.  This can be set to NULL if no extra error
+ *                          reporting is required
+ *
+ * @retval  0   on success
+ * @retval  -1  on failure
+ */
+int ear_verifier_cwt_verify(const ear_verifier_t *verifier,
+                            const uint8_t *ear_cwt, size_t ear_cwt_sz,
+                            ear_t **pear, char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Verify an EAR in JWT format into an existing ear_t object.
+ *
+ * Same as ear_verifier_jwt_verify(), but the result replaces the contents of
+ * @p ear, whose buffers are reused as they are whenever they are large enough.
+ * A loop that verifies one EAR after another into the same object does next
+ * to no heap allocation of its own once warmed up.  On failure @p ear is left
+ * empty: it can be passed to this function again, or to ear_free(), but to
+ * nothing else.
+ *
+ * @param[in]     verifier  a verification context created by
+ *                          ear_verifier_new()
+ * @param[in]     ear_jwt   NUL-terminated C string with the JWT carrying the
+ *                          EAR claims-set
+ * @param[in,out] ear       an ear_t object returned by any of the verify
+ *                          functions, on which the caller holds the only
+ *                          reference (see ear_ref())
+ * @param[out]    err_msg   pointer to a pre-allocated buffer (of at least
+ *                          @c EAR_ERR_SZ bytes) which, on failure, will be
+ *                          filled in by the callee with a human readable error
+ *                          message.  This can be set to NULL if no extra error
+ *                          reporting is required
+ *
+ * @retval  0   on success
+ * @retval  -1  on failure
+ */
+int ear_verifier_jwt_reverify(const ear_verifier_t *verifier,
+                              const char *ear_jwt, ear_t *ear,
+                              char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Verify an EAR in CWT format into an existing ear_t object.
+ *
+ * The CWT counterpart of ear_verifier_jwt_reverify().
+ *
+ * @param[in]     verifier    a verification context created by
+ *                            ear_verifier_new()
+ * @param[in]     ear_cwt     Buffer with the CWT carrying the EAR claims-set
+ * @param[in]     ear_cwt_sz  Size in bytes of @p ear_cwt
+ * @param[in,out] ear         an ear_t object on which the caller holds the
+ *                            only reference
+ * @param[out]    err_msg     pointer to a pre-allocated buffer (of at least
+ *                            @c EAR_ERR_SZ bytes) which, on failure, will be
+ *                            filled in by the callee with a human readable
+ *                            error message.  This can be set to NULL if no
+ *                            extra error reporting is required
+ *
+ * @retval  0   on success
+ * @retval  -1  on failure
+ */
+int ear_verifier_cwt_reverify(const ear_verifier_t *verifier,
+                              const uint8_t *ear_cwt, size_t ear_cwt_sz,
+                              ear_t *ear, char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Verify an EAR in JWT format and gate on its appraisal status.
+ *
+ * Answers whether @p ear_jwt is an authentic, valid EAR (as
+ * ear_verifier_jwt_verify() has it, replay guard included) in which the
+ * appraisal record @p app_rec, or else every record, has a status of
+ * @p min_tier or better.  An EAR with no appraisal record at all counts as
+ * having a status of @c EAR_TIER_NONE.
+ *
+ * No ear_t is built, and the verified-EAR cache is neither consulted nor
+ * filled.  Once the calling thread has verified an EAR of the same size, the
+ * library does no heap allocation of its own; whatever OpenSSL does to check
+ * the signature remains.
+ *
+ * @param[in]   verifier  a verification context created by ear_verifier_new()
+ * @param[in]   ear_jwt   NUL-terminated C string with the JWT carrying the EAR
+ *                        claims-set
+ * @param[in]   app_rec   the name of the appraisal record to gate on, or NULL
+ *                        to gate on all of them
+ * @param[in]   min_tier  the least acceptable status
+ *
+ * @retval  EAR_OK          the EAR is valid and passes the gate
+ * @retval  EAR_ERR_TIER    the EAR is valid, but @p app_rec (or one of the
+ *                          records) is below @p min_tier
+ * @retval  EAR_ERR_NO_APP_REC  the EAR is valid, but has no @p app_rec
+ * @retval  other           why the EAR is not valid
+ */
+ear_err_t ear_verifier_jwt_gate(const ear_verifier_t *verifier,
+                                const char *ear_jwt, const char *app_rec,
+                                ear_tier_t min_tier);
+
+/**
+ * @brief Verify an EAR in JWT format in place, in a buffer given up to it.
+ *
+ * Same as ear_verifier_jwt_verify(), but @p buf, which holds the JWT, is
+ * worked in: once the signature is checked, the payload is base64-decoded
+ * and scanned where it lies, and the summary of the claims-set that the
+ * accessors read is laid out in what is left of @p buf.  Every string
+ * returned by the accessors (application record names, statuses, akpub)
+ * then points into @p buf, and the verification allocates nothing.  The
+ * summary needs room for the decoded strings and a few dozen bytes per
+ * submod on top of the decoded payload: when @p buf_sz leaves too little, it
+ * goes to memory owned by the ear_t as usual, which is also where an EAR
+ * served from the cache of verified EARs is.
+ *
+ * The contents of @p buf are overwritten, whether the verification succeeds
+ * or not, and on success @p buf must stay untouched until the ear_t object
+ * is disposed of.
+ *
+ * @param[in]     verifier  a verification context created by
+ *                          ear_verifier_new()
+ * @param[in,out] buf       Buffer starting with the NUL-terminated JWT
+ *                          carrying the EAR claims-set
+ * @param[in]     buf_sz    Size in bytes of @p buf, at least that of the JWT
+ *                          and its NUL
+ * @param[out]    pear      Pointer to a ear_t object which, on success, will
+ *                          be populated with the EAR claims-set.
+ *                          The object is owned by the caller who needs to take
+ *                          care of its disposal using ear_free(), before
+ *                          @p buf is released or reused
+ * @param[out]    err_msg   pointer to a pre-allocated buffer (of at least
+ *                          @c EAR_ERR_SZ bytes) which, on failure, will be
+ *                          filled in by the callee with a human readable error
+ *                          message.  This can be set to NULL if no extra error
+ *                          reporting is required
+ *
+ * @retval  0   on success
+ * @retval  -1  on failure
+ */
+int ear_verifier_jwt_verify_inplace(const ear_verifier_t *verifier, char *buf,
+                                    size_t buf_sz, ear_t **pear,
+                                    char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Decode an EAR in JWT format, without verifying it.
+ *
+ * This is the first half of ear_verifier_jwt_verify(): the header and the
+ * claims-set are decoded once, so that the caller can pick the key (or
+ * tenant) from them with ear_jwt_parsed_get_info() before handing the same
+ * handle to ear_jwt_verify_parsed().  Nothing read from an unverified handle
+ * can be trusted.
+ *
+ * There is no verifier, and so there are no limits (see
+ * ear_verifier_set_limits()) on the decoding: the whole claims-set is decoded,
+ * at a cost that grows with the size of @p ear_jwt, before anything checks it.
+ * Bound the size of the token before handing it over when it comes from
+ * untrusted sources.  ear_jwt_verify_parsed() applies the limits of its
+ * verifier to the decoded claims-set.
+ *
+ * @param[in]   ear_jwt NUL-terminated C string with the JWT carrying the EAR
+ *                      claims-set.  It is copied
+ * @param[out]  pparsed Pointer to a ear_jwt_parsed_t object which, on success,
+ *                      will be populated with the decoded JWT.
+ *                      The object is owned by the caller who needs to take
+ *                      care of its disposal using ear_jwt_parsed_free()
+ * @param[out]  err_msg pointer to a pre-allocated buffer (of at least
+ *                      @c EAR_ERR_SZ bytes) which, on failure, will be filled
+ *                      in by the callee with a human readable error message.
+ *                      This can be set to NULL if no extra error reporting is
+ *                      required
+ *
+ * @retval  0   on success
+ * @retval  -1  on failure
+ */
+int ear_jwt_parse(const char *ear_jwt, ear_jwt_parsed_t **pparsed,
+                  char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Return the routing information of a decoded, unverified, EAR JWT.
+ *
+ * Any output parameter can be NULL.  Each is set to NULL if the JWT does not
+ * carry it as a string.  The strings are owned by @p parsed.
+ *
+ * @param[in]   parsed    an ear_jwt_parsed_t object
+ * @param[out]  palg      set to the header "alg"
+ * @param[out]  pkid      set to the header "kid"
+ * @param[out]  piss      set to the "iss" claim
+ * @param[out]  pprofile  set to the "eat_profile" claim
+ *
+ * @retval  0   on success
+ */
+int ear_jwt_parsed_get_info(const ear_jwt_parsed_t *parsed, const char **palg,
+                            const char **pkid, const char **piss,
+                            const char **pprofile);
+
+/**
+ * @brief Verify an EAR JWT decoded by ear_jwt_parse().
+ *
+ * Same as ear_verifier_jwt_verify(), minus the decoding: only the signature
+ * is checked and the claims-set validated.  The verified-EAR cache is not
+ * consulted.  @p parsed is left as it is, and can be verified again, e.g.,
+ * with another key.
+ *
+ * @param[in]   verifier  a verification context created by
+ *                        ear_verifier_new()
+ * @param[in]   parsed    an ear_jwt_parsed_t object
+ * @param[out]  pear      Pointer to a ear_t object which, on success, will be
+ *                        populated with the EAR claims-set.
+ *                        The object is owned by the caller who needs to take
+ *                        care of its disposal using ear_free()
+ * @param[out]  err_msg   pointer to a pre-allocated buffer (of at least
+ *                        @c EAR_ERR_SZ bytes) which, on failure, will be
+ *                        filled in by the callee with a human readable error
+ *                        message.  This can be set to NULL if no extra error
+ *                        reporting is required
+ *
+ * @retval  0   on success
+ * @retval  -1  on failure
+ */
+int ear_jwt_verify_parsed(const ear_verifier_t *verifier,
+                          const ear_jwt_parsed_t *parsed, ear_t **pear,
+                          char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Free an ear_jwt_parsed_t object
+ *
+ * @param parsed the ear_jwt_parsed_t object to free, or NULL
+ */
+void ear_jwt_parsed_free(ear_jwt_parsed_t *parsed);
+
+/**
+ * @brief Free an ear_verifier_t object allocated by ear_verifier_new
+ *
+ * @param verifier the ear_verifier_t object to free
+ */
+void ear_verifier_free(ear_verifier_t *verifier);
+
+/**
+ * @brief Bound what @p verifier accepts.
+ *
+ * A token over any of the limits fails verification with the matching
+ * EAR_ERR_LIMIT_* code.  The token size is checked first of all, and the
+ * signature before the claims-set is decoded.  The rest is checked as the
+ * claims-set is decoded, which stops at the first string, record or nesting
+ * level over the limit, for claims-sets in the subset of JSON that the
+ * library's own decoder handles.  Others (with escapes in strings, integers
+ * of more than 18 digits, or more than 64 appraisal records, say) and CWT
+ * claims-sets are decoded whole before they are checked: the cost of a
+ * hostile token is then bounded by its size, and so by @c max_token_sz only.
+ * Set that limit for tokens from untrusted sources.
+ *
+ * Strings are measured as JSON: for a CWT, byte strings count as their
+ * base64url encoding.  A verifier with a cache (see ear_verifier_set_cache())
+ * only gets hits on the EARs verified within the same limits, whoever else
+ * shares the cache.
+ *
+ * Call this before sharing the verifier among threads.  Verifiers start out
+ * with no limits, as does the one that ear_jwt_verify() and ear_cwt_verify()
+ * use.
+ *
+ * @param verifier  a verification context created by ear_verifier_new()
+ * @param limits    the limits to enforce, or NULL to lift them all
+ */
+void ear_verifier_set_limits(ear_verifier_t *verifier,
+                             const ear_limits_t *limits);
+
+/**
+ * @brief Create a replay guard for EAR "jti" values.
+ *
+ * Once attached to a verifier (see ear_verifier_set_replay_guard()) or
+ * installed process-wide (see ear_set_replay_guard()), the guard records the
+ * "jti" of each EAR that passes verification until the EAR expires ("exp",
+ * or @p default_ttl seconds after verification when there is none), and
+ * any later EAR carrying a recorded "jti" fails verification.  EARs without
+ * a "jti" fail verification too.
+ *
+ * All memory is allocated here, about 32 bytes per unit of @p capacity.
+ * When roughly @p capacity unexpired values are recorded, verification fails
+ * closed until some of them expire.
+ *
+ * Values are stored as keyed 64-bit fingerprints, so a "jti" never seen
+ * before is mistaken for a replay with probability n / 2^64, where n is the
+ * number of unexpired entries (about 5e-14 with a million).
+ *
+ * The guard is sharded and internally locked, and can be shared by any
+ * number of verifiers and threads.
+ *
+ * @param[in]   capacity    The number of unexpired values to make room for
+ * @param[in]   default_ttl Seconds to remember the "jti" of EARs without "exp"
+ * @param[out]  pguard      Pointer to a ear_replay_guard_t object which, on
+ *                          success, will be populated with the new guard.
+ *                          The object is owned by the caller who needs to
+ *                          take care of its disposal using
+ *                          ear_replay_guard_free(), after any verifier using
+ *                          it is done
+ * @param[out]  err_msg     pointer to a pre-allocated buffer (of at least
+ *                          @c EAR_ERR_SZ bytes) which, on failure, will be
+ *                          filled in by the callee with a human readable
+ *                          error message.  This can be set to NULL if no
+ *                          extra error reporting is required
+ *
+ * @retval  0   on success
+ * @retval  -1  on failure
+ */
+int ear_replay_guard_new(size_t capacity, unsigned default_ttl,
+                         ear_replay_guard_t **pguard,
+                         char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Record a "jti" value, failing if it is already recorded.
+ *
+ * This is the check done during verification, for callers that obtain jti
+ * values some other way.
+ *
+ * @param[in]   guard   a replay guard created by ear_replay_guard_new()
+ * @param[in]   jti     the "jti" value
+ * @param[in]   jti_sz  Size in bytes of @p jti
+ * @param[in]   exp     Time (seconds since the Epoch) until which to remember
+ *                      @p jti, or 0 for the guard's default TTL
+ * @param[out]  err_msg pointer to a pre-allocated buffer (of at least
+ *                      @c EAR_ERR_SZ bytes) which, on failure, will be filled
+ *                      in by the callee with a human readable error message.
+ *                      This can be set to NULL if no extra error reporting is
+ *                      required
+ *
+ * @retval  0   if @p jti was not recorded and now is
+ * @retval  -1  if @p jti is a replay, or the guard is full
+ */
+int ear_replay_guard_check(ear_replay_guard_t *guard, const char *jti,
+                           size_t jti_sz, int64_t exp,
+                           char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Free an ear_replay_guard_t object allocated by ear_replay_guard_new
+ *
+ * @param guard the ear_replay_guard_t object to free
+ */
+void ear_replay_guard_free(ear_replay_guard_t *guard);
+
+/**
+ * @brief Reject replayed EARs verified with @p verifier.
+ *
+ * Call this before sharing the verifier among threads.  A verifier's own
+ * guard takes precedence over the process-wide one.
+ *
+ * @param verifier  a verification context created by ear_verifier_new()
+ * @param guard     the replay guard to use, or NULL to stop using one
+ */
+void ear_verifier_set_replay_guard(ear_verifier_t *verifier,
+                                   ear_replay_guard_t *guard);
+
+/**
+ * @brief Reject replayed EARs in ear_jwt_verify() and in any verifier
+ *        without a replay guard of its own.
+ *
+ * @param guard the replay guard to use, or NULL to stop using one
+ */
+void ear_set_replay_guard(ear_replay_guard_t *guard);
+
+/**
+ * @brief Open (or create) a cache of verified EARs shared between processes.
+ *
+ * Once attached to a verifier (see ear_verifier_set_cache()) or installed
+ * process-wide (see ear_set_cache()), the cache is looked up by the SHA-256
+ * of each token before verifying it, and a token found there skips signature
+ * verification and decoding: its EAR is rebuilt from the stored snapshot
+ * (see ear_snapshot()).  Tokens that pass verification are stored, until
+ * they expire ("exp") and for at most @p ttl seconds.  A snapshot is only
+ * used by a verifier with the same algorithm and key as the one that stored
+ * it, and a cached EAR is still subject to the replay guard, if any.
+ *
+ * With a @p name, the cache is a POSIX shared memory object (see
+ * shm_open(3)) that any process opening the same name attaches to.  The
+ * first process to open it sizes it, and later ones use its size regardless
+ * of @p capacity and @p max_snap_sz.  Should that process die before it is
+ * done, the next one to open the object sizes it instead.  The object lives
+ * until shm_unlink(3).
+ * With a NULL @p name, the cache is anonymous memory shared with the
+ * children forked afterwards.
+ *
+ * Readers and writers never block each other: each entry is protected by a
+ * sequence lock and a checksum, and a process dying while writing an entry
+ * only loses that entry.
+ *
+ * An existing shared memory object is refused unless it is owned by the
+ * effective user and writable by nobody else.
+ *
+ * @param[in]   name        name of the shared memory object, or NULL
+ * @param[in]   capacity    The number of EARs to make room for
+ * @param[in]   max_snap_sz Size in bytes of the largest snapshot to cache
+ * @param[in]   ttl         Seconds for which an EAR is cached at most
+ * @param[out]  pcache      Pointer to a ear_cache_t object which, on
+ *                          success, will be populated with the cache.  The
+ *                          object is owned by the caller who needs to take
+ *                          care of its disposal using ear_cache_close(),
+ *                          after any verifier using it is done
+ * @param[out]  err_msg     pointer to a pre-allocated buffer (of at least
+ *                          @c EAR_ERR_SZ bytes) which, on failure, will be
+ *                          filled in by the callee with a human readable
+ *                          error message.  This can be set to NULL if no
+ *                          extra error reporting is required
+ *
+ * @retval  0   on success
+ * @retval  -1  on failure
+ */
+int ear_cache_open(const char *name, size_t capacity, size_t max_snap_sz,
+                   unsigned ttl, ear_cache_t **pcache,
+                   char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Open (or create) a cache of verified EARs kept in a file.
+ *
+ * This is the cache of ear_cache_open(), mapped from the regular file at
+ * @p path so that it outlives the processes using it: after a restart,
+ * tokens verified before are cache hits straight away.  Entries are bound to
+ * the algorithm and key that verified them, expire as they would in memory,
+ * and carry a checksum that is checked on every lookup.  The checksum only
+ * catches entries left half-written: it is not a MAC, and its seed is stored
+ * in the file, so anyone able to write the file can forge entries.
+ *
+ * The file is created with mode 0600, and never seen half-initialised by
+ * other processes opening it concurrently.  Since an entry in the file
+ * stands for a verified signature, an existing file is refused unless it is
+ * owned by the effective user and writable by nobody else.  A file of an
+ * incompatible version (or byte order) is refused too, and must be removed.
+ *
+ * With a non-zero @p compact_interval, a thread reclaims expired and
+ * abandoned entries every @p compact_interval seconds (see
+ * ear_cache_compact()) until the cache is closed.
+ *
+ * @param[in]   path                the cache file
+ * @param[in]   capacity            as for ear_cache_open()
+ * @param[in]   max_snap_sz         as for ear_cache_open()
+ * @param[in]   ttl                 as for ear_cache_open()
+ * @param[in]   compact_interval    Seconds between compactions, or 0 for
+ *                                  none
+ * @param[out]  pcache              as for ear_cache_open()
+ * @param[out]  err_msg             pointer to a pre-allocated buffer (of at
+ *                                  least @c EAR_ERR_SZ bytes) which, on
+ *                                  failure, will be filled in by the callee
+ *                                  with a human readable error message.
+ *                                  This can be set to NULL if no extra error
+ *                                  reporting is required
+ *
+ * @retval  0   on success
+ * @retval  -1  on failure
+ */
+int ear_cache_open_file(const char *path, size_t capacity, size_t max_snap_sz,
+                        unsigned ttl, unsigned compact_interval,
+                        ear_cache_t **pcache, char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Reclaim the expired entries of a cache, and those left behind by
+ *        processes that died while writing them.
+ *
+ * Lookups and stores carry on meanwhile.  For a file cache, the changes are
+ * also scheduled for writing back.
+ *
+ * @param[in]   cache   a cache opened by ear_cache_open() or
+ *                      ear_cache_open_file()
+ *
+ * @return the number of entries reclaimed
+ */
+size_t ear_cache_compact(ear_cache_t *cache);
+
+/**
+ * @brief Report the lookups that hit and missed a cache, in all processes.
+ *
+ * @param[in]   cache   a cache opened by ear_cache_open()
+ * @param[out]  phits   hits so far, or NULL
+ * @param[out]  pmisses misses so far, or NULL
+ *
+ * @retval  0   always
+ */
+int ear_cache_stats(const ear_cache_t *cache, uint64_t *phits,
+                    uint64_t *pmisses);
+
+/**
+ * @brief Detach from a cache opened by ear_cache_open or ear_cache_open_file
+ *
+ * @param cache the ear_cache_t object to close
+ */
+void ear_cache_close(ear_cache_t *cache);
+
+/**
+ * @brief Cache the EARs verified with @p verifier.
+ *
+ * Call this before sharing the verifier among threads.  A verifier's own
+ * cache takes precedence over the process-wide one.
+ *
+ * @param verifier  a verification context created by ear_verifier_new()
+ * @param cache     the cache to use, or NULL to stop using one
+ */
+void ear_verifier_set_cache(ear_verifier_t *verifier, ear_cache_t *cache);
+
+/**
+ * @brief Cache the EARs verified by ear_jwt_verify(), ear_cwt_verify() and
+ *        any verifier without a cache of its own.
+ *
+ * @param cache the cache to use, or NULL to stop using one
+ */
+void ear_set_cache(ear_cache_t *cache);
+
 /**
  * @brief Output a list of all of the appraisal records in the given EAR.
  *
@@ -79,7 +794,8 @@ int ear_jwt_verify(const char *ear_jwt, const uint8_t *pkey, size_t pkey_sz,
  * @retval  0   on success
  * @retval  -1  on failure
  */
-int ear_get_app_recs(ear_t *ear, const char ***papp_rec, size_t *papp_rec_sz);
+int ear_get_app_recs(const ear_t *ear, const char ***papp_rec,
+                     size_t *papp_rec_sz);
 
 /**
  * @brief Return the "ear.status" value of the specified appraisal record
@@ -103,9 +819,339 @@ int ear_get_app_recs(ear_t *ear, const char ***papp_rec, size_t *papp_rec_sz);
  * @retval  0   on success
  * @retval  -1  on failure
  */
-int ear_get_status(ear_t *ear, const char *app_rec, ear_tier_t *ptier,
+int ear_get_status(const ear_t *ear, const char *app_rec, ear_tier_t *ptier,
                    char err_msg[EAR_ERR_SZ]);
 
+/**
+ * @brief Return the worst "ear.status" of all the appraisal records
+ *
+ * The aggregate is worked out at verification, so that checking whether
+ * everything is affirming is a single comparison.  From best to worst, the
+ * tiers rank @c EAR_TIER_AFFIRMING, @c EAR_TIER_NONE, @c EAR_TIER_WARNING
+ * and @c EAR_TIER_CONTRAINDICATED: "none" affirms nothing, but flags nothing
+ * either.  A record whose "ear.status" is missing or unknown counts as
+ * @c EAR_TIER_NONE, and so does an EAR without any record.
+ *
+ * @param[in]   ear     an ear_t object returned from a successful invocation of
+ *                      ear_jwt_verify
+ *
+ * @return  the worst tier
+ */
+ear_tier_t ear_get_worst_tier(const ear_t *ear);
+
+/**
+ * @brief Return the "ear.status" value of every appraisal record at once
+ *
+ * @p tiers is filled in record order, which is that of ear_get_app_recs(),
+ * with the tiers worked out at verification: nothing is looked up, parsed or
+ * allocated.  A record whose "ear.status" is missing or unknown gets
+ * @c EAR_TIER_NONE, as in ear_get_worst_tier(); ear_get_status() tells which.
+ *
+ * @param[in]   ear       an ear_t object returned from a successful invocation
+ *                        of ear_jwt_verify
+ * @param[out]  tiers     array filled in with the tier of the first
+ *                        @p tiers_sz records.  Can be NULL if @p tiers_sz is 0
+ * @param[in]   tiers_sz  Number of entries in @p tiers
+ *
+ * @return  the number of appraisal records, which may be more than
+ *          @p tiers_sz
+ */
+size_t ear_get_tiers(const ear_t *ear, ear_tier_t *tiers, size_t tiers_sz);
+
+/**
+ * @brief Intern an appraisal record name, for the ear_batch_* accessors
+ *
+ * The same name always gets the same ID, which stays valid for the life of
+ * the process.  Up to 4096 distinct names can be interned, all of them by
+ * the caller (here or through ear_query_compile()): the names in EARs are
+ * only ever looked up.
+ *
+ * @param[in]   app_rec the submod name for the appraisal record
+ * @param[out]  pid     set to the ID of @p app_rec
+ * @param[out]  err_msg pointer to a pre-allocated buffer (of at least @c
+ *                      EAR_ERR_SZ bytes) which, on failure, will be filled in
+ *                      by the callee with a human readable error message.  This
+ *                      can be set to NULL if no extra error reporting is
+ *                      required
+ *
+ * @retval  0   on success
+ * @retval  -1  on failure
+ */
+int ear_app_rec_intern(const char *app_rec, ear_app_rec_id_t *pid,
+                       char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Return the "ear.status" of the same appraisal record in many EARs
+ *
+ * tiers[i] is set to the tier of record @p id in ears[i], as by
+ * ear_get_tiers(): @c EAR_TIER_NONE if the record is there without a usable
+ * "ear.status", and also if it is not there at all.  Each EAR matches record
+ * IDs to its records once, on first use, after which a lookup compares a few
+ * integers: there is no hashing or string comparison per EAR.
+ *
+ * @param[in]   ears    the EARs, which may be shared with other threads
+ * @param[in]   ears_sz Number of entries in @p ears
+ * @param[in]   id      the record, from ear_app_rec_intern()
+ * @param[out]  tiers   array of @p ears_sz entries, filled in
+ *
+ * @return  the number of EARs that have record @p id
+ */
+size_t ear_batch_get_status(const ear_t *const *ears, size_t ears_sz,
+                            ear_app_rec_id_t id, ear_tier_t *tiers);
+
+/**
+ * @brief Return the "ear.trustworthiness-vector" of the same appraisal
+ *        record in many EARs
+ *
+ * Like ear_batch_get_status().  Only integer claims in the range of an
+ * @c int8_t are present; a record without a vector, or an EAR without the
+ * record, has none.
+ *
+ * @param[in]   ears    the EARs, which may be shared with other threads
+ * @param[in]   ears_sz Number of entries in @p ears
+ * @param[in]   id      the record, from ear_app_rec_intern()
+ * @param[out]  tvecs   array of @p ears_sz entries, filled in
+ *
+ * @return  the number of EARs that have record @p id
+ */
+size_t ear_batch_get_tvec(const ear_t *const *ears, size_t ears_sz,
+                          ear_app_rec_id_t id, ear_tvec_t *tvecs);
+
+/**
+ * @brief Borrow the attested public key of the same appraisal record in many
+ *        EARs
+ *
+ * Like ear_batch_get_status().  akpubs[i] is set to the DER of the key, as
+ * by ear_veraison_get_akpub_ref(), which is owned by ears[i]; or to
+ * {NULL, 0} if ears[i] has no such key for record @p id.
+ *
+ * @param[in]   ears    the EARs, which may be shared with other threads
+ * @param[in]   ears_sz Number of entries in @p ears
+ * @param[in]   id      the record, from ear_app_rec_intern()
+ * @param[out]  akpubs  array of @p ears_sz entries, filled in
+ *
+ * @return  the number of EARs that have record @p id
+ */
+size_t ear_batch_get_akpub(const ear_t *const *ears, size_t ears_sz,
+                           ear_app_rec_id_t id, ear_slice_t *akpubs);
+
+/**
+ * @brief Compile a claim path into a query
+ *
+ * The path names a claim by its JSON member names, separated by '/', as in
+ * a JSON Pointer (RFC 6901) without the leading '/'.  An appraisal record
+ * name may be "*" to match every record; a '/' or '~' in a record name is
+ * written "~1" or "~0".  The claims that can be queried, and the type of
+ * their values, are:
+ *
+ * - "iat", "nbf", "exp": @c EAR_VALUE_INT
+ * - "eat_profile", "jti", "ear.verifier-id/build",
+ *   "ear.verifier-id/developer": @c EAR_VALUE_STRING
+ * - "submods/<rec>/ear.status": @c EAR_VALUE_TIER
+ * - "submods/<rec>/ear.appraisal-policy-id": @c EAR_VALUE_STRING
+ * - "submods/<rec>/ear.veraison.key-attestation/akpub": @c EAR_VALUE_BYTES,
+ *   the DER of the key
+ * - "submods/<rec>/ear.trustworthiness-vector/<claim>": @c EAR_VALUE_INT
+ *
+ * The path is resolved here once: the record name is interned (see
+ * ear_app_rec_intern()), and the claim is mapped to where the EAR keeps it.
+ * The query can then be evaluated against any number of EARs, from any
+ * number of threads, with ear_query_eval().
+ *
+ * @param[in]   path    NUL-terminated claim path
+ * @param[out]  pquery  set to the compiled query, to be disposed of with
+ *                      ear_query_free()
+ * @param[out]  err_msg pointer to a pre-allocated buffer (of at least @c
+ *                      EAR_ERR_SZ bytes) which, on failure, will be filled in
+ *                      by the callee with a human readable error message.  This
+ *                      can be set to NULL if no extra error reporting is
+ *                      required
+ *
+ * @retval  0   on success
+ * @retval  -1  on failure
+ */
+int ear_query_compile(const char *path, ear_query_t **pquery,
+                      char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Return the type of the values yielded by a query
+ *
+ * @param[in]   query   a query returned by ear_query_compile()
+ *
+ * @return  the type of the values that ear_query_eval() yields for @p query
+ */
+ear_value_type_t ear_query_type(const ear_query_t *query);
+
+/**
+ * @brief Evaluate a query against an EAR
+ *
+ * Matches are yielded in record order, and borrowed from @p ear.  Nothing is
+ * allocated, and no string is hashed or compared, once @p ear has matched
+ * record IDs to its records (as for the ear_batch_* accessors).
+ *
+ * @param[in]   query     a query returned by ear_query_compile()
+ * @param[in]   ear       an ear_t object returned from a successful
+ *                        invocation of ear_jwt_verify
+ * @param[out]  values    array of at least @p values_sz entries, filled in
+ *                        with the first @p values_sz matches.  Can be NULL if
+ *                        @p values_sz is 0
+ * @param[in]   values_sz Number of entries in @p values
+ *
+ * @return  the number of matches, which may be more than @p values_sz
+ */
+size_t ear_query_eval(const ear_query_t *query, const ear_t *ear,
+                      ear_value_t *values, size_t values_sz);
+
+/**
+ * @brief Dispose of a query
+ *
+ * @param[in]   query   a query returned by ear_query_compile(), or NULL
+ */
+void ear_query_free(ear_query_t *query);
+
+/**
+ * @brief Return the "ear.appraisal-policy-id" value of the specified appraisal
+ *        record
+ *
+ * The value is borrowed from @p ear, and nothing is allocated.
+ *
+ * @param[in]   ear           an ear_t object returned from a successful
+ *                            invocation of ear_jwt_verify
+ * @param[in]   app_rec       the submod name for the appraisal record
+ * @param[out]  ppolicy_id    set to the NUL-terminated policy identifier,
+ *                            which is owned by @p ear
+ * @param[out]  ppolicy_id_sz set to its length in bytes, NUL excluded
+ * @param[out]  err_msg       pointer to a pre-allocated buffer (of at least
+ *                            @c EAR_ERR_SZ bytes) which, on failure, will be
+ *                            filled in by the callee with a human readable
+ *                            error message.  This can be set to NULL if no
+ *                            extra error reporting is required
+ *
+ * @retval  0   on success
+ * @retval  -1  on failure
+ */
+int ear_get_appraisal_policy_id(const ear_t *ear, const char *app_rec,
+                                const char **ppolicy_id, size_t *ppolicy_id_sz,
+                                char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Return a time claim of the EAR
+ *
+ * Times are decoded at verification, as whole seconds since the Epoch: those
+ * written as reals (e.g., "1.666529184e+09") have their fraction dropped.
+ *
+ * @param[in]   ear     an ear_t object returned from a successful invocation of
+ *                      ear_jwt_verify
+ * @param[in]   claim   @c EAR_CLAIM_IAT, @c EAR_CLAIM_NBF or @c EAR_CLAIM_EXP
+ * @param[out]  pt      set to the time of @p claim
+ * @param[out]  err_msg pointer to a pre-allocated buffer (of at least @c
+ *                      EAR_ERR_SZ bytes) which, on failure, will be filled in
+ *                      by the callee with a human readable error message.  This
+ *                      can be set to NULL if no extra error reporting is
+ *                      required
+ *
+ * @retval  0   on success
+ * @retval  -1  if the EAR does not have @p claim as a number
+ */
+int ear_get_time(const ear_t *ear, ear_claim_t claim, int64_t *pt,
+                 char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Return a string claim of the EAR
+ *
+ * The value is borrowed from @p ear, and nothing is allocated.
+ *
+ * @param[in]   ear     an ear_t object returned from a successful invocation of
+ *                      ear_jwt_verify
+ * @param[in]   claim   any of the string claims of ear_claim_t
+ * @param[out]  pstr    set to the NUL-terminated value of @p claim, which is
+ *                      owned by @p ear
+ * @param[out]  pstr_sz set to its length in bytes, NUL excluded
+ * @param[out]  err_msg pointer to a pre-allocated buffer (of at least @c
+ *                      EAR_ERR_SZ bytes) which, on failure, will be filled in
+ *                      by the callee with a human readable error message.  This
+ *                      can be set to NULL if no extra error reporting is
+ *                      required
+ *
+ * @retval  0   on success
+ * @retval  -1  if the EAR does not have @p claim as a string
+ */
+int ear_get_string(const ear_t *ear, ear_claim_t claim, const char **pstr,
+                   size_t *pstr_sz, char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Return the size of the evidence carried in "ear.raw-evidence"
+ *
+ * The EAR keeps the claim as the base64url string it came as, which is only
+ * decoded, a chunk at a time, by ear_raw_evidence_read() and
+ * ear_raw_evidence_digest().  A claim that is not valid base64 is only found
+ * out by them (padding is tolerated).
+ *
+ * @param[in]   ear     an ear_t object returned from a successful invocation of
+ *                      ear_jwt_verify
+ * @param[out]  psz     set to the size in bytes of the decoded evidence
+ * @param[out]  err_msg pointer to a pre-allocated buffer (of at least @c
+ *                      EAR_ERR_SZ bytes) which, on failure, will be filled in
+ *                      by the callee with a human readable error message.  This
+ *                      can be set to NULL if no extra error reporting is
+ *                      required
+ *
+ * @retval  0   on success
+ * @retval  -1  if the EAR does not have "ear.raw-evidence" as a string
+ */
+int ear_get_raw_evidence_sz(const ear_t *ear, size_t *psz,
+                            char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Decode a chunk of the evidence carried in "ear.raw-evidence"
+ *
+ * Decodes the evidence from byte @p off on into @p buf, reading only the part
+ * of the claim that is needed: the whole of it can be streamed through a
+ * small buffer, or any part of it read on its own.  Nothing is allocated.
+ *
+ * @param[in]   ear     an ear_t object returned from a successful invocation of
+ *                      ear_jwt_verify
+ * @param[in]   off     offset in the decoded evidence
+ * @param[out]  buf     buffer to decode into
+ * @param[in]   buf_sz  Size in bytes of @p buf
+ * @param[out]  pn      set to the number of bytes decoded: @p buf_sz, or fewer
+ *                      at the end of the evidence (0 from its end on)
+ * @param[out]  err_msg pointer to a pre-allocated buffer (of at least @c
+ *                      EAR_ERR_SZ bytes) which, on failure, will be filled in
+ *                      by the callee with a human readable error message.  This
+ *                      can be set to NULL if no extra error reporting is
+ *                      required
+ *
+ * @retval  0   on success
+ * @retval  -1  if the EAR does not have "ear.raw-evidence" as a string, or it
+ *              is not valid base64url
+ */
+int ear_raw_evidence_read(const ear_t *ear, size_t off, uint8_t *buf,
+                          size_t buf_sz, size_t *pn, char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Feed the evidence carried in "ear.raw-evidence" to a digest
+ *
+ * Decodes the evidence through a buffer on the stack, straight into
+ * EVP_DigestUpdate() on @p md_ctx, which the caller has initialised (with
+ * EVP_DigestInit_ex()) and finalises: whatever else goes into the digest can
+ * be fed before or after.  Nothing is allocated.
+ *
+ * @param[in]     ear     an ear_t object returned from a successful
+ *                        invocation of ear_jwt_verify
+ * @param[in,out] md_ctx  an initialised OpenSSL digest context
+ * @param[out]    err_msg pointer to a pre-allocated buffer (of at least @c
+ *                        EAR_ERR_SZ bytes) which, on failure, will be filled
+ *                        in by the callee with a human readable error message.
+ *                        This can be set to NULL if no extra error reporting
+ *                        is required
+ *
+ * @retval  0   on success
+ * @retval  -1  on failure
+ */
+int ear_raw_evidence_digest(const ear_t *ear, EVP_MD_CTX *md_ctx,
+                            char err_msg[EAR_ERR_SZ]);
+
 /**
  * @brief Return the attested public key from the the specified appraisal record
  *
@@ -130,12 +1176,308 @@ int ear_get_status(ear_t *ear, const char *app_rec, ear_tier_t *ptier,
  * @retval  0   on success
  * @retval  -1  on failure
  */
-int ear_veraison_get_akpub(ear_t *ear, const char *app_rec, uint8_t **pakpub,
-                           size_t *pakpub_sz, char err_msg[EAR_ERR_SZ]);
+int ear_veraison_get_akpub(const ear_t *ear, const char *app_rec,
+                           uint8_t **pakpub, size_t *pakpub_sz,
+                           char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Borrow the attested public key from the specified appraisal record
+ *
+ * Like ear_veraison_get_akpub(), but without a copy: the key is decoded once,
+ * when the EAR is verified, and kept with it.
+ *
+ * @param[in]   ear       an ear_t object returned from a successful invocation
+ *                        of ear_jwt_verify
+ * @param[in]   app_rec   the submod name for the appraisal record
+ * @param[out]  pakpub    Pointer to a byte buffer pointer which, on success,
+ *                        is set to the attested public key (a DER-encoded
+ *                        SubjectPublicKeyInfo).  The buffer is owned by
+ *                        @p ear and valid until ear_free() is called on it
+ * @param[out]  pakpub_sz Pointer to a size_t object that, on success, will be
+ *                        assigned the length in bytes of the key
+ * @param[out]  err_msg   pointer to a pre-allocated buffer (of at least @c
+ *                        EAR_ERR_SZ bytes) which, on failure, will be filled in
+ *                        by the callee with a human readable error message.
+ *                        This can be set to NULL if no extra error reporting is
+ *                        required
+ *
+ * @retval  0   on success
+ * @retval  -1  on failure
+ */
+int ear_veraison_get_akpub_ref(const ear_t *ear, const char *app_rec,
+                               const uint8_t **pakpub, size_t *pakpub_sz,
+                               char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Return the attested public key from the specified appraisal record,
+ *        as an OpenSSL key object
+ *
+ * The key is parsed on the first call for each appraisal record, and the
+ * same object is returned by later calls.  Concurrent calls on the same
+ * @p ear are safe.
+ *
+ * @param[in]   ear       an ear_t object returned from a successful invocation
+ *                        of ear_jwt_verify
+ * @param[in]   app_rec   the submod name for the appraisal record
+ * @param[out]  ppkey     Pointer to an EVP_PKEY pointer which, on success, is
+ *                        set to the attested public key.  The object is owned
+ *                        by @p ear and valid until ear_free() is called on
+ *                        it; callers that need it for longer must take a
+ *                        reference with EVP_PKEY_up_ref()
+ * @param[out]  err_msg   pointer to a pre-allocated buffer (of at least @c
+ *                        EAR_ERR_SZ bytes) which, on failure, will be filled in
+ *                        by the callee with a human readable error message.
+ *                        This can be set to NULL if no extra error reporting is
+ *                        required
+ *
+ * @retval  0   on success
+ * @retval  -1  on failure
+ */
+int ear_veraison_get_akpub_pkey(const ear_t *ear, const char *app_rec,
+                                EVP_PKEY **ppkey, char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Verify a proof-of-possession signature with the attested public key
+ *        of the specified appraisal record
+ *
+ * The signature is over @p data, as a JWS signature (RFC7518) with algorithm
+ * @p alg would be: in particular, ECDSA signatures are the concatenation of
+ * R and S rather than DER.  The key object (see
+ * ear_veraison_get_akpub_pkey()) is kept with @p ear, and the verification
+ * context with the calling thread, so that repeated verifications with the
+ * same attested key allocate nothing.
+ *
+ * @param[in]   ear       an ear_t object returned from a successful invocation
+ *                        of ear_jwt_verify
+ * @param[in]   app_rec   the submod name for the appraisal record
+ * @param[in]   alg       the JWS algorithm of the signature (any but "none"
+ *                        and the HS* family)
+ * @param[in]   data      the signed data
+ * @param[in]   data_sz   Size in bytes of @p data
+ * @param[in]   sig       the signature
+ * @param[in]   sig_sz    Size in bytes of @p sig
+ * @param[out]  err_msg   pointer to a pre-allocated buffer (of at least @c
+ *                        EAR_ERR_SZ bytes) which, on failure, will be filled in
+ *                        by the callee with a human readable error message.
+ *                        This can be set to NULL if no extra error reporting is
+ *                        required
+ *
+ * @retval  0   if the signature verifies
+ * @retval  -1  otherwise
+ */
+int ear_veraison_verify_pop(const ear_t *ear, const char *app_rec,
+                            const char *alg, const uint8_t *data,
+                            size_t data_sz, const uint8_t *sig, size_t sig_sz,
+                            char err_msg[EAR_ERR_SZ]);
+
+// one signature for ear_veraison_verify_pop_batch()
+typedef struct ear_pop_s {
+  const uint8_t *data;
+  size_t data_sz;
+  const uint8_t *sig;
+  size_t sig_sz;
+} ear_pop_t;
+
+/**
+ * @brief Verify many proof-of-possession signatures with the attested public
+ *        key of the specified appraisal record
+ *
+ * Like ear_veraison_verify_pop(), with the appraisal record, key and
+ * algorithm looked up once for the whole batch.
+ *
+ * @param[in]   ear       an ear_t object returned from a successful invocation
+ *                        of ear_jwt_verify
+ * @param[in]   app_rec   the submod name for the appraisal record
+ * @param[in]   alg       the JWS algorithm of all the signatures
+ * @param[in]   pops      the signatures, and the data they are over
+ * @param[in]   pops_sz   Number of entries in @p pops
+ * @param[out]  results   NULL, or an array of @p pops_sz ints which, unless
+ *                        the record or key cannot be used, is filled in with
+ *                        0 for each signature that verifies, and -1 for each
+ *                        that does not
+ * @param[out]  err_msg   pointer to a pre-allocated buffer (of at least @c
+ *                        EAR_ERR_SZ bytes) which, on failure, will be filled in
+ *                        by the callee with a human readable error message.
+ *                        This can be set to NULL if no extra error reporting is
+ *                        required
+ *
+ * @retval  0   if all the signatures verify
+ * @retval  -1  otherwise
+ */
+int ear_veraison_verify_pop_batch(const ear_t *ear, const char *app_rec,
+                                  const char *alg, const ear_pop_t *pops,
+                                  size_t pops_sz, int *results,
+                                  char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Return the binary snapshot of a verified EAR.
+ *
+ * The snapshot is a compact, position-independent summary of everything the
+ * accessors read from the EAR, together with its verification context (see
+ * ear_get_verification_context()).  It can be copied, stored or placed in
+ * shared memory as is, and turned back into an ear_t by ear_snapshot_load()
+ * on any host with the same byte order.
+ *
+ * @param[in]   ear       an ear_t object
+ * @param[out]  psnap     Pointer to a byte buffer which is set to the
+ *                        snapshot.  The buffer is owned by @p ear and is only
+ *                        valid until ear_free() is called on it
+ * @param[out]  psnap_sz  Pointer to a size_t object that will be assigned the
+ *                        length in bytes of the snapshot
+ *
+ * @retval  0   on success
+ */
+int ear_snapshot(const ear_t *ear, const uint8_t **psnap, size_t *psnap_sz);
+
+/**
+ * @brief Wrap a snapshot taken by ear_snapshot() into an ear_t.
+ *
+ * The snapshot is neither copied nor parsed: it is bounds-checked and used in
+ * place, read-only, by all accessors.  Snapshots are taken after signature
+ * verification and carry no signature of their own, so they must only be
+ * loaded from storage that is as trusted as the verifier itself.  A snapshot
+ * of an EAR that has since expired is rejected.
+ *
+ * @param[in]   snap      The snapshot, aligned to 8 bytes.  It must stay valid
+ *                        and unchanged until the last reference to the
+ *                        returned object is dropped (see ear_unref())
+ * @param[in]   snap_sz   Size in bytes of @p snap
+ * @param[out]  pear      Pointer to a ear_t object which, on success, will be
+ *                        populated with the EAR.
+ *                        The object is owned by the caller who needs to take
+ *                        care of its disposal using ear_free()
+ * @param[out]  err_msg   pointer to a pre-allocated buffer (of at least
+ *                        @c EAR_ERR_SZ bytes) which, on failure, will be
+ *                        filled in by the callee with a human readable error
+ *                        message.  This can be set to NULL if no extra error
+ *                        reporting is required
+ *
+ * @retval  0   on success
+ * @retval  -1  on failure
+ */
+int ear_snapshot_load(const uint8_t *snap, size_t snap_sz, ear_t **pear,
+                      char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Seal a verified EAR into a ticket for services that share a key.
+ *
+ * A ticket is the snapshot of @p ear (see ear_snapshot()) and the ticket's
+ * expiry, followed by their HMAC under the key of @p sealer, a verifier
+ * created by ear_verifier_new() with an HMAC algorithm ("HS256", "HS384" or
+ * "HS512") and a secret that only the services in question know.  They check
+ * it with ear_ticket_verify(), which costs a hash over the summary instead
+ * of the signature verification and claims-set decoding of the original EAR.
+ *
+ * A ticket says nothing that the EAR did not: it reports the verification
+ * context of the EAR, not that of the ticket (see
+ * ear_get_verification_context()).  It expires @p ttl seconds after it is
+ * sealed, or with the EAR (its "exp", if any), whichever comes first.  A
+ * ticket is a bearer credential that ear_ticket_verify() accepts as many
+ * times as it is presented until then, so keep @p ttl short.
+ *
+ * @param[in]   sealer      the verifier with the shared HMAC key
+ * @param[in]   ear         a verified ear_t object
+ * @param[in]   ttl         Seconds for which the ticket is valid, at most.
+ *                          Must be non-zero
+ * @param[out]  buf         the buffer to write the ticket into, or NULL to
+ *                          find out how large it needs to be
+ * @param[in]   buf_sz      size in bytes of @p buf
+ * @param[out]  pticket_sz  set to the size in bytes of the ticket
+ * @param[out]  err_msg     pointer to a pre-allocated buffer (of at least
+ *                          @c EAR_ERR_SZ bytes) which, on failure, will be
+ *                          filled in by the callee with a human readable error
+ *                          message.  This can be set to NULL if no extra error
+ *                          reporting is required
+ *
+ * @retval  0   on success
+ * @retval  -1  on failure
+ */
+int ear_ticket_seal(const ear_verifier_t *sealer, const ear_t *ear,
+                    unsigned ttl, uint8_t *buf, size_t buf_sz,
+                    size_t *pticket_sz, char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Check a ticket made by ear_ticket_seal() and wrap it into an ear_t.
+ *
+ * The MAC is checked in constant time, then the ticket's expiry, and then the
+ * summary is used in place as by ear_snapshot_load(), the EAR's expiry
+ * included.  Tickets do not go through the replay guard of any verifier.
+ * Failures are probed with the EAR_ERR_ALG (@p sealer has no HMAC key),
+ * EAR_ERR_SNAPSHOT, EAR_ERR_SIGNATURE (the MAC does not match) or
+ * EAR_ERR_EXPIRED (of the ticket or of the EAR) code.
+ *
+ * @param[in]   sealer      the verifier with the shared HMAC key
+ * @param[in]   ticket      the ticket, aligned to 8 bytes.  It must stay valid
+ *                          and unchanged until the last reference to the
+ *                          returned object is dropped (see ear_unref())
+ * @param[in]   ticket_sz   size in bytes of @p ticket
+ * @param[out]  pear        Pointer to a ear_t object which, on success, will
+ *                          be populated with the EAR.
+ *                          The object is owned by the caller who needs to
+ *                          take care of its disposal using ear_free()
+ * @param[out]  err_msg     pointer to a pre-allocated buffer (of at least
+ *                          @c EAR_ERR_SZ bytes) which, on failure, will be
+ *                          filled in by the callee with a human readable error
+ *                          message.  This can be set to NULL if no extra error
+ *                          reporting is required
+ *
+ * @retval  0   on success
+ * @retval  -1  on failure
+ */
+int ear_ticket_verify(const ear_verifier_t *sealer, const uint8_t *ticket,
+                      size_t ticket_sz, ear_t **pear,
+                      char err_msg[EAR_ERR_SZ]);
+
+/**
+ * @brief Return the context in which an EAR was verified.
+ *
+ * Any output parameter can be NULL.
+ *
+ * @param[in]   ear           an ear_t object
+ * @param[out]  palg          set to the JWT name of the signature algorithm
+ * @param[out]  pkey_id       set to the @c EAR_KEY_ID_SZ byte SHA-256 digest
+ *                            of the key given to ear_verifier_new() (or
+ *                            ear_jwt_verify()).  Owned by @p ear
+ * @param[out]  pverified_at  set to the time of verification, in seconds since
+ *                            the Epoch
+ *
+ * @retval  0   on success
+ */
+int ear_get_verification_context(const ear_t *ear, const char **palg,
+                                 const uint8_t **pkey_id,
+                                 int64_t *pverified_at);
+
+/**
+ * @brief Take a reference on an ear_t object
+ *
+ * A verified ear_t never changes, and all the functions that read it can be
+ * called on the same object from any number of threads at once.  Instead of
+ * being copied, it can be handed to other threads with a reference each,
+ * which they drop with ear_unref() when done.  The object returned by
+ * ear_jwt_verify() (and the like) comes with one reference.
+ *
+ * @param ear an ear_t object
+ *
+ * @return @p ear
+ */
+ear_t *ear_ref(ear_t *ear);
+
+/**
+ * @brief Drop a reference on an ear_t object, freeing it with the last one
+ *
+ * Freed objects, up to a few per thread, are kept by the calling thread and
+ * handed out again by its next verification.
+ *
+ * @param ear the ear_t object to release, or NULL
+ */
+void ear_unref(ear_t *ear);
 
 /**
  * @brief Free an ear_t object allocated by ear_jwt_verify
  *
+ * Same as ear_unref(): if other references have been taken with ear_ref(),
+ * the object lives on until they are dropped.
+ *
  * @param ear the ear_t object to free
  */
 void ear_free(ear_t *ear);
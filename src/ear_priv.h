@@ -4,18 +4,330 @@
 #ifndef EAR_PRIV_H
 #define EAR_PRIV_H
 
+#include "ear.h"
 #include <jansson.h>
 #include <jwt.h>
+#include <openssl/evp.h>
+#include <stdatomic.h>
 #include <stddef.h>
 
-/* The ear object is currently just a wrapper around the jwt_t to hide any
- * implementation details from the caller */
+/* What verification reads from a claims-set, whichever way it was decoded
+ * (see claims_from_json() and jscan.c).  Strings are borrowed from the
+ * decoder, not NUL-terminated, and ptr is NULL unless the claim is there as
+ * a string */
+typedef struct claims_str_s {
+  const char *ptr;
+  size_t len;
+} claims_str_t;
+
+typedef struct claims_submod_s {
+  claims_str_t name;
+  claims_str_t status;
+  claims_str_t policy_id; /* "ear.appraisal-policy-id" */
+  int key_attestation; /* "ear.veraison.key-attestation" is there */
+  claims_str_t akpub;  /* if key_attestation is an object */
+  uint32_t tvec_present; /* bit i: tvec[i] is there, as an int8_t */
+  int8_t tvec[EAR_TV_CLAIMS]; /* "ear.trustworthiness-vector" */
+} claims_submod_t;
+
+#define CLAIMS_IAT (1u << 0)
+#define CLAIMS_NBF (1u << 1)
+#define CLAIMS_EXP (1u << 2)
+#define CLAIMS_SUBMODS (1u << 3)
+#define CLAIMS_SUBMODS_OBJECT (1u << 4)
+
+typedef struct claims_s {
+  uint32_t flags;
+  int64_t iat;
+  int64_t nbf;
+  int64_t exp;
+  claims_str_t profile;
+  claims_str_t jti;
+  claims_str_t iss;
+  claims_str_t sub;
+  claims_str_t aud;
+  claims_str_t build;     /* "ear.verifier-id" members */
+  claims_str_t developer;
+  claims_str_t raw_evidence; /* base64url, as in the claims-set */
+  claims_submod_t *submods; /* in per-thread scratch (JWS_TLS_SUBMODS) */
+  size_t nsubmods;
+} claims_t;
+
+/* The ear object is a summary of the verified claims-set (see snap.c), which
+ * it either owns (in buf) or borrows from the caller.  It does not change
+ * once built, except for the caches filled on demand, which only ever go
+ * from NULL to their final value (by compare-and-swap).  Freed objects are
+ * kept on a per-thread free list, buffer included, for the next EAR */
 typedef struct ear_s {
-  jwt_t *jwt;
-  json_t *submods;
+  _Atomic unsigned refs;
+  const uint8_t *snap; /* buf, unless borrowed; NULL while empty */
+  size_t snap_sz;
+  uint8_t *buf;
+  size_t buf_sz;
+  struct ear_s *next; /* on the free list */
+  _Atomic(_Atomic(EVP_PKEY *) *) akpub_pkeys; /* per record, on first use */
+  _Atomic(uint32_t *) rec_ids; /* record name IDs, on first use */
 } ear_t;
 
+/* A string in the summary's pool: off is from the start of the summary, and
+ * the string is followed by a NUL */
+typedef struct snap_str_s {
+  uint32_t off;
+  uint32_t len;
+} snap_str_t;
+
+#define SNAP_MAGIC 0x50414e53u /* "SNAP" */
+#define SNAP_VERSION 6
+
+#define SNAP_IAT (1u << 0)
+#define SNAP_NBF (1u << 1)
+#define SNAP_EXP (1u << 2)
+#define SNAP_JTI (1u << 3)
+#define SNAP_BUILD (1u << 4)
+#define SNAP_DEVELOPER (1u << 5)
+#define SNAP_RAW_EVIDENCE (1u << 6)
+
+#define SNAP_KEY_ID_SZ EAR_KEY_ID_SZ
+
+typedef struct snap_hdr_s {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t reserved;
+  uint32_t size; /* of the whole summary */
+  uint32_t flags;
+  int64_t verified_at;
+  int64_t iat;
+  int64_t nbf;
+  int64_t exp;
+  uint32_t alg; /* jwt_alg_t */
+  uint32_t nrecs;
+  uint32_t recs_off;
+  uint32_t worst_tier; /* ear_tier_t, see ear_get_worst_tier() */
+  uint8_t key_id[SNAP_KEY_ID_SZ];
+  snap_str_t profile;
+  snap_str_t jti;
+  snap_str_t build; /* of the verifier */
+  snap_str_t developer;
+  snap_str_t raw_evidence; /* base64url, decoded on demand */
+} snap_hdr_t;
+
+#define SNAP_REC_STATUS (1u << 0)
+#define SNAP_REC_KEY_ATTESTATION (1u << 1)
+#define SNAP_REC_AKPUB (1u << 2)
+#define SNAP_REC_AKPUB_DER (1u << 3) /* akpub decodes, into akpub_der */
+#define SNAP_REC_POLICY_ID (1u << 4)
+#define SNAP_REC_TV(i) (1u << (8 + (i))) /* tvec[i] is there */
+
+#define SNAP_TIER_UNKNOWN UINT32_MAX
+
+/* One appraisal record (submod) */
+typedef struct snap_rec_s {
+  snap_str_t name;
+  snap_str_t status;
+  snap_str_t akpub;     /* base64url, as in the claims-set */
+  snap_str_t akpub_der; /* akpub decoded (followed by a NUL all the same) */
+  snap_str_t policy_id;
+  uint32_t flags;
+  uint32_t tier; /* ear_tier_t, or SNAP_TIER_UNKNOWN */
+  int8_t tvec[EAR_TV_CLAIMS];
+} snap_rec_t;
+
+/* Cached EARs are found by the SHA-256 of the token */
+#define CACHE_DIGEST_SZ 32
+
+#define SNAP_HDR(ear) ((const snap_hdr_t *)(ear)->snap)
+#define SNAP_RECS(ear)                                                         \
+  ((const snap_rec_t *)((ear)->snap + SNAP_HDR(ear)->recs_off))
+#define SNAP_STR(ear, s) ((const char *)(ear)->snap + (s).off)
+
+/* The verifier holds everything about the key that can be worked out once:
+ * the expected JWS algorithm and the parsed public key (or, for the HS*
+ * family, the shared secret in key/key_sz) */
+typedef struct ear_verifier_s {
+  jwt_alg_t alg;
+  EVP_PKEY *pkey;
+  uint8_t *key;
+  size_t key_sz;
+  ear_replay_guard_t *replay;
+  ear_cache_t *cache;
+  ear_limits_t limits;
+  uint8_t key_id[SNAP_KEY_ID_SZ]; /* SHA-256 of key */
+} ear_verifier_t;
+
+/* The three base64url segments of a JWS in compact serialization.  All
+ * pointers are borrowed from the token */
+typedef struct jws_s {
+  const char *hdr;
+  size_t hdr_sz;
+  const char *pld;
+  size_t pld_sz;
+  const char *sig;
+  size_t sig_sz;
+} jws_t;
+
+/* A JWT decoded by ear_jwt_parse(), but not verified: the segments point
+ * into token, the handle's own copy */
+typedef struct ear_jwt_parsed_s {
+  jws_t jws;
+  json_t *header;
+  json_t *claims;
+  char token[];
+} ear_jwt_parsed_t;
+
+/* A claim path compiled by ear_query_compile(): where the summary keeps the
+ * claim, and for a record claim, of which records */
+typedef enum {
+  QUERY_CLAIM, /* top-level, arg is an ear_claim_t */
+  QUERY_STATUS,
+  QUERY_POLICY_ID,
+  QUERY_AKPUB,
+  QUERY_TV, /* arg is an ear_tv_claim_t */
+} query_field_t;
+
+typedef struct ear_query_s {
+  query_field_t field;
+  ear_value_type_t type;
+  unsigned arg;
+  int any_rec; /* "*", or else rec */
+  ear_app_rec_id_t rec;
+} ear_query_t;
+
+/* A borrowed run of bytes */
+typedef struct u_slice_s {
+  const uint8_t *ptr;
+  size_t sz;
+} u_slice_t;
+
+/* The parts of a COSE_Sign1, borrowed from the token */
+typedef struct cose_s {
+  u_slice_t prot;
+  u_slice_t pld;
+  u_slice_t sig;
+} cose_t;
+
+/* Zero-copy CBOR decoding (see cbor.c) */
+typedef enum {
+  CBOR_UINT = 0,
+  CBOR_NINT = 1,
+  CBOR_BSTR = 2,
+  CBOR_TSTR = 3,
+  CBOR_ARRAY = 4,
+  CBOR_MAP = 5,
+  CBOR_TAG = 6,
+  CBOR_SIMPLE = 7,
+  CBOR_FLOAT = 8,
+} cbor_type_t;
+
+/* One item head.  u is the head's argument: the (absolute) value of an
+ * integer, the length of a string, array or map, a tag number or a simple
+ * value.  String contents are borrowed from the input */
+typedef struct cbor_item_s {
+  cbor_type_t type;
+  uint64_t u;
+  double f;
+  const uint8_t *ptr;
+} cbor_item_t;
+
+typedef struct cbor_s {
+  const uint8_t *p;
+  const uint8_t *end;
+} cbor_t;
+
+/* deepest nesting of arrays, maps and tags accepted */
+#define CBOR_MAX_DEPTH 16
+
+/* exact size of the data decoded from n base64url characters (unpadded) */
+#define U_B64URL_DECODED_SZ(n) ((n) / 4 * 3 + ((n) % 4 ? (n) % 4 - 1 : 0))
+
+/* number of base64url characters (unpadded) encoding n bytes */
+#define U_B64URL_ENCODED_SZ(n) (((n) * 4 + 2) / 3)
+
+/* The per-thread scratch buffers (see jws_tls_scratch()) */
+typedef enum {
+  JWS_TLS_PAYLOAD, /* the decoded payload */
+  JWS_TLS_INDEX,   /* its jscan_index() */
+  JWS_TLS_SUBMODS, /* claims_t submods */
+  JWS_TLS_SCRATCHES,
+} jws_scratch_t;
+
+/* largest signature accepted (an RSA-8192 signature) */
+#define JWS_SIG_MAX 1024
+
+extern const char *const tvec_names[EAR_TV_CLAIMS];
+
 size_t u_strlcpy(char *dst, const char *src, size_t sz);
 int u_b64url_decode(const char *in, uint8_t **pout, size_t *pout_sz);
+int u_b64url_decode_n(const char *in, size_t in_sz, uint8_t *out,
+                      size_t out_sz, size_t *pout_sz);
+size_t u_b64url_encode_n(const uint8_t *in, size_t in_sz, char *out);
+int u_b64_decode_at(const char *in, size_t in_sz, size_t off, uint8_t *out,
+                    size_t out_sz, size_t *pout_sz);
+uint64_t u_hash64(const void *p, size_t sz, uint64_t seed);
+
+void cbor_init(cbor_t *c, const uint8_t *buf, size_t sz);
+int cbor_next(cbor_t *c, cbor_item_t *item);
+int cbor_skip(cbor_t *c, unsigned depth);
+int cbor_int(const cbor_item_t *item, int64_t *pv);
+size_t cbor_head(uint8_t *out, cbor_type_t type, uint64_t arg);
+
+int cose_split(const uint8_t *buf, size_t sz, cose_t *cose);
+ear_err_t cose_check_header(const ear_verifier_t *verifier, const cose_t *cose,
+                            char err_msg[EAR_ERR_SZ]);
+int cose_verify(const ear_verifier_t *verifier, const cose_t *cose);
+ear_err_t cwt_claims(const cose_t *cose, json_t **pclaims,
+                     char err_msg[EAR_ERR_SZ]);
+
+ear_err_t snap_build(ear_t *ear, const claims_t *claims,
+                     const ear_verifier_t *verifier, int64_t now,
+                     uint8_t *room, size_t room_sz, char err_msg[EAR_ERR_SZ]);
+ear_err_t snap_check(const uint8_t *snap, size_t snap_sz,
+                     char err_msg[EAR_ERR_SZ]);
+const snap_rec_t *snap_find(const ear_t *ear, const char *app_rec);
+int snap_tier(claims_str_t tier, ear_tier_t *ptier);
+unsigned snap_tier_rank(uint32_t tier);
+
+int jscan_index(const uint8_t *buf, size_t sz, uint32_t *idx, size_t *pn,
+                int simd);
+ear_err_t jscan_claims(const uint8_t *buf, size_t sz,
+                       const ear_limits_t *limits, claims_t *claims);
+
+int jws_split(const char *token, jws_t *jws);
+ear_err_t jws_key_load(jwt_alg_t alg, const uint8_t *key, size_t key_sz,
+                       EVP_PKEY **ppkey, char err_msg[EAR_ERR_SZ]);
+int jws_verify(const ear_verifier_t *verifier, const jws_t *jws);
+int jws_verify_raw(const ear_verifier_t *verifier, const u_slice_t *msg,
+                   size_t msg_n, const uint8_t *sig, size_t sig_sz);
+int jws_mac(const ear_verifier_t *verifier, const u_slice_t *msg,
+            size_t msg_n, uint8_t mac[EVP_MAX_MD_SIZE], size_t *pmac_sz);
+int jws_verify_pop(jwt_alg_t alg, EVP_PKEY *pkey, const u_slice_t *msg,
+                   size_t msg_n, const uint8_t *sig, size_t sig_sz);
+int jws_sha256(const void *p, size_t sz, uint8_t md[CACHE_DIGEST_SZ]);
+unsigned jws_tls_index(void);
+ear_verifier_t **jws_tls_verifier(void);
+ear_t *jws_tls_ear_pop(void);
+int jws_tls_ear_push(ear_t *ear);
+uint8_t *jws_tls_scratch(jws_scratch_t which, size_t sz);
+json_t *jws_tls_header_get(const jws_t *jws, jwt_alg_t alg);
+void jws_tls_header_put(const jws_t *jws, jwt_alg_t alg, json_t *header);
+
+ear_err_t replay_check(ear_replay_guard_t *guard, const char *jti,
+                       size_t jti_sz, int64_t exp, int64_t now);
+ear_replay_guard_t *replay_default(void);
+
+#define INTERN_NONE UINT32_MAX /* no ID: the name was never interned */
+
+int intern_id(const char *name, size_t len, uint32_t *pid);
+int intern_find(const char *name, size_t len, uint32_t *pid);
+uint32_t intern_count(void);
+const char *intern_name(uint32_t id, size_t *plen);
+
+ear_err_t cache_attach(int fd, int create, size_t capacity, size_t max_snap_sz,
+                       unsigned ttl, ear_cache_t **pcache,
+                       char err_msg[EAR_ERR_SZ]);
+int cache_get(ear_cache_t *cache, const uint8_t *digest, int64_t now,
+              uint8_t **pbuf, size_t *pbuf_sz, size_t *psnap_sz);
+void cache_put(ear_cache_t *cache, const uint8_t *digest, int64_t now,
+               int64_t expires, const uint8_t *snap, size_t sz);
+ear_cache_t *cache_default(void);
 
 #endif // !EAR_PRIV_H
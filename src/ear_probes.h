@@ -0,0 +1,35 @@
+// Copyright 2023 Contributors to the Veraison project.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef EAR_PROBES_H
+#define EAR_PROBES_H
+
+/* USDT (SystemTap SDT) probes in the verification path, compiled in when the
+ * library is configured with -DEAR_USDT=ON.  An inactive probe is a single
+ * nop; without EAR_USDT the macros expand to nothing.
+ *
+ *  ear:verify__entry(const char *token, const char *alg)
+ *  ear:verify__stage(const char *stage, size_t token_len, const char *alg)
+ *  ear:verify__error(int code, size_t token_len, const char *alg)
+ *  ear:verify__return(int code, size_t token_len, const char *alg)
+ *  ear:key__error(int code, const char *alg)
+ *  ear:lookup__error(int code, const char *app_rec)
+ *
+ * "code" is an ear_err_t; "stage" names the step about to start.  E.g.,
+ * to count verification failures by error code in a running relying party:
+ *
+ *  bpftrace -p PID -e 'usdt:*:ear:verify__error { @[arg0] = count(); }'
+ */
+
+#ifdef EAR_USDT
+#include <sys/sdt.h>
+
+#define EAR_PROBE2(name, a1, a2) DTRACE_PROBE2(ear, name, a1, a2)
+#define EAR_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(ear, name, a1, a2, a3)
+#else
+// the arguments are plain locals, so this compiles to nothing
+#define EAR_PROBE2(name, a1, a2) ((void)(a1), (void)(a2))
+#define EAR_PROBE3(name, a1, a2, a3) ((void)(a1), (void)(a2), (void)(a3))
+#endif // EAR_USDT
+
+#endif // !EAR_PROBES_H
@@ -0,0 +1,142 @@
+// Copyright 2023 Contributors to the Veraison project.
+// SPDX-License-Identifier: Apache-2.0
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "ear.h"
+#include "ear_priv.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The process-wide table of interned appraisal record names.  A name's ID is
+ * its index in intern_names, where it stays for the life of the process.
+ * IDs are found by hash in intern_slots, an open-addressing table with
+ * linear probing that is never more than half full.  Lookups take no lock:
+ * a name is published before the slot that leads to it (release, paired
+ * with the acquire on the slot), and neither ever changes again.  Inserts
+ * are serialized by intern_lock, and probe again under it.  intern_n is
+ * published last, so that every ID below it can be found by a probe.
+ *
+ * Only names that callers ask for are inserted (ear_app_rec_intern(),
+ * ear_query_compile()).  Names in EARs come from tokens and are only looked
+ * up (intern_find()), so that they can neither fill the table nor take the
+ * lock. */
+
+#define INTERN_MAX 4096
+#define INTERN_SLOTS (2 * INTERN_MAX)
+#define INTERN_SEED 0x9e3779b97f4a7c15ull
+
+typedef struct intern_name_s {
+  size_t len;
+  char name[];
+} intern_name_t;
+
+static _Atomic(intern_name_t *) intern_names[INTERN_MAX];
+static _Atomic uint32_t intern_slots[INTERN_SLOTS]; /* ID + 1, 0 if free */
+static _Atomic uint32_t intern_n;
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* 0 with *pid set if name is interned, or else -1 with *pslot set to the
+ * free slot that ended the probe */
+static int intern_probe(const char *name, size_t len, uint64_t h,
+                        uint32_t *pid, size_t *pslot) {
+  for (size_t i = h % INTERN_SLOTS;; i = (i + 1) % INTERN_SLOTS) {
+    uint32_t v = atomic_load_explicit(&intern_slots[i], memory_order_acquire);
+    intern_name_t *e;
+
+    if (v == 0) {
+      *pslot = i;
+      return -1;
+    }
+
+    e = atomic_load_explicit(&intern_names[v - 1], memory_order_relaxed);
+
+    if (e->len == len && !memcmp(e->name, name, len)) {
+      *pid = v - 1;
+      return 0;
+    }
+  }
+}
+
+int intern_id(const char *name, size_t len, uint32_t *pid) {
+  uint64_t h = u_hash64(name, len, INTERN_SEED);
+  intern_name_t *e = NULL;
+  size_t slot;
+  uint32_t n;
+  int ret = -1;
+
+  if (intern_probe(name, len, h, pid, &slot) == 0)
+    return 0;
+
+  (void)pthread_mutex_lock(&intern_lock);
+
+  // someone else may have got there first
+  if (intern_probe(name, len, h, pid, &slot) == 0) {
+    ret = 0;
+    goto done;
+  }
+
+  n = atomic_load_explicit(&intern_n, memory_order_relaxed);
+
+  if (n == INTERN_MAX || (e = malloc(sizeof *e + len + 1)) == NULL)
+    goto done;
+
+  e->len = len;
+  memcpy(e->name, name, len);
+  e->name[len] = '\0';
+
+  atomic_store_explicit(&intern_names[n], e, memory_order_relaxed);
+  atomic_store_explicit(&intern_slots[slot], n + 1, memory_order_release);
+  atomic_store_explicit(&intern_n, n + 1, memory_order_release);
+
+  *pid = n;
+  ret = 0;
+
+done:
+  (void)pthread_mutex_unlock(&intern_lock);
+
+  return ret;
+}
+
+int intern_find(const char *name, size_t len, uint32_t *pid) {
+  size_t slot;
+
+  return intern_probe(name, len, u_hash64(name, len, INTERN_SEED), pid,
+                      &slot);
+}
+
+uint32_t intern_count(void) {
+  return atomic_load_explicit(&intern_n, memory_order_acquire);
+}
+
+const char *intern_name(uint32_t id, size_t *plen) {
+  intern_name_t *e;
+
+  if (id >= intern_count())
+    return NULL;
+
+  e = atomic_load_explicit(&intern_names[id], memory_order_relaxed);
+  *plen = e->len;
+
+  return e->name;
+}
+
+int ear_app_rec_intern(const char *app_rec, ear_app_rec_id_t *pid,
+                       char err_msg[EAR_ERR_SZ]) {
+  assert(app_rec != NULL);
+  assert(pid != NULL);
+
+  if (intern_id(app_rec, strlen(app_rec), pid) == -1) {
+    if (err_msg != NULL)
+      (void)snprintf(err_msg, EAR_ERR_SZ,
+                     "cannot intern \"%s\": more than %u record names",
+                     app_rec, INTERN_MAX);
+    return -1;
+  }
+
+  return 0;
+}
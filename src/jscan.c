@@ -0,0 +1,827 @@
+// Copyright 2023 Contributors to the Veraison project.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ear_priv.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Schema-driven decoding of EAR claims-sets in JSON, without a tree.
+ *
+ * Stage 1 indexes the payload 64 bytes at a time, in the manner of
+ * simdjson.  It records the offset of every quote, of every {}[]:, outside
+ * strings, and of the first byte of every other run of non-whitespace
+ * (numbers and literals).  The character classes come from SSE2 where
+ * available and from a byte loop otherwise; the strings are then found with
+ * bit arithmetic alone.
+ *
+ * Stage 2 walks the index, checking the grammar as it goes, and picks the
+ * claims that verification reads into a claims_t.
+ *
+ * Only a strict subset of JSON is decoded here:
+ * - ASCII strings only;
+ * - integers of up to 18 digits, and reals of up to 32 characters that
+ *   strtod() reads as jansson does;
+ * - no escapes in the strings that are picked;
+ * - no repeated names among those that are looked at;
+ * - at most JSCAN_MAX_SUBMODS appraisal records, as each name is checked
+ *   against all those before it.
+ * Anything else, valid or not, is left to jansson (jscan_claims() returns
+ * EAR_ERR_PAYLOAD), so the outcome never depends on which of the two decoded
+ * a payload.
+ *
+ * The verifier's limits (see ear_verifier_set_limits()) are enforced on the
+ * way, and stop the walk at the first string, record or nesting level over
+ * them: that is final (jscan_claims() returns the EAR_ERR_LIMIT_* code), for
+ * jansson would only find the same. */
+
+#define JSCAN_MAX_DEPTH 64
+#define JSCAN_MAX_SUBMODS 64
+
+/* integers with more digits may not fit a json_int_t */
+#define JSCAN_MAX_DIGITS 18
+
+/* longest real number decoded here */
+#define JSCAN_MAX_REAL 32
+
+typedef struct jscan_masks_s {
+  uint64_t quote;
+  uint64_t bslash;
+  uint64_t op;  /* {}[]:, */
+  uint64_t ws;  /* space, \t, \n, \r */
+  uint64_t bad; /* below 0x20 or above 0x7f: not allowed in strings */
+} jscan_masks_t;
+
+static unsigned ctz64(uint64_t x) {
+#if defined(__GNUC__)
+  return (unsigned)__builtin_ctzll(x);
+#else
+  unsigned n = 0;
+
+  while (!(x & 1))
+    x >>= 1, n++;
+
+  return n;
+#endif
+}
+
+static void classify_scalar(const uint8_t *p, jscan_masks_t *m) {
+  memset(m, 0, sizeof *m);
+
+  for (unsigned i = 0; i < 64; i++) {
+    uint64_t bit = (uint64_t)1 << i;
+
+    switch (p[i]) {
+    case '"':
+      m->quote |= bit;
+      break;
+    case '\\':
+      m->bslash |= bit;
+      break;
+    case '{':
+    case '}':
+    case '[':
+    case ']':
+    case ':':
+    case ',':
+      m->op |= bit;
+      break;
+    case ' ':
+      m->ws |= bit;
+      break;
+    case '\t':
+    case '\n':
+    case '\r':
+      m->ws |= bit;
+      m->bad |= bit;
+      break;
+    default:
+      if (p[i] < 0x20 || p[i] > 0x7f)
+        m->bad |= bit;
+    }
+  }
+}
+
+#if defined(__SSE2__)
+static void classify_simd(const uint8_t *p, jscan_masks_t *m) {
+  memset(m, 0, sizeof *m);
+
+  for (unsigned i = 0; i < 4; i++) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(const void *)(p + 16 * i));
+    // '[' and ']' are '{' and '}' with bit 5 clear
+    __m128i v20 = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i op = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v20, _mm_set1_epi8('{')),
+                     _mm_cmpeq_epi8(v20, _mm_set1_epi8('}'))),
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')),
+                     _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+    __m128i ws = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                     _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                     _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+    // signed: the bytes above 0x7f are negative
+    __m128i bad = _mm_cmplt_epi8(v, _mm_set1_epi8(0x20));
+    unsigned shift = 16 * i;
+
+    m->quote |= (uint64_t)(unsigned)_mm_movemask_epi8(
+                    _mm_cmpeq_epi8(v, _mm_set1_epi8('"')))
+                << shift;
+    m->bslash |= (uint64_t)(unsigned)_mm_movemask_epi8(
+                     _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')))
+                 << shift;
+    m->op |= (uint64_t)(unsigned)_mm_movemask_epi8(op) << shift;
+    m->ws |= (uint64_t)(unsigned)_mm_movemask_epi8(ws) << shift;
+    m->bad |= (uint64_t)(unsigned)_mm_movemask_epi8(bad) << shift;
+  }
+}
+#else
+#define classify_simd classify_scalar
+#endif
+
+/* The bytes escaped by a backslash.  Backslashes are rare, so they are
+ * simply taken one at a time.  carry is set if the next block starts
+ * escaped */
+static uint64_t find_escaped(uint64_t bslash, uint64_t *carry) {
+  uint64_t escaped = *carry;
+
+  *carry = 0;
+
+  while (bslash) {
+    unsigned i = ctz64(bslash);
+    uint64_t bit = (uint64_t)1 << i;
+
+    bslash &= bslash - 1;
+
+    if (escaped & bit)
+      continue; // itself escaped
+
+    if (i == 63)
+      *carry = 1;
+    else
+      escaped |= bit << 1;
+  }
+
+  return escaped;
+}
+
+/* Bit i is set if an odd number of bits up to and including i are */
+static uint64_t prefix_xor(uint64_t x) {
+  x ^= x << 1;
+  x ^= x << 2;
+  x ^= x << 4;
+  x ^= x << 8;
+  x ^= x << 16;
+  x ^= x << 32;
+
+  return x;
+}
+
+int jscan_index(const uint8_t *buf, size_t sz, uint32_t *idx, size_t *pn,
+                int simd) {
+  uint64_t in_str = 0, escaped_carry = 0, atom_carry = 0;
+  uint8_t tail[64];
+  size_t n = 0;
+
+  if (sz > UINT32_MAX - 64)
+    return -1;
+
+  for (size_t off = 0; off < sz; off += 64) {
+    const uint8_t *p = buf + off;
+    jscan_masks_t m;
+    uint64_t escaped, quote, str, atom, bits;
+
+    if (sz - off < 64) {
+      memset(tail, ' ', sizeof tail);
+      memcpy(tail, p, sz - off);
+      p = tail;
+    }
+
+    if (simd)
+      classify_simd(p, &m);
+    else
+      classify_scalar(p, &m);
+
+    escaped = find_escaped(m.bslash, &escaped_carry);
+    quote = m.quote & ~escaped;
+
+    // set from an opening quote up to, not including, the closing one
+    str = prefix_xor(quote) ^ in_str;
+    in_str = 0 - (str >> 63);
+
+    if (m.bad & str)
+      return -1;
+
+    atom = ~(m.ws | m.op | m.quote | str);
+    bits = (m.op & ~str) | quote | (atom & ~((atom << 1) | atom_carry));
+    atom_carry = atom >> 63;
+
+    while (bits) {
+      idx[n++] = (uint32_t)(off + ctz64(bits));
+      bits &= bits - 1;
+    }
+  }
+
+  if (in_str)
+    return -1;
+
+  *pn = n;
+
+  return 0;
+}
+
+typedef struct jscan_s {
+  const uint8_t *buf;
+  size_t sz;
+  const uint32_t *idx;
+  size_t n;
+  size_t k; /* next entry of idx */
+  const ear_limits_t *limits;
+  size_t max_str; /* limits->max_str_sz, but for "ear.raw-evidence" */
+  ear_err_t err;  /* the limit that stopped the walk, if any */
+} jscan_t;
+
+/* A scalar: type is '"' for strings, '0' for integers, '.' for reals (also
+ * in i, truncated), or the first byte of the value otherwise */
+typedef struct jscan_val_s {
+  int type;
+  claims_str_t str;
+  int escaped;
+  int64_t i;
+} jscan_val_t;
+
+static int peek(const jscan_t *js) {
+  return js->k < js->n ? js->buf[js->idx[js->k]] : -1;
+}
+
+static int expect(jscan_t *js, int c) {
+  if (peek(js) != c)
+    return -1;
+
+  js->k++;
+
+  return 0;
+}
+
+static int is_digit(uint8_t c) { return c >= '0' && c <= '9'; }
+
+static int is_hex(uint8_t c) {
+  return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+}
+
+/* Leave \u0000 and surrogates, which jansson may reject, to jansson */
+static int check_escapes(const uint8_t *p, const uint8_t *end) {
+  while ((p = memchr(p, '\\', (size_t)(end - p))) != NULL) {
+    if (++p == end)
+      return -1;
+
+    switch (*p++) {
+    case '"':
+    case '\\':
+    case '/':
+    case 'b':
+    case 'f':
+    case 'n':
+    case 'r':
+    case 't':
+      break;
+    case 'u':
+      if (end - p < 4 || !is_hex(p[0]) || !is_hex(p[1]) || !is_hex(p[2]) ||
+          !is_hex(p[3]) || ((p[0] | 0x20) == 'd' && p[1] >= '8') ||
+          !memcmp(p, "0000", 4))
+        return -1;
+      p += 4;
+      break;
+    default:
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int scan_string(jscan_t *js, jscan_val_t *v) {
+  const uint8_t *start, *end;
+
+  // every quote is indexed, and nothing in between
+  if (peek(js) != '"' || js->k + 1 >= js->n)
+    return -1;
+
+  start = js->buf + js->idx[js->k] + 1;
+  end = js->buf + js->idx[js->k + 1];
+  js->k += 2;
+
+  if (js->max_str != 0 && (size_t)(end - start) > js->max_str) {
+    js->err = EAR_ERR_LIMIT_STRING;
+    return -1;
+  }
+
+  v->type = '"';
+  v->str.ptr = (const char *)start;
+  v->str.len = (size_t)(end - start);
+  v->escaped = memchr(start, '\\', v->str.len) != NULL;
+
+  return v->escaped ? check_escapes(start, end) : 0;
+}
+
+/* The real number in p, which has been checked against the grammar, as
+ * jansson would have it: with strtod(), which must take all of it (it does
+ * not if the locale has another decimal point) and not overflow */
+static int scan_real(const uint8_t *p, size_t sz, jscan_val_t *v) {
+  char buf[JSCAN_MAX_REAL + 1], *end;
+  double d;
+
+  if (sz > JSCAN_MAX_REAL)
+    return -1;
+
+  memcpy(buf, p, sz);
+  buf[sz] = '\0';
+
+  d = strtod(buf, &end);
+
+  // the truncated value, as used for times, must be representable
+  if (end != buf + sz || !(d > -9.2e18 && d < 9.2e18))
+    return -1;
+
+  v->type = '.';
+  v->i = (int64_t)d;
+
+  return 0;
+}
+
+static int scan_atom(jscan_t *js, jscan_val_t *v) {
+  const uint8_t *p = js->buf + js->idx[js->k];
+  const uint8_t *end =
+      js->k + 1 < js->n ? js->buf + js->idx[js->k + 1] : js->buf + js->sz;
+  const uint8_t *atom = p, *digits;
+  int neg = 0;
+
+  js->k++;
+
+  // an atom runs up to the next entry, give or take whitespace
+  while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n' ||
+                     end[-1] == '\r'))
+    end--;
+
+  v->type = *p;
+
+  if ((end - p == 4 && (!memcmp(p, "true", 4) || !memcmp(p, "null", 4))) ||
+      (end - p == 5 && !memcmp(p, "false", 5)))
+    return 0;
+
+  if (p < end && *p == '-')
+    neg = 1, p++;
+
+  digits = p;
+  v->i = 0;
+
+  // no leading zeros
+  if (p < end && *p == '0')
+    p++;
+  else
+    for (; p < end && *p >= '0' && *p <= '9'; p++)
+      v->i = v->i * 10 + (*p - '0');
+
+  if (p == digits || p - digits > JSCAN_MAX_DIGITS)
+    return -1;
+
+  if (neg)
+    v->i = -v->i;
+
+  v->type = '0';
+
+  if (p == end)
+    return 0;
+
+  if (*p == '.') {
+    if (++p == end || !is_digit(*p))
+      return -1;
+
+    while (p < end && is_digit(*p))
+      p++;
+  }
+
+  if (p < end && (*p | 0x20) == 'e') {
+    if (++p < end && (*p == '+' || *p == '-'))
+      p++;
+
+    if (p == end || !is_digit(*p))
+      return -1;
+
+    while (p < end && is_digit(*p))
+      p++;
+  }
+
+  if (p != end)
+    return -1;
+
+  return scan_real(atom, (size_t)(end - atom), v);
+}
+
+static int scan_value(jscan_t *js, unsigned depth, jscan_val_t *v);
+
+/* Whether a container can be entered at depth (0 for the claims-set) */
+static int depth_ok(jscan_t *js, unsigned depth) {
+  if (js->limits->max_depth != 0 && depth >= js->limits->max_depth) {
+    js->err = EAR_ERR_LIMIT_DEPTH;
+    return 0;
+  }
+
+  return depth < JSCAN_MAX_DEPTH;
+}
+
+/* Any object or array, which is only checked */
+static int scan_container(jscan_t *js, unsigned depth) {
+  jscan_val_t v;
+  int close = peek(js) == '{' ? '}' : ']';
+
+  if (!depth_ok(js, depth))
+    return -1;
+
+  js->k++;
+
+  if (peek(js) == close) {
+    js->k++;
+    return 0;
+  }
+
+  for (;;) {
+    if (close == '}' && (scan_string(js, &v) == -1 || expect(js, ':') == -1))
+      return -1;
+
+    if (scan_value(js, depth + 1, &v) == -1)
+      return -1;
+
+    if (peek(js) == close) {
+      js->k++;
+      return 0;
+    }
+
+    if (expect(js, ',') == -1)
+      return -1;
+  }
+}
+
+static int scan_value(jscan_t *js, unsigned depth, jscan_val_t *v) {
+  switch (peek(js)) {
+  case '"':
+    return scan_string(js, v);
+  case '{':
+  case '[':
+    v->type = peek(js);
+    return scan_container(js, depth);
+  case -1:
+  case '}':
+  case ']':
+  case ':':
+  case ',':
+    return -1;
+  default:
+    return scan_atom(js, v);
+  }
+}
+
+/* Enter an object, after which an object_next() loop takes the members */
+static int object_enter(jscan_t *js, unsigned depth, int *pempty) {
+  if (!depth_ok(js, depth) || expect(js, '{') == -1)
+    return -1;
+
+  if ((*pempty = (peek(js) == '}')))
+    js->k++;
+
+  return 0;
+}
+
+/* The name of the next member, which must not be escaped for it to be
+ * compared */
+static int object_name(jscan_t *js, jscan_val_t *name) {
+  if (scan_string(js, name) == -1 || name->escaped || expect(js, ':') == -1)
+    return -1;
+
+  return 0;
+}
+
+/* 1 if another member follows, 0 at the end of the object */
+static int object_next(jscan_t *js) {
+  if (peek(js) == '}') {
+    js->k++;
+    return 0;
+  }
+
+  return expect(js, ',') == -1 ? -1 : 1;
+}
+
+static int is_name(const jscan_val_t *name, const char *s) {
+  size_t len = strlen(s);
+
+  return name->str.len == len && !memcmp(name->str.ptr, s, len);
+}
+
+/* A picked string claim: only set if it is a string */
+static int pick_str(const jscan_val_t *v, claims_str_t *pstr) {
+  if (v->type != '"')
+    return 0;
+
+  if (v->escaped)
+    return -1;
+
+  *pstr = v->str;
+
+  return 0;
+}
+
+static int scan_key_attestation(jscan_t *js, unsigned depth,
+                                claims_submod_t *submod) {
+  jscan_val_t name, v;
+  int empty, more, seen = 0;
+
+  if (object_enter(js, depth, &empty) == -1)
+    return -1;
+
+  for (more = !empty; more == 1; more = object_next(js)) {
+    if (object_name(js, &name) == -1 ||
+        scan_value(js, depth + 1, &v) == -1)
+      return -1;
+
+    if (is_name(&name, "akpub")) {
+      if (seen++ || pick_str(&v, &submod->akpub) == -1)
+        return -1;
+    }
+  }
+
+  return more;
+}
+
+/* The string members of an object into strs, by name */
+static int scan_strs(jscan_t *js, unsigned depth, const char *const *names,
+                     claims_str_t *const *strs, unsigned n) {
+  jscan_val_t name, v;
+  unsigned seen = 0;
+  int empty, more;
+
+  if (object_enter(js, depth, &empty) == -1)
+    return -1;
+
+  for (more = !empty; more == 1; more = object_next(js)) {
+    if (object_name(js, &name) == -1 ||
+        scan_value(js, depth + 1, &v) == -1)
+      return -1;
+
+    for (unsigned i = 0; i < n; i++) {
+      if (is_name(&name, names[i])) {
+        if ((seen & (1u << i)) || pick_str(&v, strs[i]) == -1)
+          return -1;
+        seen |= 1u << i;
+      }
+    }
+  }
+
+  return more;
+}
+
+static int scan_tvec(jscan_t *js, unsigned depth, claims_submod_t *submod) {
+  jscan_val_t name, v;
+  unsigned seen = 0;
+  int empty, more;
+
+  if (object_enter(js, depth, &empty) == -1)
+    return -1;
+
+  for (more = !empty; more == 1; more = object_next(js)) {
+    if (object_name(js, &name) == -1 ||
+        scan_value(js, depth + 1, &v) == -1)
+      return -1;
+
+    for (unsigned i = 0; i < EAR_TV_CLAIMS; i++) {
+      if (is_name(&name, tvec_names[i])) {
+        if (seen & (1u << i))
+          return -1;
+        seen |= 1u << i;
+
+        // only integers count, and only those a claim can take
+        if (v.type == '0' && v.i >= INT8_MIN && v.i <= INT8_MAX) {
+          submod->tvec_present |= 1u << i;
+          submod->tvec[i] = (int8_t)v.i;
+        }
+      }
+    }
+  }
+
+  return more;
+}
+
+static int scan_submod(jscan_t *js, unsigned depth, claims_submod_t *submod) {
+  jscan_val_t name, v;
+  int empty, more, seen_status = 0, seen_ka = 0, seen_policy = 0;
+  int seen_tvec = 0;
+
+  if (object_enter(js, depth, &empty) == -1)
+    return -1;
+
+  for (more = !empty; more == 1; more = object_next(js)) {
+    if (object_name(js, &name) == -1)
+      return -1;
+
+    if (is_name(&name, "ear.veraison.key-attestation")) {
+      if (seen_ka++)
+        return -1;
+
+      submod->key_attestation = 1;
+
+      if (peek(js) == '{') {
+        if (scan_key_attestation(js, depth + 1, submod) == -1)
+          return -1;
+        continue;
+      }
+    }
+
+    if (is_name(&name, "ear.trustworthiness-vector")) {
+      if (seen_tvec++)
+        return -1;
+
+      if (peek(js) == '{') {
+        if (scan_tvec(js, depth + 1, submod) == -1)
+          return -1;
+        continue;
+      }
+    }
+
+    if (scan_value(js, depth + 1, &v) == -1)
+      return -1;
+
+    if (is_name(&name, "ear.status") &&
+        (seen_status++ || pick_str(&v, &submod->status) == -1))
+      return -1;
+
+    if (is_name(&name, "ear.appraisal-policy-id") &&
+        (seen_policy++ || pick_str(&v, &submod->policy_id) == -1))
+      return -1;
+  }
+
+  return more;
+}
+
+static int scan_submods(jscan_t *js, unsigned depth, claims_t *claims) {
+  jscan_val_t name, v;
+  claims_submod_t *submod;
+  int empty, more;
+
+  if (object_enter(js, depth, &empty) == -1)
+    return -1;
+
+  for (more = !empty; more == 1; more = object_next(js)) {
+    if (object_name(js, &name) == -1)
+      return -1;
+
+    if (js->limits->max_submods != 0 &&
+        claims->nsubmods == js->limits->max_submods) {
+      js->err = EAR_ERR_LIMIT_SUBMODS;
+      return -1;
+    }
+
+    // more than that is left to jansson's hashtable
+    if (claims->nsubmods == JSCAN_MAX_SUBMODS)
+      return -1;
+
+    for (size_t i = 0; i < claims->nsubmods; i++) {
+      if (claims->submods[i].name.len == name.str.len &&
+          !memcmp(claims->submods[i].name.ptr, name.str.ptr, name.str.len))
+        return -1;
+    }
+
+    claims->submods = (claims_submod_t *)(void *)jws_tls_scratch(
+        JWS_TLS_SUBMODS, (claims->nsubmods + 1) * sizeof *submod);
+    if (claims->submods == NULL)
+      return -1;
+
+    submod = &claims->submods[claims->nsubmods++];
+    memset(submod, 0, sizeof *submod);
+    submod->name = name.str;
+
+    if (peek(js) == '{') {
+      if (scan_submod(js, depth + 1, submod) == -1)
+        return -1;
+    } else if (scan_value(js, depth + 1, &v) == -1) {
+      return -1;
+    }
+  }
+
+  return more;
+}
+
+ear_err_t jscan_claims(const uint8_t *buf, size_t sz,
+                       const ear_limits_t *limits, claims_t *claims) {
+  static const ear_limits_t no_limits;
+  static const char *const strs[] = {"eat_profile", "jti", "iss",
+                                     "sub",         "aud", "ear.raw-evidence"};
+  static const char *const times[] = {"iat", "nbf", "exp"};
+  static const char *const verifier_id[] = {"build", "developer"};
+  claims_str_t *str_claims[] = {&claims->profile, &claims->jti,
+                                &claims->iss,     &claims->sub,
+                                &claims->aud,     &claims->raw_evidence};
+  claims_str_t *const verifier_id_claims[] = {&claims->build,
+                                              &claims->developer};
+  int64_t *time_claims[] = {&claims->iat, &claims->nbf, &claims->exp};
+  jscan_t js = {buf, sz, NULL, 0, 0, NULL, 0, EAR_OK};
+  jscan_val_t name, v;
+  uint32_t *idx;
+  unsigned seen = 0; /* CLAIMS_IAT and co., then the strings from bit 8 */
+  int empty, more, seen_verifier_id = 0;
+
+  memset(claims, 0, sizeof *claims);
+
+  js.limits = limits != NULL ? limits : &no_limits;
+  js.max_str = js.limits->max_str_sz;
+
+  if ((idx = (uint32_t *)(void *)jws_tls_scratch(
+           JWS_TLS_INDEX, (sz + 1) * sizeof *idx)) == NULL ||
+      jscan_index(buf, sz, idx, &js.n, 1) == -1)
+    return EAR_ERR_PAYLOAD;
+
+  js.idx = idx;
+
+  if (object_enter(&js, 0, &empty) == -1)
+    goto err;
+
+  for (more = !empty; more == 1; more = object_next(&js)) {
+    unsigned i;
+
+    if (object_name(&js, &name) == -1)
+      goto err;
+
+    if (is_name(&name, "submods")) {
+      if (claims->flags & CLAIMS_SUBMODS)
+        goto err;
+
+      claims->flags |= CLAIMS_SUBMODS;
+
+      if (peek(&js) == '{') {
+        claims->flags |= CLAIMS_SUBMODS_OBJECT;
+
+        if (scan_submods(&js, 1, claims) == -1)
+          goto err;
+        continue;
+      }
+    }
+
+    if (is_name(&name, "ear.verifier-id")) {
+      if (seen_verifier_id++)
+        goto err;
+
+      if (peek(&js) == '{') {
+        if (scan_strs(&js, 1, verifier_id, verifier_id_claims, 2) == -1)
+          goto err;
+        continue;
+      }
+    }
+
+    // the evidence has a limit of its own
+    if (is_name(&name, "ear.raw-evidence") && peek(&js) == '"') {
+      js.max_str = js.limits->max_raw_evidence_sz;
+
+      if (scan_value(&js, 1, &v) == -1) {
+        if (js.err == EAR_ERR_LIMIT_STRING)
+          js.err = EAR_ERR_LIMIT_RAW_EVIDENCE;
+        goto err;
+      }
+
+      js.max_str = js.limits->max_str_sz;
+    } else if (scan_value(&js, 1, &v) == -1) {
+      goto err;
+    }
+
+    for (i = 0; i < sizeof strs / sizeof strs[0]; i++) {
+      if (is_name(&name, strs[i])) {
+        if ((seen & (0x100u << i)) || pick_str(&v, str_claims[i]) == -1)
+          goto err;
+        seen |= 0x100u << i;
+      }
+    }
+
+    for (i = 0; i < sizeof times / sizeof times[0]; i++) {
+      if (is_name(&name, times[i])) {
+        if (seen & (CLAIMS_IAT << i))
+          goto err;
+        seen |= CLAIMS_IAT << i;
+
+        // only numbers count, reals truncated
+        if (v.type == '0' || v.type == '.') {
+          claims->flags |= CLAIMS_IAT << i;
+          *time_claims[i] = v.i;
+        }
+      }
+    }
+  }
+
+  // nothing after the object
+  if (more == -1 || js.k != js.n)
+    goto err;
+
+  return EAR_OK;
+
+err:
+  return js.err != EAR_OK ? js.err : EAR_ERR_PAYLOAD;
+}
@@ -0,0 +1,635 @@
+// Copyright 2023 Contributors to the Veraison project.
+// SPDX-License-Identifier: Apache-2.0
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "ear.h"
+#include "ear_priv.h"
+#include <assert.h>
+#include <limits.h>
+#include <openssl/core_names.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* JWS signature verification (RFC7515, RFC7518) on top of OpenSSL.
+ *
+ * Every thread keeps one digest, MAC and public key context per algorithm.
+ * The contexts are re-initialised rather than re-allocated between uses, and
+ * the public key context stays bound to the last key it was used with, so
+ * a thread verifying against the same ear_verifier_t does no context
+ * allocation in steady state.  Proof-of-possession signatures, made with
+ * the attested keys of EARs, have slots of their own, so that they do not
+ * unbind the EAR verification key (or the other way round).
+ *
+ * Threads also remember the last few JWT protected headers they decoded, as
+ * nearly all EARs from a given issuer carry the very same one.
+ *
+ * Each thread gets an index, which spreads per-thread counters (such as the
+ * cache's) over several cache lines.  Indices are consecutive within a
+ * process and offset by a hash of its PID, also in forked children, so the
+ * threads of sibling processes seldom land on the same line. */
+
+typedef enum { JWS_HMAC, JWS_RSA, JWS_RSA_PSS, JWS_ECDSA } jws_kind_t;
+
+static const struct jws_alg_s {
+  const char *md;
+  jws_kind_t kind;
+  int ec_bits;
+} jws_algs[JWT_ALG_TERM] = {
+    [JWT_ALG_HS256] = {"SHA256", JWS_HMAC, 0},
+    [JWT_ALG_HS384] = {"SHA384", JWS_HMAC, 0},
+    [JWT_ALG_HS512] = {"SHA512", JWS_HMAC, 0},
+    [JWT_ALG_RS256] = {"SHA256", JWS_RSA, 0},
+    [JWT_ALG_RS384] = {"SHA384", JWS_RSA, 0},
+    [JWT_ALG_RS512] = {"SHA512", JWS_RSA, 0},
+    [JWT_ALG_ES256] = {"SHA256", JWS_ECDSA, 256},
+    [JWT_ALG_ES384] = {"SHA384", JWS_ECDSA, 384},
+    [JWT_ALG_ES512] = {"SHA512", JWS_ECDSA, 521},
+    [JWT_ALG_PS256] = {"SHA256", JWS_RSA_PSS, 0},
+    [JWT_ALG_PS384] = {"SHA384", JWS_RSA_PSS, 0},
+    [JWT_ALG_PS512] = {"SHA512", JWS_RSA_PSS, 0},
+};
+
+typedef struct jws_slot_s {
+  EVP_MD_CTX *md_ctx;
+  EVP_MAC_CTX *mac_ctx;
+  int mac_keyed; /* mac_ctx holds the key whose digest is mac_key_id */
+  uint8_t mac_key_id[SNAP_KEY_ID_SZ];
+  EVP_PKEY_CTX *pkey_ctx;
+} jws_slot_t;
+
+/* ear_t objects kept for reuse by each thread, unless their buffer is larger
+ * than this */
+#define JWS_TLS_EARS 16
+#define JWS_TLS_EAR_BUF_MAX 65536
+
+/* Decoded JWT protected headers kept by each thread, direct-mapped by the
+ * hash of their base64url segment.  Longer segments are not kept */
+#define JWS_TLS_HDRS 8
+#define JWS_TLS_HDR_SEG_MAX 256
+
+typedef struct jws_hdr_s {
+  jwt_alg_t alg; /* the "alg" it was checked against */
+  size_t seg_sz;
+  char seg[JWS_TLS_HDR_SEG_MAX];
+  json_t *header; /* NULL while empty */
+} jws_hdr_t;
+
+typedef struct jws_tls_s {
+  jws_slot_t slots[JWT_ALG_TERM];
+  jws_slot_t pop_slots[JWT_ALG_TERM]; /* for jws_verify_pop() */
+  ear_verifier_t *verifier; /* the last one built by ear_jwt_verify() */
+  EVP_MD_CTX *sha256_ctx;   /* for jws_sha256() */
+  ear_t *ears;              /* free list */
+  unsigned n_ears;
+  uint8_t *scratch[JWS_TLS_SCRATCHES]; /* see jws_tls_scratch() */
+  size_t scratch_sz[JWS_TLS_SCRATCHES];
+  jws_hdr_t hdrs[JWS_TLS_HDRS];
+  unsigned index; /* see jws_tls_index() */
+} jws_tls_t;
+
+static pthread_once_t jws_once = PTHREAD_ONCE_INIT;
+static pthread_key_t jws_key;
+static int jws_key_ok;
+static EVP_MD *jws_mds[JWT_ALG_TERM];
+static EVP_MAC *jws_hmac;
+static _Atomic unsigned jws_threads; /* started using jws_tls() so far */
+static unsigned jws_salt;            /* of this process's thread indices */
+
+/* Tell this process's threads from those of its parent */
+static void jws_forked(void) {
+  jws_salt = (unsigned)getpid() * 0x9e3779b9u;
+}
+
+static void jws_tls_free(void *p) {
+  jws_tls_t *tls = p;
+
+  for (unsigned i = 0; i < JWT_ALG_TERM; i++) {
+    EVP_MD_CTX_free(tls->slots[i].md_ctx);
+    EVP_MAC_CTX_free(tls->slots[i].mac_ctx);
+    EVP_PKEY_CTX_free(tls->slots[i].pkey_ctx);
+    EVP_MD_CTX_free(tls->pop_slots[i].md_ctx);
+    EVP_PKEY_CTX_free(tls->pop_slots[i].pkey_ctx);
+  }
+
+  ear_verifier_free(tls->verifier);
+  EVP_MD_CTX_free(tls->sha256_ctx);
+
+  while (tls->ears != NULL) {
+    ear_t *ear = tls->ears;
+
+    tls->ears = ear->next;
+    free(ear->buf);
+    free(ear);
+  }
+
+  for (unsigned i = 0; i < JWS_TLS_SCRATCHES; i++)
+    free(tls->scratch[i]);
+
+  for (unsigned i = 0; i < JWS_TLS_HDRS; i++) {
+    if (tls->hdrs[i].header != NULL)
+      json_decref(tls->hdrs[i].header);
+  }
+
+  free(tls);
+}
+
+/* Explicitly fetch the digests once, which avoids the implicit fetch (and
+ * its method store lookup) on every EVP_DigestInit_ex() */
+static void jws_init(void) {
+  for (unsigned i = 0; i < JWT_ALG_TERM; i++) {
+    if (jws_algs[i].md != NULL)
+      jws_mds[i] = EVP_MD_fetch(NULL, jws_algs[i].md, NULL);
+  }
+
+  jws_hmac = EVP_MAC_fetch(NULL, "HMAC", NULL);
+
+  jws_key_ok = (pthread_key_create(&jws_key, jws_tls_free) == 0);
+
+  jws_forked();
+  (void)pthread_atfork(NULL, NULL, jws_forked);
+}
+
+static jws_tls_t *jws_tls(void) {
+  jws_tls_t *tls;
+
+  (void)pthread_once(&jws_once, jws_init);
+
+  if (!jws_key_ok)
+    return NULL;
+
+  if ((tls = pthread_getspecific(jws_key)) != NULL)
+    return tls;
+
+  if ((tls = calloc(1, sizeof *tls)) == NULL)
+    return NULL;
+
+  tls->index = atomic_fetch_add_explicit(&jws_threads, 1, memory_order_relaxed);
+
+  if (pthread_setspecific(jws_key, tls) != 0) {
+    free(tls);
+    return NULL;
+  }
+
+  return tls;
+}
+
+int jws_split(const char *token, jws_t *jws) {
+  assert(token != NULL);
+  assert(jws != NULL);
+
+  const char *p, *q;
+
+  if ((p = strchr(token, '.')) == NULL || (q = strchr(p + 1, '.')) == NULL ||
+      strchr(q + 1, '.') != NULL)
+    return -1;
+
+  jws->hdr = token;
+  jws->hdr_sz = (size_t)(p - token);
+  jws->pld = p + 1;
+  jws->pld_sz = (size_t)(q - p - 1);
+  jws->sig = q + 1;
+  jws->sig_sz = strlen(q + 1);
+
+  // tolerate the trailing newline of tokens read from files
+  while (jws->sig_sz > 0 && (jws->sig[jws->sig_sz - 1] == '\n' ||
+                             jws->sig[jws->sig_sz - 1] == '\r'))
+    jws->sig_sz--;
+
+  if (jws->hdr_sz == 0 || jws->pld_sz == 0 || jws->sig_sz == 0)
+    return -1;
+
+  return 0;
+}
+
+ear_err_t jws_key_load(jwt_alg_t alg, const uint8_t *key, size_t key_sz,
+                       EVP_PKEY **ppkey, char err_msg[EAR_ERR_SZ]) {
+  assert(alg > JWT_ALG_NONE && alg < JWT_ALG_TERM);
+  assert(ppkey != NULL);
+
+  const struct jws_alg_s *a = &jws_algs[alg];
+  BIO *bio = NULL;
+  EVP_PKEY *pkey = NULL;
+  int type;
+
+  if (a->kind == JWS_HMAC) {
+    *ppkey = NULL;
+    return EAR_OK;
+  }
+
+  if (key_sz > INT_MAX || (bio = BIO_new_mem_buf(key, (int)key_sz)) == NULL) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "cannot read the public key");
+    goto err;
+  }
+
+  if ((pkey = PEM_read_bio_PUBKEY(bio, NULL, NULL, NULL)) == NULL) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "cannot parse the public key");
+    goto err;
+  }
+
+  type = EVP_PKEY_get_base_id(pkey);
+
+  if ((a->kind == JWS_ECDSA &&
+       (type != EVP_PKEY_EC || EVP_PKEY_get_bits(pkey) != a->ec_bits)) ||
+      (a->kind == JWS_RSA && type != EVP_PKEY_RSA) ||
+      (a->kind == JWS_RSA_PSS && type != EVP_PKEY_RSA &&
+       type != EVP_PKEY_RSA_PSS)) {
+    (void)snprintf(err_msg, EAR_ERR_SZ,
+                   "public key type does not match JWT algorithm \"%s\"",
+                   jwt_alg_str(alg));
+    goto err;
+  }
+
+  BIO_free(bio);
+
+  *ppkey = pkey;
+
+  return EAR_OK;
+
+err:
+  BIO_free(bio);
+  EVP_PKEY_free(pkey);
+
+  return EAR_ERR_KEY;
+}
+
+/* Make sure the slot's public key context is bound to pkey */
+static int jws_bind(jws_slot_t *slot, jwt_alg_t alg, EVP_PKEY *pkey) {
+  const struct jws_alg_s *a = &jws_algs[alg];
+  EVP_PKEY_CTX *ctx = NULL;
+
+  if (slot->pkey_ctx != NULL) {
+    // the context holds a reference on its key, so pointer equality is safe
+    if (EVP_PKEY_CTX_get0_pkey(slot->pkey_ctx) == pkey)
+      return 0;
+
+    EVP_PKEY_CTX_free(slot->pkey_ctx), slot->pkey_ctx = NULL;
+  }
+
+  if ((ctx = EVP_PKEY_CTX_new_from_pkey(NULL, pkey, NULL)) == NULL ||
+      EVP_PKEY_verify_init(ctx) <= 0 ||
+      EVP_PKEY_CTX_set_signature_md(ctx, jws_mds[alg]) <= 0)
+    goto err;
+
+  if (a->kind == JWS_RSA &&
+      EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING) <= 0)
+    goto err;
+
+  if (a->kind == JWS_RSA_PSS &&
+      (EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PSS_PADDING) <= 0 ||
+       EVP_PKEY_CTX_set_rsa_pss_saltlen(ctx, RSA_PSS_SALTLEN_DIGEST) <= 0 ||
+       EVP_PKEY_CTX_set_rsa_mgf1_md(ctx, jws_mds[alg]) <= 0))
+    goto err;
+
+  slot->pkey_ctx = ctx;
+
+  return 0;
+
+err:
+  EVP_PKEY_CTX_free(ctx);
+
+  return -1;
+}
+
+static size_t der_uint(uint8_t *out, const uint8_t *b, size_t n) {
+  size_t pad;
+
+  while (n > 1 && *b == 0)
+    b++, n--;
+
+  pad = (*b & 0x80) ? 1 : 0;
+
+  if (out != NULL) {
+    out[0] = 0x02;
+    out[1] = (uint8_t)(n + pad);
+    out[2] = 0x00;
+    memcpy(out + 2 + pad, b, n);
+  }
+
+  return 2 + pad + n;
+}
+
+/* Re-encode a JWS ECDSA signature (R || S) as the DER Ecdsa-Sig-Value that
+ * OpenSSL expects.  The output buffer must be at least rs_sz + 9 bytes */
+static size_t jws_ecdsa_der(const uint8_t *rs, size_t rs_sz, uint8_t *der) {
+  size_t n = rs_sz / 2, len, off;
+
+  len = der_uint(NULL, rs, n) + der_uint(NULL, rs + n, n);
+  off = (len < 0x80) ? 2 : 3;
+
+  der[0] = 0x30;
+  if (off == 2) {
+    der[1] = (uint8_t)len;
+  } else {
+    der[1] = 0x81;
+    der[2] = (uint8_t)len;
+  }
+
+  off += der_uint(der + off, rs, n);
+  off += der_uint(der + off, rs + n, n);
+
+  return off;
+}
+
+static int jws_hmac_compute(jws_slot_t *slot, const ear_verifier_t *verifier,
+                            const u_slice_t *msg, size_t msg_n,
+                            uint8_t mac[EVP_MAX_MD_SIZE], size_t *pmac_sz) {
+  OSSL_PARAM params[] = {
+      OSSL_PARAM_construct_utf8_string(
+          OSSL_MAC_PARAM_DIGEST, (char *)jws_algs[verifier->alg].md, 0),
+      OSSL_PARAM_construct_end(),
+  };
+
+  if (slot->mac_ctx == NULL &&
+      (jws_hmac == NULL || (slot->mac_ctx = EVP_MAC_CTX_new(jws_hmac)) == NULL))
+    return -1;
+
+  // keying (and fetching the digest) allocates, so a context that already
+  // holds the key is only reset.  Keys are told apart by their digest, which
+  // unlike the verifier's address cannot be recycled for another key
+  if (slot->mac_keyed &&
+      !memcmp(slot->mac_key_id, verifier->key_id, SNAP_KEY_ID_SZ)) {
+    if (!EVP_MAC_init(slot->mac_ctx, NULL, 0, NULL))
+      goto err;
+  } else {
+    slot->mac_keyed = 0;
+
+    if (!EVP_MAC_init(slot->mac_ctx, verifier->key, verifier->key_sz, params))
+      goto err;
+
+    memcpy(slot->mac_key_id, verifier->key_id, SNAP_KEY_ID_SZ);
+    slot->mac_keyed = 1;
+  }
+
+  for (size_t i = 0; i < msg_n; i++)
+    if (!EVP_MAC_update(slot->mac_ctx, msg[i].ptr, msg[i].sz))
+      goto err;
+
+  if (!EVP_MAC_final(slot->mac_ctx, mac, pmac_sz, EVP_MAX_MD_SIZE))
+    goto err;
+
+  return 0;
+
+err:
+  slot->mac_keyed = 0;
+
+  return -1;
+}
+
+static int jws_hmac_verify(jws_slot_t *slot, const ear_verifier_t *verifier,
+                           const u_slice_t *msg, size_t msg_n,
+                           const uint8_t *sig, size_t sig_sz) {
+  uint8_t mac[EVP_MAX_MD_SIZE];
+  size_t mac_sz;
+
+  if (jws_hmac_compute(slot, verifier, msg, msg_n, mac, &mac_sz) == -1)
+    return -1;
+
+  if (mac_sz != sig_sz || CRYPTO_memcmp(mac, sig, sig_sz) != 0)
+    return -1;
+
+  return 0;
+}
+
+static int jws_pkey_verify(jws_slot_t *slot, jwt_alg_t alg, EVP_PKEY *pkey,
+                           const u_slice_t *msg, size_t msg_n,
+                           const uint8_t *sig, size_t sig_sz) {
+  const struct jws_alg_s *a = &jws_algs[alg];
+  uint8_t der[JWS_SIG_MAX + 16], md[EVP_MAX_MD_SIZE];
+  size_t der_sz;
+  unsigned int md_sz;
+
+  if (jws_mds[alg] == NULL || sig_sz > JWS_SIG_MAX)
+    return -1;
+
+  if (slot->md_ctx == NULL && (slot->md_ctx = EVP_MD_CTX_new()) == NULL)
+    return -1;
+
+  if (!EVP_DigestInit_ex(slot->md_ctx, jws_mds[alg], NULL))
+    return -1;
+
+  for (size_t i = 0; i < msg_n; i++)
+    if (!EVP_DigestUpdate(slot->md_ctx, msg[i].ptr, msg[i].sz))
+      return -1;
+
+  if (!EVP_DigestFinal_ex(slot->md_ctx, md, &md_sz))
+    return -1;
+
+  if (jws_bind(slot, alg, pkey) == -1)
+    return -1;
+
+  if (a->kind == JWS_ECDSA) {
+    if (sig_sz != 2 * (size_t)((a->ec_bits + 7) / 8))
+      return -1;
+
+    der_sz = jws_ecdsa_der(sig, sig_sz, der);
+
+    return EVP_PKEY_verify(slot->pkey_ctx, der, der_sz, md, md_sz) == 1 ? 0
+                                                                        : -1;
+  }
+
+  return EVP_PKEY_verify(slot->pkey_ctx, sig, sig_sz, md, md_sz) == 1 ? 0 : -1;
+}
+
+int jws_verify_raw(const ear_verifier_t *verifier, const u_slice_t *msg,
+                   size_t msg_n, const uint8_t *sig, size_t sig_sz) {
+  assert(verifier != NULL);
+  assert(msg != NULL);
+
+  jws_tls_t *tls;
+  jws_slot_t *slot;
+
+  if ((tls = jws_tls()) == NULL)
+    return -1;
+
+  slot = &tls->slots[verifier->alg];
+
+  if (jws_algs[verifier->alg].kind == JWS_HMAC)
+    return jws_hmac_verify(slot, verifier, msg, msg_n, sig, sig_sz);
+
+  return jws_pkey_verify(slot, verifier->alg, verifier->pkey, msg, msg_n, sig,
+                         sig_sz);
+}
+
+int jws_mac(const ear_verifier_t *verifier, const u_slice_t *msg,
+            size_t msg_n, uint8_t mac[EVP_MAX_MD_SIZE], size_t *pmac_sz) {
+  assert(verifier != NULL);
+  assert(msg != NULL);
+
+  jws_tls_t *tls;
+
+  if (jws_algs[verifier->alg].kind != JWS_HMAC || (tls = jws_tls()) == NULL)
+    return -1;
+
+  return jws_hmac_compute(&tls->slots[verifier->alg], verifier, msg, msg_n,
+                          mac, pmac_sz);
+}
+
+int jws_verify_pop(jwt_alg_t alg, EVP_PKEY *pkey, const u_slice_t *msg,
+                   size_t msg_n, const uint8_t *sig, size_t sig_sz) {
+  assert(pkey != NULL);
+  assert(msg != NULL);
+
+  jws_tls_t *tls;
+
+  if (alg <= JWT_ALG_NONE || alg >= JWT_ALG_TERM ||
+      jws_algs[alg].kind == JWS_HMAC || (tls = jws_tls()) == NULL)
+    return -1;
+
+  return jws_pkey_verify(&tls->pop_slots[alg], alg, pkey, msg, msg_n, sig,
+                         sig_sz);
+}
+
+int jws_verify(const ear_verifier_t *verifier, const jws_t *jws) {
+  assert(verifier != NULL);
+  assert(jws != NULL);
+
+  // the JWS signing input is the header and payload segments, dot included
+  u_slice_t msg = {(const uint8_t *)jws->hdr, jws->hdr_sz + 1 + jws->pld_sz};
+  uint8_t sig[JWS_SIG_MAX];
+  size_t sig_sz;
+
+  if (u_b64url_decode_n(jws->sig, jws->sig_sz, sig, sizeof sig, &sig_sz) ==
+      -1)
+    return -1;
+
+  return jws_verify_raw(verifier, &msg, 1, sig, sig_sz);
+}
+
+int jws_sha256(const void *p, size_t sz, uint8_t md[CACHE_DIGEST_SZ]) {
+  const EVP_MD *sha256;
+  jws_tls_t *tls;
+
+  if ((tls = jws_tls()) == NULL || (sha256 = jws_mds[JWT_ALG_HS256]) == NULL)
+    return -1;
+
+  if (tls->sha256_ctx == NULL && (tls->sha256_ctx = EVP_MD_CTX_new()) == NULL)
+    return -1;
+
+  if (!EVP_DigestInit_ex(tls->sha256_ctx, sha256, NULL) ||
+      !EVP_DigestUpdate(tls->sha256_ctx, p, sz) ||
+      !EVP_DigestFinal_ex(tls->sha256_ctx, md, NULL))
+    return -1;
+
+  return 0;
+}
+
+ear_t *jws_tls_ear_pop(void) {
+  jws_tls_t *tls;
+  ear_t *ear;
+
+  if ((tls = jws_tls()) == NULL || (ear = tls->ears) == NULL)
+    return NULL;
+
+  tls->ears = ear->next;
+  tls->n_ears--;
+  ear->next = NULL;
+
+  return ear;
+}
+
+int jws_tls_ear_push(ear_t *ear) {
+  jws_tls_t *tls;
+
+  if (ear->buf_sz > JWS_TLS_EAR_BUF_MAX || (tls = jws_tls()) == NULL ||
+      tls->n_ears >= JWS_TLS_EARS)
+    return -1;
+
+  ear->next = tls->ears;
+  tls->ears = ear;
+  tls->n_ears++;
+
+  return 0;
+}
+
+/* Scratch buffer which, of at least sz bytes, private to the calling thread
+ * and valid until its next call for the same buffer.  The contents are kept
+ * when it grows, which it does at least twofold, so that growing it one
+ * item at a time costs amortized constant time per item */
+uint8_t *jws_tls_scratch(jws_scratch_t which, size_t sz) {
+  jws_tls_t *tls;
+  uint8_t *p;
+  size_t new_sz;
+
+  if ((tls = jws_tls()) == NULL)
+    return NULL;
+
+  if (sz > tls->scratch_sz[which]) {
+    new_sz = tls->scratch_sz[which] * 2;
+    if (new_sz < sz)
+      new_sz = sz;
+
+    if ((p = realloc(tls->scratch[which], new_sz)) == NULL)
+      return NULL;
+
+    tls->scratch[which] = p;
+    tls->scratch_sz[which] = new_sz;
+  }
+
+  return tls->scratch[which];
+}
+
+static jws_hdr_t *jws_tls_hdr(jws_tls_t *tls, const jws_t *jws) {
+  return &tls->hdrs[u_hash64(jws->hdr, jws->hdr_sz, 0) % JWS_TLS_HDRS];
+}
+
+/* The decoded protected header of jws, if this thread has already decoded
+ * and checked it against alg.  The header is borrowed from the thread */
+json_t *jws_tls_header_get(const jws_t *jws, jwt_alg_t alg) {
+  jws_tls_t *tls;
+  jws_hdr_t *h;
+
+  if (jws->hdr_sz > JWS_TLS_HDR_SEG_MAX || (tls = jws_tls()) == NULL)
+    return NULL;
+
+  h = jws_tls_hdr(tls, jws);
+
+  if (h->header == NULL || h->alg != alg || h->seg_sz != jws->hdr_sz ||
+      memcmp(h->seg, jws->hdr, jws->hdr_sz))
+    return NULL;
+
+  return h->header;
+}
+
+/* Remember header, decoded from jws and checked against alg, taking a
+ * reference on it */
+void jws_tls_header_put(const jws_t *jws, jwt_alg_t alg, json_t *header) {
+  jws_tls_t *tls;
+  jws_hdr_t *h;
+
+  if (jws->hdr_sz > JWS_TLS_HDR_SEG_MAX || (tls = jws_tls()) == NULL)
+    return;
+
+  h = jws_tls_hdr(tls, jws);
+
+  if (h->header != NULL)
+    json_decref(h->header);
+
+  h->alg = alg;
+  h->seg_sz = jws->hdr_sz;
+  memcpy(h->seg, jws->hdr, jws->hdr_sz);
+  h->header = json_incref(header);
+}
+
+unsigned jws_tls_index(void) {
+  jws_tls_t *tls = jws_tls();
+
+  return ((tls != NULL) ? tls->index : 0) + jws_salt;
+}
+
+ear_verifier_t **jws_tls_verifier(void) {
+  jws_tls_t *tls;
+
+  if ((tls = jws_tls()) == NULL)
+    return NULL;
+
+  return &tls->verifier;
+}
@@ -0,0 +1,216 @@
+// Copyright 2023 Contributors to the Veraison project.
+// SPDX-License-Identifier: Apache-2.0
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "ear.h"
+#include "ear_priv.h"
+#include <assert.h>
+#include <openssl/rand.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* The replay guard is a fixed-size hash set of jti fingerprints, split into
+ * REPLAY_SHARDS independently locked shards so that concurrent verifiers
+ * rarely contend.  Each shard is an open-addressing table with linear probing
+ * bounded to REPLAY_WINDOW slots.  Nothing is ever deleted: an expired entry
+ * is simply overwritten by the next insertion that probes it, and since slots
+ * never go back to empty, an empty slot still ends a probe sequence early. */
+
+#define REPLAY_SHARDS 64
+#define REPLAY_WINDOW 32
+
+typedef struct replay_slot_s {
+  uint64_t fp; /* 0 means empty */
+  int64_t exp;
+} replay_slot_t;
+
+typedef struct replay_shard_s {
+  _Alignas(64) pthread_mutex_t lock;
+  replay_slot_t *slots;
+  size_t mask;
+} replay_shard_t;
+
+struct ear_replay_guard_s {
+  replay_shard_t shards[REPLAY_SHARDS];
+  replay_slot_t *slots;
+  uint64_t seed;
+  int64_t default_ttl;
+};
+
+static _Atomic(ear_replay_guard_t *) replay_default_guard;
+
+int ear_replay_guard_new(size_t capacity, unsigned default_ttl,
+                         ear_replay_guard_t **pguard,
+                         char err_msg[EAR_ERR_SZ]) {
+  assert(capacity > 0);
+  assert(pguard != NULL);
+
+  ear_replay_guard_t *guard = NULL;
+  size_t per_shard = REPLAY_WINDOW;
+  unsigned i = 0;
+  char e[EAR_ERR_SZ] = {'\0'};
+
+  // keep the load factor at or below 1/2
+  while (per_shard < capacity * 2 / REPLAY_SHARDS + 1) {
+    if (per_shard > SIZE_MAX / 2 / REPLAY_SHARDS / sizeof(replay_slot_t)) {
+      (void)snprintf(e, sizeof e, "replay guard capacity too large");
+      goto err;
+    }
+    per_shard *= 2;
+  }
+
+  if ((guard = aligned_alloc(64, sizeof *guard)) == NULL) {
+    (void)snprintf(e, sizeof e, "cannot allocate the replay guard");
+    goto err;
+  }
+
+  memset(guard, 0, sizeof *guard);
+
+  guard->slots = calloc(per_shard * REPLAY_SHARDS, sizeof(replay_slot_t));
+  if (guard->slots == NULL) {
+    (void)snprintf(e, sizeof e, "cannot allocate the replay guard");
+    goto err;
+  }
+
+  // a secret seed stops anyone from aiming jti values at a single window
+  if (RAND_bytes((unsigned char *)&guard->seed, sizeof guard->seed) != 1) {
+    (void)snprintf(e, sizeof e, "cannot seed the replay guard");
+    goto err;
+  }
+
+  guard->default_ttl = default_ttl;
+
+  for (i = 0; i < REPLAY_SHARDS; i++) {
+    if (pthread_mutex_init(&guard->shards[i].lock, NULL) != 0) {
+      (void)snprintf(e, sizeof e, "cannot initialise the replay guard");
+      goto err;
+    }
+
+    guard->shards[i].slots = guard->slots + i * per_shard;
+    guard->shards[i].mask = per_shard - 1;
+  }
+
+  *pguard = guard;
+
+  return 0;
+
+err:
+  if (guard != NULL) {
+    while (i-- > 0)
+      (void)pthread_mutex_destroy(&guard->shards[i].lock);
+    free(guard->slots);
+    free(guard);
+  }
+
+  if (err_msg != NULL)
+    (void)u_strlcpy(err_msg, e, EAR_ERR_SZ);
+
+  return -1;
+}
+
+void ear_replay_guard_free(ear_replay_guard_t *guard) {
+  if (guard == NULL)
+    return;
+
+  for (unsigned i = 0; i < REPLAY_SHARDS; i++)
+    (void)pthread_mutex_destroy(&guard->shards[i].lock);
+
+  free(guard->slots);
+  free(guard);
+}
+
+ear_err_t replay_check(ear_replay_guard_t *guard, const char *jti,
+                       size_t jti_sz, int64_t exp, int64_t now) {
+  uint64_t fp = u_hash64(jti, jti_sz, guard->seed);
+  replay_shard_t *shard;
+  replay_slot_t *slot, *free_slot = NULL;
+  ear_err_t code = EAR_ERR_REPLAY_FULL;
+
+  if (fp == 0)
+    fp = 1;
+
+  if (exp == 0)
+    exp = now + guard->default_ttl;
+
+  // top bits pick the shard, bottom bits the home slot
+  shard = &guard->shards[fp >> 58];
+
+  (void)pthread_mutex_lock(&shard->lock);
+
+  for (size_t i = 0; i < REPLAY_WINDOW; i++) {
+    slot = &shard->slots[(fp + i) & shard->mask];
+
+    if (slot->fp == 0) {
+      if (free_slot == NULL)
+        free_slot = slot;
+      break;
+    }
+
+    if (slot->exp <= now) {
+      if (free_slot == NULL)
+        free_slot = slot;
+      continue;
+    }
+
+    if (slot->fp == fp) {
+      code = EAR_ERR_REPLAY;
+      goto done;
+    }
+  }
+
+  if (free_slot != NULL) {
+    free_slot->fp = fp;
+    free_slot->exp = exp;
+    code = EAR_OK;
+  }
+
+done:
+  (void)pthread_mutex_unlock(&shard->lock);
+
+  return code;
+}
+
+int ear_replay_guard_check(ear_replay_guard_t *guard, const char *jti,
+                           size_t jti_sz, int64_t exp,
+                           char err_msg[EAR_ERR_SZ]) {
+  assert(guard != NULL);
+  assert(jti != NULL);
+
+  char e[EAR_ERR_SZ] = {'\0'};
+
+  switch (replay_check(guard, jti, jti_sz, exp, (int64_t)time(NULL))) {
+  case EAR_OK:
+    return 0;
+  case EAR_ERR_REPLAY:
+    (void)snprintf(e, sizeof e, "\"jti\" has already been seen");
+    break;
+  default:
+    (void)snprintf(e, sizeof e, "replay guard is full");
+    break;
+  }
+
+  if (err_msg != NULL)
+    (void)u_strlcpy(err_msg, e, EAR_ERR_SZ);
+
+  return -1;
+}
+
+void ear_verifier_set_replay_guard(ear_verifier_t *verifier,
+                                   ear_replay_guard_t *guard) {
+  assert(verifier != NULL);
+
+  verifier->replay = guard;
+}
+
+void ear_set_replay_guard(ear_replay_guard_t *guard) {
+  atomic_store(&replay_default_guard, guard);
+}
+
+ear_replay_guard_t *replay_default(void) {
+  return atomic_load_explicit(&replay_default_guard, memory_order_acquire);
+}
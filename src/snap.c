@@ -0,0 +1,322 @@
+// Copyright 2023 Contributors to the Veraison project.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ear.h"
+#include "ear_priv.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The EAR summary ("snapshot") is what an ear_t really is: everything the
+ * accessors need from a verified claims-set, plus the context it was
+ * verified in, laid out in a single buffer that only uses offsets.  It is
+ * built once at the end of verification and can then be copied, stored or
+ * shared between processes as is, and wrapped again by ear_snapshot_load()
+ * with a bounds check rather than a parse.
+ *
+ *   snap_hdr_t | snap_rec_t[nrecs] | string pool (NUL-terminated strings)
+ *
+ * Integers are in host byte order: a snapshot taken on a host with the
+ * other byte order fails the magic check. */
+
+#define SNAP_ALIGN 8
+
+// the layout is the format: do not let it drift with the compiler
+_Static_assert(sizeof(snap_hdr_t) == 136, "snap_hdr_t layout");
+_Static_assert(sizeof(snap_rec_t) == 56, "snap_rec_t layout");
+
+typedef struct snap_builder_s {
+  uint8_t *buf; /* NULL while sizing */
+  size_t pool;  /* next free byte in the pool */
+} snap_builder_t;
+
+int snap_tier(claims_str_t tier, ear_tier_t *ptier) {
+  struct tiers_map {
+    const char *s;
+    ear_tier_t e;
+  } tiers[] = {
+      {"affirming", EAR_TIER_AFFIRMING},
+      {"contraindicated", EAR_TIER_CONTRAINDICATED},
+      {"warning", EAR_TIER_WARNING},
+      {"none", EAR_TIER_NONE},
+  };
+
+  for (unsigned i = 0; i < sizeof tiers / sizeof(struct tiers_map); i++) {
+    if (strlen(tiers[i].s) == tier.len &&
+        !memcmp(tier.ptr, tiers[i].s, tier.len)) {
+      *ptier = tiers[i].e;
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+/* Rank of tier as ear_get_worst_tier() orders them, from best to worst */
+unsigned snap_tier_rank(uint32_t tier) {
+  switch (tier) {
+  case EAR_TIER_AFFIRMING:
+    return 0;
+  case EAR_TIER_WARNING:
+    return 2;
+  case EAR_TIER_CONTRAINDICATED:
+    return 3;
+  default: // EAR_TIER_NONE, or no usable status
+    return 1;
+  }
+}
+
+static snap_str_t snap_put(snap_builder_t *sb, const char *s, size_t len) {
+  snap_str_t str = {(uint32_t)sb->pool, (uint32_t)len};
+
+  if (sb->buf != NULL) {
+    memcpy(sb->buf + sb->pool, s, len);
+    sb->buf[sb->pool + len] = '\0';
+  }
+
+  sb->pool += len + 1;
+
+  return str;
+}
+
+static snap_str_t snap_put_str(snap_builder_t *sb, claims_str_t s) {
+  return snap_put(sb, s.ptr, s.len);
+}
+
+/* Put the base64url string s, decoded.  Room is kept for the longest
+ * decoding, so that sizing and filling agree on the layout whatever the
+ * outcome.  Returns 0 if s decodes (always, while sizing) */
+static int snap_put_b64(snap_builder_t *sb, claims_str_t s, snap_str_t *pstr) {
+  size_t max = U_B64URL_DECODED_SZ(s.len), sz = 0;
+  int ret = 0;
+
+  if (sb->buf != NULL) {
+    ret = u_b64url_decode_n(s.ptr, s.len, sb->buf + sb->pool, max, &sz);
+    if (ret == -1)
+      sz = 0;
+
+    sb->buf[sb->pool + sz] = '\0';
+  }
+
+  pstr->off = (uint32_t)sb->pool;
+  pstr->len = (uint32_t)sz;
+  sb->pool += max + 1;
+
+  return ret;
+}
+
+/* Lay out the summary of claims into sb.  With sb->buf == NULL only the
+ * size is worked out */
+static void snap_layout(snap_builder_t *sb, const claims_t *claims,
+                        const ear_verifier_t *verifier, int64_t now) {
+  snap_hdr_t hdr = {0};
+  snap_rec_t rec;
+  size_t nrecs = claims->nsubmods;
+
+  hdr.magic = SNAP_MAGIC;
+  hdr.version = SNAP_VERSION;
+  hdr.alg = (uint32_t)verifier->alg;
+  hdr.verified_at = now;
+  memcpy(hdr.key_id, verifier->key_id, sizeof hdr.key_id);
+  hdr.nrecs = (uint32_t)nrecs;
+  hdr.recs_off = sizeof hdr;
+  hdr.worst_tier = nrecs > 0 ? EAR_TIER_AFFIRMING : EAR_TIER_NONE;
+
+  sb->pool = sizeof hdr + nrecs * sizeof rec;
+
+  if (claims->flags & CLAIMS_IAT)
+    hdr.iat = claims->iat, hdr.flags |= SNAP_IAT;
+  if (claims->flags & CLAIMS_NBF)
+    hdr.nbf = claims->nbf, hdr.flags |= SNAP_NBF;
+  if (claims->flags & CLAIMS_EXP)
+    hdr.exp = claims->exp, hdr.flags |= SNAP_EXP;
+
+  // the profile has been validated, so it is always there
+  hdr.profile = snap_put_str(sb, claims->profile);
+
+  if (claims->jti.ptr != NULL) {
+    hdr.jti = snap_put_str(sb, claims->jti);
+    hdr.flags |= SNAP_JTI;
+  }
+
+  if (claims->build.ptr != NULL) {
+    hdr.build = snap_put_str(sb, claims->build);
+    hdr.flags |= SNAP_BUILD;
+  }
+
+  if (claims->developer.ptr != NULL) {
+    hdr.developer = snap_put_str(sb, claims->developer);
+    hdr.flags |= SNAP_DEVELOPER;
+  }
+
+  // kept encoded: most callers never read it, and those that do can decode
+  // it a chunk at a time
+  if (claims->raw_evidence.ptr != NULL) {
+    hdr.raw_evidence = snap_put_str(sb, claims->raw_evidence);
+    hdr.flags |= SNAP_RAW_EVIDENCE;
+  }
+
+  for (size_t i = 0; i < nrecs; i++) {
+    const claims_submod_t *submod = &claims->submods[i];
+    ear_tier_t tier;
+
+    memset(&rec, 0, sizeof rec);
+    rec.name = snap_put_str(sb, submod->name);
+    rec.tier = SNAP_TIER_UNKNOWN;
+
+    if (submod->status.ptr != NULL) {
+      rec.flags |= SNAP_REC_STATUS;
+      rec.status = snap_put_str(sb, submod->status);
+
+      if (snap_tier(submod->status, &tier) == 0)
+        rec.tier = (uint32_t)tier;
+    }
+
+    if (submod->policy_id.ptr != NULL) {
+      rec.flags |= SNAP_REC_POLICY_ID;
+      rec.policy_id = snap_put_str(sb, submod->policy_id);
+    }
+
+    rec.flags |= submod->tvec_present * SNAP_REC_TV(0);
+    memcpy(rec.tvec, submod->tvec, sizeof rec.tvec);
+
+    if (submod->key_attestation) {
+      rec.flags |= SNAP_REC_KEY_ATTESTATION;
+
+      if (submod->akpub.ptr != NULL) {
+        rec.flags |= SNAP_REC_AKPUB;
+        rec.akpub = snap_put_str(sb, submod->akpub);
+
+        // decoded once here, rather than by every accessor call
+        if (snap_put_b64(sb, submod->akpub, &rec.akpub_der) == 0)
+          rec.flags |= SNAP_REC_AKPUB_DER;
+      }
+    }
+
+    if (snap_tier_rank(rec.tier) > snap_tier_rank(hdr.worst_tier))
+      hdr.worst_tier =
+          rec.tier == SNAP_TIER_UNKNOWN ? EAR_TIER_NONE : rec.tier;
+
+    if (sb->buf != NULL)
+      memcpy(sb->buf + hdr.recs_off + i * sizeof rec, &rec, sizeof rec);
+  }
+
+  // keep the whole blob a multiple of the alignment, so snapshots can be
+  // packed back to back
+  while (sb->pool % SNAP_ALIGN)
+    sb->pool++;
+
+  hdr.size = (uint32_t)sb->pool;
+
+  if (sb->buf != NULL)
+    memcpy(sb->buf, &hdr, sizeof hdr);
+}
+
+/* Summarize claims into ear: into room, from its first aligned byte, if it is
+ * not NULL and large enough, or else into ear's own buffer */
+ear_err_t snap_build(ear_t *ear, const claims_t *claims,
+                     const ear_verifier_t *verifier, int64_t now,
+                     uint8_t *room, size_t room_sz, char err_msg[EAR_ERR_SZ]) {
+  snap_builder_t sb = {NULL, 0};
+  size_t pad = room != NULL ? -(uintptr_t)room % SNAP_ALIGN : 0;
+
+  snap_layout(&sb, claims, verifier, now);
+
+  if (sb.pool > UINT32_MAX) {
+    (void)snprintf(err_msg, EAR_ERR_SZ, "EAR claims-set too large");
+    return EAR_ERR_PAYLOAD;
+  }
+
+  if (room != NULL && pad <= room_sz && sb.pool <= room_sz - pad) {
+    sb.buf = room + pad;
+    goto fill;
+  }
+
+  // a recycled ear comes with a buffer
+  if (sb.pool > ear->buf_sz) {
+    free(ear->buf);
+    ear->buf_sz = 0;
+
+    if ((ear->buf = malloc(sb.pool)) == NULL) {
+      (void)snprintf(err_msg, EAR_ERR_SZ, "cannot allocate the EAR summary");
+      return EAR_ERR_ALLOC;
+    }
+
+    ear->buf_sz = sb.pool;
+  }
+
+  sb.buf = ear->buf;
+
+fill:
+  memset(sb.buf, 0, sb.pool);
+
+  snap_layout(&sb, claims, verifier, now);
+
+  ear->snap = sb.buf;
+  ear->snap_sz = sb.pool;
+
+  return EAR_OK;
+}
+
+static int snap_str_ok(const uint8_t *snap, size_t snap_sz, snap_str_t s) {
+  return (size_t)s.off + s.len < snap_sz && snap[s.off + s.len] == '\0';
+}
+
+ear_err_t snap_check(const uint8_t *snap, size_t snap_sz,
+                     char err_msg[EAR_ERR_SZ]) {
+  const snap_hdr_t *hdr = (const snap_hdr_t *)snap;
+  const snap_rec_t *recs;
+
+  if (((uintptr_t)snap % SNAP_ALIGN) != 0 || snap_sz < sizeof *hdr ||
+      hdr->magic != SNAP_MAGIC || hdr->version != SNAP_VERSION ||
+      hdr->size != snap_sz || hdr->recs_off != sizeof *hdr ||
+      hdr->nrecs > (snap_sz - sizeof *hdr) / sizeof(snap_rec_t) ||
+      hdr->alg >= JWT_ALG_TERM || hdr->worst_tier > EAR_TIER_CONTRAINDICATED)
+    goto err;
+
+  if (!snap_str_ok(snap, snap_sz, hdr->profile) ||
+      ((hdr->flags & SNAP_JTI) && !snap_str_ok(snap, snap_sz, hdr->jti)) ||
+      ((hdr->flags & SNAP_BUILD) && !snap_str_ok(snap, snap_sz, hdr->build)) ||
+      ((hdr->flags & SNAP_DEVELOPER) &&
+       !snap_str_ok(snap, snap_sz, hdr->developer)) ||
+      ((hdr->flags & SNAP_RAW_EVIDENCE) &&
+       !snap_str_ok(snap, snap_sz, hdr->raw_evidence)))
+    goto err;
+
+  recs = (const snap_rec_t *)(snap + hdr->recs_off);
+
+  for (uint32_t i = 0; i < hdr->nrecs; i++) {
+    const snap_rec_t *rec = &recs[i];
+
+    if (!snap_str_ok(snap, snap_sz, rec->name) ||
+        ((rec->flags & SNAP_REC_STATUS) &&
+         !snap_str_ok(snap, snap_sz, rec->status)) ||
+        ((rec->flags & SNAP_REC_AKPUB) &&
+         !snap_str_ok(snap, snap_sz, rec->akpub)) ||
+        ((rec->flags & SNAP_REC_AKPUB_DER) &&
+         !snap_str_ok(snap, snap_sz, rec->akpub_der)) ||
+        ((rec->flags & SNAP_REC_POLICY_ID) &&
+         !snap_str_ok(snap, snap_sz, rec->policy_id)) ||
+        (rec->tier != SNAP_TIER_UNKNOWN &&
+         rec->tier > EAR_TIER_CONTRAINDICATED))
+      goto err;
+  }
+
+  return EAR_OK;
+
+err:
+  (void)snprintf(err_msg, EAR_ERR_SZ, "malformed EAR snapshot");
+  return EAR_ERR_SNAPSHOT;
+}
+
+const snap_rec_t *snap_find(const ear_t *ear, const char *app_rec) {
+  const snap_hdr_t *hdr = SNAP_HDR(ear);
+  const snap_rec_t *recs = SNAP_RECS(ear);
+
+  for (uint32_t i = 0; i < hdr->nrecs; i++)
+    if (!strcmp(SNAP_STR(ear, recs[i].name), app_rec))
+      return &recs[i];
+
+  return NULL;
+}
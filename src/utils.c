@@ -1,4 +1,5 @@
 #include "base64.h"
+#include "ear_priv.h"
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -68,3 +69,163 @@ err:
 
   return -1;
 }
+
+/*
+ * base64 decode exactly in_sz characters using the URL-safe alphabet, without
+ * padding, into the caller supplied buffer @p out of size @p out_sz.
+ * On success (retval=0), @p pout_sz is set to the number of decoded bytes.
+ * @p out may be @p in: the decoded bytes never overtake the encoded ones.
+ */
+int u_b64url_decode_n(const char *in, size_t in_sz, uint8_t *out,
+                      size_t out_sz, size_t *pout_sz) {
+  int n;
+
+  if (in == NULL || in_sz == 0 || U_B64URL_DECODED_SZ(in_sz) > out_sz) {
+    return -1;
+  }
+
+  if ((n = Base64decode_n((char *)out, in, in_sz)) <= 0) {
+    return -1;
+  }
+
+  *pout_sz = (size_t)n;
+
+  return 0;
+}
+
+/*
+ * base64 encode @p in_sz bytes using the URL-safe alphabet, without padding,
+ * into @p out, which must have room for U_B64URL_ENCODED_SZ(in_sz) characters.
+ * Returns the number of characters written; @p out is not NUL terminated.
+ */
+size_t u_b64url_encode_n(const uint8_t *in, size_t in_sz, char *out) {
+  static const char abc[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+  char *o = out;
+  size_t i;
+
+  for (i = 0; i + 2 < in_sz; i += 3) {
+    *o++ = abc[in[i] >> 2];
+    *o++ = abc[(in[i] & 0x03) << 4 | in[i + 1] >> 4];
+    *o++ = abc[(in[i + 1] & 0x0f) << 2 | in[i + 2] >> 6];
+    *o++ = abc[in[i + 2] & 0x3f];
+  }
+
+  if (i < in_sz) {
+    *o++ = abc[in[i] >> 2];
+    if (i + 1 < in_sz) {
+      *o++ = abc[(in[i] & 0x03) << 4 | in[i + 1] >> 4];
+      *o++ = abc[(in[i + 1] & 0x0f) << 2];
+    } else {
+      *o++ = abc[(in[i] & 0x03) << 4];
+    }
+  }
+
+  return (size_t)(o - out);
+}
+
+/*
+ * base64 decode, using the URL-safe alphabet, the bytes from offset @p off of
+ * the decoding of the @p in_sz characters at @p in (padded or not), as many as
+ * fit in @p out, of size @p out_sz.  Only the characters that make up those
+ * bytes are read, so a long string can be decoded a chunk at a time, from
+ * anywhere.
+ * On success (retval=0), @p pout_sz is set to the number of decoded bytes,
+ * which is 0 past the end.
+ */
+int u_b64_decode_at(const char *in, size_t in_sz, size_t off, uint8_t *out,
+                    size_t out_sz, size_t *pout_sz) {
+  uint8_t q[3];
+  size_t g = off / 3, n = 0, k;
+  int m;
+
+  // the padding says nothing that the length does not
+  if (in_sz > 0 && in[in_sz - 1] == '=')
+    in_sz--;
+  if (in_sz > 0 && in[in_sz - 1] == '=')
+    in_sz--;
+
+  if (in_sz % 4 == 1)
+    return -1;
+
+  *pout_sz = 0;
+
+  if (off >= U_B64URL_DECODED_SZ(in_sz))
+    return 0;
+
+  // the rest of a quantum that off falls in the middle of
+  if (off % 3 != 0) {
+    k = in_sz - 4 * g < 4 ? in_sz - 4 * g : 4;
+    if ((m = Base64decode_n((char *)q, in + 4 * g, k)) <= (int)(off % 3))
+      return -1;
+
+    n = (size_t)m - off % 3 < out_sz ? (size_t)m - off % 3 : out_sz;
+    memcpy(out, q + off % 3, n);
+    g++;
+  }
+
+  // whole quanta straight into out
+  k = (out_sz - n) / 3;
+  if (k > (in_sz - 4 * g) / 4)
+    k = (in_sz - 4 * g) / 4;
+
+  while (k > 0) {
+    // in runs that Base64decode_n() can count in an int
+    size_t run = k < (1u << 28) ? k : (1u << 28);
+
+    if (Base64decode_n((char *)out + n, in + 4 * g, 4 * run) != (int)(3 * run))
+      return -1;
+
+    n += 3 * run;
+    g += run;
+    k -= run;
+  }
+
+  // and the start of the next one, or the final partial one
+  if (n < out_sz && 4 * g < in_sz) {
+    k = in_sz - 4 * g < 4 ? in_sz - 4 * g : 4;
+    if ((m = Base64decode_n((char *)q, in + 4 * g, k)) <= 0)
+      return -1;
+
+    k = (size_t)m < out_sz - n ? (size_t)m : out_sz - n;
+    memcpy(out + n, q, k);
+    n += k;
+  }
+
+  *pout_sz = n;
+
+  return 0;
+}
+
+static uint64_t fmix64(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+
+  return k;
+}
+
+/*
+ * Keyed, non-cryptographic 64-bit hash of the @p sz bytes at @p p (in the
+ * style of MurmurHash3, consuming 8 bytes per round).
+ */
+uint64_t u_hash64(const void *p, size_t sz, uint64_t seed) {
+  const uint8_t *b = p;
+  uint64_t h = seed ^ (sz * 0x9e3779b97f4a7c15ULL), k;
+
+  for (; sz >= 8; b += 8, sz -= 8) {
+    memcpy(&k, b, 8);
+    h ^= fmix64(k);
+    h = (h << 27 | h >> 37) * 5 + 0x52dce729;
+  }
+
+  if (sz > 0) {
+    k = 0;
+    memcpy(&k, b, sz);
+    h ^= fmix64(k);
+  }
+
+  return fmix64(h);
+}
@@ -2,83 +2,1554 @@
 // Copyright 2023 Contributors to the Veraison project.
 // SPDX-License-Identifier: Apache-2.0
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "ear.h"
 #include "ear_priv.h"
 #include "unity.h"
+#include <fcntl.h>
+#include <openssl/hmac.h>
+#include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+uint8_t pkey[] = {
+    0x2d, 0x2d, 0x2d, 0x2d, 0x2d, 0x42, 0x45, 0x47, 0x49, 0x4e, 0x20, 0x50,
+    0x55, 0x42, 0x4c, 0x49, 0x43, 0x20, 0x4b, 0x45, 0x59, 0x2d, 0x2d, 0x2d,
+    0x2d, 0x2d, 0x0a, 0x4d, 0x46, 0x6b, 0x77, 0x45, 0x77, 0x59, 0x48, 0x4b,
+    0x6f, 0x5a, 0x49, 0x7a, 0x6a, 0x30, 0x43, 0x41, 0x51, 0x59, 0x49, 0x4b,
+    0x6f, 0x5a, 0x49, 0x7a, 0x6a, 0x30, 0x44, 0x41, 0x51, 0x63, 0x44, 0x51,
+    0x67, 0x41, 0x45, 0x75, 0x73, 0x57, 0x78, 0x48, 0x4b, 0x32, 0x50, 0x6d,
+    0x66, 0x6e, 0x48, 0x4b, 0x77, 0x58, 0x50, 0x53, 0x35, 0x34, 0x6d, 0x30,
+    0x6b, 0x54, 0x63, 0x47, 0x4a, 0x39, 0x30, 0x0a, 0x55, 0x69, 0x67, 0x6c,
+    0x57, 0x69, 0x47, 0x61, 0x68, 0x74, 0x61, 0x67, 0x6e, 0x76, 0x38, 0x67,
+    0x45, 0x34, 0x76, 0x34, 0x4c, 0x63, 0x47, 0x32, 0x31, 0x57, 0x4b, 0x2b,
+    0x44, 0x36, 0x56, 0x4b, 0x74, 0x34, 0x42, 0x4b, 0x4f, 0x6d, 0x53, 0x32,
+    0x31, 0x79, 0x7a, 0x50, 0x37, 0x57, 0x74, 0x76, 0x74, 0x75, 0x30, 0x6f,
+    0x75, 0x2f, 0x77, 0x52, 0x66, 0x67, 0x3d, 0x3d, 0x0a, 0x2d, 0x2d, 0x2d,
+    0x2d, 0x2d, 0x45, 0x4e, 0x44, 0x20, 0x50, 0x55, 0x42, 0x4c, 0x49, 0x43,
+    0x20, 0x4b, 0x45, 0x59, 0x2d, 0x2d, 0x2d, 0x2d, 0x2d, 0x0a};
+
+size_t pkey_sz = sizeof pkey;
+
+const char *valid_ear =
+    "eyJhbGciOiJFUzI1NiIsInR5cCI6IkpXVCJ9"
+    "."
+    "eyJlYXIucmF3LWV2aWRlbmNlIjoiTnpRM01qWTVOek0yTlRZek56UUsiLCJlYXIudmVyaWZp"
+    "ZXItaWQiOnsiYnVpbGQiOiJ2dHMgMC4wLjEiLCJkZXZlbG9wZXIiOiJodHRwczovL3ZlcmFp"
+    "c29uLXByb2plY3Qub3JnIn0sImVhdF9wcm9maWxlIjoidGFnOmdpdGh1Yi5jb20sMjAyMzp2"
+    "ZXJhaXNvbi9lYXIiLCJpYXQiOjEuNjY2NTI5MTg0ZSswOSwianRpIjoiNTViOGIzZmFkOGRk"
+    "MWQ4ZWFjNGU0OGYxMTdmZTUwOGIxMWY4NDRkOWYwMTg5YmZlZDliODc1MTVhNjc1NDI2NCIs"
+    "Im5iZiI6MTY3NzI0Nzg3OSwic3VibW9kcyI6eyJQQVJTRUNfVFBNIjp7ImVhci5hcHByYWlz"
+    "YWwtcG9saWN5LWlkIjoiaHR0cHM6Ly92ZXJhaXNvbi5leGFtcGxlL3BvbGljeS8xLzYwYTAw"
+    "NjhkIiwiZWFyLnN0YXR1cyI6ImFmZmlybWluZyIsImVhci50cnVzdHdvcnRoaW5lc3MtdmVj"
+    "dG9yIjp7ImV4ZWN1dGFibGVzIjoyLCJoYXJkd2FyZSI6MiwiaW5zdGFuY2UtaWRlbnRpdHki"
+    "OjJ9LCJlYXIudmVyYWlzb24ua2V5LWF0dGVzdGF0aW9uIjp7ImFrcHViIjoiTUZrd0V3WUhL"
+    "b1pJemowQ0FRWUlLb1pJemowREFRY0RRZ0FFY2pTcDhfTVdNM2d5OFR1Z1dPMVRwUVNqX3ZJ"
+    "a3NMcEMtZzhsNVMzbHBHYjdQV1dHb0NBakVQOF9BNTlWWndMWGd3b1p6TjBXeHVCUGpwYVdp"
+    "V3NmQ1EifX19fQ"
+    "."
+    "3Ym-f1LEgamxePUM7h6Y2RJDGh9eeL0xKor0n1wE9jdAnLNwm3rTKFV2S2LbqVFoDtK9QGal"
+    "T2t5RnUdfwZNmg";
+
+const uint8_t parsec_tpm_akpub[] = {
+    0x30, 0x59, 0x30, 0x13, 0x06, 0x07, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x02,
+    0x01, 0x06, 0x08, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x03, 0x01, 0x07, 0x03,
+    0x42, 0x00, 0x04, 0x72, 0x34, 0xa9, 0xf3, 0xf3, 0x16, 0x33, 0x78, 0x32,
+    0xf1, 0x3b, 0xa0, 0x58, 0xed, 0x53, 0xa5, 0x04, 0xa3, 0xfe, 0xf2, 0x24,
+    0xb0, 0xba, 0x42, 0xfa, 0x0f, 0x25, 0xe5, 0x2d, 0xe5, 0xa4, 0x66, 0xfb,
+    0x3d, 0x65, 0x86, 0xa0, 0x20, 0x23, 0x10, 0xff, 0x3f, 0x03, 0x9f, 0x55,
+    0x67, 0x02, 0xd7, 0x83, 0x0a, 0x19, 0xcc, 0xdd, 0x16, 0xc6, 0xe0, 0x4f,
+    0x8e, 0x96, 0x96, 0x89, 0x6b, 0x1f, 0x09};
+
+// the claims of valid_ear, as a CWT signed with cwt_pkey
+const char *cwt_pkey =
+    "-----BEGIN PUBLIC KEY-----\n"
+    "MFkwEwYHKoZIzj0CAQYIKoZIzj0DAQcDQgAEmJcgdxZWAuBZNqT1IfTkb5njnwXo\n"
+    "qzC6vehi1B8M0LXnqGHlN5WSI01gdnenbFsFfCRHdD92uFQfvCwBl2uLOw==\n"
+    "-----END PUBLIC KEY-----\n";
+
+const uint8_t valid_ear_cwt[] = {
+    0xd2, 0x84, 0x43, 0xa1, 0x01, 0x26, 0xa0, 0x59, 0x01, 0x6b, 0xa7, 0x19,
+    0x03, 0xea, 0x4f, 0x37, 0x34, 0x37, 0x32, 0x36, 0x39, 0x37, 0x33, 0x36,
+    0x35, 0x36, 0x33, 0x37, 0x34, 0x0a, 0x19, 0x03, 0xec, 0xa2, 0x00, 0x69,
+    0x76, 0x74, 0x73, 0x20, 0x30, 0x2e, 0x30, 0x2e, 0x31, 0x01, 0x78, 0x1c,
+    0x68, 0x74, 0x74, 0x70, 0x73, 0x3a, 0x2f, 0x2f, 0x76, 0x65, 0x72, 0x61,
+    0x69, 0x73, 0x6f, 0x6e, 0x2d, 0x70, 0x72, 0x6f, 0x6a, 0x65, 0x63, 0x74,
+    0x2e, 0x6f, 0x72, 0x67, 0x19, 0x01, 0x09, 0x78, 0x20, 0x74, 0x61, 0x67,
+    0x3a, 0x67, 0x69, 0x74, 0x68, 0x75, 0x62, 0x2e, 0x63, 0x6f, 0x6d, 0x2c,
+    0x32, 0x30, 0x32, 0x33, 0x3a, 0x76, 0x65, 0x72, 0x61, 0x69, 0x73, 0x6f,
+    0x6e, 0x2f, 0x65, 0x61, 0x72, 0x06, 0x1a, 0x63, 0x55, 0x37, 0xa0, 0x07,
+    0x58, 0x20, 0x55, 0xb8, 0xb3, 0xfa, 0xd8, 0xdd, 0x1d, 0x8e, 0xac, 0x4e,
+    0x48, 0xf1, 0x17, 0xfe, 0x50, 0x8b, 0x11, 0xf8, 0x44, 0xd9, 0xf0, 0x18,
+    0x9b, 0xfe, 0xd9, 0xb8, 0x75, 0x15, 0xa6, 0x75, 0x42, 0x64, 0x05, 0x1a,
+    0x63, 0xf8, 0xc5, 0x87, 0x19, 0x01, 0x0a, 0xa1, 0x6a, 0x50, 0x41, 0x52,
+    0x53, 0x45, 0x43, 0x5f, 0x54, 0x50, 0x4d, 0xa4, 0x19, 0x03, 0xeb, 0x78,
+    0x2a, 0x68, 0x74, 0x74, 0x70, 0x73, 0x3a, 0x2f, 0x2f, 0x76, 0x65, 0x72,
+    0x61, 0x69, 0x73, 0x6f, 0x6e, 0x2e, 0x65, 0x78, 0x61, 0x6d, 0x70, 0x6c,
+    0x65, 0x2f, 0x70, 0x6f, 0x6c, 0x69, 0x63, 0x79, 0x2f, 0x31, 0x2f, 0x36,
+    0x30, 0x61, 0x30, 0x30, 0x36, 0x38, 0x64, 0x19, 0x03, 0xe8, 0x02, 0x19,
+    0x03, 0xe9, 0xa3, 0x02, 0x02, 0x04, 0x02, 0x00, 0x02, 0x3a, 0x00, 0x01,
+    0x11, 0x71, 0xa1, 0x65, 0x61, 0x6b, 0x70, 0x75, 0x62, 0x78, 0x7a, 0x4d,
+    0x46, 0x6b, 0x77, 0x45, 0x77, 0x59, 0x48, 0x4b, 0x6f, 0x5a, 0x49, 0x7a,
+    0x6a, 0x30, 0x43, 0x41, 0x51, 0x59, 0x49, 0x4b, 0x6f, 0x5a, 0x49, 0x7a,
+    0x6a, 0x30, 0x44, 0x41, 0x51, 0x63, 0x44, 0x51, 0x67, 0x41, 0x45, 0x63,
+    0x6a, 0x53, 0x70, 0x38, 0x5f, 0x4d, 0x57, 0x4d, 0x33, 0x67, 0x79, 0x38,
+    0x54, 0x75, 0x67, 0x57, 0x4f, 0x31, 0x54, 0x70, 0x51, 0x53, 0x6a, 0x5f,
+    0x76, 0x49, 0x6b, 0x73, 0x4c, 0x70, 0x43, 0x2d, 0x67, 0x38, 0x6c, 0x35,
+    0x53, 0x33, 0x6c, 0x70, 0x47, 0x62, 0x37, 0x50, 0x57, 0x57, 0x47, 0x6f,
+    0x43, 0x41, 0x6a, 0x45, 0x50, 0x38, 0x5f, 0x41, 0x35, 0x39, 0x56, 0x5a,
+    0x77, 0x4c, 0x58, 0x67, 0x77, 0x6f, 0x5a, 0x7a, 0x4e, 0x30, 0x57, 0x78,
+    0x75, 0x42, 0x50, 0x6a, 0x70, 0x61, 0x57, 0x69, 0x57, 0x73, 0x66, 0x43,
+    0x51, 0x58, 0x40, 0xf8, 0xcf, 0x6c, 0x29, 0x37, 0x4b, 0xfc, 0x91, 0x0a,
+    0x5c, 0x87, 0x7d, 0xee, 0x0e, 0xe9, 0xa0, 0x9b, 0xb0, 0x8f, 0x29, 0x74,
+    0xa4, 0x90, 0x66, 0x2b, 0x5c, 0x01, 0x93, 0x90, 0x60, 0x6f, 0x37, 0x2c,
+    0x08, 0xd8, 0xa6, 0x55, 0xaa, 0xd1, 0x3a, 0xbc, 0x1c, 0x73, 0xfc, 0x59,
+    0x11, 0xa4, 0xbc, 0xc1, 0x2b, 0xfd, 0x6e, 0xe0, 0x70, 0x73, 0x97, 0xb8,
+    0x43, 0xad, 0xf6, 0xd3, 0x6d, 0xbf, 0x83};
+
+// an EAR signed with cwt_pkey, whose attested key has signed "pop challenge"
+// into pop_sig
+const char *pop_ear =
+    "eyJhbGciOiJFUzI1NiIsInR5cCI6IkpXVCJ9.eyJlYXRfcHJvZmlsZSI6InRhZzpnaXRodWI"
+    "uY29tLDIwMjM6dmVyYWlzb24vZWFyIiwiaWF0IjoxNjY2NTI5MTg0LCJqdGkiOiJwb3AtdGV"
+    "zdCIsInN1Ym1vZHMiOnsiUEFSU0VDX1RQTSI6eyJlYXIuc3RhdHVzIjoiYWZmaXJtaW5nIiw"
+    "iZWFyLnZlcmFpc29uLmtleS1hdHRlc3RhdGlvbiI6eyJha3B1YiI6Ik1Ga3dFd1lIS29aSXp"
+    "qMENBUVlJS29aSXpqMERBUWNEUWdBRVVBQ0pKcHRobGtMQV82Njh6eGtBTjR2a19zSW05cXI"
+    "tTEJfcXE3N0ZJcnF5UE1MZHVzUXk2OXdpNVRKR1JZZ2lPTGoyZ05yNmxpeEo2cWFyc1N6RDN"
+    "RIn19fX0.04v4eRIs30Xr-fPY0htl3_enP4R-dSiQPGyqo38fse0c1kMtDBLUFwCE0bwhiRM"
+    "nCeR7oKStYHewiEALMRIahA";
+
+const uint8_t pop_sig[] = {
+    0xf3, 0x26, 0x6e, 0x08, 0x3f, 0x93, 0x93, 0x2c, 0x7e, 0xbe, 0xdc, 0x43,
+    0xe5, 0x6b, 0x73, 0x1a, 0xb1, 0x30, 0xc5, 0xd6, 0xbf, 0xbc, 0x24, 0x25,
+    0xa1, 0xb8, 0x7f, 0x88, 0x93, 0xe2, 0xe1, 0x3d, 0xc7, 0xfc, 0x14, 0xbc,
+    0xbe, 0x23, 0x12, 0xab, 0x06, 0x1c, 0x75, 0x5f, 0x05, 0x80, 0x85, 0xd1,
+    0xd7, 0xa8, 0xe4, 0xec, 0x92, 0xe8, 0x9f, 0x68, 0x12, 0xe4, 0xc6, 0xdc,
+    0x54, 0xe1, 0x42, 0x54};
+
+void test_jwt_verify_valid_ear(void) {
+  ear_t *ear;
+  int ret = ear_jwt_verify(valid_ear, pkey, pkey_sz, "ES256", &ear, NULL);
+  TEST_ASSERT(ret == 0);
+
+  ear_free(ear);
+}
+
+void test_verifier_jwt_verify_valid_ear(void) {
+  ear_verifier_t *verifier;
+  ear_t *ear;
+  int ret = ear_verifier_new(pkey, pkey_sz, "ES256", &verifier, NULL);
+  TEST_ASSERT(ret == 0);
+
+  // the verifier (and its per-thread contexts) are reusable
+  for (int i = 0; i < 3; i++) {
+    ret = ear_verifier_jwt_verify(verifier, valid_ear, &ear, NULL);
+    TEST_ASSERT(ret == 0);
+
+    ear_free(ear);
+  }
+
+  ear_verifier_free(verifier);
+}
+
+void test_jwt_verify_bad_signature(void) {
+  ear_t *ear = NULL;
+  char err_msg[EAR_ERR_SZ];
+  size_t sz = strlen(valid_ear);
+  char *tampered = strdup(valid_ear);
+
+  tampered[sz - 1] = (tampered[sz - 1] == 'A') ? 'B' : 'A';
+
+  int ret = ear_jwt_verify(tampered, pkey, pkey_sz, "ES256", &ear, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING("cannot verify EAR JWT signature", err_msg);
+
+  ret = ear_jwt_verify(valid_ear, pkey, pkey_sz, "ES384", &ear, err_msg);
+  TEST_ASSERT(ret == -1);
+
+  free(tampered);
+}
+
+void test_jwt_header_cache(void) {
+  ear_verifier_t *es256, *hs256;
+  ear_t *ear;
+  char err_msg[EAR_ERR_SZ];
+  const uint8_t secret[32] = {0};
+  int ret = ear_verifier_new(pkey, pkey_sz, "ES256", &es256, NULL);
+  TEST_ASSERT(ret == 0);
+
+  ret = ear_verifier_new(secret, sizeof secret, "HS256", &hs256, NULL);
+  TEST_ASSERT(ret == 0);
+
+  // the second time round, the header is this thread's decoded copy
+  for (int i = 0; i < 2; i++) {
+    ret = ear_verifier_jwt_verify(es256, valid_ear, &ear, NULL);
+    TEST_ASSERT(ret == 0);
+    ear_free(ear);
+  }
+
+  // which was only ever checked against ES256
+  ret = ear_verifier_jwt_verify(hs256, valid_ear, &ear, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING(
+      "EAR JWT algorithm does not match the expected \"HS256\"", err_msg);
+
+  ear_verifier_free(hs256);
+  ear_verifier_free(es256);
+}
+
+void test_jwt_parse(void) {
+  ear_verifier_t *verifier;
+  ear_jwt_parsed_t *parsed;
+  ear_t *ear;
+  ear_tier_t tier;
+  const char *alg, *kid, *iss, *profile;
+  char err_msg[EAR_ERR_SZ];
+  size_t sz = strlen(valid_ear);
+  char *tampered = strdup(valid_ear);
+  int ret = ear_jwt_parse(valid_ear, &parsed, NULL);
+  TEST_ASSERT(ret == 0);
+
+  ret = ear_jwt_parsed_get_info(parsed, &alg, &kid, &iss, &profile);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_STRING("ES256", alg);
+  TEST_ASSERT_NULL(kid);
+  TEST_ASSERT_NULL(iss);
+  TEST_ASSERT_EQUAL_STRING("tag:github.com,2023:veraison/ear", profile);
+
+  ret = ear_verifier_new(pkey, pkey_sz, alg, &verifier, NULL);
+  TEST_ASSERT(ret == 0);
+
+  ret = ear_jwt_verify_parsed(verifier, parsed, &ear, NULL);
+  TEST_ASSERT(ret == 0);
+
+  ret = ear_get_status(ear, "PARSEC_TPM", &tier, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_INT(EAR_TIER_AFFIRMING, tier);
+
+  ear_free(ear);
+  ear_jwt_parsed_free(parsed);
+
+  // decoding does not mean verifying
+  tampered[sz - 1] = (tampered[sz - 1] == 'A') ? 'B' : 'A';
+
+  ret = ear_jwt_parse(tampered, &parsed, NULL);
+  TEST_ASSERT(ret == 0);
+
+  ret = ear_jwt_verify_parsed(verifier, parsed, &ear, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING("cannot verify EAR JWT signature", err_msg);
+
+  ear_jwt_parsed_free(parsed);
+
+  ret = ear_jwt_parse("not.a-jwt", &parsed, err_msg);
+  TEST_ASSERT(ret == -1);
+
+  ear_verifier_free(verifier);
+  free(tampered);
+}
+
+void test_cwt_verify_valid_ear(void) {
+  ear_t *ear;
+  ear_tier_t tier;
+  uint8_t *akpub;
+  size_t akpub_sz;
+  int ret = ear_cwt_verify(valid_ear_cwt, sizeof valid_ear_cwt,
+                           (const uint8_t *)cwt_pkey, strlen(cwt_pkey), "ES256",
+                           &ear, NULL);
+  TEST_ASSERT(ret == 0);
+
+  // the accessors see the same claims as with the JWT serialization
+  ret = ear_get_status(ear, "PARSEC_TPM", &tier, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_INT(EAR_TIER_AFFIRMING, tier);
+
+  ret = ear_veraison_get_akpub(ear, "PARSEC_TPM", &akpub, &akpub_sz, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_size_t(sizeof parsec_tpm_akpub, akpub_sz);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(parsec_tpm_akpub, akpub,
+                                sizeof parsec_tpm_akpub);
+
+  free(akpub);
+  ear_free(ear);
+}
+
+void test_cwt_verify_bad_signature(void) {
+  ear_t *ear = NULL;
+  char err_msg[EAR_ERR_SZ];
+  uint8_t tampered[sizeof valid_ear_cwt];
+
+  memcpy(tampered, valid_ear_cwt, sizeof tampered);
+  tampered[sizeof tampered - 1] ^= 0x01;
+
+  int ret = ear_cwt_verify(tampered, sizeof tampered,
+                           (const uint8_t *)cwt_pkey, strlen(cwt_pkey), "ES256",
+                           &ear, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING("cannot verify EAR CWT signature", err_msg);
+
+  ret = ear_cwt_verify(valid_ear_cwt, sizeof valid_ear_cwt,
+                       (const uint8_t *)cwt_pkey, strlen(cwt_pkey), "ES384",
+                       &ear, err_msg);
+  TEST_ASSERT(ret == -1);
+
+  // truncated
+  ret = ear_cwt_verify(valid_ear_cwt, sizeof valid_ear_cwt - 1,
+                       (const uint8_t *)cwt_pkey, strlen(cwt_pkey), "ES256",
+                       &ear, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING("malformed EAR CWT", err_msg);
+}
+
+void test_snapshot_load(void) {
+  ear_t *ear, *loaded;
+  const uint8_t *snap, *key_id;
+  uint8_t *copy, digest[EAR_KEY_ID_SZ];
+  size_t snap_sz, akpub_sz, app_rec_count;
+  const char *alg, **app_rec_list;
+  int64_t verified_at;
+  ear_tier_t tier;
+  uint8_t *akpub;
+  char err_msg[EAR_ERR_SZ];
+  int ret = ear_jwt_verify(valid_ear, pkey, pkey_sz, "ES256", &ear, NULL);
+  TEST_ASSERT(ret == 0);
+
+  ret = ear_snapshot(ear, &snap, &snap_sz);
+  TEST_ASSERT(ret == 0);
+
+  // the snapshot outlives (and does not depend on) the original EAR
+  copy = malloc(snap_sz);
+  memcpy(copy, snap, snap_sz);
+  ear_free(ear);
+
+  ret = ear_snapshot_load(copy, snap_sz, &loaded, NULL);
+  TEST_ASSERT(ret == 0);
+
+  ret = ear_get_status(loaded, "PARSEC_TPM", &tier, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_INT(EAR_TIER_AFFIRMING, tier);
+
+  ret = ear_veraison_get_akpub(loaded, "PARSEC_TPM", &akpub, &akpub_sz, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(parsec_tpm_akpub, akpub,
+                                sizeof parsec_tpm_akpub);
+  free(akpub);
+
+  ret = ear_get_app_recs(loaded, &app_rec_list, &app_rec_count);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_size_t(1, app_rec_count);
+  TEST_ASSERT_EQUAL_STRING("PARSEC_TPM", app_rec_list[0]);
+  free(app_rec_list);
+
+  ret = ear_get_verification_context(loaded, &alg, &key_id, &verified_at);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_STRING("ES256", alg);
+  TEST_ASSERT(verified_at > 0);
+  EVP_Digest(pkey, pkey_sz, digest, NULL, EVP_sha256(), NULL);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(digest, key_id, EAR_KEY_ID_SZ);
+
+  ear_free(loaded);
+
+  // a damaged snapshot is refused
+  copy[0] ^= 0xff;
+  ret = ear_snapshot_load(copy, snap_sz, &loaded, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING("malformed EAR snapshot", err_msg);
+  copy[0] ^= 0xff;
+
+  ret = ear_snapshot_load(copy, snap_sz - 8, &loaded, err_msg);
+  TEST_ASSERT(ret == -1);
+
+  free(copy);
+}
+
+void test_replay_guard(void) {
+  ear_replay_guard_t *guard;
+  ear_verifier_t *verifier;
+  ear_t *ear = NULL;
+  char err_msg[EAR_ERR_SZ];
+  int ret = ear_replay_guard_new(16, 60, &guard, NULL);
+  TEST_ASSERT(ret == 0);
+
+  ret = ear_replay_guard_check(guard, "a", 1, 0, NULL);
+  TEST_ASSERT(ret == 0);
+  ret = ear_replay_guard_check(guard, "b", 1, 0, NULL);
+  TEST_ASSERT(ret == 0);
+  ret = ear_replay_guard_check(guard, "a", 1, 0, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING("\"jti\" has already been seen", err_msg);
+
+  // expired values can be reused
+  ret = ear_replay_guard_check(guard, "c", 1, 1, NULL);
+  TEST_ASSERT(ret == 0);
+  ret = ear_replay_guard_check(guard, "c", 1, 1, NULL);
+  TEST_ASSERT(ret == 0);
+
+  // a guarded verifier accepts valid_ear only once
+  ret = ear_verifier_new(pkey, pkey_sz, "ES256", &verifier, NULL);
+  TEST_ASSERT(ret == 0);
+  ear_verifier_set_replay_guard(verifier, guard);
+  ret = ear_verifier_jwt_verify(verifier, valid_ear, &ear, NULL);
+  TEST_ASSERT(ret == 0);
+  ear_free(ear);
+  ret = ear_verifier_jwt_verify(verifier, valid_ear, &ear, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING("replayed EAR (\"jti\" seen before)", err_msg);
+
+  ear_verifier_free(verifier);
+  ear_replay_guard_free(guard);
+}
+
+void test_cache(void) {
+  ear_cache_t *cache;
+  ear_verifier_t *verifier, *other;
+  ear_t *ear = NULL;
+  ear_tier_t tier;
+  uint64_t hits, misses;
+  char err_msg[EAR_ERR_SZ];
+  int ret = ear_cache_open(NULL, 16, 4096, 60, &cache, NULL);
+  TEST_ASSERT(ret == 0);
+
+  ret = ear_verifier_new(pkey, pkey_sz, "ES256", &verifier, NULL);
+  TEST_ASSERT(ret == 0);
+  ear_verifier_set_cache(verifier, cache);
+
+  // verified once, then served from the cache
+  ret = ear_verifier_jwt_verify(verifier, valid_ear, &ear, NULL);
+  TEST_ASSERT(ret == 0);
+  ear_free(ear);
+  ret = ear_verifier_jwt_verify(verifier, valid_ear, &ear, NULL);
+  TEST_ASSERT(ret == 0);
+  ret = ear_get_status(ear, "PARSEC_TPM", &tier, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT(tier == EAR_TIER_AFFIRMING);
+  ear_free(ear);
+
+  ret = ear_cache_stats(cache, &hits, &misses);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT(hits == 1 && misses == 1);
+
+  // an entry stored under one key is no good to another
+  ret = ear_verifier_new((const uint8_t *)cwt_pkey, strlen(cwt_pkey), "ES256",
+                         &other, NULL);
+  TEST_ASSERT(ret == 0);
+  ear_verifier_set_cache(other, cache);
+  ret = ear_verifier_jwt_verify(other, valid_ear, &ear, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING("cannot verify EAR JWT signature", err_msg);
+
+  ear_verifier_free(other);
+  ear_verifier_free(verifier);
+  ear_cache_close(cache);
+}
+
+void test_cache_named(void) {
+  ear_cache_t *cache, *again;
+  ear_verifier_t *verifier;
+  ear_t *ear = NULL;
+  uint64_t hits;
+  char name[64], err_msg[EAR_ERR_SZ];
+  int fd, ret;
+
+  (void)snprintf(name, sizeof name, "/ear-test-%ld", (long)getpid());
+
+  // what an initialiser that died half-way leaves behind
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  TEST_ASSERT(fd != -1);
+  TEST_ASSERT(ftruncate(fd, 4096) == 0);
+  (void)close(fd);
+
+  ret = ear_cache_open(name, 16, 4096, 60, &cache, err_msg);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, ret, err_msg);
+  ret = ear_cache_open(name, 16, 4096, 60, &again, err_msg);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, ret, err_msg);
+
+  ret = ear_verifier_new(pkey, pkey_sz, "ES256", &verifier, NULL);
+  TEST_ASSERT(ret == 0);
+
+  // stored through one mapping, found through the other
+  ear_verifier_set_cache(verifier, cache);
+  ret = ear_verifier_jwt_verify(verifier, valid_ear, &ear, NULL);
+  TEST_ASSERT(ret == 0);
+  ear_free(ear);
+
+  ear_verifier_set_cache(verifier, again);
+  ret = ear_verifier_jwt_verify(verifier, valid_ear, &ear, NULL);
+  TEST_ASSERT(ret == 0);
+  ear_free(ear);
+
+  ret = ear_cache_stats(cache, &hits, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_UINT64(1, hits);
+
+  ear_verifier_free(verifier);
+  ear_cache_close(again);
+  ear_cache_close(cache);
+  (void)shm_unlink(name);
+}
+
+void test_cache_file(void) {
+  char path[64];
+  ear_cache_t *cache;
+  ear_verifier_t *verifier;
+  ear_t *ear = NULL;
+  uint64_t hits, misses;
+  int ret;
+
+  (void)snprintf(path, sizeof path, "/tmp/ear_test_cache.%ld",
+                 (long)getpid());
+
+  ret = ear_verifier_new(pkey, pkey_sz, "ES256", &verifier, NULL);
+  TEST_ASSERT(ret == 0);
+
+  ret = ear_cache_open_file(path, 16, 4096, 60, 0, &cache, NULL);
+  TEST_ASSERT(ret == 0);
+  ear_verifier_set_cache(verifier, cache);
+  ret = ear_verifier_jwt_verify(verifier, valid_ear, &ear, NULL);
+  TEST_ASSERT(ret == 0);
+  ear_free(ear);
+  ear_cache_close(cache);
+
+  // still warm after reopening, and nothing to reclaim
+  ret = ear_cache_open_file(path, 16, 4096, 60, 1, &cache, NULL);
+  TEST_ASSERT(ret == 0);
+  ear_verifier_set_cache(verifier, cache);
+  ret = ear_verifier_jwt_verify(verifier, valid_ear, &ear, NULL);
+  TEST_ASSERT(ret == 0);
+  ear_free(ear);
+
+  ret = ear_cache_stats(cache, &hits, &misses);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT(hits == 1 && misses == 1);
+  TEST_ASSERT(ear_cache_compact(cache) == 0);
+
+  ear_verifier_free(verifier);
+  ear_cache_close(cache);
+  (void)unlink(path);
+}
+
+static void *shared_ear_reader(void *arg) {
+  ear_t *ear = arg;
+  EVP_PKEY *akpub_pkey = NULL;
+  ear_tier_t tier;
+
+  for (int i = 0; i < 100; i++) {
+    if (ear_get_status(ear, "PARSEC_TPM", &tier, NULL) != 0 ||
+        tier != EAR_TIER_AFFIRMING ||
+        ear_veraison_get_akpub_pkey(ear, "PARSEC_TPM", &akpub_pkey, NULL) != 0)
+      break;
+  }
+
+  ear_unref(ear);
+
+  return akpub_pkey;
+}
+
+void test_ear_ref(void) {
+  pthread_t threads[4];
+  void *akpub_pkey[4];
+  ear_t *ear;
+  int ret = ear_jwt_verify(valid_ear, pkey, pkey_sz, "ES256", &ear, NULL);
+  TEST_ASSERT(ret == 0);
+
+  // every reader gets its own reference, and the same lazily parsed key
+  for (int i = 0; i < 4; i++) {
+    ret = pthread_create(&threads[i], NULL, shared_ear_reader, ear_ref(ear));
+    TEST_ASSERT(ret == 0);
+  }
+
+  for (int i = 0; i < 4; i++) {
+    ret = pthread_join(threads[i], &akpub_pkey[i]);
+    TEST_ASSERT(ret == 0);
+    TEST_ASSERT(akpub_pkey[i] != NULL && akpub_pkey[i] == akpub_pkey[0]);
+  }
+
+  // the last reference frees it
+  ear_unref(ear);
+}
+
+void test_verifier_reverify(void) {
+  ear_verifier_t *jwt_verifier, *cwt_verifier;
+  ear_t *ear;
+  ear_tier_t tier;
+  char err_msg[EAR_ERR_SZ];
+  size_t sz = strlen(valid_ear);
+  char *tampered = strdup(valid_ear);
+  int ret = ear_verifier_new(pkey, pkey_sz, "ES256", &jwt_verifier, NULL);
+  TEST_ASSERT(ret == 0);
+
+  ret = ear_verifier_new((const uint8_t *)cwt_pkey, strlen(cwt_pkey), "ES256",
+                         &cwt_verifier, NULL);
+  TEST_ASSERT(ret == 0);
+
+  ret = ear_verifier_jwt_verify(jwt_verifier, valid_ear, &ear, NULL);
+  TEST_ASSERT(ret == 0);
+
+  // the same object, over and over, in either format
+  for (int i = 0; i < 4; i++) {
+    ret = ear_verifier_jwt_reverify(jwt_verifier, valid_ear, ear, NULL);
+    TEST_ASSERT(ret == 0);
+
+    ret = ear_verifier_cwt_reverify(cwt_verifier, valid_ear_cwt,
+                                    sizeof valid_ear_cwt, ear, NULL);
+    TEST_ASSERT(ret == 0);
+
+    ret = ear_get_status(ear, "PARSEC_TPM", &tier, NULL);
+    TEST_ASSERT(ret == 0);
+    TEST_ASSERT_EQUAL_INT(EAR_TIER_AFFIRMING, tier);
+  }
+
+  // a failure leaves it empty, but reusable
+  tampered[sz - 1] = (tampered[sz - 1] == 'A') ? 'B' : 'A';
+
+  ret = ear_verifier_jwt_reverify(jwt_verifier, tampered, ear, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING("cannot verify EAR JWT signature", err_msg);
+
+  ret = ear_verifier_jwt_reverify(jwt_verifier, valid_ear, ear, NULL);
+  TEST_ASSERT(ret == 0);
+
+  ret = ear_get_status(ear, "PARSEC_TPM", &tier, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_INT(EAR_TIER_AFFIRMING, tier);
+
+  ear_free(ear);
+  ear_verifier_free(cwt_verifier);
+  ear_verifier_free(jwt_verifier);
+  free(tampered);
+}
+
+void test_verifier_jwt_verify_inplace(void) {
+  ear_verifier_t *verifier;
+  ear_t *ear, *ref;
+  ear_tier_t tier;
+  const char **app_recs;
+  const uint8_t *akpub, *akpub_want, *snap;
+  size_t app_recs_sz, akpub_sz, akpub_want_sz, snap_sz;
+  size_t sz = strlen(valid_ear), buf_sz = sz + 1024;
+  char *buf = malloc(buf_sz);
+  char err_msg[EAR_ERR_SZ];
+  int ret = ear_verifier_new(pkey, pkey_sz, "ES256", &verifier, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT(buf != NULL);
+
+  ret = ear_verifier_jwt_verify(verifier, valid_ear, &ref, NULL);
+  TEST_ASSERT(ret == 0);
+
+  ret = ear_veraison_get_akpub_ref(ref, "PARSEC_TPM", &akpub_want,
+                                   &akpub_want_sz, NULL);
+  TEST_ASSERT(ret == 0);
+
+  // with room to spare, the summary and all it returns are in buf
+  memcpy(buf, valid_ear, sz + 1);
+
+  ret = ear_verifier_jwt_verify_inplace(verifier, buf, buf_sz, &ear, err_msg);
+  TEST_ASSERT(ret == 0);
+
+  ret = ear_snapshot(ear, &snap, &snap_sz);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT((const char *)snap >= buf &&
+              (const char *)snap + snap_sz <= buf + buf_sz);
+
+  ret = ear_get_app_recs(ear, &app_recs, &app_recs_sz);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_size_t(1, app_recs_sz);
+  TEST_ASSERT_EQUAL_STRING("PARSEC_TPM", app_recs[0]);
+  TEST_ASSERT(app_recs[0] >= buf && app_recs[0] < buf + buf_sz);
+  free((void *)app_recs);
+
+  ret = ear_get_status(ear, "PARSEC_TPM", &tier, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_INT(EAR_TIER_AFFIRMING, tier);
+
+  ret = ear_veraison_get_akpub_ref(ear, "PARSEC_TPM", &akpub, &akpub_sz, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT((const char *)akpub >= buf &&
+              (const char *)akpub < buf + buf_sz);
+  TEST_ASSERT_EQUAL_size_t(akpub_want_sz, akpub_sz);
+  TEST_ASSERT_EQUAL_MEMORY(akpub_want, akpub, akpub_sz);
+
+  ear_free(ear);
+
+  // with none, the summary goes to the ear_t, all the same
+  memcpy(buf, valid_ear, sz + 1);
+
+  ret = ear_verifier_jwt_verify_inplace(verifier, buf, sz + 1, &ear, NULL);
+  TEST_ASSERT(ret == 0);
+
+  ret = ear_get_status(ear, "PARSEC_TPM", &tier, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_INT(EAR_TIER_AFFIRMING, tier);
+
+  ear_free(ear);
+
+  // the signature is checked before anything is decoded
+  memcpy(buf, valid_ear, sz + 1);
+  buf[sz - 1] = (buf[sz - 1] == 'A') ? 'B' : 'A';
+
+  ret = ear_verifier_jwt_verify_inplace(verifier, buf, buf_sz, &ear, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING("cannot verify EAR JWT signature", err_msg);
+
+  // no NUL within buf_sz
+  memset(buf, 'A', buf_sz);
+
+  ret = ear_verifier_jwt_verify_inplace(verifier, buf, buf_sz, &ear, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING("malformed EAR JWT", err_msg);
+
+  ear_free(ref);
+  ear_verifier_free(verifier);
+  free(buf);
+}
+
+void test_get_status_affirming(void) {
+  ear_t *ear;
+  int ret = ear_jwt_verify(valid_ear, pkey, pkey_sz, "ES256", &ear, NULL);
+  TEST_ASSERT(ret == 0);
+
+  ear_tier_t tier;
+
+  ret = ear_get_status(ear, "PARSEC_TPM", &tier, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_INT(EAR_TIER_AFFIRMING, tier);
+
+  ear_free(ear);
+}
+
+// the secret of the HS256 EARs made by hs256_ear()
+const uint8_t hs256_secret[32] = {0};
+
+/* An EAR JWT over claims, signed with hs256_secret.  Free with free() */
+static char *hs256_ear(const char *claims) {
+  const char *hdr = "{\"alg\":\"HS256\",\"typ\":\"JWT\"}";
+  size_t hdr_sz = strlen(hdr), claims_sz = strlen(claims), sz;
+  char *jwt = malloc(U_B64URL_ENCODED_SZ(hdr_sz) +
+                     U_B64URL_ENCODED_SZ(claims_sz) + 48);
+  uint8_t mac[32];
+  unsigned mac_sz = sizeof mac;
+
+  TEST_ASSERT_NOT_NULL(jwt);
+
+  sz = u_b64url_encode_n((const uint8_t *)hdr, hdr_sz, jwt);
+  jwt[sz++] = '.';
+  sz += u_b64url_encode_n((const uint8_t *)claims, claims_sz, jwt + sz);
+
+  TEST_ASSERT_NOT_NULL(HMAC(EVP_sha256(), hs256_secret, sizeof hs256_secret,
+                            (const uint8_t *)jwt, sz, mac, &mac_sz));
+
+  jwt[sz++] = '.';
+  sz += u_b64url_encode_n(mac, mac_sz, jwt + sz);
+  jwt[sz] = '\0';
+
+  return jwt;
+}
+
+void test_get_tiers(void) {
+  struct {
+    const char *submods;
+    ear_tier_t worst;
+    size_t nrecs;
+    ear_tier_t tiers[4];
+  } tcs[] = {
+      {"{\"a\":{\"ear.status\":\"affirming\"},"
+       "\"b\":{\"ear.status\":\"affirming\"}}",
+       EAR_TIER_AFFIRMING, 2, {EAR_TIER_AFFIRMING, EAR_TIER_AFFIRMING}},
+      {"{\"a\":{\"ear.status\":\"affirming\"},"
+       "\"b\":{\"ear.status\":\"none\"}}",
+       EAR_TIER_NONE, 2, {EAR_TIER_AFFIRMING, EAR_TIER_NONE}},
+      // a missing or unknown status is as good as "none"
+      {"{\"a\":{\"ear.status\":\"affirming\"},\"b\":{},"
+       "\"c\":{\"ear.status\":\"so-so\"}}",
+       EAR_TIER_NONE, 3, {EAR_TIER_AFFIRMING, EAR_TIER_NONE, EAR_TIER_NONE}},
+      {"{\"a\":{\"ear.status\":\"none\"},"
+       "\"b\":{\"ear.status\":\"warning\"},"
+       "\"c\":{\"ear.status\":\"affirming\"}}",
+       EAR_TIER_WARNING, 3,
+       {EAR_TIER_NONE, EAR_TIER_WARNING, EAR_TIER_AFFIRMING}},
+      {"{\"a\":{\"ear.status\":\"contraindicated\"},"
+       "\"b\":{\"ear.status\":\"warning\"},"
+       "\"c\":{\"ear.status\":\"none\"},"
+       "\"d\":{\"ear.status\":\"affirming\"}}",
+       EAR_TIER_CONTRAINDICATED, 4,
+       {EAR_TIER_CONTRAINDICATED, EAR_TIER_WARNING, EAR_TIER_NONE,
+        EAR_TIER_AFFIRMING}},
+      {"{}", EAR_TIER_NONE, 0, {EAR_TIER_NONE}},
+  };
+  ear_verifier_t *verifier;
+  ear_tier_t tiers[4];
+  char claims[512];
+  int ret = ear_verifier_new(hs256_secret, sizeof hs256_secret, "HS256",
+                             &verifier, NULL);
+  TEST_ASSERT(ret == 0);
+
+  for (size_t i = 0; i < sizeof tcs / sizeof tcs[0]; i++) {
+    ear_t *ear;
+    char *jwt;
+
+    (void)snprintf(claims, sizeof claims,
+                   "{\"eat_profile\":\"tag:github.com,2023:veraison/ear\","
+                   "\"submods\":%s}",
+                   tcs[i].submods);
+    jwt = hs256_ear(claims);
+
+    ret = ear_verifier_jwt_verify(verifier, jwt, &ear, NULL);
+    TEST_ASSERT(ret == 0);
+
+    TEST_ASSERT_EQUAL_INT(tcs[i].worst, ear_get_worst_tier(ear));
+
+    memset(tiers, 0xff, sizeof tiers);
+    TEST_ASSERT_EQUAL_size_t(tcs[i].nrecs, ear_get_tiers(ear, tiers, 4));
+    if (tcs[i].nrecs > 0)
+      TEST_ASSERT_EQUAL_INT_ARRAY(tcs[i].tiers, tiers, tcs[i].nrecs);
+
+    // only as many as there is room for, but all of them counted
+    memset(tiers, 0xff, sizeof tiers);
+    TEST_ASSERT_EQUAL_size_t(tcs[i].nrecs, ear_get_tiers(ear, tiers, 1));
+    TEST_ASSERT_EQUAL_INT(-1, (int)tiers[1]);
+    TEST_ASSERT_EQUAL_size_t(tcs[i].nrecs, ear_get_tiers(ear, NULL, 0));
+
+    ear_free(ear);
+    free(jwt);
+  }
+
+  ear_verifier_free(verifier);
+}
+
+void test_jwt_gate(void) {
+  const char *claims =
+      "{\"eat_profile\":\"tag:github.com,2023:veraison/ear\","
+      "\"submods\":{\"a\":{\"ear.status\":\"affirming\"},"
+      "\"b\":{\"ear.status\":\"warning\"}}}";
+  struct {
+    const char *app_rec;
+    ear_tier_t min_tier;
+    ear_err_t want;
+  } tcs[] = {
+      {NULL, EAR_TIER_WARNING, EAR_OK},
+      {NULL, EAR_TIER_CONTRAINDICATED, EAR_OK},
+      {NULL, EAR_TIER_AFFIRMING, EAR_ERR_TIER},
+      {NULL, EAR_TIER_NONE, EAR_ERR_TIER},
+      {"a", EAR_TIER_AFFIRMING, EAR_OK},
+      {"b", EAR_TIER_AFFIRMING, EAR_ERR_TIER},
+      {"b", EAR_TIER_WARNING, EAR_OK},
+      {"c", EAR_TIER_CONTRAINDICATED, EAR_ERR_NO_APP_REC},
+  };
+  ear_verifier_t *es256, *hs256;
+  size_t sz = strlen(valid_ear);
+  char *tampered = strdup(valid_ear);
+  char *jwt = hs256_ear(claims);
+  int ret = ear_verifier_new(hs256_secret, sizeof hs256_secret, "HS256",
+                             &hs256, NULL);
+  TEST_ASSERT(ret == 0);
+
+  ret = ear_verifier_new(pkey, pkey_sz, "ES256", &es256, NULL);
+  TEST_ASSERT(ret == 0);
+
+  for (size_t i = 0; i < sizeof tcs / sizeof tcs[0]; i++)
+    TEST_ASSERT_EQUAL_INT(tcs[i].want,
+                          ear_verifier_jwt_gate(hs256, jwt, tcs[i].app_rec,
+                                                tcs[i].min_tier));
+
+  TEST_ASSERT_EQUAL_INT(
+      EAR_OK, ear_verifier_jwt_gate(es256, valid_ear, "PARSEC_TPM",
+                                    EAR_TIER_AFFIRMING));
+
+  tampered[sz - 1] = (tampered[sz - 1] == 'A') ? 'B' : 'A';
+  TEST_ASSERT_EQUAL_INT(
+      EAR_ERR_SIGNATURE,
+      ear_verifier_jwt_gate(es256, tampered, NULL, EAR_TIER_CONTRAINDICATED));
+
+  TEST_ASSERT_EQUAL_INT(
+      EAR_ERR_MALFORMED,
+      ear_verifier_jwt_gate(es256, "not.a-jwt", NULL, EAR_TIER_NONE));
+
+  TEST_ASSERT_EQUAL_INT(EAR_ERR_ALG_MISMATCH,
+                        ear_verifier_jwt_gate(hs256, valid_ear, NULL,
+                                              EAR_TIER_CONTRAINDICATED));
+
+  ear_verifier_free(es256);
+  ear_verifier_free(hs256);
+  free(tampered);
+  free(jwt);
+}
+
+void test_ticket(void) {
+  const uint8_t other_secret[32] = {1};
+  ear_verifier_t *sealer, *other, *es256;
+  ear_t *ear, *loaded;
+  uint8_t *ticket;
+  size_t ticket_sz, sz;
+  int64_t expires;
+  unsigned int mac_sz;
+  const char *alg;
+  ear_tier_t tier;
+  char err_msg[EAR_ERR_SZ];
+  int ret = ear_jwt_verify(valid_ear, pkey, pkey_sz, "ES256", &ear, NULL);
+  TEST_ASSERT(ret == 0);
+
+  ret = ear_verifier_new(hs256_secret, sizeof hs256_secret, "HS256", &sealer,
+                         NULL);
+  TEST_ASSERT(ret == 0);
+  ret = ear_verifier_new(other_secret, sizeof other_secret, "HS256", &other,
+                         NULL);
+  TEST_ASSERT(ret == 0);
+  ret = ear_verifier_new(pkey, pkey_sz, "ES256", &es256, NULL);
+  TEST_ASSERT(ret == 0);
+
+  // the summary, the expiry and an HMAC-SHA256
+  ret = ear_ticket_seal(sealer, ear, 60, NULL, 0, &ticket_sz, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_size_t(ear->snap_sz + 8 + 32, ticket_sz);
+
+  ticket = malloc(ticket_sz);
+
+  ret = ear_ticket_seal(sealer, ear, 60, ticket, ticket_sz - 1, &sz, err_msg);
+  TEST_ASSERT(ret == -1);
+
+  ret = ear_ticket_seal(es256, ear, 60, ticket, ticket_sz, &sz, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING("tickets are sealed with an HMAC key", err_msg);
+
+  ret = ear_ticket_seal(sealer, ear, 60, ticket, ticket_sz, &sz, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_size_t(ticket_sz, sz);
+  ear_free(ear);
+
+  ret = ear_ticket_verify(sealer, ticket, ticket_sz, &loaded, err_msg);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, ret, err_msg);
+
+  ret = ear_get_status(loaded, "PARSEC_TPM", &tier, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_INT(EAR_TIER_AFFIRMING, tier);
+
+  // the context is that of the EAR, not of the ticket
+  ret = ear_get_verification_context(loaded, &alg, NULL, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_STRING("ES256", alg);
+
+  ear_free(loaded);
+
+  // wrong key, wrong kind of key, tampered with, truncated
+  ret = ear_ticket_verify(other, ticket, ticket_sz, &loaded, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING("ticket MAC verification failed", err_msg);
+
+  // back to the right key, on the same thread
+  ret = ear_ticket_verify(sealer, ticket, ticket_sz, &loaded, err_msg);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, ret, err_msg);
+  ear_free(loaded);
+
+  ret = ear_ticket_verify(es256, ticket, ticket_sz, &loaded, err_msg);
+  TEST_ASSERT(ret == -1);
+
+  ticket[ticket_sz / 2] ^= 0x01;
+  ret = ear_ticket_verify(sealer, ticket, ticket_sz, &loaded, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING("ticket MAC verification failed", err_msg);
+  ticket[ticket_sz / 2] ^= 0x01;
+
+  ticket[ticket_sz - 1] ^= 0x01;
+  ret = ear_ticket_verify(sealer, ticket, ticket_sz, &loaded, err_msg);
+  TEST_ASSERT(ret == -1);
+  ticket[ticket_sz - 1] ^= 0x01;
+
+  ret = ear_ticket_verify(sealer, ticket, ticket_sz - 1, &loaded, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING("malformed EAR ticket", err_msg);
+
+  ret = ear_ticket_verify(sealer, ticket, 16, &loaded, err_msg);
+  TEST_ASSERT(ret == -1);
+
+  // the expiry is MACed, and checked
+  memcpy(&expires, ticket + ticket_sz - 40, sizeof expires);
+  TEST_ASSERT_INT64_WITHIN(1, (int64_t)time(NULL) + 60, expires);
+
+  expires += 3600;
+  memcpy(ticket + ticket_sz - 40, &expires, sizeof expires);
+  ret = ear_ticket_verify(sealer, ticket, ticket_sz, &loaded, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING("ticket MAC verification failed", err_msg);
+
+  expires = (int64_t)time(NULL);
+  memcpy(ticket + ticket_sz - 40, &expires, sizeof expires);
+  (void)HMAC(EVP_sha256(), hs256_secret, sizeof hs256_secret, ticket,
+             ticket_sz - 32, ticket + ticket_sz - 32, &mac_sz);
+  ret = ear_ticket_verify(sealer, ticket, ticket_sz, &loaded, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING("ticket expired", err_msg);
+
+  ear_verifier_free(sealer);
+  ear_verifier_free(other);
+  ear_verifier_free(es256);
+  free(ticket);
+}
+
+void test_verifier_limits(void) {
+  // the longest string is the profile (32 bytes), bar "ear.raw-evidence"
+  // (40), and "ear.trustworthiness-vector" is 4 deep
+  const char *claims[] = {
+      "{\"eat_profile\":\"tag:github.com,2023:veraison/ear\","
+      "\"iss\":\"aA\","
+      "\"ear.raw-evidence\":\"AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA\","
+      "\"submods\":{\"a\":{\"ear.status\":\"affirming\","
+      "\"ear.trustworthiness-vector\":{\"hardware\":2}},"
+      "\"b\":{\"ear.status\":\"warning\"}}}",
+      // the same, left to jansson by the escape
+      "{\"eat_profile\":\"tag:github.com,2023:veraison/ear\","
+      "\"iss\":\"a\\u0041\","
+      "\"ear.raw-evidence\":\"AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA\","
+      "\"submods\":{\"a\":{\"ear.status\":\"affirming\","
+      "\"ear.trustworthiness-vector\":{\"hardware\":2}},"
+      "\"b\":{\"ear.status\":\"warning\"}}}",
+      // likewise, with everything past the escape for jansson alone to check
+      "{\"iss\":\"a\\u0041\","
+      "\"ear.raw-evidence\":\"AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA\","
+      "\"eat_profile\":\"tag:github.com,2023:veraison/ear\","
+      "\"submods\":{\"a\":{\"ear.status\":\"affirming\","
+      "\"ear.trustworthiness-vector\":{\"hardware\":2}},"
+      "\"b\":{\"ear.status\":\"warning\"}}}",
+  };
+  struct {
+    ear_limits_t limits;
+    ear_err_t want;
+  } tcs[] = {
+      {{0}, EAR_OK},
+      {{.max_submods = 2}, EAR_OK},
+      {{.max_submods = 1}, EAR_ERR_LIMIT_SUBMODS},
+      {{.max_str_sz = 32}, EAR_OK},
+      {{.max_str_sz = 31}, EAR_ERR_LIMIT_STRING},
+      {{.max_depth = 4}, EAR_OK},
+      {{.max_depth = 3}, EAR_ERR_LIMIT_DEPTH},
+      {{.max_raw_evidence_sz = 40}, EAR_OK},
+      {{.max_raw_evidence_sz = 39}, EAR_ERR_LIMIT_RAW_EVIDENCE},
+  };
+  ear_verifier_t *verifier, *limited;
+  ear_cache_t *cache;
+  uint64_t hits;
+  ear_limits_t limits = {0};
+  ear_t *ear = NULL;
+  char *jwt, err_msg[EAR_ERR_SZ];
+  int ret = ear_verifier_new(hs256_secret, sizeof hs256_secret, "HS256",
+                             &verifier, NULL);
+  TEST_ASSERT(ret == 0);
+
+  for (size_t i = 0; i < sizeof claims / sizeof claims[0]; i++) {
+    jwt = hs256_ear(claims[i]);
+
+    for (size_t j = 0; j < sizeof tcs / sizeof tcs[0]; j++) {
+      ear_verifier_set_limits(verifier, &tcs[j].limits);
+      TEST_ASSERT_EQUAL_INT(tcs[j].want,
+                            ear_verifier_jwt_gate(verifier, jwt, NULL,
+                                                  EAR_TIER_CONTRAINDICATED));
+    }
+
+    limits.max_token_sz = strlen(jwt);
+    ear_verifier_set_limits(verifier, &limits);
+    TEST_ASSERT_EQUAL_INT(EAR_OK,
+                          ear_verifier_jwt_gate(verifier, jwt, NULL,
+                                                EAR_TIER_CONTRAINDICATED));
+
+    limits.max_token_sz--;
+    ear_verifier_set_limits(verifier, &limits);
+    TEST_ASSERT_EQUAL_INT(EAR_ERR_LIMIT_TOKEN,
+                          ear_verifier_jwt_gate(verifier, jwt, NULL,
+                                                EAR_TIER_CONTRAINDICATED));
+
+    free(jwt);
+  }
+
+  // through the verify path, with the limit in the message
+  jwt = hs256_ear(claims[0]);
+
+  limits = (ear_limits_t){.max_submods = 1};
+  ear_verifier_set_limits(verifier, &limits);
+  ret = ear_verifier_jwt_verify(verifier, jwt, &ear, err_msg);
+  TEST_ASSERT_EQUAL_INT(-1, ret);
+  TEST_ASSERT_NULL(ear);
+  TEST_ASSERT_EQUAL_STRING("more than 1 appraisal records", err_msg);
 
-void setUp(void) {}
-void tearDown(void) {}
+  ear_verifier_set_limits(verifier, NULL);
+  ret = ear_verifier_jwt_verify(verifier, jwt, &ear, err_msg);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, ret, err_msg);
 
-uint8_t pkey[] = {
-    0x2d, 0x2d, 0x2d, 0x2d, 0x2d, 0x42, 0x45, 0x47, 0x49, 0x4e, 0x20, 0x50,
-    0x55, 0x42, 0x4c, 0x49, 0x43, 0x20, 0x4b, 0x45, 0x59, 0x2d, 0x2d, 0x2d,
-    0x2d, 0x2d, 0x0a, 0x4d, 0x46, 0x6b, 0x77, 0x45, 0x77, 0x59, 0x48, 0x4b,
-    0x6f, 0x5a, 0x49, 0x7a, 0x6a, 0x30, 0x43, 0x41, 0x51, 0x59, 0x49, 0x4b,
-    0x6f, 0x5a, 0x49, 0x7a, 0x6a, 0x30, 0x44, 0x41, 0x51, 0x63, 0x44, 0x51,
-    0x67, 0x41, 0x45, 0x75, 0x73, 0x57, 0x78, 0x48, 0x4b, 0x32, 0x50, 0x6d,
-    0x66, 0x6e, 0x48, 0x4b, 0x77, 0x58, 0x50, 0x53, 0x35, 0x34, 0x6d, 0x30,
-    0x6b, 0x54, 0x63, 0x47, 0x4a, 0x39, 0x30, 0x0a, 0x55, 0x69, 0x67, 0x6c,
-    0x57, 0x69, 0x47, 0x61, 0x68, 0x74, 0x61, 0x67, 0x6e, 0x76, 0x38, 0x67,
-    0x45, 0x34, 0x76, 0x34, 0x4c, 0x63, 0x47, 0x32, 0x31, 0x57, 0x4b, 0x2b,
-    0x44, 0x36, 0x56, 0x4b, 0x74, 0x34, 0x42, 0x4b, 0x4f, 0x6d, 0x53, 0x32,
-    0x31, 0x79, 0x7a, 0x50, 0x37, 0x57, 0x74, 0x76, 0x74, 0x75, 0x30, 0x6f,
-    0x75, 0x2f, 0x77, 0x52, 0x66, 0x67, 0x3d, 0x3d, 0x0a, 0x2d, 0x2d, 0x2d,
-    0x2d, 0x2d, 0x45, 0x4e, 0x44, 0x20, 0x50, 0x55, 0x42, 0x4c, 0x49, 0x43,
-    0x20, 0x4b, 0x45, 0x59, 0x2d, 0x2d, 0x2d, 0x2d, 0x2d, 0x0a};
+  ear_free(ear);
 
-size_t pkey_sz = sizeof pkey;
+  // an EAR cached by a verifier without limits is no hit for one with them,
+  // whose own verifications are
+  ret = ear_cache_open(NULL, 16, 4096, 3600, &cache, NULL);
+  TEST_ASSERT(ret == 0);
+  ret = ear_verifier_new(hs256_secret, sizeof hs256_secret, "HS256", &limited,
+                         NULL);
+  TEST_ASSERT(ret == 0);
+  ear_verifier_set_cache(verifier, cache);
+  ear_verifier_set_cache(limited, cache);
 
-const char *valid_ear =
-    "eyJhbGciOiJFUzI1NiIsInR5cCI6IkpXVCJ9"
-    "."
-    "eyJlYXIucmF3LWV2aWRlbmNlIjoiTnpRM01qWTVOek0yTlRZek56UUsiLCJlYXIudmVyaWZp"
-    "ZXItaWQiOnsiYnVpbGQiOiJ2dHMgMC4wLjEiLCJkZXZlbG9wZXIiOiJodHRwczovL3ZlcmFp"
-    "c29uLXByb2plY3Qub3JnIn0sImVhdF9wcm9maWxlIjoidGFnOmdpdGh1Yi5jb20sMjAyMzp2"
-    "ZXJhaXNvbi9lYXIiLCJpYXQiOjEuNjY2NTI5MTg0ZSswOSwianRpIjoiNTViOGIzZmFkOGRk"
-    "MWQ4ZWFjNGU0OGYxMTdmZTUwOGIxMWY4NDRkOWYwMTg5YmZlZDliODc1MTVhNjc1NDI2NCIs"
-    "Im5iZiI6MTY3NzI0Nzg3OSwic3VibW9kcyI6eyJQQVJTRUNfVFBNIjp7ImVhci5hcHByYWlz"
-    "YWwtcG9saWN5LWlkIjoiaHR0cHM6Ly92ZXJhaXNvbi5leGFtcGxlL3BvbGljeS8xLzYwYTAw"
-    "NjhkIiwiZWFyLnN0YXR1cyI6ImFmZmlybWluZyIsImVhci50cnVzdHdvcnRoaW5lc3MtdmVj"
-    "dG9yIjp7ImV4ZWN1dGFibGVzIjoyLCJoYXJkd2FyZSI6MiwiaW5zdGFuY2UtaWRlbnRpdHki"
-    "OjJ9LCJlYXIudmVyYWlzb24ua2V5LWF0dGVzdGF0aW9uIjp7ImFrcHViIjoiTUZrd0V3WUhL"
-    "b1pJemowQ0FRWUlLb1pJemowREFRY0RRZ0FFY2pTcDhfTVdNM2d5OFR1Z1dPMVRwUVNqX3ZJ"
-    "a3NMcEMtZzhsNVMzbHBHYjdQV1dHb0NBakVQOF9BNTlWWndMWGd3b1p6TjBXeHVCUGpwYVdp"
-    "V3NmQ1EifX19fQ"
-    "."
-    "3Ym-f1LEgamxePUM7h6Y2RJDGh9eeL0xKor0n1wE9jdAnLNwm3rTKFV2S2LbqVFoDtK9QGal"
-    "T2t5RnUdfwZNmg";
+  ret = ear_verifier_jwt_verify(verifier, jwt, &ear, NULL);
+  TEST_ASSERT(ret == 0);
+  ear_free(ear);
 
-const uint8_t parsec_tpm_akpub[] = {
-    0x30, 0x59, 0x30, 0x13, 0x06, 0x07, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x02,
-    0x01, 0x06, 0x08, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x03, 0x01, 0x07, 0x03,
-    0x42, 0x00, 0x04, 0x72, 0x34, 0xa9, 0xf3, 0xf3, 0x16, 0x33, 0x78, 0x32,
-    0xf1, 0x3b, 0xa0, 0x58, 0xed, 0x53, 0xa5, 0x04, 0xa3, 0xfe, 0xf2, 0x24,
-    0xb0, 0xba, 0x42, 0xfa, 0x0f, 0x25, 0xe5, 0x2d, 0xe5, 0xa4, 0x66, 0xfb,
-    0x3d, 0x65, 0x86, 0xa0, 0x20, 0x23, 0x10, 0xff, 0x3f, 0x03, 0x9f, 0x55,
-    0x67, 0x02, 0xd7, 0x83, 0x0a, 0x19, 0xcc, 0xdd, 0x16, 0xc6, 0xe0, 0x4f,
-    0x8e, 0x96, 0x96, 0x89, 0x6b, 0x1f, 0x09};
+  limits = (ear_limits_t){.max_submods = 1};
+  ear_verifier_set_limits(limited, &limits);
+  ret = ear_verifier_jwt_verify(limited, jwt, &ear, err_msg);
+  TEST_ASSERT_EQUAL_INT(-1, ret);
+  TEST_ASSERT_EQUAL_STRING("more than 1 appraisal records", err_msg);
 
-void test_jwt_verify_valid_ear(void) {
-  ear_t *ear;
+  limits = (ear_limits_t){.max_submods = 2};
+  ear_verifier_set_limits(limited, &limits);
+  for (int i = 0; i < 2; i++) {
+    ret = ear_verifier_jwt_verify(limited, jwt, &ear, err_msg);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, ret, err_msg);
+    ear_free(ear);
+  }
+
+  ret = ear_cache_stats(cache, &hits, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_UINT64(1, hits);
+
+  ear_verifier_free(limited);
+  ear_cache_close(cache);
+  free(jwt);
+
+  ear_verifier_free(verifier);
+
+  // a CWT, whose "ear.raw-evidence" does not lift the limit on its profile
+  ret = ear_verifier_new((const uint8_t *)cwt_pkey, strlen(cwt_pkey), "ES256",
+                         &verifier, NULL);
+  TEST_ASSERT(ret == 0);
+
+  limits = (ear_limits_t){.max_str_sz = 31};
+  ear_verifier_set_limits(verifier, &limits);
+  ret = ear_verifier_cwt_verify(verifier, valid_ear_cwt, sizeof valid_ear_cwt,
+                                &ear, err_msg);
+  TEST_ASSERT_EQUAL_INT(-1, ret);
+  TEST_ASSERT_EQUAL_STRING("string longer than 31 bytes", err_msg);
+
+  limits.max_str_sz = 0;
+  ear_verifier_set_limits(verifier, &limits);
+  ret = ear_verifier_cwt_verify(verifier, valid_ear_cwt, sizeof valid_ear_cwt,
+                                &ear, err_msg);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, ret, err_msg);
+  ear_free(ear);
+
+  ear_verifier_free(verifier);
+}
+
+void test_batch(void) {
+  const char *claims[] = {
+      "{\"a\":{\"ear.status\":\"warning\","
+      "\"ear.trustworthiness-vector\":{\"hardware\":32,\"executables\":-1,"
+      "\"configuration\":200,\"file-system\":\"2\"}},"
+      "\"b\":{\"ear.status\":\"affirming\"}}",
+      "{\"b\":{\"ear.status\":\"contraindicated\"}}",
+      "{\"a\":{}}",
+  };
+  ear_verifier_t *verifier;
+  ear_t *ears[4];
+  ear_tier_t tiers[4];
+  ear_tvec_t tvecs[4];
+  ear_slice_t akpubs[4];
+  ear_app_rec_id_t a, b, tpm, again, late;
+  const uint8_t *akpub;
+  size_t akpub_sz;
+  uint32_t n;
+  char *jwt;
+  int ret = ear_verifier_new(hs256_secret, sizeof hs256_secret, "HS256",
+                             &verifier, NULL);
+  TEST_ASSERT(ret == 0);
+
+  for (size_t i = 0; i < 3; i++) {
+    char buf[512];
+
+    (void)snprintf(buf, sizeof buf,
+                   "{\"eat_profile\":\"tag:github.com,2023:veraison/ear\","
+                   "\"submods\":%s}",
+                   claims[i]);
+    jwt = hs256_ear(buf);
+
+    ret = ear_verifier_jwt_verify(verifier, jwt, &ears[i], NULL);
+    TEST_ASSERT(ret == 0);
+    free(jwt);
+  }
+
+  ret = ear_jwt_verify(valid_ear, pkey, pkey_sz, "ES256", &ears[3], NULL);
+  TEST_ASSERT(ret == 0);
+
+  // interning is idempotent, and the name of a record need not have been
+  ret = ear_app_rec_intern("b", &b, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_size_t(2, ear_batch_get_status((const ear_t *const *)ears,
+                                                   4, b, tiers));
+  TEST_ASSERT_EQUAL_INT(EAR_TIER_AFFIRMING, tiers[0]);
+  TEST_ASSERT_EQUAL_INT(EAR_TIER_CONTRAINDICATED, tiers[1]);
+  TEST_ASSERT_EQUAL_INT(EAR_TIER_NONE, tiers[2]);
+  TEST_ASSERT_EQUAL_INT(EAR_TIER_NONE, tiers[3]);
+
+  ret = ear_app_rec_intern("a", &a, NULL);
+  TEST_ASSERT(ret == 0);
+  ret = ear_app_rec_intern("b", &again, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT(a != b && b == again);
+
+  TEST_ASSERT_EQUAL_size_t(2, ear_batch_get_status((const ear_t *const *)ears,
+                                                   4, a, tiers));
+  TEST_ASSERT_EQUAL_INT(EAR_TIER_WARNING, tiers[0]);
+  TEST_ASSERT_EQUAL_INT(EAR_TIER_NONE, tiers[1]);
+  TEST_ASSERT_EQUAL_INT(EAR_TIER_NONE, tiers[2]);
+
+  // only int8_t claims are there
+  TEST_ASSERT_EQUAL_size_t(2, ear_batch_get_tvec((const ear_t *const *)ears,
+                                                 4, a, tvecs));
+  TEST_ASSERT_EQUAL_HEX32((1u << EAR_TV_HARDWARE) | (1u << EAR_TV_EXECUTABLES),
+                          tvecs[0].present);
+  TEST_ASSERT_EQUAL_INT(32, tvecs[0].claims[EAR_TV_HARDWARE]);
+  TEST_ASSERT_EQUAL_INT(-1, tvecs[0].claims[EAR_TV_EXECUTABLES]);
+  TEST_ASSERT_EQUAL_HEX32(0, tvecs[1].present);
+  TEST_ASSERT_EQUAL_HEX32(0, tvecs[2].present);
+
+  ret = ear_app_rec_intern("PARSEC_TPM", &tpm, NULL);
+  TEST_ASSERT(ret == 0);
+
+  TEST_ASSERT_EQUAL_size_t(1, ear_batch_get_tvec((const ear_t *const *)ears,
+                                                 4, tpm, tvecs));
+  TEST_ASSERT_EQUAL_HEX32((1u << EAR_TV_INSTANCE_IDENTITY) |
+                              (1u << EAR_TV_EXECUTABLES) |
+                              (1u << EAR_TV_HARDWARE),
+                          tvecs[3].present);
+  TEST_ASSERT_EQUAL_INT(2, tvecs[3].claims[EAR_TV_HARDWARE]);
+
+  TEST_ASSERT_EQUAL_size_t(1, ear_batch_get_akpub((const ear_t *const *)ears,
+                                                  4, tpm, akpubs));
+  TEST_ASSERT_NULL(akpubs[0].ptr);
+  TEST_ASSERT_EQUAL_size_t(0, akpubs[0].sz);
+
+  ret = ear_veraison_get_akpub_ref(ears[3], "PARSEC_TPM", &akpub, &akpub_sz,
+                                   NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT(akpubs[3].ptr == akpub);
+  TEST_ASSERT_EQUAL_size_t(akpub_sz, akpubs[3].sz);
+
+  // the names in EARs are looked up, not interned, and one interned after
+  // they have been is found all the same
+  ear_free(ears[2]);
+  jwt = hs256_ear("{\"eat_profile\":\"tag:github.com,2023:veraison/ear\","
+                  "\"submods\":{\"batch-late\":{\"ear.status\":"
+                  "\"warning\"}}}");
+  ret = ear_verifier_jwt_verify(verifier, jwt, &ears[2], NULL);
+  TEST_ASSERT(ret == 0);
+  free(jwt);
+
+  n = intern_count();
+  TEST_ASSERT_EQUAL_size_t(1, ear_batch_get_status((const ear_t *const *)ears,
+                                                   4, a, tiers));
+  TEST_ASSERT_EQUAL_UINT32(n, intern_count());
+
+  ret = ear_app_rec_intern("batch-late", &late, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_size_t(1, ear_batch_get_status((const ear_t *const *)ears,
+                                                   4, late, tiers));
+  TEST_ASSERT_EQUAL_INT(EAR_TIER_WARNING, tiers[2]);
+
+  for (size_t i = 0; i < 4; i++)
+    ear_free(ears[i]);
+
+  ear_verifier_free(verifier);
+}
+
+void test_query(void) {
+  const char *claims =
+      "{\"eat_profile\":\"tag:github.com,2023:veraison/ear\","
+      "\"submods\":{\"a/b\":{\"ear.status\":\"warning\","
+      "\"ear.trustworthiness-vector\":{\"hardware\":32}},"
+      "\"c\":{\"ear.status\":\"affirming\","
+      "\"ear.trustworthiness-vector\":{\"hardware\":2}},"
+      "\"d\":{}}}";
+  const char *bad[] = {
+      "submods",
+      "submods/PARSEC_TPM",
+      "submods/PARSEC_TPM/ear.veraison.key-attestation",
+      "submods/PARSEC_TPM/ear.trustworthiness-vector/firmware",
+      "submods/PARSE~2C_TPM/ear.status",
+      "ear.verifier-id",
+      "/iat",
+  };
+  ear_verifier_t *hs256;
+  ear_query_t *query;
+  ear_value_t values[2];
+  ear_t *ear, *other;
+  char err_msg[EAR_ERR_SZ];
+  char *jwt = hs256_ear(claims);
   int ret = ear_jwt_verify(valid_ear, pkey, pkey_sz, "ES256", &ear, NULL);
   TEST_ASSERT(ret == 0);
 
+  ret = ear_verifier_new(hs256_secret, sizeof hs256_secret, "HS256", &hs256,
+                         NULL);
+  TEST_ASSERT(ret == 0);
+
+  ret = ear_verifier_jwt_verify(hs256, jwt, &other, NULL);
+  TEST_ASSERT(ret == 0);
+
+  // a top-level claim
+  ret = ear_query_compile("nbf", &query, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_INT(EAR_VALUE_INT, ear_query_type(query));
+  TEST_ASSERT_EQUAL_size_t(1, ear_query_eval(query, ear, values, 2));
+  TEST_ASSERT_NULL(values[0].app_rec);
+  TEST_ASSERT_EQUAL_INT64(1677247879, values[0].i);
+  TEST_ASSERT_EQUAL_size_t(0, ear_query_eval(query, other, values, 2));
+  ear_query_free(query);
+
+  ret = ear_query_compile("ear.verifier-id/build", &query, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_INT(EAR_VALUE_STRING, ear_query_type(query));
+  TEST_ASSERT_EQUAL_size_t(1, ear_query_eval(query, ear, values, 2));
+  TEST_ASSERT_EQUAL_STRING("vts 0.0.1", (const char *)values[0].s.ptr);
+  TEST_ASSERT_EQUAL_size_t(9, values[0].s.sz);
+  ear_query_free(query);
+
+  // a named record, against the same key as ear_veraison_get_akpub_ref()
+  ret = ear_query_compile("submods/PARSEC_TPM/"
+                          "ear.veraison.key-attestation/akpub",
+                          &query, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_INT(EAR_VALUE_BYTES, ear_query_type(query));
+  for (int i = 0; i < 2; i++) {
+    const uint8_t *akpub;
+    size_t akpub_sz;
+
+    TEST_ASSERT_EQUAL_size_t(1, ear_query_eval(query, ear, values, 1));
+    TEST_ASSERT_EQUAL_STRING("PARSEC_TPM", values[0].app_rec);
+    ret = ear_veraison_get_akpub_ref(ear, "PARSEC_TPM", &akpub, &akpub_sz,
+                                     NULL);
+    TEST_ASSERT(ret == 0);
+    TEST_ASSERT_EQUAL_PTR(akpub, values[0].s.ptr);
+    TEST_ASSERT_EQUAL_size_t(akpub_sz, values[0].s.sz);
+  }
+  TEST_ASSERT_EQUAL_size_t(0, ear_query_eval(query, other, values, 2));
+  ear_query_free(query);
+
+  ret = ear_query_compile("submods/PARSEC_TPM/ear.appraisal-policy-id", &query,
+                          NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_size_t(1, ear_query_eval(query, ear, NULL, 0));
+  TEST_ASSERT_EQUAL_size_t(1, ear_query_eval(query, ear, values, 1));
+  TEST_ASSERT_EQUAL_STRING("https://veraison.example/policy/1/60a0068d",
+                           (const char *)values[0].s.ptr);
+  ear_query_free(query);
+
+  // every record, in record order, those without the claim skipped
+  ret = ear_query_compile("submods/*/ear.trustworthiness-vector/hardware",
+                          &query, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_size_t(2, ear_query_eval(query, other, values, 2));
+  TEST_ASSERT_EQUAL_STRING("a/b", values[0].app_rec);
+  TEST_ASSERT_EQUAL_INT64(32, values[0].i);
+  TEST_ASSERT_EQUAL_STRING("c", values[1].app_rec);
+  TEST_ASSERT_EQUAL_INT64(2, values[1].i);
+  TEST_ASSERT_EQUAL_size_t(2, ear_query_eval(query, other, values, 1));
+  TEST_ASSERT_EQUAL_size_t(1, ear_query_eval(query, ear, values, 2));
+  TEST_ASSERT_EQUAL_STRING("PARSEC_TPM", values[0].app_rec);
+  ear_query_free(query);
+
+  // a '/' in a record name is escaped
+  ret = ear_query_compile("submods/a~1b/ear.status", &query, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_INT(EAR_VALUE_TIER, ear_query_type(query));
+  TEST_ASSERT_EQUAL_size_t(1, ear_query_eval(query, other, values, 2));
+  TEST_ASSERT_EQUAL_INT64(EAR_TIER_WARNING, values[0].i);
+  TEST_ASSERT_EQUAL_STRING("warning", (const char *)values[0].s.ptr);
+  ear_query_free(query);
+
+  for (size_t i = 0; i < sizeof bad / sizeof bad[0]; i++) {
+    query = NULL;
+    ret = ear_query_compile(bad[i], &query, err_msg);
+    TEST_ASSERT(ret == -1);
+    TEST_ASSERT_NULL(query);
+    TEST_ASSERT_EQUAL_STRING_LEN("unsupported claim path", err_msg, 22);
+  }
+
+  ear_free(other);
   ear_free(ear);
+  ear_verifier_free(hs256);
+  free(jwt);
 }
 
-void test_get_status_affirming(void) {
-  ear_t *ear;
+void test_raw_evidence(void) {
+  const char *claims =
+      "{\"eat_profile\":\"tag:github.com,2023:veraison/ear\",\"submods\":{},"
+      "\"ear.raw-evidence\":"
+      "\"MFkwEwYHKoZIzj0CAQYIKoZIzj0DAQcDQgAEcjSp8_MWM3gy8TugWO1TpQSj_vIksLpC-"
+      "g8l5S3lpGb7PWWGoCAjEP8_A59VZwLXgwoZzN0WxuBPjpaWiWsfCQ\"}";
+  const char *bad =
+      "{\"eat_profile\":\"tag:github.com,2023:veraison/ear\",\"submods\":{},"
+      "\"ear.raw-evidence\":\"MFkwE*YH\"}";
+  const char *none =
+      "{\"eat_profile\":\"tag:github.com,2023:veraison/ear\",\"submods\":{}}";
+  ear_verifier_t *hs256;
+  ear_t *ear, *other;
+  uint8_t buf[sizeof parsec_tpm_akpub + 8], md[2][EVP_MAX_MD_SIZE];
+  unsigned md_sz[2];
+  EVP_MD_CTX *md_ctx = EVP_MD_CTX_new();
+  char err_msg[EAR_ERR_SZ];
+  char *jwt = hs256_ear(claims), *bad_jwt = hs256_ear(bad);
+  char *none_jwt = hs256_ear(none);
+  size_t sz, n;
   int ret = ear_jwt_verify(valid_ear, pkey, pkey_sz, "ES256", &ear, NULL);
   TEST_ASSERT(ret == 0);
+  TEST_ASSERT_NOT_NULL(md_ctx);
 
-  ear_tier_t tier;
+  ret = ear_verifier_new(hs256_secret, sizeof hs256_secret, "HS256", &hs256,
+                         NULL);
+  TEST_ASSERT(ret == 0);
 
-  ret = ear_get_status(ear, "PARSEC_TPM", &tier, NULL);
+  ret = ear_get_raw_evidence_sz(ear, &sz, NULL);
   TEST_ASSERT(ret == 0);
-  TEST_ASSERT_EQUAL_INT(EAR_TIER_AFFIRMING, tier);
+  TEST_ASSERT_EQUAL_size_t(15, sz);
+
+  ret = ear_raw_evidence_read(ear, 0, buf, sizeof buf, &n, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_size_t(15, n);
+  TEST_ASSERT_EQUAL_MEMORY("74726973656374\n", buf, n);
+
+  ret = ear_verifier_jwt_verify(hs256, jwt, &other, NULL);
+  TEST_ASSERT(ret == 0);
+
+  ret = ear_get_raw_evidence_sz(other, &sz, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_size_t(sizeof parsec_tpm_akpub, sz);
+
+  // any chunk, from anywhere, and nothing from the end on
+  for (size_t chunk = 1; chunk <= 8; chunk++) {
+    for (size_t off = 0; off <= sz + 1; off++) {
+      size_t want = off >= sz ? 0 : sz - off < chunk ? sz - off : chunk;
+
+      memset(buf, 0, sizeof buf);
+      ret = ear_raw_evidence_read(other, off, buf, chunk, &n, NULL);
+      TEST_ASSERT(ret == 0);
+      TEST_ASSERT_EQUAL_size_t(want, n);
+      if (n > 0)
+        TEST_ASSERT_EQUAL_MEMORY(parsec_tpm_akpub + off, buf, n);
+    }
+  }
+
+  // the digest is that of the decoded evidence
+  TEST_ASSERT(EVP_DigestInit_ex(md_ctx, EVP_sha256(), NULL) == 1);
+  ret = ear_raw_evidence_digest(other, md_ctx, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT(EVP_DigestFinal_ex(md_ctx, md[0], &md_sz[0]) == 1);
+  TEST_ASSERT(EVP_Digest(parsec_tpm_akpub, sizeof parsec_tpm_akpub, md[1],
+                         &md_sz[1], EVP_sha256(), NULL) == 1);
+  TEST_ASSERT_EQUAL_MEMORY(md[1], md[0], md_sz[1]);
+
+  ear_free(other);
+
+  // only found out when decoded
+  ret = ear_verifier_jwt_verify(hs256, bad_jwt, &other, NULL);
+  TEST_ASSERT(ret == 0);
+  ret = ear_raw_evidence_read(other, 0, buf, sizeof buf, &n, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING("\"ear.raw-evidence\" is not valid base64url",
+                           err_msg);
+  ear_free(other);
 
+  ret = ear_verifier_jwt_verify(hs256, none_jwt, &other, NULL);
+  TEST_ASSERT(ret == 0);
+  ret = ear_get_raw_evidence_sz(other, &sz, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING("\"ear.raw-evidence\" not found", err_msg);
+  ear_free(other);
+
+  EVP_MD_CTX_free(md_ctx);
+  ear_verifier_free(hs256);
   ear_free(ear);
+  free(none_jwt);
+  free(bad_jwt);
+  free(jwt);
+}
+
+void test_get_claims(void) {
+  ear_t *jwt_ear, *cwt_ear;
+  const char *str;
+  size_t sz;
+  int64_t t;
+  char err_msg[EAR_ERR_SZ];
+  int ret = ear_jwt_verify(valid_ear, pkey, pkey_sz, "ES256", &jwt_ear, NULL);
+  TEST_ASSERT(ret == 0);
+
+  ret = ear_cwt_verify(valid_ear_cwt, sizeof valid_ear_cwt,
+                       (const uint8_t *)cwt_pkey, strlen(cwt_pkey), "ES256",
+                       &cwt_ear, NULL);
+  TEST_ASSERT(ret == 0);
+
+  // "iat" is a real in valid_ear
+  ret = ear_get_time(jwt_ear, EAR_CLAIM_IAT, &t, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT(t == 1666529184);
+
+  ret = ear_get_time(jwt_ear, EAR_CLAIM_EXP, &t, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING("\"exp\" not found", err_msg);
+
+  ret = ear_get_string(jwt_ear, EAR_CLAIM_PROFILE, &str, &sz, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_STRING("tag:github.com,2023:veraison/ear", str);
+  TEST_ASSERT_EQUAL_size_t(strlen(str), sz);
+
+  ret = ear_get_string(jwt_ear, EAR_CLAIM_JTI, &str, &sz, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_STRING(
+      "55b8b3fad8dd1d8eac4e48f117fe508b11f844d9f0189bfed9b87515a6754264", str);
+
+  ret = ear_get_appraisal_policy_id(jwt_ear, "PARSEC_TPM", &str, &sz, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_STRING("https://veraison.example/policy/1/60a0068d", str);
+  TEST_ASSERT_EQUAL_size_t(strlen(str), sz);
+
+  ret = ear_get_appraisal_policy_id(jwt_ear, "CCA", &str, &sz, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING("no appraisal record found for \"CCA\"", err_msg);
+
+  // the CWT serialization reads the same (but for its "jti")
+  for (ear_claim_t c = EAR_CLAIM_IAT; c <= EAR_CLAIM_NBF; c++) {
+    int64_t want;
+
+    ret = ear_get_time(jwt_ear, c, &want, NULL);
+    TEST_ASSERT(ret == 0);
+    ret = ear_get_time(cwt_ear, c, &t, NULL);
+    TEST_ASSERT(ret == 0);
+    TEST_ASSERT(want == t);
+  }
+
+  for (ear_claim_t c = EAR_CLAIM_PROFILE; c <= EAR_CLAIM_VERIFIER_DEVELOPER;
+       c++) {
+    const char *want;
+    size_t want_sz;
+
+    if (c == EAR_CLAIM_JTI)
+      continue;
+
+    ret = ear_get_string(jwt_ear, c, &want, &want_sz, NULL);
+    TEST_ASSERT(ret == 0);
+    ret = ear_get_string(cwt_ear, c, &str, &sz, NULL);
+    TEST_ASSERT(ret == 0);
+    TEST_ASSERT_EQUAL_size_t(want_sz, sz);
+    TEST_ASSERT_EQUAL_STRING(want, str);
+  }
+
+  ret = ear_get_string(cwt_ear, EAR_CLAIM_VERIFIER_BUILD, &str, &sz, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_STRING("vts 0.0.1", str);
+
+  ear_free(cwt_ear);
+  ear_free(jwt_ear);
 }
 
 void test_veraison_get_akpub(void) {
@@ -99,6 +1570,82 @@ void test_veraison_get_akpub(void) {
   ear_free(ear);
 }
 
+void test_veraison_get_akpub_ref(void) {
+  ear_t *ear;
+  int ret = ear_jwt_verify(valid_ear, pkey, pkey_sz, "ES256", &ear, NULL);
+  TEST_ASSERT(ret == 0);
+
+  const uint8_t *akpub;
+  size_t akpub_sz;
+  EVP_PKEY *akpub_pkey, *again;
+
+  ret = ear_veraison_get_akpub_ref(ear, "PARSEC_TPM", &akpub, &akpub_sz, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT_EQUAL_size_t(sizeof parsec_tpm_akpub, akpub_sz);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(parsec_tpm_akpub, akpub,
+                                sizeof parsec_tpm_akpub);
+
+  // parsed once, then the same object
+  ret = ear_veraison_get_akpub_pkey(ear, "PARSEC_TPM", &akpub_pkey, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT(EVP_PKEY_get_base_id(akpub_pkey) == EVP_PKEY_EC);
+  ret = ear_veraison_get_akpub_pkey(ear, "PARSEC_TPM", &again, NULL);
+  TEST_ASSERT(ret == 0);
+  TEST_ASSERT(again == akpub_pkey);
+
+  ear_free(ear);
+}
+
+void test_veraison_verify_pop(void) {
+  const uint8_t challenge[] = "pop challenge";
+  uint8_t tampered[sizeof pop_sig];
+  ear_t *ear;
+  char err_msg[EAR_ERR_SZ];
+  int results[2];
+  int ret = ear_jwt_verify(pop_ear, (const uint8_t *)cwt_pkey,
+                           strlen(cwt_pkey), "ES256", &ear, NULL);
+  TEST_ASSERT(ret == 0);
+
+  ret = ear_veraison_verify_pop(ear, "PARSEC_TPM", "ES256", challenge,
+                                sizeof challenge - 1, pop_sig, sizeof pop_sig,
+                                NULL);
+  TEST_ASSERT(ret == 0);
+
+  memcpy(tampered, pop_sig, sizeof pop_sig);
+  tampered[0] ^= 1;
+  ret = ear_veraison_verify_pop(ear, "PARSEC_TPM", "ES256", challenge,
+                                sizeof challenge - 1, tampered,
+                                sizeof tampered, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING("cannot verify the proof-of-possession signature",
+                           err_msg);
+
+  ret = ear_veraison_verify_pop(ear, "PARSEC_TPM", "HS256", challenge,
+                                sizeof challenge - 1, pop_sig, sizeof pop_sig,
+                                err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT_EQUAL_STRING(
+      "unsupported proof-of-possession algorithm \"HS256\"", err_msg);
+
+  ear_pop_t pops[] = {
+      {challenge, sizeof challenge - 1, pop_sig, sizeof pop_sig},
+      {challenge, sizeof challenge - 1, tampered, sizeof tampered},
+  };
+
+  ret = ear_veraison_verify_pop_batch(ear, "PARSEC_TPM", "ES256", pops, 2,
+                                      results, err_msg);
+  TEST_ASSERT(ret == -1);
+  TEST_ASSERT(results[0] == 0 && results[1] == -1);
+  TEST_ASSERT_EQUAL_STRING(
+      "1 of 2 proof-of-possession signatures do not verify", err_msg);
+
+  ret = ear_veraison_verify_pop_batch(ear, "PARSEC_TPM", "ES256", pops, 1,
+                                      NULL, NULL);
+  TEST_ASSERT(ret == 0);
+
+  ear_free(ear);
+}
+
 void test_get_app_recs(void) {
   ear_t *ear;
   const char **app_rec_list;
@@ -141,7 +1688,7 @@ static void DBG_print_buf(const uint8_t *b, size_t b_sz) {
   } while (0);
 
 void test_b64(void) {
-  uint8_t *b = NULL;
+  uint8_t *b = NULL, b_buf[4];
   size_t b_sz;
 
   struct tc {
@@ -190,14 +1737,288 @@ void test_b64(void) {
     FRESET(b);
     b_sz = 0;
   }
+
+  // padded or not, from any offset
+  for (size_t off = 0; off <= 4; off++) {
+    uint8_t buf[4];
+
+    TEST_ASSERT_EQUAL_INT(0, u_b64_decode_at("Y2lhbw==", 8, off, buf,
+                                             sizeof buf, &b_sz));
+    TEST_ASSERT_EQUAL_size_t(4 - off, b_sz);
+    if (b_sz > 0)
+      TEST_ASSERT_EQUAL_MEMORY("ciao" + off, buf, b_sz);
+  }
+
+  TEST_ASSERT_EQUAL_INT(-1, u_b64_decode_at("Y2lhb", 5, 0, b_buf, 4, &b_sz));
+  TEST_ASSERT_EQUAL_INT(-1, u_b64_decode_at("+/8A", 4, 0, b_buf, 4, &b_sz));
+  TEST_ASSERT_EQUAL_INT(0, u_b64_decode_at("-_8A", 4, 1, b_buf, 4, &b_sz));
+  TEST_ASSERT_EQUAL_size_t(2, b_sz);
+}
+
+/* jscan_claims() either leaves buf to jansson, or agrees with it.  Returns 1
+ * if jscan_claims() decoded buf */
+static void str_agrees(const json_t *j, const claims_str_t *str) {
+  TEST_ASSERT_EQUAL(json_is_string(j), str->ptr != NULL);
+  if (json_is_string(j)) {
+    TEST_ASSERT_EQUAL_size_t(json_string_length(j), str->len);
+    TEST_ASSERT_EQUAL_MEMORY(json_string_value(j), str->ptr, str->len);
+  }
+}
+
+static int jscan_agrees(const uint8_t *buf, size_t sz) {
+  const char *strs[] = {"eat_profile", "jti", "iss",
+                        "sub",         "aud", "ear.raw-evidence"};
+  const char *times[] = {"iat", "nbf", "exp"};
+  claims_t c;
+  const claims_str_t *str_claims[] = {&c.profile, &c.jti, &c.iss,
+                                      &c.sub,     &c.aud, &c.raw_evidence};
+  const int64_t *time_claims[] = {&c.iat, &c.nbf, &c.exp};
+  json_t *json, *submods, *verifier_id;
+
+  if (jscan_claims(buf, sz, NULL, &c) != EAR_OK)
+    return 0;
+
+  json = json_loadb((const char *)buf, sz, 0, NULL);
+  TEST_ASSERT(json_is_object(json));
+
+  for (unsigned i = 0; i < 3; i++) {
+    json_t *t = json_object_get(json, times[i]);
+
+    TEST_ASSERT_EQUAL(json_is_number(t), !!(c.flags & (CLAIMS_IAT << i)));
+    if (json_is_integer(t))
+      TEST_ASSERT(json_integer_value(t) == *time_claims[i]);
+    if (json_is_real(t))
+      TEST_ASSERT((int64_t)json_real_value(t) == *time_claims[i]);
+  }
+
+  for (unsigned i = 0; i < 6; i++)
+    str_agrees(json_object_get(json, strs[i]), str_claims[i]);
+
+  verifier_id = json_object_get(json, "ear.verifier-id");
+  str_agrees(json_object_get(verifier_id, "build"), &c.build);
+  str_agrees(json_object_get(verifier_id, "developer"), &c.developer);
+
+  submods = json_object_get(json, "submods");
+  TEST_ASSERT_EQUAL(submods != NULL, !!(c.flags & CLAIMS_SUBMODS));
+  TEST_ASSERT_EQUAL(json_is_object(submods),
+                    !!(c.flags & CLAIMS_SUBMODS_OBJECT));
+  TEST_ASSERT_EQUAL_size_t(json_is_object(submods) ? json_object_size(submods)
+                                                   : 0,
+                           c.nsubmods);
+
+  for (size_t i = 0; i < c.nsubmods; i++) {
+    const claims_submod_t *s = &c.submods[i];
+    char name[256];
+    json_t *submod, *status, *tvec, *ka, *akpub;
+
+    TEST_ASSERT(s->name.len < sizeof name);
+    memcpy(name, s->name.ptr, s->name.len);
+    name[s->name.len] = '\0';
+
+    submod = json_object_get(submods, name);
+    TEST_ASSERT_NOT_NULL(submod);
+
+    status = json_object_get(submod, "ear.status");
+    str_agrees(status, &s->status);
+    str_agrees(json_object_get(submod, "ear.appraisal-policy-id"),
+               &s->policy_id);
+
+    tvec = json_object_get(submod, "ear.trustworthiness-vector");
+    for (unsigned t = 0; t < EAR_TV_CLAIMS; t++) {
+      json_t *claim = json_object_get(tvec, tvec_names[t]);
+      int want = json_is_integer(claim) && json_integer_value(claim) >= -128 &&
+                 json_integer_value(claim) <= 127;
+
+      TEST_ASSERT_EQUAL(want, !!(s->tvec_present & (1u << t)));
+      if (want)
+        TEST_ASSERT_EQUAL_INT(json_integer_value(claim), s->tvec[t]);
+    }
+
+    ka = json_object_get(submod, "ear.veraison.key-attestation");
+    TEST_ASSERT_EQUAL(ka != NULL, s->key_attestation);
+
+    akpub = json_object_get(ka, "akpub");
+    str_agrees(akpub, &s->akpub);
+  }
+
+  json_decref(json);
+
+  return 1;
+}
+
+static void jscan_index_agrees(const uint8_t *buf, size_t sz) {
+  uint32_t *simd = malloc((sz + 1) * sizeof *simd);
+  uint32_t *scalar = malloc((sz + 1) * sizeof *scalar);
+  size_t simd_n = 0, scalar_n = 0;
+  int ret = jscan_index(buf, sz, simd, &simd_n, 1);
+
+  TEST_ASSERT_EQUAL_INT(ret, jscan_index(buf, sz, scalar, &scalar_n, 0));
+  TEST_ASSERT_EQUAL_size_t(simd_n, scalar_n);
+  if (ret == 0 && simd_n > 0)
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(scalar, simd, simd_n);
+
+  free(simd);
+  free(scalar);
+}
+
+void test_jscan_claims(void) {
+  const char *payload = strchr(valid_ear, '.') + 1;
+  const char *alphabet = "{}[]:,\"\\ \t\n0123456789-+.eEtruefalsn/xu";
+  struct {
+    const char *json;
+    int decoded;
+  } tcs[] = {
+      {"{}", 1},
+      {" {\"submods\":{\"a\":1,\"b\":{\"ear.status\":\"warning\"}}} ", 1},
+      {"{\"exp\":-12,\"x\":[true,false,null,{\"y\":\"a\\\\\\\"\"}]}", 1},
+      {"{\"x\":\"\\u00e9\\/\"}", 1},
+      {"{\"iat\":1.5e3,\"x\":[-0.25,0E-7]}", 1},
+      // left to jansson: valid, but outside the subset
+      {"{\"iat\":1234567890123456789}", 0},
+      {"{\"iat\":1e400}", 0},
+      {"{\"jti\":\"a\\/b\"}", 0},
+      {"{\"x\":\"\\u0000\"}", 0},
+      {"{\"x\":\"\\ud83d\\ude00\"}", 0},
+      {"{\"x\":\"\xc3\xa9\"}", 0},
+      {"{\"jti\":\"a\",\"jti\":\"b\"}", 0},
+      {"{\"submods\":{\"a\":{},\"a\":{}}}", 0},
+      {"{\"j\\u0074i\":\"a\"}", 0},
+      // invalid
+      {"", 0},
+      {"[]", 0},
+      {"{\"a\":01}", 0},
+      {"{\"a\":1.}", 0},
+      {"{\"a\":.5}", 0},
+      {"{\"a\":1e}", 0},
+      {"{\"a\":tru}", 0},
+      {"{\"a\":1 2}", 0},
+      {"{\"a\":\"b}", 0},
+      {"{\"a\":1,}", 0},
+      {"{\"a\":1}x", 0},
+      {"{\"a\"\t:\"\t\"}", 0},
+  };
+  uint8_t *base = NULL, *buf;
+  size_t base_sz = 0, sz, decoded = 0;
+  uint64_t rnd = 0x9e3779b97f4a7c15u;
+  ear_verifier_t *verifier;
+  ear_t *ear = NULL;
+  char *jwt, err_msg[EAR_ERR_SZ];
+  char *b64 = strndup(payload, (size_t)(strchr(payload, '.') - payload));
+  int ret = u_b64url_decode(b64, &base, &base_sz);
+  TEST_ASSERT(ret == 0);
+
+  TEST_ASSERT_EQUAL_INT(1, jscan_agrees(base, base_sz));
+
+  for (size_t i = 0; i < sizeof tcs / sizeof tcs[0]; i++) {
+    sz = strlen(tcs[i].json);
+    jscan_index_agrees((const uint8_t *)tcs[i].json, sz);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(
+        tcs[i].decoded, jscan_agrees((const uint8_t *)tcs[i].json, sz),
+        tcs[i].json);
+  }
+
+  // up to 64 records, and the rest left to jansson
+  for (size_t n = 64; n <= 65; n++) {
+    char *json = malloc(32 + n * 16);
+    size_t off = (size_t)sprintf(json, "{\"submods\":{");
+
+    for (size_t i = 0; i < n; i++)
+      off += (size_t)sprintf(json + off, "%s\"r%zu\":{}", i ? "," : "", i);
+    (void)strcpy(json + off, "}}");
+
+    TEST_ASSERT_EQUAL_INT(n == 64, jscan_agrees((const uint8_t *)json,
+                                                strlen(json)));
+    free(json);
+  }
+
+  // a time too large for jscan_claims() is refused by jansson too
+  TEST_ASSERT_EQUAL_INT(0, jscan_agrees((const uint8_t *)"{\"exp\":1e300}",
+                                        14));
+  ret = ear_verifier_new(hs256_secret, sizeof hs256_secret, "HS256",
+                         &verifier, NULL);
+  TEST_ASSERT(ret == 0);
+  jwt = hs256_ear("{\"eat_profile\":\"tag:github.com,2023:veraison/ear\","
+                  "\"exp\":1e300,\"submods\":{}}");
+  ret = ear_verifier_jwt_verify(verifier, jwt, &ear, err_msg);
+  TEST_ASSERT_EQUAL_INT(-1, ret);
+  TEST_ASSERT_EQUAL_STRING("\"exp\" is out of range", err_msg);
+  free(jwt);
+  ear_verifier_free(verifier);
+
+  // mutations of a real claims-set, each decoded (or not) as jansson would
+  buf = malloc(base_sz + 8);
+
+  for (int n = 0; n < 20000; n++) {
+    memcpy(buf, base, base_sz);
+    sz = base_sz;
+
+    for (int m = 0; m < 1 + n % 3; m++) {
+      size_t at;
+
+      rnd ^= rnd << 13, rnd ^= rnd >> 7, rnd ^= rnd << 17;
+      at = (size_t)(rnd >> 32) % sz;
+
+      switch (rnd % 4) {
+      case 0: // replace
+        buf[at] = (uint8_t)alphabet[(rnd >> 8) % strlen(alphabet)];
+        break;
+      case 1: // delete
+        memmove(buf + at, buf + at + 1, --sz - at);
+        break;
+      case 2: // insert
+        if (sz < base_sz + 8) {
+          memmove(buf + at + 1, buf + at, sz++ - at);
+          buf[at] = (uint8_t)alphabet[(rnd >> 8) % strlen(alphabet)];
+        }
+        break;
+      default: // any byte
+        buf[at] = (uint8_t)(rnd >> 16);
+      }
+    }
+
+    jscan_index_agrees(buf, sz);
+    decoded += (size_t)jscan_agrees(buf, sz);
+  }
+
+  // most single mutations land in strings, which still decode
+  TEST_ASSERT(decoded > 1000);
+
+  free(buf);
+  free(base);
+  free(b64);
 }
 
 int main(void) {
   UNITY_BEGIN();
   RUN_TEST(test_jwt_verify_valid_ear);
+  RUN_TEST(test_verifier_jwt_verify_valid_ear);
+  RUN_TEST(test_jwt_verify_bad_signature);
+  RUN_TEST(test_jwt_header_cache);
+  RUN_TEST(test_jwt_parse);
+  RUN_TEST(test_cwt_verify_valid_ear);
+  RUN_TEST(test_cwt_verify_bad_signature);
+  RUN_TEST(test_snapshot_load);
+  RUN_TEST(test_replay_guard);
+  RUN_TEST(test_cache);
+  RUN_TEST(test_cache_named);
+  RUN_TEST(test_cache_file);
+  RUN_TEST(test_ear_ref);
+  RUN_TEST(test_verifier_reverify);
+  RUN_TEST(test_verifier_jwt_verify_inplace);
   RUN_TEST(test_get_status_affirming);
+  RUN_TEST(test_get_tiers);
+  RUN_TEST(test_jwt_gate);
+  RUN_TEST(test_ticket);
+  RUN_TEST(test_verifier_limits);
+  RUN_TEST(test_batch);
+  RUN_TEST(test_query);
+  RUN_TEST(test_raw_evidence);
+  RUN_TEST(test_get_claims);
   RUN_TEST(test_veraison_get_akpub);
+  RUN_TEST(test_veraison_get_akpub_ref);
+  RUN_TEST(test_veraison_verify_pop);
   RUN_TEST(test_get_app_recs);
   RUN_TEST(test_b64);
+  RUN_TEST(test_jscan_claims);
   return UNITY_END();
 }